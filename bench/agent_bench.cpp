@@ -0,0 +1,98 @@
+/*
+ * A benchmark of the multi-agent environment (demo::cpu::agentenv). Many agents, each with the
+ * compound eyes of a glTF scene, take random key press actions for a number of steps; it reports
+ * steps/s, agent steps/s and rays/s.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "agentenv.h"
+
+#ifndef EYE_BENCH_DATA_DIR
+# define EYE_BENCH_DATA_DIR "data"
+#endif
+
+int main (int argc, char** argv)
+{
+    using sc = std::chrono::steady_clock;
+
+    std::string path = EYE_BENCH_DATA_DIR "/axis_coloured_blocks.gltf";
+    std::size_t n_agents = 256u;
+    int samples = 1;
+    unsigned int steps = 100u;
+    unsigned int threads = 0u;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = std::string(argv[i]);
+        if (arg == "-h") {
+            std::cout << "USAGE:\nagent_bench [options]\n\n"
+                      << "\t-f\tglTF scene with compound eye cameras (default "
+                      << EYE_BENCH_DATA_DIR << "/axis_coloured_blocks.gltf)\n"
+                      << "\t-n\tAgents (default 256)\n"
+                      << "\t-s\tSamples per ommatidium (default 1)\n"
+                      << "\t-k\tSteps (default 100)\n"
+                      << "\t-t\tThreads (default all cores)\n";
+            return 0;
+        } else if (i + 1 >= argc) {
+            std::cerr << "Option " << arg << " needs a value" << std::endl;
+            return 1;
+        } else if (arg == "-f") {
+            path = argv[++i];
+        } else if (arg == "-n") {
+            n_agents = std::stoul (argv[++i]);
+        } else if (arg == "-s") {
+            samples = std::stoi (argv[++i]);
+        } else if (arg == "-k") {
+            steps = static_cast<unsigned int>(std::stoul (argv[++i]));
+        } else if (arg == "-t") {
+            threads = static_cast<unsigned int>(std::stoul (argv[++i]));
+        } else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    try {
+        demo::cpu::eyerenderer r (threads);
+        r.load_gltf_scene (path);
+        std::vector<std::size_t> cameras;
+        for (std::size_t ci = 0; ci < r.camera_count(); ++ci) {
+            r.goto_camera (ci);
+            if (r.is_compound_eye_active()) {
+                r.change_samples_per_ommatidium_by (samples - r.samples_per_ommatidium());
+                cameras.push_back (ci);
+            }
+        }
+        if (cameras.empty()) { throw std::runtime_error ("There is no compound eye camera in " + path); }
+
+        demo::cpu::agentenv env (r, cameras, n_agents);
+        std::cerr << env.size() << " agents of " << env.frame_size() << " ommatidia, " << samples
+                  << " samples per ommatidium, " << r.pool.size() << " threads\n";
+
+        using move = demo::cpu::agent_action::move;
+        std::mt19937 rng (1u);
+        std::uniform_int_distribution<int> pick (0, static_cast<int>(move::roll_right));
+        std::vector<demo::cpu::agent_action> actions (env.size());
+        sc::time_point t0 = sc::now();
+        for (unsigned int k = 0; k < steps; ++k) {
+            for (auto& a : actions) { a = demo::cpu::agent_action::of (static_cast<move>(pick (rng))); }
+            env.step (actions);
+        }
+        const double secs = std::chrono::duration<double>(sc::now() - t0).count();
+        const double agent_steps = static_cast<double>(steps) * static_cast<double>(env.size());
+        std::cout << steps << " steps in " << secs << " s: " << steps / secs << " steps/s, "
+                  << agent_steps / secs << " agent steps/s, "
+                  << agent_steps * static_cast<double>(env.frame_size()) * samples / secs << " rays/s" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,321 @@
+/*
+ * A ray casting benchmark for the CPU compound eye renderer (demo::cpu). It needs no GPU, OptiX
+ * or mathplot, so it runs on CI machines.
+ *
+ * For each scene, eye size and samples per ommatidium it ray casts frames until it has enough
+ * for stable numbers, then reports rays/s, ommatidia/s, frame latency percentiles and the peak
+ * resident memory as JSON. Eyes are generated (ommatidia evenly spread over a sphere) so that
+ * the sweep is not limited to the .eye files in data/eyes.
+ *
+ * Scenes are glTF files or "blocks:<k>", a synthetic k x k grid of coloured cubes around the eye.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include <sys/resource.h>
+
+#include "cpueyerenderer.h"
+
+#ifndef EYE_BENCH_DATA_DIR
+# define EYE_BENCH_DATA_DIR "data"
+#endif
+
+namespace bench
+{
+    using sc = std::chrono::steady_clock;
+    // vec3 is a std::array, so bring in demo::cpu's arithmetic operators
+    using demo::cpu::operator+;
+    using demo::cpu::operator*;
+
+    struct settings
+    {
+        std::vector<std::string> scenes;
+        std::vector<std::size_t> eye_sizes = { 1000, 10000, 100000 };
+        std::vector<int> samples = { 1, 4, 16, 64, 256, 1024, 4096, 16384, 32000 };
+        unsigned int threads = 0u;
+        // Configurations that would cast more rays than this per frame are skipped
+        double max_rays_per_frame = 2e8;
+        double min_seconds = 0.5;
+        unsigned int min_frames = 3u;
+        unsigned int max_frames = 200u;
+        std::string output_path = "";
+    };
+
+    void print_help()
+    {
+        std::cout << "USAGE:\neye_bench [options]\n\n"
+                  << "\t-s\tScene: a glTF path or blocks:<k> (may be repeated; default "
+                  << EYE_BENCH_DATA_DIR << "/axis_coloured_blocks.gltf and blocks:32)\n"
+                  << "\t-n\tComma separated eye sizes (default 1000,10000,100000)\n"
+                  << "\t-p\tComma separated samples per ommatidium (default 1,4,...,16384,32000)\n"
+                  << "\t-t\tThreads (default all cores)\n"
+                  << "\t-r\tSkip configurations casting more than this many rays per frame (default 2e8)\n"
+                  << "\t-m\tMinimum seconds of frames per configuration (default 0.5)\n"
+                  << "\t-o\tWrite the JSON report here rather than to stdout\n";
+    }
+
+    template <typename T>
+    std::vector<T> parse_list (const std::string& s)
+    {
+        std::vector<T> v;
+        std::stringstream ss (s);
+        std::string item;
+        while (std::getline (ss, item, ',')) {
+            if (!item.empty()) { v.push_back (static_cast<T>(std::stod (item))); }
+        }
+        return v;
+    }
+
+    // Peak resident set size of this process so far, in MB
+    double peak_rss_mb()
+    {
+        rusage ru;
+        getrusage (RUSAGE_SELF, &ru);
+        return static_cast<double>(ru.ru_maxrss) / 1024.0; // ru_maxrss is in kB on Linux
+    }
+
+    // n ommatidia on a Fibonacci sphere of the given radius, each facing outwards
+    std::vector<demo::eyefile::ommatidium> sphere_eye (const std::size_t n, const float radius = 0.01f)
+    {
+        std::vector<demo::eyefile::ommatidium> omms (n);
+        const double golden = M_PI * (3.0 - std::sqrt (5.0));
+        // Acceptance angle about equal to the interommatidial angle
+        const float acceptance = static_cast<float>(std::sqrt (4.0 * M_PI / static_cast<double>(n)));
+        for (std::size_t i = 0; i < n; ++i) {
+            const double z = 1.0 - 2.0 * (static_cast<double>(i) + 0.5) / static_cast<double>(n);
+            const double r = std::sqrt (1.0 - z * z);
+            const double phi = golden * static_cast<double>(i);
+            const demo::cpu::vec3 d = { static_cast<float>(r * std::cos (phi)), static_cast<float>(r * std::sin (phi)),
+                                        static_cast<float>(z) };
+            omms[i].direction = d;
+            omms[i].position = d * radius;
+            omms[i].acceptance_angle = acceptance;
+        }
+        return omms;
+    }
+
+    // A k x k grid of unit cubes in the ground plane (y = -1), centred on the origin
+    demo::cpu::scene blocks_scene (const int k)
+    {
+        using demo::cpu::vec3;
+        demo::cpu::scene s;
+        s.path = "blocks:" + std::to_string (k);
+        s.background_shader = "simple_sky";
+        for (int m = 0; m < 8; ++m) {
+            s.materials.push_back ({ "m" + std::to_string (m),
+                                     { (m & 1) ? 0.8f : 0.2f, (m & 2) ? 0.8f : 0.2f, (m & 4) ? 0.8f : 0.2f } });
+        }
+        // One cube mesh per material (flat shaded: 4 vertices per face)
+        const std::array<vec3, 6> normals = { vec3{1,0,0}, vec3{-1,0,0}, vec3{0,1,0}, vec3{0,-1,0}, vec3{0,0,1}, vec3{0,0,-1} };
+        for (int m = 0; m < 8; ++m) {
+            demo::cpu::primitive p;
+            p.material = m;
+            for (const vec3& nrm : normals) {
+                // Two axes spanning the face
+                const vec3 a = std::abs (nrm[1]) > 0.5f ? vec3{1,0,0} : vec3{0,1,0};
+                const vec3 b = demo::cpu::cross (nrm, a);
+                const uint32_t base = static_cast<uint32_t>(p.positions.size());
+                for (int c = 0; c < 4; ++c) {
+                    const float sa = (c == 1 || c == 2) ? 0.5f : -0.5f;
+                    const float sb = (c >= 2) ? 0.5f : -0.5f;
+                    p.positions.push_back (nrm * 0.5f + a * sa + b * sb);
+                    p.normals.push_back (nrm);
+                }
+                for (uint32_t i : { 0u, 1u, 2u, 0u, 2u, 3u }) { p.indices.push_back (base + i); }
+            }
+            s.meshes.push_back ({ "cube" + std::to_string (m), { p } });
+        }
+        const float spacing = 3.0f;
+        for (int i = 0; i < k; ++i) {
+            for (int j = 0; j < k; ++j) {
+                demo::cpu::instance inst;
+                inst.mesh = static_cast<uint32_t>((i * 7 + j * 3) % 8);
+                const vec3 t = { (i - 0.5f * (k - 1)) * spacing, -1.0f, (j - 0.5f * (k - 1)) * spacing };
+                inst.transform = demo::cpu::from_trs (t, { 0.0f, 0.0f, 0.0f, 1.0f }, { 1.0f, 1.0f + static_cast<float>((i + j) % 3), 1.0f });
+                s.instances.push_back (inst);
+            }
+        }
+        demo::cpu::camera cam;
+        cam.name = "eye";
+        s.cameras.push_back (cam);
+        return s;
+    }
+
+    // The pose to put the eye at: the scene's first compound camera, else its first camera
+    demo::cpu::mat4 eye_pose (const demo::cpu::scene& s)
+    {
+        for (const auto& c : s.cameras) { if (!c.eye_path.empty()) { return c.pose; } }
+        return s.cameras.empty() ? demo::cpu::identity() : s.cameras[0].pose;
+    }
+
+    struct result
+    {
+        std::string scene;
+        std::size_t triangles = 0u;
+        double bvh_build_ms = 0.0;
+        std::size_t ommatidia = 0u;
+        int samples = 0;
+        unsigned int frames = 0u;
+        double rays_per_sec = 0.0;
+        double ommatidia_per_sec = 0.0;
+        double lat_mean = 0.0, lat_p50 = 0.0, lat_p95 = 0.0, lat_p99 = 0.0, lat_max = 0.0;
+        double peak_rss_mb = 0.0;
+    };
+
+    void write_json (std::ostream& os, const settings& sets, const unsigned int threads, const std::vector<result>& results)
+    {
+        os << "{\n  \"benchmark\": \"eye_bench\",\n  \"backend\": \"cpu\",\n  \"threads\": " << threads
+           << ",\n  \"min_seconds\": " << sets.min_seconds << ",\n  \"results\": [";
+        for (std::size_t i = 0; i < results.size(); ++i) {
+            const result& r = results[i];
+            os << (i == 0 ? "\n" : ",\n")
+               << "    {\"scene\": \"" << r.scene << "\", \"triangles\": " << r.triangles
+               << ", \"bvh_build_ms\": " << r.bvh_build_ms
+               << ", \"ommatidia\": " << r.ommatidia << ", \"samples_per_ommatidium\": " << r.samples
+               << ", \"frames\": " << r.frames
+               << ", \"rays_per_sec\": " << r.rays_per_sec << ", \"ommatidia_per_sec\": " << r.ommatidia_per_sec
+               << ", \"latency_ms\": {\"mean\": " << r.lat_mean << ", \"p50\": " << r.lat_p50
+               << ", \"p95\": " << r.lat_p95 << ", \"p99\": " << r.lat_p99 << ", \"max\": " << r.lat_max << "}"
+               << ", \"peak_rss_mb\": " << r.peak_rss_mb << "}";
+        }
+        os << "\n  ],\n  \"peak_rss_mb\": " << peak_rss_mb() << "\n}\n";
+    }
+
+    // Latency percentile q of the (sorted) frame times
+    double percentile (const std::vector<double>& sorted, const double q)
+    {
+        if (sorted.empty()) { return 0.0; }
+        std::size_t i = std::min (static_cast<std::size_t>(q * static_cast<double>(sorted.size())), sorted.size() - 1u);
+        return sorted[i];
+    }
+
+} // namespace bench
+
+int main (int argc, char** argv)
+{
+    bench::settings sets;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = std::string(argv[i]);
+        if (arg == "-h") {
+            bench::print_help();
+            return 0;
+        } else if (i + 1 >= argc) {
+            std::cerr << "Option " << arg << " needs a value" << std::endl;
+            return 1;
+        } else if (arg == "-s") {
+            sets.scenes.push_back (argv[++i]);
+        } else if (arg == "-n") {
+            sets.eye_sizes = bench::parse_list<std::size_t> (argv[++i]);
+        } else if (arg == "-p") {
+            sets.samples = bench::parse_list<int> (argv[++i]);
+        } else if (arg == "-t") {
+            sets.threads = static_cast<unsigned int>(std::stoul (argv[++i]));
+        } else if (arg == "-r") {
+            sets.max_rays_per_frame = std::stod (argv[++i]);
+        } else if (arg == "-m") {
+            sets.min_seconds = std::stod (argv[++i]);
+        } else if (arg == "-o") {
+            sets.output_path = argv[++i];
+        } else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (sets.scenes.empty()) { sets.scenes = { EYE_BENCH_DATA_DIR "/axis_coloured_blocks.gltf", "blocks:32" }; }
+
+    demo::threadpool pool (sets.threads);
+    std::vector<bench::result> results;
+
+    try {
+        for (const std::string& scene_name : sets.scenes) {
+            demo::cpu::scene s;
+            if (scene_name.rfind ("blocks:", 0) == 0) {
+                s = bench::blocks_scene (std::stoi (scene_name.substr (7)));
+            } else {
+                s = demo::cpu::load_gltf (scene_name);
+            }
+            demo::cpu::bvh accel;
+            bench::sc::time_point tb = bench::sc::now();
+            accel.build (s);
+            const double build_ms = std::chrono::duration<double, std::milli>(bench::sc::now() - tb).count();
+            const demo::cpu::mat4 pose = bench::eye_pose (s);
+            demo::cpu::tracer tr { &s, &accel };
+            std::cerr << scene_name << ": " << s.triangle_count() << " triangles, BVH built in " << build_ms << " ms\n";
+
+            for (const std::size_t n : sets.eye_sizes) {
+                const std::vector<demo::eyefile::ommatidium> omms = bench::sphere_eye (n);
+                std::vector<std::array<float, 3>> out (n);
+                for (const int spo : sets.samples) {
+                    if (static_cast<double>(n) * spo > sets.max_rays_per_frame) { continue; }
+                    demo::cpu::eye_view ev;
+                    ev.ommatidia = omms.data();
+                    ev.n = n;
+                    ev.pose = pose;
+                    ev.samples = spo;
+                    ev.out = out.data();
+
+                    tr.trace (pool, &ev, 1u); // warm up
+                    std::vector<double> lat;
+                    lat.reserve (sets.max_frames);
+                    bench::sc::time_point t0 = bench::sc::now();
+                    double elapsed = 0.0;
+                    while (lat.size() < sets.max_frames && (lat.size() < sets.min_frames || elapsed < sets.min_seconds)) {
+                        ev.seed = static_cast<uint32_t>(lat.size() + 1u);
+                        bench::sc::time_point tf = bench::sc::now();
+                        tr.trace (pool, &ev, 1u);
+                        bench::sc::time_point te = bench::sc::now();
+                        lat.push_back (std::chrono::duration<double, std::milli>(te - tf).count());
+                        elapsed = std::chrono::duration<double>(te - t0).count();
+                    }
+
+                    bench::result r;
+                    r.scene = scene_name;
+                    r.triangles = s.triangle_count();
+                    r.bvh_build_ms = build_ms;
+                    r.ommatidia = n;
+                    r.samples = spo;
+                    r.frames = static_cast<unsigned int>(lat.size());
+                    r.ommatidia_per_sec = static_cast<double>(n) * r.frames / elapsed;
+                    r.rays_per_sec = r.ommatidia_per_sec * spo;
+                    for (double l : lat) { r.lat_mean += l; }
+                    r.lat_mean /= static_cast<double>(lat.size());
+                    std::sort (lat.begin(), lat.end());
+                    r.lat_p50 = bench::percentile (lat, 0.50);
+                    r.lat_p95 = bench::percentile (lat, 0.95);
+                    r.lat_p99 = bench::percentile (lat, 0.99);
+                    r.lat_max = lat.back();
+                    r.peak_rss_mb = bench::peak_rss_mb();
+                    results.push_back (r);
+                    std::cerr << "  " << n << " ommatidia x " << spo << " samples: " << r.rays_per_sec / 1e6
+                              << " Mrays/s, p50 " << r.lat_p50 << " ms\n";
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    if (sets.output_path.empty()) {
+        bench::write_json (std::cout, sets, static_cast<unsigned int>(pool.size()), results);
+    } else {
+        std::ofstream fout (sets.output_path);
+        bench::write_json (fout, sets, static_cast<unsigned int>(pool.size()), results);
+        if (!fout.good()) {
+            std::cerr << "Failed writing " << sets.output_path << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
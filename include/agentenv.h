@@ -0,0 +1,146 @@
+/*
+ * A vectorised environment of many agents, each with its own compound eye pose, in one shared
+ * scene, for reinforcement learning.
+ *
+ * The agents share an eyerenderer's scene, BVH, eyes and thread pool, none of which they change;
+ * an agent is only its pose. Each agent carries the compound eyes of the same cameras: the first
+ * is the agent's primary eye, and the others keep the poses relative to it that the glTF gave
+ * them (as demo::eyerig does). step() moves every agent by its action and then ray casts all the
+ * agents' eyes together with eyerenderer::render_batch(), in one parallel pass over the pool, so
+ * that hundreds of small eyes keep every core busy. The observations come back in bulk, as one
+ * contiguous agents x ommatidia buffer.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <span>
+#include <vector>
+#include <stdexcept>
+
+#include "cpumaths.h"
+#include "cpueyerenderer.h"
+
+namespace demo::cpu
+{
+    /*
+     * One agent's movement for one step, in its primary eye's own (left handed) frame, applied
+     * as the window applies eye3dvisual's movements: translate, then pitch about x, yaw about y
+     * and roll about z. ux is right, uy up and uz forward; angles are in radians.
+     */
+    struct agent_action
+    {
+        vec3 translate = { 0.0f, 0.0f, 0.0f };
+        float pitch = 0.0f;
+        float yaw = 0.0f;
+        float roll = 0.0f;
+
+        // The discrete moves of the window's movement keys (see eye3dvisual::move_sense)
+        enum class move { none, forward, backward, left, right, up, down, rot_up, rot_down, rot_left, rot_right, roll_left, roll_right };
+
+        // The action of one key press, with eye3dvisual's speeds (up and down are 0.2 x speed)
+        static agent_action of (const move m, const float speed = 0.04f, const float angular_speed = 0.0174533f)
+        {
+            agent_action a;
+            switch (m) {
+            case move::forward: a.translate = { 0.0f, 0.0f, speed }; break;
+            case move::backward: a.translate = { 0.0f, 0.0f, -speed }; break;
+            case move::left: a.translate = { -speed, 0.0f, 0.0f }; break;
+            case move::right: a.translate = { speed, 0.0f, 0.0f }; break;
+            case move::up: a.translate = { 0.0f, 0.2f * speed, 0.0f }; break;
+            case move::down: a.translate = { 0.0f, -0.2f * speed, 0.0f }; break;
+            case move::rot_up: a.pitch = angular_speed; break;
+            case move::rot_down: a.pitch = -angular_speed; break;
+            case move::rot_left: a.yaw = angular_speed; break;
+            case move::rot_right: a.yaw = -angular_speed; break;
+            case move::roll_left: a.roll = -angular_speed; break;
+            case move::roll_right: a.roll = angular_speed; break;
+            case move::none:
+            default: break;
+            }
+            return a;
+        }
+    };
+
+    struct agentenv
+    {
+        /*
+         * n_agents agents with the compound eyes of r's cameras (cameras[0] is each agent's
+         * primary eye), all starting at the primary camera's current pose. r must outlive the
+         * environment and should not ray cast for anything else during a step().
+         */
+        agentenv (eyerenderer& _r, const std::vector<std::size_t>& _cameras, const std::size_t n_agents)
+            : r (_r), cameras (_cameras)
+        {
+            if (this->cameras.empty()) { throw std::runtime_error ("agentenv: no cameras"); }
+            const mat4 primary_inv = inverse (this->r.camera_pose (this->cameras[0]));
+            for (std::size_t ci : this->cameras) {
+                if (this->r.ommatidia (ci).empty()) { throw std::runtime_error ("agentenv: camera has no compound eye"); }
+                this->offsets.push_back (primary_inv * this->r.camera_pose (ci));
+                this->n_frame += this->r.ommatidia (ci).size();
+            }
+            this->poses.assign (n_agents, this->r.camera_pose (this->cameras[0]));
+        }
+
+        std::size_t size() const { return this->poses.size(); }
+        // An agent's outputs: all its eyes' ommatidia, one eye after another
+        std::size_t frame_size() const { return this->n_frame; }
+
+        // Place agent a (its primary eye) at pose
+        void reset (const std::size_t a, const mat4& pose) { this->poses.at (a) = pose; }
+        const mat4& pose (const std::size_t a) const { return this->poses.at (a); }
+
+        /*
+         * Move agent a by actions[a] (one action per agent), then ray cast all the agents.
+         * Returns the observations (see observations()).
+         */
+        std::span<const std::array<float, 3>> step (std::span<const agent_action> actions)
+        {
+            if (actions.size() != this->poses.size()) { throw std::runtime_error ("agentenv: need one action per agent"); }
+            for (std::size_t a = 0; a < this->poses.size(); ++a) {
+                mat4& p = this->poses[a];
+                const agent_action& act = actions[a];
+                translate_locally (p, act.translate);
+                rotate_locally (p, act.pitch, { 1.0f, 0.0f, 0.0f });
+                rotate_locally (p, act.yaw, { 0.0f, 1.0f, 0.0f });
+                rotate_locally (p, act.roll, { 0.0f, 0.0f, 1.0f });
+            }
+            return this->observe();
+        }
+
+        // Ray cast all the agents where they are
+        std::span<const std::array<float, 3>> observe()
+        {
+            const std::size_t nc = this->cameras.size();
+            this->eye_poses.resize (this->poses.size() * nc);
+            for (std::size_t a = 0; a < this->poses.size(); ++a) {
+                this->eye_poses[a * nc] = this->poses[a];
+                for (std::size_t k = 1; k < nc; ++k) { this->eye_poses[a * nc + k] = this->poses[a] * this->offsets[k]; }
+            }
+            this->r.render_batch (this->cameras, this->eye_poses, this->obs);
+            return this->obs;
+        }
+
+        // The last observations, agents x frame_size() (agent a's are [a * frame_size(), (a + 1) * frame_size()))
+        std::span<const std::array<float, 3>> observations() const { return this->obs; }
+        std::span<const std::array<float, 3>> observation (const std::size_t a) const
+        {
+            return std::span<const std::array<float, 3>>(this->obs).subspan (a * this->n_frame, this->n_frame);
+        }
+
+    private:
+        eyerenderer& r;
+        std::vector<std::size_t> cameras;
+        // Each eye's pose relative to the primary eye
+        std::vector<mat4> offsets;
+        std::size_t n_frame = 0u;
+        // Each agent's primary eye pose, and every eye's pose for the ray cast
+        std::vector<mat4> poses;
+        std::vector<mat4> eye_poses;
+        std::vector<std::array<float, 3>> obs;
+    };
+
+} // namespace
@@ -0,0 +1,112 @@
+/*
+ * The CPU eyebackend. Ray casts compound eyes with demo::cpu::eyerenderer, so it needs no GPU.
+ * Nothing from libEyeRenderer3 is called; compound-ray's headers are used only for the
+ * Ommatidium type that mplot::compoundray::EyeVisual draws.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include "eyebackend.h"
+#include "cpueyerenderer.h"
+#include "meshvisual.h"
+
+namespace demo
+{
+    struct cpubackend final : public eyebackend
+    {
+        // n_threads == 0 means use all cores
+        explicit cpubackend (unsigned int n_threads = 0u) : r (n_threads) {}
+
+        void load_scene (const std::string& path, const bool blender_axes) override
+        {
+            this->r.load_gltf_scene (path, blender_axes ? cpu::blender_transform() : cpu::identity());
+            this->omms.clear();
+            this->omms.resize (this->r.camera_count());
+        }
+
+        uint64_t scene_generation() override { return this->r.scene_generation(); }
+
+        int camera_count() override { return static_cast<int>(this->r.camera_count()); }
+        void goto_camera (int ci) override { this->r.goto_camera (static_cast<std::size_t>(ci)); }
+        int camera_index() override { return static_cast<int>(this->r.camera_index()); }
+        std::string eye_data_path() override { return this->r.eye_data_path(); }
+        bool is_compound_eye_active() override { return this->r.is_compound_eye_active(); }
+
+        int samples_per_ommatidium() override { return this->r.samples_per_ommatidium(); }
+        void change_samples_per_ommatidium_by (int d) override { this->r.change_samples_per_ommatidium_by (d); }
+
+        void translate_cameras_locally (float x, float y, float z) override { this->r.translate_cameras_locally (x, y, z); }
+        void rotate_cameras_locally_around (float angle, float x, float y, float z) override
+        {
+            this->r.rotate_cameras_locally_around (angle, x, y, z);
+        }
+        sm::mat44<float> camera_space() override { return to_mat44 (this->r.camera_pose()); }
+        void set_camera_space (const sm::mat44<float>& cs) override { this->r.set_camera_pose (to_mat4 (cs)); }
+        sm::mat44<float> camera_space_of (const int ci) override
+        {
+            return to_mat44 (this->r.camera_pose (static_cast<std::size_t>(ci)));
+        }
+        void set_camera_space_of (const int ci, const sm::mat44<float>& cs) override
+        {
+            this->r.set_camera_pose (static_cast<std::size_t>(ci), to_mat4 (cs));
+        }
+
+        void render_frame() override { this->r.render_frame(); }
+        void get_camera_data (std::vector<std::array<float, 3>>& out) override { this->r.get_camera_data (out); }
+        void render_frame_into (std::vector<std::array<float, 3>>& out) override { this->r.render_frame (out); }
+        // All the eyes go into one parallel pass over the thread pool
+        void render_eyes (const std::vector<int>& cameras, std::vector<std::array<float, 3>>& out) override
+        {
+            this->cams.assign (cameras.begin(), cameras.end());
+            this->r.render_eyes (this->cams, out);
+        }
+        // The whole batch goes into one parallel pass, with no round trips through the current camera
+        void render_batch (const std::vector<int>& cameras, std::span<const sm::mat44<float>> poses,
+                           std::vector<std::array<float, 3>>& out) override
+        {
+            this->cams.assign (cameras.begin(), cameras.end());
+            this->batch_poses.resize (poses.size());
+            for (std::size_t i = 0; i < poses.size(); ++i) { this->batch_poses[i] = to_mat4 (poses[i]); }
+            this->r.render_batch (this->cams, this->batch_poses, out);
+        }
+        void set_accumulation (const bool on) override
+        {
+            this->r.accumulate = on;
+            this->r.reset_accumulation();
+        }
+
+        std::vector<Ommatidium>* ommatidia() override { return this->ommatidia_of (this->camera_index()); }
+        std::vector<Ommatidium>* ommatidia_of (const int ci) override
+        {
+            // Convert each camera's eye to compound-ray's Ommatidium once per scene load
+            std::vector<Ommatidium>& dst = this->omms.at (static_cast<std::size_t>(ci));
+            const auto src = this->r.ommatidia (static_cast<std::size_t>(ci));
+            if (dst.size() != src.size()) {
+                dst.resize (src.size());
+                for (std::size_t i = 0; i < src.size(); ++i) {
+                    dst[i].relativePosition = { src[i].position[0], src[i].position[1], src[i].position[2] };
+                    dst[i].relativeDirection = { src[i].direction[0], src[i].direction[1], src[i].direction[2] };
+                    dst[i].acceptanceAngleRadians = src[i].acceptance_angle;
+                    dst[i].focalPointOffset = src[i].focal_offset;
+                }
+            }
+            return &dst;
+        }
+
+        void add_scene_to (mplot::Visual<>* v, scene_draw_stats* stats) override
+        {
+            demo::scene_to_meshvisuals (this->r.sc, v, stats);
+        }
+
+        cpu::eyerenderer r;
+
+    private:
+        // Each camera's ommatidia as compound-ray's Ommatidium (empty until asked for)
+        std::vector<std::vector<Ommatidium>> omms;
+        std::vector<std::size_t> cams;
+        std::vector<cpu::mat4> batch_poses;
+    };
+
+} // namespace
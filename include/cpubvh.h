@@ -0,0 +1,315 @@
+/*
+ * A bounding volume hierarchy over the world-space triangles of a demo::cpu::scene, with
+ * traversal of small SIMD ray packets. The samples of one ommatidium all start at the same
+ * point and fan out within its acceptance cone, so they are coherent enough that a packet
+ * visits nearly the same nodes as any one of its rays.
+ *
+ * The BVH is built with binned surface area heuristic splits. Packet loops are written in
+ * structure-of-arrays form with 'omp simd' so that the compiler emits SSE/AVX code.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "cpumaths.h"
+#include "cpuscene.h"
+
+namespace demo::cpu
+{
+    // Flattened node. Interior nodes have count == 0 and children at first and first + 1
+    struct bvh_node
+    {
+        float bmin[3];
+        uint32_t first;
+        float bmax[3];
+        uint16_t count;
+        uint16_t axis;
+    };
+    static_assert (sizeof (bvh_node) == 32, "bvh_node should be 32 bytes");
+
+    // A triangle prepared for Moller-Trumbore intersection
+    struct bvh_triangle
+    {
+        vec3 v0;
+        vec3 e1;
+        vec3 e2;
+    };
+
+    // K rays in structure-of-arrays form. Set t to the maximum distance before intersecting; on
+    // return t is the nearest hit distance and tri the hit triangle (or -1).
+    template <int K>
+    struct ray_packet
+    {
+        alignas(32) float ox[K];
+        alignas(32) float oy[K];
+        alignas(32) float oz[K];
+        alignas(32) float dx[K];
+        alignas(32) float dy[K];
+        alignas(32) float dz[K];
+        alignas(32) float t[K];
+        alignas(32) int32_t tri[K];
+    };
+
+    struct bvh
+    {
+        static constexpr unsigned int max_leaf_size = 4u;
+        static constexpr unsigned int n_bins = 16u;
+        static constexpr unsigned int max_depth = 60u;
+        static constexpr float t_min = 1e-4f;
+
+        std::vector<bvh_node> nodes;
+        std::vector<bvh_triangle> triangles;
+        // Material index of each triangle in triangles
+        std::vector<int32_t> materials;
+
+        // Build from all instances in the scene
+        void build (const scene& sc)
+        {
+            std::vector<bvh_triangle> tris;
+            std::vector<int32_t> mats;
+            tris.reserve (sc.triangle_count());
+            mats.reserve (sc.triangle_count());
+            for (const auto& inst : sc.instances) {
+                for (const auto& p : sc.meshes[inst.mesh].primitives) {
+                    for (std::size_t i = 0; i + 2 < p.indices.size(); i += 3) {
+                        const vec3 a = transform_point (inst.transform, p.positions[p.indices[i]]);
+                        const vec3 b = transform_point (inst.transform, p.positions[p.indices[i + 1]]);
+                        const vec3 c = transform_point (inst.transform, p.positions[p.indices[i + 2]]);
+                        tris.push_back ({ a, b - a, c - a });
+                        mats.push_back (p.material);
+                    }
+                }
+            }
+            this->build (tris, mats);
+        }
+
+        // Build from a triangle soup (v0, e1, e2 form) and per-triangle materials
+        void build (const std::vector<bvh_triangle>& tris, const std::vector<int32_t>& mats)
+        {
+            this->nodes.clear();
+            this->triangles.clear();
+            this->materials.clear();
+            const uint32_t n = static_cast<uint32_t>(tris.size());
+            if (n == 0u) { return; }
+
+            std::vector<aabb> tb (n);
+            std::vector<vec3> centroid (n);
+            for (uint32_t i = 0; i < n; ++i) {
+                const vec3 a = tris[i].v0;
+                const vec3 b = a + tris[i].e1;
+                const vec3 c = a + tris[i].e2;
+                tb[i].grow (a);
+                tb[i].grow (b);
+                tb[i].grow (c);
+                centroid[i] = (a + b + c) * (1.0f / 3.0f);
+            }
+            std::vector<uint32_t> order (n);
+            for (uint32_t i = 0; i < n; ++i) { order[i] = i; }
+
+            this->nodes.reserve (2u * n);
+            this->nodes.push_back ({});
+            struct job { uint32_t node; uint32_t first; uint32_t count; uint32_t depth; };
+            std::vector<job> jobs;
+            jobs.push_back ({ 0u, 0u, n, 0u });
+
+            while (!jobs.empty()) {
+                job j = jobs.back();
+                jobs.pop_back();
+
+                aabb bounds;
+                aabb cbounds;
+                for (uint32_t i = j.first; i < j.first + j.count; ++i) {
+                    bounds.grow (tb[order[i]]);
+                    cbounds.grow (centroid[order[i]]);
+                }
+                bvh_node& nd = this->nodes[j.node];
+                for (int a = 0; a < 3; ++a) { nd.bmin[a] = bounds.lo[a]; nd.bmax[a] = bounds.hi[a]; }
+
+                auto make_leaf = [&]() {
+                    this->nodes[j.node].first = j.first;
+                    this->nodes[j.node].count = static_cast<uint16_t>(j.count);
+                    this->nodes[j.node].axis = 0u;
+                };
+                if (j.count <= max_leaf_size
+                    || (j.depth >= max_depth && j.count <= 0xffffu)) { make_leaf(); continue; }
+
+                // Binned SAH over the widest centroid axis
+                int axis = 0;
+                vec3 ext = cbounds.hi - cbounds.lo;
+                if (ext[1] > ext[axis]) { axis = 1; }
+                if (ext[2] > ext[axis]) { axis = 2; }
+                uint32_t mid = j.first + j.count / 2u;
+                if (ext[axis] > 0.0f) {
+                    std::array<aabb, n_bins> bin_box;
+                    std::array<uint32_t, n_bins> bin_n = {};
+                    const float scale = static_cast<float>(n_bins) / ext[axis];
+                    auto bin_of = [&](uint32_t ti) {
+                        int b = static_cast<int>((centroid[ti][axis] - cbounds.lo[axis]) * scale);
+                        return static_cast<unsigned int>(std::clamp (b, 0, static_cast<int>(n_bins) - 1));
+                    };
+                    for (uint32_t i = j.first; i < j.first + j.count; ++i) {
+                        unsigned int b = bin_of (order[i]);
+                        ++bin_n[b];
+                        bin_box[b].grow (tb[order[i]]);
+                    }
+                    // Sweep from the right to get the costs of every right-hand side
+                    std::array<float, n_bins> right_cost = {};
+                    aabb acc;
+                    uint32_t cnt = 0u;
+                    for (unsigned int b = n_bins - 1u; b > 0u; --b) {
+                        acc.grow (bin_box[b]);
+                        cnt += bin_n[b];
+                        right_cost[b] = cnt > 0u ? acc.area() * static_cast<float>(cnt) : 0.0f;
+                    }
+                    float best = std::numeric_limits<float>::max();
+                    unsigned int best_b = 0u;
+                    acc = aabb{};
+                    cnt = 0u;
+                    for (unsigned int b = 0u; b < n_bins - 1u; ++b) {
+                        acc.grow (bin_box[b]);
+                        cnt += bin_n[b];
+                        if (cnt == 0u || cnt == j.count) { continue; }
+                        float c = acc.area() * static_cast<float>(cnt) + right_cost[b + 1u];
+                        if (c < best) { best = c; best_b = b; }
+                    }
+                    const float leaf_cost = bounds.area() * static_cast<float>(j.count);
+                    if (best < std::numeric_limits<float>::max()) {
+                        if (best >= leaf_cost && j.count <= 2u * max_leaf_size) { make_leaf(); continue; }
+                        auto it = std::partition (order.begin() + j.first, order.begin() + j.first + j.count,
+                                                  [&](uint32_t ti) { return bin_of (ti) <= best_b; });
+                        mid = static_cast<uint32_t>(it - order.begin());
+                    } else {
+                        std::nth_element (order.begin() + j.first, order.begin() + mid, order.begin() + j.first + j.count,
+                                          [&](uint32_t a, uint32_t b) { return centroid[a][axis] < centroid[b][axis]; });
+                    }
+                } else if (j.count <= 0xffffu) {
+                    // All centroids coincide, so splitting won't help. (If there are too many
+                    // for a leaf's count, fall through to split them in half by index.)
+                    make_leaf();
+                    continue;
+                }
+
+                const uint32_t left = static_cast<uint32_t>(this->nodes.size());
+                this->nodes.push_back ({});
+                this->nodes.push_back ({});
+                this->nodes[j.node].first = left;
+                this->nodes[j.node].count = 0u;
+                this->nodes[j.node].axis = static_cast<uint16_t>(axis);
+                jobs.push_back ({ left + 1u, mid, j.first + j.count - mid, j.depth + 1u });
+                jobs.push_back ({ left, j.first, mid - j.first, j.depth + 1u });
+            }
+
+            this->triangles.resize (n);
+            this->materials.resize (n);
+            for (uint32_t i = 0; i < n; ++i) {
+                this->triangles[i] = tris[order[i]];
+                this->materials[i] = mats[order[i]];
+            }
+        }
+
+        // Intersect a packet of K rays with the scene
+        template <int K>
+        void intersect (ray_packet<K>& rp) const
+        {
+            for (int k = 0; k < K; ++k) { rp.tri[k] = -1; }
+            if (this->nodes.empty()) { return; }
+
+            alignas(32) float ix[K], iy[K], iz[K];
+            for (int k = 0; k < K; ++k) {
+                ix[k] = 1.0f / (std::fabs (rp.dx[k]) > 1e-12f ? rp.dx[k] : 1e-12f);
+                iy[k] = 1.0f / (std::fabs (rp.dy[k]) > 1e-12f ? rp.dy[k] : 1e-12f);
+                iz[k] = 1.0f / (std::fabs (rp.dz[k]) > 1e-12f ? rp.dz[k] : 1e-12f);
+            }
+            // Packet direction signs decide the near child (all rays in a packet point roughly the same way)
+            const bool neg[3] = { rp.dx[0] < 0.0f, rp.dy[0] < 0.0f, rp.dz[0] < 0.0f };
+
+            uint32_t stack[2 * max_depth + 4];
+            int sp = 0;
+            stack[sp++] = 0u;
+            while (sp > 0) {
+                const bvh_node& nd = this->nodes[stack[--sp]];
+                int any = 0;
+#pragma omp simd reduction(|:any)
+                for (int k = 0; k < K; ++k) {
+                    float tx0 = (nd.bmin[0] - rp.ox[k]) * ix[k];
+                    float tx1 = (nd.bmax[0] - rp.ox[k]) * ix[k];
+                    float ty0 = (nd.bmin[1] - rp.oy[k]) * iy[k];
+                    float ty1 = (nd.bmax[1] - rp.oy[k]) * iy[k];
+                    float tz0 = (nd.bmin[2] - rp.oz[k]) * iz[k];
+                    float tz1 = (nd.bmax[2] - rp.oz[k]) * iz[k];
+                    float tn = std::max (std::max (std::min (tx0, tx1), std::min (ty0, ty1)), std::max (std::min (tz0, tz1), 0.0f));
+                    float tf = std::min (std::min (std::max (tx0, tx1), std::max (ty0, ty1)), std::min (std::max (tz0, tz1), rp.t[k]));
+                    any |= (tn <= tf) ? 1 : 0;
+                }
+                if (!any) { continue; }
+
+                if (nd.count > 0u) {
+                    for (uint32_t ti = nd.first; ti < nd.first + nd.count; ++ti) {
+                        const bvh_triangle& tr = this->triangles[ti];
+                        const int32_t tid = static_cast<int32_t>(ti);
+#pragma omp simd
+                        for (int k = 0; k < K; ++k) {
+                            float px = rp.dy[k] * tr.e2[2] - rp.dz[k] * tr.e2[1];
+                            float py = rp.dz[k] * tr.e2[0] - rp.dx[k] * tr.e2[2];
+                            float pz = rp.dx[k] * tr.e2[1] - rp.dy[k] * tr.e2[0];
+                            float det = tr.e1[0] * px + tr.e1[1] * py + tr.e1[2] * pz;
+                            float inv = 1.0f / det;
+                            float sx = rp.ox[k] - tr.v0[0];
+                            float sy = rp.oy[k] - tr.v0[1];
+                            float sz = rp.oz[k] - tr.v0[2];
+                            float u = (sx * px + sy * py + sz * pz) * inv;
+                            float qx = sy * tr.e1[2] - sz * tr.e1[1];
+                            float qy = sz * tr.e1[0] - sx * tr.e1[2];
+                            float qz = sx * tr.e1[1] - sy * tr.e1[0];
+                            float v = (rp.dx[k] * qx + rp.dy[k] * qy + rp.dz[k] * qz) * inv;
+                            float tt = (tr.e2[0] * qx + tr.e2[1] * qy + tr.e2[2] * qz) * inv;
+                            bool hit = std::fabs (det) > 1e-12f && u >= 0.0f && v >= 0.0f && u + v <= 1.0f
+                                       && tt > t_min && tt < rp.t[k];
+                            rp.t[k] = hit ? tt : rp.t[k];
+                            rp.tri[k] = hit ? tid : rp.tri[k];
+                        }
+                    }
+                } else {
+                    // Push the far child first so that the near child is visited first
+                    if (neg[nd.axis]) {
+                        stack[sp++] = nd.first;
+                        stack[sp++] = nd.first + 1u;
+                    } else {
+                        stack[sp++] = nd.first + 1u;
+                        stack[sp++] = nd.first;
+                    }
+                }
+            }
+        }
+
+    private:
+        struct aabb
+        {
+            vec3 lo = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+            vec3 hi = { std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() };
+            void grow (const vec3& p)
+            {
+                for (int a = 0; a < 3; ++a) { lo[a] = std::min (lo[a], p[a]); hi[a] = std::max (hi[a], p[a]); }
+            }
+            void grow (const aabb& b)
+            {
+                for (int a = 0; a < 3; ++a) { lo[a] = std::min (lo[a], b.lo[a]); hi[a] = std::max (hi[a], b.hi[a]); }
+            }
+            float area() const
+            {
+                if (hi[0] < lo[0]) { return 0.0f; }
+                vec3 e = hi - lo;
+                return e[0] * e[1] + e[1] * e[2] + e[2] * e[0];
+            }
+        };
+    };
+
+} // namespace
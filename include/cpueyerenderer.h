@@ -0,0 +1,522 @@
+/*
+ * A multithreaded CPU compound eye renderer. It reads the same glTF scenes and .eye files as
+ * compound-ray's libEyeRenderer3 and mirrors its camera API, so that compound eyes can be
+ * simulated on machines without an OptiX-capable GPU.
+ *
+ * Each ommatidium casts samples_per_ommatidium rays whose directions are Gaussian-distributed
+ * about the ommatidial axis, with the acceptance angle as the full width at half maximum (as
+ * compound-ray does). The ommatidium's output is the mean colour of its samples. Ommatidia are
+ * spread over a thread pool and each ommatidium's samples are traced as SIMD ray packets.
+ *
+ * Optionally (eyerenderer::accumulate), frames refine one another while nothing moves, with
+ * each frame's rays going to the ommatidia whose outputs are least certain.
+ *
+ * A scene may hold several compound eyes (a pair of eyes and the ocelli, say). render_eyes()
+ * ray casts any number of them in one parallel pass, and render_batch() does the same for a batch
+ * of poses, returning one contiguous poses x ommatidia buffer.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "cpumaths.h"
+#include "cpuscene.h"
+#include "cpubvh.h"
+#include "scenecache.h"
+#include "eyefile.h"
+#include "threadpool.h"
+
+namespace demo::cpu
+{
+    // The largest allowed samples per ommatidium (as the limit in eye3dvisual)
+    constexpr int max_samples_per_ommatidium = 32000;
+
+    // One compound eye to trace: its ommatidia, its pose in the world and where to write results
+    struct eye_view
+    {
+        const eyefile::ommatidium* ommatidia = nullptr;
+        std::size_t n = 0u;
+        mat4 pose = identity();
+        int samples = 1;
+        uint32_t seed = 0u;
+        std::array<float, 3>* out = nullptr;
+    };
+
+    namespace detail
+    {
+        // A small, fast RNG (PCG-XSH-RR) for sample directions
+        struct pcg32
+        {
+            uint64_t state;
+            explicit pcg32 (uint64_t seed) : state (seed * 6364136223846793005ull + 1442695040888963407ull) {}
+            uint32_t next()
+            {
+                uint64_t old = this->state;
+                this->state = old * 6364136223846793005ull + 1442695040888963407ull;
+                uint32_t xorshifted = static_cast<uint32_t>(((old >> 18u) ^ old) >> 27u);
+                uint32_t rot = static_cast<uint32_t>(old >> 59u);
+                return (xorshifted >> rot) | (xorshifted << ((~rot + 1u) & 31u));
+            }
+            // Uniform in (0, 1]
+            float uniform() { return (static_cast<float>(this->next() >> 8) + 1.0f) * (1.0f / 16777216.0f); }
+        };
+
+        inline uint64_t mix (uint64_t a, uint64_t b)
+        {
+            uint64_t h = a * 0x9e3779b97f4a7c15ull ^ (b + 0x632be59bd9b4e019ull + (a << 6) + (a >> 2));
+            h ^= h >> 31;
+            h *= 0xbf58476d1ce4e5b9ull;
+            h ^= h >> 29;
+            return h;
+        }
+
+        // Orthonormal basis about unit vector n (Duff et al. 2017)
+        inline void basis (const vec3& n, vec3& b1, vec3& b2)
+        {
+            const float sign = std::copysign (1.0f, n[2]);
+            const float a = -1.0f / (sign + n[2]);
+            const float b = n[0] * n[1] * a;
+            b1 = { 1.0f + sign * n[0] * n[0] * a, sign * b, -sign * n[0] };
+            b2 = { b, sign + n[1] * n[1] * a, -n[1] };
+        }
+    } // namespace detail
+
+    /*
+     * Traces eye_views against a scene. Stateless apart from references to the scene and its
+     * BVH, so many tracers (or threads) may share one scene.
+     */
+    struct tracer
+    {
+        static constexpr int packet_size = 8;
+
+        const scene* sc = nullptr;
+        const bvh* accel = nullptr;
+
+        // Background colour for rays that hit nothing. compound-ray's 'simple_sky' style.
+        vec3 sky (const vec3& dir) const
+        {
+            const float h = dot (dir, this->sc->up);
+            if (h < 0.0f) { return { 0.35f, 0.3f, 0.25f }; }
+            const float f = std::min (1.0f, h);
+            return { 0.8f - 0.5f * f, 0.85f - 0.35f * f, 0.9f - 0.05f * f };
+        }
+
+        vec3 surface (const int32_t tri) const
+        {
+            const int32_t m = this->accel->materials[static_cast<std::size_t>(tri)];
+            if (m < 0 || static_cast<std::size_t>(m) >= this->sc->materials.size()) { return { 0.8f, 0.8f, 0.8f }; }
+            return this->sc->materials[static_cast<std::size_t>(m)].colour;
+        }
+
+        // Sums over a set of samples: their colours and their squared luminances
+        struct sample_sums
+        {
+            vec3 colour = { 0.0f, 0.0f, 0.0f };
+            float lum2 = 0.0f;
+        };
+
+        // Rec. 709 luminance
+        static float luminance (const vec3& c) { return 0.2126f * c[0] + 0.7152f * c[1] + 0.0722f * c[2]; }
+
+        /*
+         * Trace samples rays for ommatidium i of ev. A single sample goes straight down the
+         * ommatidial axis (as compound-ray does) unless jitter is true.
+         */
+        sample_sums trace_samples (const eye_view& ev, const std::size_t i, const int samples, const bool jitter = false) const
+        {
+            const eyefile::ommatidium& om = ev.ommatidia[i];
+            const vec3 org = transform_point (ev.pose, om.position);
+            const vec3 axis = normalize (transform_vector (ev.pose, om.direction));
+            vec3 b1, b2;
+            detail::basis (axis, b1, b2);
+            // Acceptance angle is the FWHM of the Gaussian: sigma = FWHM / (2 sqrt(2 ln 2))
+            const float sigma = om.acceptance_angle / 2.35482f;
+
+            detail::pcg32 rng (detail::mix (ev.seed, i));
+            sample_sums acc;
+            const bool spread = jitter || samples > 1;
+            ray_packet<packet_size> rp;
+            for (int s0 = 0; s0 < samples; s0 += packet_size) {
+                const int ns = std::min (packet_size, samples - s0);
+                for (int k = 0; k < packet_size; ++k) {
+                    vec3 d = axis;
+                    if (k < ns && sigma > 0.0f && spread) {
+                        // Box-Muller gives a 2D Gaussian offset in the tangent plane
+                        const float r = sigma * std::sqrt (-2.0f * std::log (rng.uniform()));
+                        const float th = 6.2831853f * rng.uniform();
+                        const float ang = std::min (r, 3.14159265f);
+                        const float sa = std::sin (ang);
+                        d = axis * std::cos (ang) + (b1 * std::cos (th) + b2 * std::sin (th)) * sa;
+                    }
+                    rp.ox[k] = org[0];
+                    rp.oy[k] = org[1];
+                    rp.oz[k] = org[2];
+                    rp.dx[k] = d[0];
+                    rp.dy[k] = d[1];
+                    rp.dz[k] = d[2];
+                    // Lanes past the end of the samples get a zero-length ray
+                    rp.t[k] = k < ns ? std::numeric_limits<float>::max() : 0.0f;
+                }
+                this->accel->intersect (rp);
+                for (int k = 0; k < ns; ++k) {
+                    const vec3 c = rp.tri[k] >= 0 ? this->surface (rp.tri[k]) : this->sky ({ rp.dx[k], rp.dy[k], rp.dz[k] });
+                    const float l = luminance (c);
+                    acc.colour = acc.colour + c;
+                    acc.lum2 += l * l;
+                }
+            }
+            return acc;
+        }
+
+        // Trace all the samples of ommatidium i of ev and return its mean colour
+        vec3 trace_ommatidium (const eye_view& ev, const std::size_t i) const
+        {
+            const int samples = std::max (1, ev.samples);
+            return this->trace_samples (ev, i, samples).colour * (1.0f / static_cast<float>(samples));
+        }
+
+        /*
+         * Progressive refinement of one eye view. Trace samples[i] more (jittered) rays for each
+         * ommatidium i, add them to its running sums, and write its running mean to ev.out[i].
+         */
+        void accumulate (threadpool& pool, const eye_view& ev, const uint32_t* samples,
+                         vec3* sum, float* sum_lum2, uint32_t* count) const
+        {
+            const std::size_t grain = std::max (std::size_t{1}, std::size_t{2048} / static_cast<std::size_t>(std::max (1, ev.samples)));
+            pool.parallel_for (ev.n, grain, [&](std::size_t b, std::size_t e) {
+                for (std::size_t i = b; i < e; ++i) {
+                    if (samples[i] > 0u) {
+                        const sample_sums ss = this->trace_samples (ev, i, static_cast<int>(samples[i]), true);
+                        sum[i] = sum[i] + ss.colour;
+                        sum_lum2[i] += ss.lum2;
+                        count[i] += samples[i];
+                    }
+                    ev.out[i] = count[i] > 0u ? sum[i] * (1.0f / static_cast<float>(count[i])) : vec3{ 0.0f, 0.0f, 0.0f };
+                }
+            });
+        }
+
+        /*
+         * Trace several eye views in one parallel pass over the pool. All the ommatidia of all
+         * the views go into one work list, so a pair of eyes keeps every core busy just as a
+         * single eye twice the size would.
+         */
+        void trace (threadpool& pool, const eye_view* views, const std::size_t n_views) const
+        {
+            std::vector<std::size_t> starts (n_views + 1u, 0u);
+            int max_samples = 1;
+            for (std::size_t v = 0; v < n_views; ++v) {
+                starts[v + 1u] = starts[v] + views[v].n;
+                max_samples = std::max (max_samples, views[v].samples);
+            }
+            const std::size_t total = starts[n_views];
+            // Aim for a couple of thousand rays per chunk
+            const std::size_t grain = std::max (std::size_t{1}, std::size_t{2048} / static_cast<std::size_t>(max_samples));
+            pool.parallel_for (total, grain, [&](std::size_t b, std::size_t e) {
+                std::size_t v = static_cast<std::size_t>(std::upper_bound (starts.begin(), starts.end(), b) - starts.begin()) - 1u;
+                for (std::size_t gi = b; gi < e; ++gi) {
+                    while (gi >= starts[v + 1u]) { ++v; }
+                    const std::size_t i = gi - starts[v];
+                    views[v].out[i] = this->trace_ommatidium (views[v], i);
+                }
+            });
+        }
+    };
+
+    /*
+     * The CPU analogue of libEyeRenderer3: a scene, its cameras and the current camera's output.
+     * Method names follow the libEyeRenderer functions that they replace.
+     */
+    struct eyerenderer
+    {
+        explicit eyerenderer (unsigned int n_threads = 0u) : pool (n_threads) {}
+
+        scene sc;
+        bvh accel;
+        threadpool pool;
+
+        // If set, scenes are loaded through a cache of processed scenes in this directory (see scenecache.h)
+        std::string scene_cache_dir = "";
+        // True if the last scene loaded came from the cache
+        bool scene_from_cache = false;
+
+        // Load a glTF scene, its cameras and their compound eyes. transform is applied to the scene.
+        void load_gltf_scene (const std::string& path, const mat4& transform = identity())
+        {
+            scenecache::loaded l = scenecache::load (path, transform, this->scene_cache_dir, &this->pool);
+            this->scene_from_cache = l.from_cache;
+            this->set_scene (std::move (l.sc), std::move (l.accel));
+        }
+
+        // Use an already loaded (or cached) scene and BVH
+        void set_scene (scene&& s, bvh&& b)
+        {
+            this->sc = std::move (s);
+            this->accel = std::move (b);
+            this->setup_cameras();
+        }
+
+        // Counts scene loads, so that results cached against a scene can tell it has changed
+        uint64_t scene_generation() const { return this->generation; }
+
+        std::size_t camera_count() const { return this->sc.cameras.size(); }
+        std::size_t camera_index() const { return this->current; }
+        void goto_camera (std::size_t ci)
+        {
+            if (ci >= this->sc.cameras.size()) { throw std::runtime_error ("goto_camera: no such camera"); }
+            this->current = ci;
+        }
+        const std::string& eye_data_path() const { return this->sc.cameras.at (this->current).eye_path; }
+        bool is_compound_eye_active() const
+        {
+            return this->current < this->eyes.size() && !this->eyes[this->current].empty();
+        }
+
+        int samples_per_ommatidium() const { return this->samples.at (this->current); }
+        void change_samples_per_ommatidium_by (int d)
+        {
+            int& s = this->samples.at (this->current);
+            s = std::clamp (s + d, 1, max_samples_per_ommatidium);
+        }
+
+        // Move the current camera in its own frame of reference
+        void translate_cameras_locally (float x, float y, float z)
+        {
+            translate_locally (this->poses.at (this->current), { x, y, z });
+        }
+        // Rotate the current camera by angle (radians) about an axis in its own frame
+        void rotate_cameras_locally_around (float angle, float x, float y, float z)
+        {
+            rotate_locally (this->poses.at (this->current), angle, { x, y, z });
+        }
+        void set_camera_pose (const mat4& m) { this->poses.at (this->current) = m; }
+        const mat4& camera_pose() const { return this->poses.at (this->current); }
+        // The pose of any camera
+        void set_camera_pose (const std::size_t ci, const mat4& m) { this->poses.at (ci) = m; }
+        const mat4& camera_pose (const std::size_t ci) const { return this->poses.at (ci); }
+
+        // Ray cast the current compound eye
+        void render_frame() { this->render_frame (this->data); }
+
+        // Ray cast the current compound eye straight into out (resized to the number of
+        // ommatidia). get_camera_data() does not see frames rendered this way.
+        void render_frame (std::vector<std::array<float, 3>>& out)
+        {
+            if (!this->is_compound_eye_active()) { return; }
+            const std::size_t ci = this->current;
+            this->render_eyes (std::span<const std::size_t>(&ci, 1u), out);
+        }
+
+        /*
+         * Ray cast the compound eyes of several cameras, each at its own pose and samples per
+         * ommatidium, in one parallel pass. Their outputs go one after another into out (resized
+         * to their total number of ommatidia), in the order of cameras.
+         */
+        void render_eyes (std::span<const std::size_t> cameras, std::vector<std::array<float, 3>>& out)
+        {
+            this->views.clear();
+            for (std::size_t ci : cameras) {
+                if (ci >= this->poses.size()) { throw std::runtime_error ("render_eyes: no such camera"); }
+                this->add_view (ci, this->poses[ci]);
+            }
+            this->point_views_at (out);
+            tracer tr { &this->sc, &this->accel };
+            if (this->accumulate) {
+                // Each eye shares out its own rays, so refinement goes eye by eye
+                for (std::size_t k = 0; k < this->views.size(); ++k) {
+                    this->render_accumulated (tr, this->views[k], cameras[k]);
+                }
+            } else {
+                tr.trace (this->pool, this->views.data(), this->views.size());
+            }
+        }
+
+        /*
+         * Ray cast the compound eyes of cameras at each of a batch of poses, all in one parallel
+         * pass. poses holds one pose for each camera for each item of the batch: item b's pose for
+         * cameras[k] is poses[b * cameras.size() + k]. The outputs go into out (resized to fit) as
+         * a contiguous items x ommatidia tensor, each item laid out as render_eyes() lays out a
+         * frame. The cameras' own poses are left alone and there is no accumulation, so a batch
+         * gives the frames that render_eyes() would give at each pose in turn.
+         */
+        void render_batch (std::span<const std::size_t> cameras, std::span<const mat4> batch_poses,
+                           std::vector<std::array<float, 3>>& out)
+        {
+            if (cameras.empty() || batch_poses.size() % cameras.size() != 0u) {
+                throw std::runtime_error ("render_batch: need one pose per camera per item");
+            }
+            this->views.clear();
+            for (std::size_t p = 0; p < batch_poses.size(); ++p) {
+                this->add_view (cameras[p % cameras.size()], batch_poses[p]);
+            }
+            this->point_views_at (out);
+            tracer tr { &this->sc, &this->accel };
+            tr.trace (this->pool, this->views.data(), this->views.size());
+        }
+
+        /*
+         * Progressive refinement. While the camera, its pose, its samples per ommatidium and the
+         * scene are unchanged, each frame's samples are added to those of earlier frames. After
+         * the first frame, the frame's budget of (ommatidia x samples per ommatidium) rays is
+         * shared out by each ommatidium's standard error, so that ommatidia over edges get more
+         * and converged ommatidia get none. Any change starts the accumulation again.
+         */
+        bool accumulate = false;
+        // An ommatidium has converged once the standard error of its mean luminance is below this
+        float accumulate_tolerance = 0.002f;
+        // ...and it has at least this many samples
+        uint32_t accumulate_min_samples = 16u;
+
+        // Start the accumulation again on the next frame
+        void reset_accumulation() { for (accumulation& a : this->acc) { a.frames = 0u; } }
+        // Frames accumulated into the current camera's output
+        uint32_t accumulated_frames() const { return this->acc.at (this->current).frames; }
+        // Rays cast in the current camera's last accumulated frame
+        std::size_t accumulated_rays_last() const { return this->acc.at (this->current).rays_last; }
+
+        // Copy out the current eye's per-ommatidium colours (as libEyeRenderer's getCameraData)
+        void get_camera_data (std::vector<std::array<float, 3>>& out) const { out = this->data; }
+
+        // The current eye's ommatidia
+        std::span<const eyefile::ommatidium> ommatidia() const { return this->eyes.at (this->current).ommatidia(); }
+        // The ommatidia of camera ci's eye (empty if it has none)
+        std::span<const eyefile::ommatidium> ommatidia (const std::size_t ci) const { return this->eyes.at (ci).ommatidia(); }
+
+    private:
+        // Add a view of camera ci's eye at pose to views
+        void add_view (const std::size_t ci, const mat4& pose)
+        {
+            if (ci >= this->eyes.size() || this->eyes[ci].empty()) {
+                throw std::runtime_error ("render_eyes: camera has no compound eye");
+            }
+            const auto omms = this->eyes[ci].ommatidia();
+            eye_view& ev = this->views.emplace_back();
+            ev.ommatidia = omms.data();
+            ev.n = omms.size();
+            ev.pose = pose;
+            ev.samples = this->samples[ci];
+            ev.seed = this->frame++;
+        }
+
+        // Size out for the views and point each view at its part of it, one after another
+        void point_views_at (std::vector<std::array<float, 3>>& out)
+        {
+            std::size_t total = 0u;
+            for (const eye_view& ev : this->views) { total += ev.n; }
+            out.resize (total);
+            std::size_t start = 0u;
+            for (eye_view& ev : this->views) {
+                ev.out = out.data() + start;
+                start += ev.n;
+            }
+        }
+
+        void setup_cameras()
+        {
+            const std::size_t nc = this->sc.cameras.size();
+            this->eyes.clear();
+            this->eyes.resize (nc);
+            this->poses.resize (nc);
+            this->samples.assign (nc, 1);
+            for (std::size_t ci = 0; ci < nc; ++ci) {
+                this->poses[ci] = this->sc.cameras[ci].pose;
+                if (!this->sc.cameras[ci].eye_path.empty()) {
+                    // Text or (memory mapped) binary
+                    this->eyes[ci].open (this->sc.cameras[ci].eye_path);
+                }
+            }
+            this->current = 0u;
+            this->data.clear();
+            this->acc.clear();
+            this->acc.resize (nc);
+            ++this->generation;
+        }
+
+        void render_accumulated (const tracer& tr, const eye_view& ev, const std::size_t ci)
+        {
+            accumulation& a = this->acc[ci];
+            const std::size_t n = ev.n;
+            if (a.frames == 0u || a.samples != ev.samples || a.pose != ev.pose || a.sum.size() != n) {
+                a.samples = ev.samples;
+                a.pose = ev.pose;
+                a.frames = 0u;
+                a.sum.assign (n, { 0.0f, 0.0f, 0.0f });
+                a.sum_lum2.assign (n, 0.0f);
+                a.count.assign (n, 0u);
+                a.alloc.resize (n);
+                a.weight.resize (n);
+            }
+
+            if (a.frames == 0u) {
+                std::fill (a.alloc.begin(), a.alloc.end(), static_cast<uint32_t>(std::max (1, ev.samples)));
+            } else {
+                // Weight each unconverged ommatidium by the standard error of its mean luminance
+                double wsum = 0.0;
+                for (std::size_t i = 0; i < n; ++i) {
+                    const float cnt = static_cast<float>(a.count[i]);
+                    const float mean_l = tracer::luminance (a.sum[i]) / cnt;
+                    const float var = std::max (0.0f, a.sum_lum2[i] / cnt - mean_l * mean_l);
+                    const float se = std::sqrt (var / cnt);
+                    const bool converged = a.count[i] >= static_cast<uint32_t>(max_samples_per_ommatidium)
+                    || (a.count[i] >= this->accumulate_min_samples && se < this->accumulate_tolerance);
+                    a.weight[i] = converged ? 0.0f : std::max (se, 1e-6f);
+                    wsum += a.weight[i];
+                }
+                const double budget = static_cast<double>(n) * std::max (1, ev.samples);
+                const uint32_t cap = 16u * static_cast<uint32_t>(std::max (1, ev.samples));
+                for (std::size_t i = 0; i < n; ++i) {
+                    if (a.weight[i] == 0.0f) {
+                        a.alloc[i] = 0u;
+                    } else {
+                        const double share = std::round (budget * a.weight[i] / wsum);
+                        a.alloc[i] = std::clamp (static_cast<uint32_t>(share), 1u, cap);
+                    }
+                }
+            }
+            a.rays_last = 0u;
+            for (uint32_t s : a.alloc) { a.rays_last += s; }
+
+            tr.accumulate (this->pool, ev, a.alloc.data(), a.sum.data(), a.sum_lum2.data(), a.count.data());
+            ++a.frames;
+        }
+
+        std::size_t current = 0u;
+        uint32_t frame = 0u;
+        uint64_t generation = 0u;
+        std::vector<eyefile::eye> eyes;
+        std::vector<mat4> poses;
+        std::vector<int> samples;
+        std::vector<std::array<float, 3>> data;
+        // The views of the last render_eyes() (kept to reuse their memory)
+        std::vector<eye_view> views;
+
+        // Running sums for progressive refinement of one camera's eye
+        struct accumulation
+        {
+            int samples = 0;
+            mat4 pose = {};
+            uint32_t frames = 0u;
+            std::size_t rays_last = 0u;
+            std::vector<vec3> sum;
+            std::vector<float> sum_lum2;
+            std::vector<uint32_t> count;
+            // This frame's samples for each ommatidium, and the weights they were shared out by
+            std::vector<uint32_t> alloc;
+            std::vector<float> weight;
+        };
+        // One per camera
+        std::vector<accumulation> acc;
+    };
+
+} // namespace
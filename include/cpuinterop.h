@@ -0,0 +1,29 @@
+/*
+ * Conversions between the CPU renderer's plain std::array types and sm types.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <sm/mat44>
+#include "cpumaths.h"
+
+namespace demo
+{
+    // Convert a column-major demo::cpu::mat4 to an sm::mat44
+    inline sm::mat44<float> to_mat44 (const cpu::mat4& m)
+    {
+        sm::mat44<float> r;
+        for (unsigned int i = 0; i < 16u; ++i) { r.mat[i] = m[i]; }
+        return r;
+    }
+
+    inline cpu::mat4 to_mat4 (const sm::mat44<float>& m)
+    {
+        cpu::mat4 r;
+        for (unsigned int i = 0; i < 16u; ++i) { r[i] = m.mat[i]; }
+        return r;
+    }
+
+} // namespace
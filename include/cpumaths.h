@@ -0,0 +1,153 @@
+/*
+ * Tiny, dependency-free 3-vector and 4x4 matrix helpers for the CPU compound eye renderer. The
+ * renderer keeps to plain std::arrays so that it builds without the OptiX/CUDA stack and so that
+ * its inner loops can be laid out for the vectoriser. Convert to sm::vec/sm::mat44 at the edges.
+ *
+ * Matrices are column-major, like sm::mat44 and OpenGL.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <array>
+#include <cmath>
+
+namespace demo::cpu
+{
+    using vec3 = std::array<float, 3>;
+    using mat4 = std::array<float, 16>;
+
+    inline vec3 operator+ (const vec3& a, const vec3& b) { return { a[0] + b[0], a[1] + b[1], a[2] + b[2] }; }
+    inline vec3 operator- (const vec3& a, const vec3& b) { return { a[0] - b[0], a[1] - b[1], a[2] - b[2] }; }
+    inline vec3 operator* (const vec3& a, const float f) { return { a[0] * f, a[1] * f, a[2] * f }; }
+    inline vec3 operator* (const float f, const vec3& a) { return a * f; }
+
+    inline float dot (const vec3& a, const vec3& b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+    inline vec3 cross (const vec3& a, const vec3& b)
+    {
+        return { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+    }
+    inline float length (const vec3& a) { return std::sqrt (dot (a, a)); }
+    inline vec3 normalize (const vec3& a)
+    {
+        float l = length (a);
+        return l > 0.0f ? a * (1.0f / l) : a;
+    }
+
+    inline mat4 identity()
+    {
+        return { 1.0f, 0.0f, 0.0f, 0.0f,  0.0f, 1.0f, 0.0f, 0.0f,  0.0f, 0.0f, 1.0f, 0.0f,  0.0f, 0.0f, 0.0f, 1.0f };
+    }
+
+    inline mat4 operator* (const mat4& a, const mat4& b)
+    {
+        mat4 r = {};
+        for (int c = 0; c < 4; ++c) {
+            for (int rr = 0; rr < 4; ++rr) {
+                float s = 0.0f;
+                for (int k = 0; k < 4; ++k) { s += a[k * 4 + rr] * b[c * 4 + k]; }
+                r[c * 4 + rr] = s;
+            }
+        }
+        return r;
+    }
+
+    // The inverse of m (the identity if m is singular)
+    inline mat4 inverse (const mat4& m)
+    {
+        mat4 inv;
+        inv[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+        inv[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+        inv[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+        inv[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+        inv[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+        inv[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+        inv[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+        inv[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+        inv[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+        inv[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+        inv[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+        inv[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+        inv[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+        inv[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+        inv[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] - m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+        inv[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] + m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+        const float det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+        if (det == 0.0f) { return identity(); }
+        for (float& v : inv) { v /= det; }
+        return inv;
+    }
+
+    // Apply m to a point (w = 1)
+    inline vec3 transform_point (const mat4& m, const vec3& p)
+    {
+        return { m[0] * p[0] + m[4] * p[1] + m[8] * p[2] + m[12],
+                 m[1] * p[0] + m[5] * p[1] + m[9] * p[2] + m[13],
+                 m[2] * p[0] + m[6] * p[1] + m[10] * p[2] + m[14] };
+    }
+
+    // Apply the linear part of m to a direction (w = 0)
+    inline vec3 transform_vector (const mat4& m, const vec3& v)
+    {
+        return { m[0] * v[0] + m[4] * v[1] + m[8] * v[2],
+                 m[1] * v[0] + m[5] * v[1] + m[9] * v[2],
+                 m[2] * v[0] + m[6] * v[1] + m[10] * v[2] };
+    }
+
+    inline vec3 column (const mat4& m, int c) { return { m[c * 4], m[c * 4 + 1], m[c * 4 + 2] }; }
+    inline void set_column (mat4& m, int c, const vec3& v) { m[c * 4] = v[0]; m[c * 4 + 1] = v[1]; m[c * 4 + 2] = v[2]; }
+
+    // Rotation of angle (radians) about the unit axis ax
+    inline mat4 rotation (const vec3& ax, const float angle)
+    {
+        const vec3 a = normalize (ax);
+        const float c = std::cos (angle);
+        const float s = std::sin (angle);
+        const float t = 1.0f - c;
+        mat4 m = identity();
+        m[0] = t * a[0] * a[0] + c;        m[4] = t * a[0] * a[1] - s * a[2]; m[8] = t * a[0] * a[2] + s * a[1];
+        m[1] = t * a[0] * a[1] + s * a[2]; m[5] = t * a[1] * a[1] + c;        m[9] = t * a[1] * a[2] - s * a[0];
+        m[2] = t * a[0] * a[2] - s * a[1]; m[6] = t * a[1] * a[2] + s * a[0]; m[10] = t * a[2] * a[2] + c;
+        return m;
+    }
+
+    // Move a pose (a localspace matrix) by t, given in the pose's own frame
+    inline void translate_locally (mat4& pose, const vec3& t)
+    {
+        set_column (pose, 3, column (pose, 3) + transform_vector (pose, t));
+    }
+
+    // Rotate a pose by angle (radians) about axis, given in the pose's own frame
+    inline void rotate_locally (mat4& pose, const float angle, const vec3& axis)
+    {
+        if (angle != 0.0f) { pose = pose * rotation (axis, angle); }
+    }
+
+    // Compose translation, rotation quaternion (x, y, z, w, as glTF stores it) and scale
+    inline mat4 from_trs (const vec3& t, const std::array<float, 4>& q, const vec3& s)
+    {
+        const float x = q[0], y = q[1], z = q[2], w = q[3];
+        mat4 m = identity();
+        m[0] = (1.0f - 2.0f * (y * y + z * z)) * s[0];
+        m[1] = (2.0f * (x * y + z * w)) * s[0];
+        m[2] = (2.0f * (x * z - y * w)) * s[0];
+        m[4] = (2.0f * (x * y - z * w)) * s[1];
+        m[5] = (1.0f - 2.0f * (x * x + z * z)) * s[1];
+        m[6] = (2.0f * (y * z + x * w)) * s[1];
+        m[8] = (2.0f * (x * z + y * w)) * s[2];
+        m[9] = (2.0f * (y * z - x * w)) * s[2];
+        m[10] = (1.0f - 2.0f * (x * x + y * y)) * s[2];
+        m[12] = t[0];
+        m[13] = t[1];
+        m[14] = t[2];
+        return m;
+    }
+
+    // The transform of a y-up glTF scene into Blender's z-up axes (as mplot::compoundray::blender_transform)
+    inline mat4 blender_transform()
+    {
+        return { 1.0f, 0.0f, 0.0f, 0.0f,  0.0f, 0.0f, 1.0f, 0.0f,  0.0f, -1.0f, 0.0f, 0.0f,  0.0f, 0.0f, 0.0f, 1.0f };
+    }
+
+} // namespace
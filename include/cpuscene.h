@@ -0,0 +1,420 @@
+/*
+ * A CPU-side glTF scene for the CPU compound eye renderer. This reads the same glTF files as
+ * compound-ray's loadGlTFscene() (meshes, material base colours, cameras and their compound eye
+ * 'extras'), but without any OptiX or CUDA.
+ *
+ * Textures are not sampled; each primitive takes the base colour factor of its material.
+ *
+ * Given a thread pool, load_gltf() reads buffers and decodes meshes in parallel. See
+ * scenecache.h for a cache of loaded scenes that avoids parsing altogether.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "jsonparse.h"
+#include "cpumaths.h"
+#include "threadpool.h"
+
+namespace demo::cpu
+{
+    struct material
+    {
+        std::string name;
+        vec3 colour = { 0.8f, 0.8f, 0.8f };
+        // The material has a base colour texture (which isn't sampled; see above)
+        bool textured = false;
+    };
+
+    // A triangle list in the mesh's own frame of reference
+    struct primitive
+    {
+        std::vector<vec3> positions;
+        std::vector<vec3> normals; // may be empty
+        std::vector<uint32_t> indices;
+        int material = -1;
+    };
+
+    struct mesh
+    {
+        std::string name;
+        std::vector<primitive> primitives;
+    };
+
+    // A node that places a mesh in the world. Several instances may share one mesh.
+    struct instance
+    {
+        std::string name;
+        uint32_t mesh = 0u;
+        mat4 transform = identity();
+    };
+
+    struct camera
+    {
+        std::string name;
+        // Camera localspace in the world; columns are ux (right), uy (up), uz (forward) and the
+        // position. This is compound-ray's left-handed camera frame.
+        mat4 pose = identity();
+        // Path to the .eye file for compound eye cameras, empty otherwise
+        std::string eye_path;
+        std::string projection;
+    };
+
+    struct scene
+    {
+        std::string path;
+        std::vector<material> materials;
+        std::vector<mesh> meshes;
+        std::vector<instance> instances;
+        std::vector<camera> cameras;
+        std::string background_shader;
+        // The scene's up direction, used by the sky shader
+        vec3 up = { 0.0f, 1.0f, 0.0f };
+        // The external files (buffers) that the glTF file reads
+        std::vector<std::string> dependencies;
+
+        // Total number of world-space triangles
+        std::size_t triangle_count() const
+        {
+            std::size_t n = 0u;
+            for (const auto& inst : this->instances) {
+                for (const auto& p : this->meshes[inst.mesh].primitives) { n += p.indices.size() / 3u; }
+            }
+            return n;
+        }
+    };
+
+    namespace gltf_detail
+    {
+        inline std::vector<uint8_t> base64_decode (std::string_view in)
+        {
+            auto val = [](char c) -> int {
+                if (c >= 'A' && c <= 'Z') { return c - 'A'; }
+                if (c >= 'a' && c <= 'z') { return c - 'a' + 26; }
+                if (c >= '0' && c <= '9') { return c - '0' + 52; }
+                if (c == '+' || c == '-') { return 62; }
+                if (c == '/' || c == '_') { return 63; }
+                return -1;
+            };
+            std::vector<uint8_t> out;
+            out.reserve (in.size() * 3u / 4u);
+            uint32_t acc = 0u;
+            int bits = 0;
+            for (char c : in) {
+                int v = val (c);
+                if (v < 0) { continue; } // padding, whitespace
+                acc = (acc << 6) | static_cast<uint32_t>(v);
+                bits += 6;
+                if (bits >= 8) {
+                    bits -= 8;
+                    out.push_back (static_cast<uint8_t>((acc >> bits) & 0xffu));
+                }
+            }
+            return out;
+        }
+
+        inline std::vector<uint8_t> read_file (const std::filesystem::path& p)
+        {
+            std::ifstream f (p, std::ios::binary);
+            if (!f.is_open()) { throw std::runtime_error ("Could not open '" + p.string() + "'"); }
+            return std::vector<uint8_t> ((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+        }
+
+        // Read an accessor into floats (n components per element) or into uint32 indices
+        struct accessor_reader
+        {
+            const json::value& doc;
+            const std::vector<std::vector<uint8_t>>& buffers;
+
+            struct view { const uint8_t* data; std::size_t count; std::size_t stride; int ctype; int ncomp; };
+
+            static int num_components (const std::string& type)
+            {
+                if (type == "SCALAR") { return 1; }
+                if (type == "VEC2") { return 2; }
+                if (type == "VEC3") { return 3; }
+                if (type == "VEC4") { return 4; }
+                throw std::runtime_error ("glTF: unsupported accessor type " + type);
+            }
+            static std::size_t component_size (int ctype)
+            {
+                switch (ctype) {
+                case 5120: case 5121: return 1u;
+                case 5122: case 5123: return 2u;
+                case 5125: case 5126: return 4u;
+                default: throw std::runtime_error ("glTF: unsupported component type " + std::to_string (ctype));
+                }
+            }
+
+            view get (int ai) const
+            {
+                const json::value& acc = this->doc["accessors"][static_cast<std::size_t>(ai)];
+                if (acc.contains ("sparse")) { throw std::runtime_error ("glTF: sparse accessors are not supported"); }
+                view v;
+                v.count = static_cast<std::size_t>(acc["count"].num);
+                v.ctype = static_cast<int>(acc["componentType"].num);
+                v.ncomp = num_components (acc["type"].str);
+                const std::size_t elsize = component_size (v.ctype) * static_cast<std::size_t>(v.ncomp);
+                const json::value& bv = this->doc["bufferViews"][static_cast<std::size_t>(acc["bufferView"].num)];
+                const auto& buf = this->buffers.at (static_cast<std::size_t>(bv["buffer"].num));
+                const std::size_t offset = static_cast<std::size_t>(bv.number_or ("byteOffset", 0.0) + acc.number_or ("byteOffset", 0.0));
+                v.stride = static_cast<std::size_t>(bv.number_or ("byteStride", 0.0));
+                if (v.stride == 0u) { v.stride = elsize; }
+                if (v.count > 0u && offset + (v.count - 1u) * v.stride + elsize > buf.size()) {
+                    throw std::runtime_error ("glTF: accessor runs off the end of its buffer");
+                }
+                v.data = buf.data() + offset;
+                return v;
+            }
+
+            std::vector<vec3> vec3s (int ai) const
+            {
+                view v = this->get (ai);
+                if (v.ctype != 5126 || v.ncomp != 3) { throw std::runtime_error ("glTF: expected float VEC3 accessor"); }
+                std::vector<vec3> out (v.count);
+                for (std::size_t i = 0; i < v.count; ++i) { std::memcpy (out[i].data(), v.data + i * v.stride, sizeof (vec3)); }
+                return out;
+            }
+
+            std::vector<uint32_t> indices (int ai) const
+            {
+                view v = this->get (ai);
+                std::vector<uint32_t> out (v.count);
+                for (std::size_t i = 0; i < v.count; ++i) {
+                    const uint8_t* p = v.data + i * v.stride;
+                    if (v.ctype == 5121) {
+                        out[i] = *p;
+                    } else if (v.ctype == 5123) {
+                        uint16_t s;
+                        std::memcpy (&s, p, 2);
+                        out[i] = s;
+                    } else if (v.ctype == 5125) {
+                        std::memcpy (&out[i], p, 4);
+                    } else {
+                        throw std::runtime_error ("glTF: bad index component type");
+                    }
+                }
+                return out;
+            }
+        };
+
+        inline vec3 get_vec3 (const json::value& node, std::string_view key, const vec3& dflt)
+        {
+            const json::value* v = node.find (key);
+            if (v == nullptr || v->size() != 3u) { return dflt; }
+            return { static_cast<float>((*v)[0].num), static_cast<float>((*v)[1].num), static_cast<float>((*v)[2].num) };
+        }
+
+        // Call fn (i) for i in [0, n), on pool if there is one. The first exception thrown is rethrown here.
+        template <typename F>
+        void for_each_index (const std::size_t n, threadpool* pool, F&& fn)
+        {
+            if (pool == nullptr || n < 2u) {
+                for (std::size_t i = 0; i < n; ++i) { fn (i); }
+                return;
+            }
+            std::vector<std::exception_ptr> errors (n);
+            pool->parallel_for (n, 1u, [&](std::size_t b, std::size_t e) {
+                for (std::size_t i = b; i < e; ++i) {
+                    try { fn (i); } catch (...) { errors[i] = std::current_exception(); }
+                }
+            });
+            for (const auto& ep : errors) { if (ep) { std::rethrow_exception (ep); } }
+        }
+
+        inline mat4 node_local_transform (const json::value& node)
+        {
+            const json::value* m = node.find ("matrix");
+            if (m != nullptr && m->size() == 16u) {
+                mat4 r;
+                for (std::size_t i = 0; i < 16u; ++i) { r[i] = static_cast<float>((*m)[i].num); }
+                return r;
+            }
+            std::array<float, 4> q = { 0.0f, 0.0f, 0.0f, 1.0f };
+            const json::value* rq = node.find ("rotation");
+            if (rq != nullptr && rq->size() == 4u) {
+                for (std::size_t i = 0; i < 4u; ++i) { q[i] = static_cast<float>((*rq)[i].num); }
+            }
+            return from_trs (get_vec3 (node, "translation", { 0.0f, 0.0f, 0.0f }), q,
+                             get_vec3 (node, "scale", { 1.0f, 1.0f, 1.0f }));
+        }
+    } // namespace gltf_detail
+
+    /*
+     * Load a .gltf file (embedded base64 or external .bin buffers; .glb is not supported).
+     * world_transform is applied to the whole scene, as in loadGlTFscene(path, transform). With a
+     * pool, buffers are read and meshes decoded in parallel.
+     */
+    inline scene load_gltf (const std::string& path, const mat4& world_transform = identity(),
+                            threadpool* pool = nullptr)
+    {
+        namespace fs = std::filesystem;
+        std::ifstream fin (path);
+        if (!fin.is_open()) { throw std::runtime_error ("Could not open glTF file '" + path + "'"); }
+        std::stringstream ss;
+        ss << fin.rdbuf();
+        const std::string text = ss.str();
+        const json::value doc = json::parse (text);
+        const fs::path base = fs::path(path).parent_path();
+
+        scene sc;
+        sc.path = path;
+        sc.up = normalize (transform_vector (world_transform, { 0.0f, 1.0f, 0.0f }));
+
+        // Buffers
+        std::vector<std::vector<uint8_t>> buffers;
+        if (const json::value* bufs = doc.find ("buffers")) {
+            for (const auto& b : bufs->arr) {
+                const std::string uri = b.string_or ("uri", "");
+                if (!uri.empty() && uri.rfind ("data:", 0) != 0) { sc.dependencies.push_back ((base / uri).string()); }
+            }
+            buffers.resize (bufs->size());
+            gltf_detail::for_each_index (bufs->size(), pool, [&](std::size_t bi) {
+                const std::string uri = (*bufs)[bi].string_or ("uri", "");
+                if (uri.rfind ("data:", 0) == 0) {
+                    auto comma = uri.find (',');
+                    if (comma == std::string::npos || uri.find (";base64") > comma) {
+                        throw std::runtime_error ("glTF: only base64 data URIs are supported");
+                    }
+                    buffers[bi] = gltf_detail::base64_decode (std::string_view(uri).substr (comma + 1));
+                } else if (!uri.empty()) {
+                    buffers[bi] = gltf_detail::read_file (base / uri);
+                } else {
+                    throw std::runtime_error ("glTF: buffer without uri (.glb files are not supported)");
+                }
+            });
+        }
+        gltf_detail::accessor_reader rd { doc, buffers };
+
+        // Materials
+        if (const json::value* mats = doc.find ("materials")) {
+            for (const auto& m : mats->arr) {
+                material mat;
+                mat.name = m.string_or ("name", "");
+                if (const json::value* pbr = m.find ("pbrMetallicRoughness")) {
+                    if (const json::value* bc = pbr->find ("baseColorFactor"); bc != nullptr && bc->size() >= 3u) {
+                        mat.colour = { static_cast<float>((*bc)[0].num), static_cast<float>((*bc)[1].num),
+                                       static_cast<float>((*bc)[2].num) };
+                    }
+                    mat.textured = pbr->find ("baseColorTexture") != nullptr;
+                }
+                sc.materials.push_back (mat);
+            }
+        }
+
+        // Meshes
+        if (const json::value* meshes = doc.find ("meshes")) {
+            sc.meshes.resize (meshes->size());
+            gltf_detail::for_each_index (meshes->size(), pool, [&](std::size_t mi) {
+                const json::value& m = (*meshes)[mi];
+                mesh& me = sc.meshes[mi];
+                me.name = m.string_or ("name", "");
+                for (const auto& p : m["primitives"].arr) {
+                    if (p.int_or ("mode", 4) != 4) { continue; } // triangles only
+                    primitive pr;
+                    const json::value& attr = p["attributes"];
+                    pr.positions = rd.vec3s (static_cast<int>(attr["POSITION"].num));
+                    if (const json::value* n = attr.find ("NORMAL")) { pr.normals = rd.vec3s (static_cast<int>(n->num)); }
+                    if (const json::value* ind = p.find ("indices")) {
+                        pr.indices = rd.indices (static_cast<int>(ind->num));
+                    } else {
+                        pr.indices.resize (pr.positions.size());
+                        for (uint32_t i = 0; i < pr.indices.size(); ++i) { pr.indices[i] = i; }
+                    }
+                    pr.indices.resize (pr.indices.size() - pr.indices.size() % 3u);
+                    for (auto i : pr.indices) {
+                        if (i >= pr.positions.size()) { throw std::runtime_error ("glTF: index out of range in mesh " + me.name); }
+                    }
+                    pr.material = p.int_or ("material", -1);
+                    me.primitives.push_back (std::move (pr));
+                }
+            });
+        }
+
+        // Walk the node hierarchy of the default scene
+        const json::value* nodes = doc.find ("nodes");
+        const json::value* cameras = doc.find ("cameras");
+        auto visit = [&](auto&& self, std::size_t ni, const mat4& parent) -> void {
+            const json::value& node = (*nodes)[ni];
+            const mat4 world = parent * gltf_detail::node_local_transform (node);
+            if (const json::value* mi = node.find ("mesh")) {
+                if (!(mi->num >= 0.0) || mi->num >= static_cast<double>(sc.meshes.size())) {
+                    throw std::runtime_error ("glTF: mesh index out of range in node " + node.string_or ("name", ""));
+                }
+                sc.instances.push_back ({ node.string_or ("name", ""), static_cast<uint32_t>(mi->num), world });
+            }
+            if (const json::value* ci = node.find ("camera"); ci != nullptr && cameras != nullptr) {
+                const json::value& cam = (*cameras)[static_cast<std::size_t>(ci->num)];
+                camera c;
+                c.name = node.string_or ("name", cam.string_or ("name", ""));
+                // glTF cameras look down -z. compound-ray's camera frame is left handed with
+                // uz forward, so flip z and remove any node scaling.
+                vec3 ux = normalize (column (world, 0));
+                vec3 uy = normalize (column (world, 1));
+                vec3 uz = normalize (column (world, 2)) * -1.0f;
+                set_column (c.pose, 0, ux);
+                set_column (c.pose, 1, uy);
+                set_column (c.pose, 2, uz);
+                set_column (c.pose, 3, column (world, 3));
+                if (const json::value* ex = cam.find ("extras")) {
+                    if (ex->string_or ("compound-eye", "false") == "true") {
+                        c.eye_path = ex->string_or ("compound-structure", "");
+                        c.projection = ex->string_or ("compound-projection", "");
+                    }
+                }
+                sc.cameras.push_back (c);
+            }
+            if (const json::value* ch = node.find ("children")) {
+                for (const auto& c : ch->arr) { self (self, static_cast<std::size_t>(c.num), world); }
+            }
+        };
+        if (nodes != nullptr) {
+            const json::value* scenes = doc.find ("scenes");
+            const std::size_t si = static_cast<std::size_t>(doc.number_or ("scene", 0.0));
+            if (scenes != nullptr && si < scenes->size()) {
+                const json::value& s = (*scenes)[si];
+                if (const json::value* ex = s.find ("extras")) { sc.background_shader = ex->string_or ("background-shader", ""); }
+                if (const json::value* roots = s.find ("nodes")) {
+                    for (const auto& r : roots->arr) { visit (visit, static_cast<std::size_t>(r.num), world_transform); }
+                }
+            } else {
+                // No scene: the roots are the nodes that are no other node's child
+                std::vector<bool> is_child (nodes->size(), false);
+                for (const auto& node : nodes->arr) {
+                    if (const json::value* children = node.find ("children")) {
+                        for (const auto& c : children->arr) {
+                            const std::size_t ci = static_cast<std::size_t>(c.num);
+                            if (ci < is_child.size()) { is_child[ci] = true; }
+                        }
+                    }
+                }
+                for (std::size_t ni = 0; ni < nodes->size(); ++ni) {
+                    if (!is_child[ni]) { visit (visit, ni, world_transform); }
+                }
+            }
+        }
+
+        // Resolve eye paths as compound-ray does (relative to the working directory), falling
+        // back to the glTF file's directory.
+        for (auto& c : sc.cameras) {
+            if (!c.eye_path.empty() && !fs::exists (c.eye_path) && fs::exists (base / c.eye_path)) {
+                c.eye_path = (base / c.eye_path).string();
+            }
+        }
+
+        return sc;
+    }
+
+} // namespace
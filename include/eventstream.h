@@ -0,0 +1,231 @@
+/*
+ * Event camera style output: rather than every ommatidium of every frame, emit only the
+ * ommatidia whose output has changed by more than a threshold since they last emitted, as
+ * (index, new value) events, with a full keyframe every so often.
+ *
+ * eventencoder keeps, for each ommatidium, the value it last emitted. An ommatidium emits when any
+ * channel (or, for a luminance stream, its luminance) differs from that by more than threshold, so
+ * slow drifts accumulate until they emit too, and a decoder that applies the events to the last
+ * keyframe never strays from the true frame by more than threshold. Keyframes (the first frame,
+ * then every keyframe_interval frames, or after reset()) carry the whole frame. For a compact
+ * outputformat, the emitted values are quantised to the format (luminance is given in all three
+ * channels), and the encoder remembers the quantised values, as a decoder of the format sees
+ * them, so the threshold bounds the decoder's error in that format too. A threshold below half
+ * the format's quantisation step would let an unchanging ommatidium, which is up to half a step
+ * from its quantised value, emit on every frame, so the threshold is raised to at least that
+ * (see eventencoder::min_threshold).
+ *
+ * eventwriter writes the events to a flat binary file (little endian):
+ *
+ *   header: char[4] "OMME", uint32 version (1), uint32 n_ommatidia, uint32 format
+ *           (outputformat::code(), as in framewriter.h), float threshold, uint32 keyframe_interval
+ *   then per step: uint64 step, float[16] camera localspace (column major), uint32 keyframe (0|1),
+ *                  uint32 n_events, uint32 index[n_events] (absent for keyframes, whose events
+ *                  are every ommatidium in order), n_events values in the format
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <span>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "outputformat.h"
+
+namespace demo
+{
+    // One frame's events
+    struct eventframe
+    {
+        // If true, values holds every ommatidium and indices is empty
+        bool keyframe = false;
+        std::vector<uint32_t> indices;
+        std::vector<std::array<float, 3>> values;
+
+        std::size_t size() const { return this->values.size(); }
+    };
+
+    struct eventencoder
+    {
+        /*
+         * For frames of n_ommatidia. keyframe_interval 0 makes only the first frame (and the first
+         * after reset()) a keyframe. The values are quantised to format; for a luminance format,
+         * changes are measured in Rec. 709 luminance. The threshold is raised to
+         * min_threshold (format) if it is below it.
+         */
+        eventencoder (const std::size_t n_ommatidia, const float _threshold, const uint32_t _keyframe_interval = 60u,
+                      const outputformat _format = {})
+            : threshold (_threshold >= 0.0f ? std::max (_threshold, min_threshold (_format)) : _threshold)
+            , keyframe_interval (_keyframe_interval), format (_format), luminance (_format.luminance)
+        {
+            if (!(this->threshold >= 0.0f)) { throw std::runtime_error ("eventencoder: the threshold must be >= 0"); }
+            this->reference.resize (n_ommatidia);
+            this->changed.resize (n_ommatidia);
+        }
+
+        // Half of format's quantisation step for values in 0-1 (0 for float32)
+        static float min_threshold (const outputformat& format)
+        {
+            if (format.type == outputformat::element::u8) { return 0.5f / 255.0f; }
+            // Halves in [0.5, 1) are 2^-11 apart
+            if (format.type == outputformat::element::f16) { return 0.5f / 2048.0f; }
+            return 0.0f;
+        }
+
+        // Make the next frame a keyframe
+        void reset() { this->since_keyframe = 0u; }
+
+        // Compare frame with the values last emitted and fill out with the events
+        void encode (std::span<const std::array<float, 3>> frame, eventframe& out)
+        {
+            const std::size_t n = this->reference.size();
+            if (frame.size() != n) { throw std::runtime_error ("eventencoder: wrong number of ommatidia"); }
+            out.indices.clear();
+            out.keyframe = this->since_keyframe == 0u;
+            if (out.keyframe) {
+                out.values.assign (frame.begin(), frame.end());
+                this->quantise (out.values);
+                std::copy (out.values.begin(), out.values.end(), this->reference.begin());
+            } else {
+                // A branch free pass to flag the changed ommatidia, then a pass to gather them
+                const float* cur = frame.data()->data();
+                const float* ref = this->reference.data()->data();
+                uint8_t* ch = this->changed.data();
+                const float th = this->threshold;
+                if (this->luminance) {
+#pragma omp simd
+                    for (std::size_t i = 0; i < n; ++i) {
+                        const float d = outputcodec::luminance (cur[3 * i] - ref[3 * i], cur[3 * i + 1] - ref[3 * i + 1],
+                                                                cur[3 * i + 2] - ref[3 * i + 2]);
+                        ch[i] = std::fabs (d) > th ? 1u : 0u;
+                    }
+                } else {
+#pragma omp simd
+                    for (std::size_t i = 0; i < n; ++i) {
+                        const float d = std::max (std::fabs (cur[3 * i] - ref[3 * i]),
+                                                  std::max (std::fabs (cur[3 * i + 1] - ref[3 * i + 1]),
+                                                            std::fabs (cur[3 * i + 2] - ref[3 * i + 2])));
+                        ch[i] = d > th ? 1u : 0u;
+                    }
+                }
+                out.values.clear();
+                for (std::size_t i = 0; i < n; ++i) {
+                    if (ch[i] == 0u) { continue; }
+                    out.indices.push_back (static_cast<uint32_t>(i));
+                    out.values.push_back (frame[i]);
+                }
+                this->quantise (out.values);
+                for (std::size_t e = 0; e < out.indices.size(); ++e) { this->reference[out.indices[e]] = out.values[e]; }
+            }
+            if (++this->since_keyframe == this->keyframe_interval) { this->since_keyframe = 0u; }
+            this->total_events += out.size();
+            ++this->frames;
+        }
+
+        // For a compact format, the last encode()'s values in the format (as eventframe::values)
+        std::span<const uint8_t> encoded() const { return this->encoded_values; }
+
+        // The mean fraction of ommatidia that emitted per frame, over all frames so far
+        double event_fraction() const
+        {
+            const double denom = static_cast<double>(this->frames) * static_cast<double>(this->reference.size());
+            return denom > 0.0 ? static_cast<double>(this->total_events) / denom : 0.0;
+        }
+
+        const float threshold;
+        const uint32_t keyframe_interval;
+        const outputformat format;
+        const bool luminance;
+
+    private:
+        // Replace values with what a decoder of format would get back (a round trip through it)
+        void quantise (std::vector<std::array<float, 3>>& values)
+        {
+            if (this->format.native()) { return; }
+            this->encoded_values.resize (values.size() * this->format.bytes_per_ommatidium());
+            outputcodec::encode (values, this->format, this->encoded_values.data());
+            outputcodec::decode (this->encoded_values.data(), this->format, values);
+        }
+
+        // The value each ommatidium last emitted
+        std::vector<std::array<float, 3>> reference;
+        std::vector<uint8_t> changed;
+        std::vector<uint8_t> encoded_values;
+        uint32_t since_keyframe = 0u;
+        uint64_t total_events = 0u;
+        uint64_t frames = 0u;
+    };
+
+    // Apply a frame's events to frame, the decoder's copy of the ommatidium outputs
+    inline void apply_events (const eventframe& ev, std::span<std::array<float, 3>> frame)
+    {
+        if (ev.keyframe) {
+            if (ev.values.size() != frame.size()) { throw std::runtime_error ("apply_events: wrong number of ommatidia"); }
+            std::copy (ev.values.begin(), ev.values.end(), frame.begin());
+            return;
+        }
+        for (std::size_t e = 0; e < ev.indices.size(); ++e) { frame[ev.indices[e]] = ev.values[e]; }
+    }
+
+    struct eventwriter
+    {
+        static constexpr uint32_t version = 1u;
+
+        eventwriter (const std::string& path, const uint32_t _n_ommatidia, const float threshold,
+                     const uint32_t keyframe_interval = 60u, const outputformat _format = {})
+            : encoder (_n_ommatidia, threshold, keyframe_interval, _format), n_ommatidia (_n_ommatidia), format (_format)
+        {
+            this->buf.resize (1u << 22);
+            this->fout.rdbuf()->pubsetbuf (this->buf.data(), static_cast<std::streamsize>(this->buf.size()));
+            this->fout.open (path, std::ios::out | std::ios::trunc | std::ios::binary);
+            if (!this->fout.is_open()) { throw std::runtime_error ("Could not open '" + path + "' for writing"); }
+            const uint32_t hdr[3] = { version, this->n_ommatidia, this->format.code() };
+            this->fout.write ("OMME", 4);
+            this->fout.write (reinterpret_cast<const char*>(hdr), sizeof (hdr));
+            this->fout.write (reinterpret_cast<const char*>(&this->encoder.threshold), sizeof (this->encoder.threshold));
+            this->fout.write (reinterpret_cast<const char*>(&keyframe_interval), sizeof (keyframe_interval));
+        }
+
+        // Encode a step's frame and write its events. Returns the number of events.
+        std::size_t write (const uint64_t step, const std::array<float, 16>& pose, std::span<const std::array<float, 3>> data)
+        {
+            this->encoder.encode (data, this->events);
+            const uint32_t ev_hdr[2] = { this->events.keyframe ? 1u : 0u, static_cast<uint32_t>(this->events.size()) };
+            this->fout.write (reinterpret_cast<const char*>(&step), sizeof (step));
+            this->fout.write (reinterpret_cast<const char*>(pose.data()), sizeof (float) * 16u);
+            this->fout.write (reinterpret_cast<const char*>(ev_hdr), sizeof (ev_hdr));
+            if (!this->events.keyframe) {
+                this->fout.write (reinterpret_cast<const char*>(this->events.indices.data()),
+                                  static_cast<std::streamsize>(this->events.indices.size() * sizeof (uint32_t)));
+            }
+            if (this->format.native()) {
+                this->fout.write (reinterpret_cast<const char*>(this->events.values.data()),
+                                  static_cast<std::streamsize>(this->events.values.size() * sizeof (std::array<float, 3>)));
+            } else {
+                // The encoder has already encoded the values to quantise them
+                std::span<const uint8_t> enc = this->encoder.encoded();
+                this->fout.write (reinterpret_cast<const char*>(enc.data()), static_cast<std::streamsize>(enc.size()));
+            }
+            if (!this->fout.good()) { throw std::runtime_error ("eventwriter: write failed"); }
+            return this->events.size();
+        }
+
+        eventencoder encoder;
+
+    private:
+        std::vector<char> buf;
+        std::ofstream fout;
+        uint32_t n_ommatidia = 0u;
+        outputformat format;
+        eventframe events;
+    };
+
+} // namespace
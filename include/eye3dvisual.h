@@ -46,7 +46,9 @@ namespace demo
             campose_reset_request, // A request to reset the pose of the camera
             show_camframe,         // Show camera axes?
             paused,                // Pause sim (i.e. pause time)?
-            stepfwd                // If true and if paused is true, step forward one timestep in the camera input
+            stepfwd,               // If true and if paused is true, step forward one timestep in the camera input
+            samples_up_request,    // A request to double the samples per ommatidium (Page Up)
+            samples_down_request   // A request to halve the samples per ommatidium (Page Down)
         };
         sm::flags<state> vstate;
 
@@ -129,15 +131,32 @@ namespace demo
             return out;
         }
 
+        // Apply any Page Up/Page Down request to the samples per ommatidium csamp and return the
+        // new value. Doubling stops at 32000, beyond which graphics memory use gets very large.
+        int requestedSamples (const int csamp)
+        {
+            int nsamp = csamp;
+            if (this->vstate.test (state::samples_up_request)) {
+                if (csamp < 32000) {
+                    nsamp = csamp * 2; // double
+                } else {
+                    std::cout << "max allowed samples\n";
+                }
+                this->vstate.reset (state::samples_up_request);
+            }
+            if (this->vstate.test (state::samples_down_request)) {
+                nsamp = csamp - csamp / 2; // halve
+                this->vstate.reset (state::samples_down_request);
+            }
+            return nsamp;
+        }
+
         // Is the camera 'actively moving'?
         bool isActivelyMoving() { return this->move_state.any(); }
 
-        // Cancel any movement. Also unpause
-        void stop()
-        {
-            this->vstate.reset (state::paused);
-            this->move_state.reset();
-        }
+        // Cancel any movement. This leaves a pause in place; a move made while paused happens
+        // at the next simulation step (see demo::simclock)
+        void stop() { this->move_state.reset(); }
 
     protected:
 
@@ -231,16 +250,10 @@ namespace demo
                     this->vstate.flip (state::paused);
 
                 } else if (key == mplot::key::page_up) {
-                    int csamp = getCurrentEyeSamplesPerOmmatidium();
-                    if (csamp < 32000) {
-                        changeCurrentEyeSamplesPerOmmatidiumBy (csamp); // double
-                    } else {
-                        // else graphics memory use will get very large
-                        std::cout << "max allowed samples\n";
-                    }
+                    // The ray caster may be busy on another thread, so just record the request
+                    this->vstate.set (state::samples_up_request);
                 } else if (key == mplot::key::page_down) {
-                    int csamp = getCurrentEyeSamplesPerOmmatidium();
-                    changeCurrentEyeSamplesPerOmmatidiumBy (-(csamp/2)); // halve
+                    this->vstate.set (state::samples_down_request);
                 }
             }
         }
@@ -0,0 +1,142 @@
+/*
+ * The interface between the demo program and whatever does the compound eye ray casting.
+ * demo::optixbackend wraps compound-ray's libEyeRenderer3 (which needs an OptiX GPU) and
+ * demo::cpubackend wraps the multithreaded CPU renderer, demo::cpu::eyerenderer.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <sampleConfig.h>
+#include "MulticamScene.h" // for compound-ray's Ommatidium
+
+#include <sm/mat44>
+#include <mplot/Visual.h>
+
+namespace demo
+{
+    struct scene_draw_stats;
+
+    struct eyebackend
+    {
+        virtual ~eyebackend() = default;
+
+        // Load a glTF scene, optionally transforming it into Blender's z-up axes
+        virtual void load_scene (const std::string& path, const bool blender_axes) = 0;
+        // Incremented by each scene load (for demo::render_cache)
+        virtual uint64_t scene_generation() = 0;
+
+        // Camera selection. A scene may have several cameras; some compound, some not.
+        virtual int camera_count() = 0;
+        virtual void goto_camera (int ci) = 0;
+        virtual int camera_index() = 0;
+        virtual std::string eye_data_path() = 0;
+        virtual bool is_compound_eye_active() = 0;
+
+        // Samples per ommatidium of the current camera
+        virtual int samples_per_ommatidium() = 0;
+        virtual void change_samples_per_ommatidium_by (int d) = 0;
+
+        // Camera movement in the camera's own (left handed) frame
+        virtual void translate_cameras_locally (float x, float y, float z) = 0;
+        virtual void rotate_cameras_locally_around (float angle, float x, float y, float z) = 0;
+        // The camera localspace (as mplot::compoundray::getCameraSpace) and a setter for it
+        virtual sm::mat44<float> camera_space() = 0;
+        virtual void set_camera_space (const sm::mat44<float>& cs) = 0;
+        // The localspace of any camera ci. These visit ci with goto_camera() and then return to
+        // the current camera; override where the ray caster can reach ci directly.
+        virtual sm::mat44<float> camera_space_of (const int ci)
+        {
+            const int cur = this->camera_index();
+            this->goto_camera (ci);
+            sm::mat44<float> cs = this->camera_space();
+            this->goto_camera (cur);
+            return cs;
+        }
+        virtual void set_camera_space_of (const int ci, const sm::mat44<float>& cs)
+        {
+            const int cur = this->camera_index();
+            this->goto_camera (ci);
+            this->set_camera_space (cs);
+            this->goto_camera (cur);
+        }
+
+        // Ray cast the current compound eye and then copy out the per-ommatidium colours
+        virtual void render_frame() = 0;
+        virtual void get_camera_data (std::vector<std::array<float, 3>>& out) = 0;
+        // render_frame() then get_camera_data(). Override where the ray caster can write into out directly
+        virtual void render_frame_into (std::vector<std::array<float, 3>>& out)
+        {
+            this->render_frame();
+            this->get_camera_data (out);
+        }
+        /*
+         * Ray cast the compound eyes of several cameras, writing their outputs one after another
+         * into out, in the order of cameras. This default renders them in turn; override where
+         * the ray caster can cast them all in one batch.
+         */
+        virtual void render_eyes (const std::vector<int>& cameras, std::vector<std::array<float, 3>>& out)
+        {
+            const int cur = this->camera_index();
+            std::size_t total = 0u;
+            for (int ci : cameras) {
+                this->goto_camera (ci);
+                this->render_frame_into (this->eye_out);
+                out.resize (total + this->eye_out.size());
+                std::copy (this->eye_out.begin(), this->eye_out.end(), out.begin() + total);
+                total += this->eye_out.size();
+            }
+            out.resize (total);
+            this->goto_camera (cur);
+        }
+        /*
+         * Ray cast the compound eyes of cameras at each of a batch of poses. poses holds one pose
+         * per camera per item (item b's pose for cameras[k] is poses[b * cameras.size() + k]) and
+         * out receives a contiguous items x ommatidia tensor, each item laid out as render_eyes()
+         * lays out a frame. The cameras end at the poses they started at. This default visits the
+         * items in turn; override where the ray caster can cast the whole batch at once.
+         */
+        virtual void render_batch (const std::vector<int>& cameras, std::span<const sm::mat44<float>> poses,
+                                   std::vector<std::array<float, 3>>& out)
+        {
+            const std::size_t nc = cameras.size();
+            if (nc == 0u || poses.size() % nc != 0u) { throw std::runtime_error ("render_batch: need one pose per camera per item"); }
+            this->batch_saved.clear();
+            for (int ci : cameras) { this->batch_saved.push_back (this->camera_space_of (ci)); }
+            out.clear();
+            for (std::size_t b = 0; b < poses.size() / nc; ++b) {
+                for (std::size_t k = 0; k < nc; ++k) { this->set_camera_space_of (cameras[k], poses[b * nc + k]); }
+                this->render_eyes (cameras, this->batch_frame);
+                out.insert (out.end(), this->batch_frame.begin(), this->batch_frame.end());
+            }
+            for (std::size_t k = 0; k < nc; ++k) { this->set_camera_space_of (cameras[k], this->batch_saved[k]); }
+        }
+        // Progressive refinement: while the camera, its pose and samples are unchanged, refine
+        // each frame with the samples of the frames before it (see cpu::eyerenderer::accumulate)
+        virtual void set_accumulation (const bool on) = 0;
+        // The current compound eye's ommatidia, for mplot::compoundray::EyeVisual
+        virtual std::vector<Ommatidium>* ommatidia() = 0;
+        // The ommatidia of camera ci's compound eye
+        virtual std::vector<Ommatidium>* ommatidia_of (const int ci) = 0;
+
+        // Add VisualModels for the scene's meshes to a mathplot Visual. They count what they draw in stats, if given.
+        virtual void add_scene_to (mplot::Visual<>* v, scene_draw_stats* stats) = 0;
+
+    private:
+        // One eye's outputs, for the default render_eyes()
+        std::vector<std::array<float, 3>> eye_out;
+        // One item's frame and the cameras' own poses, for the default render_batch()
+        std::vector<std::array<float, 3>> batch_frame;
+        std::vector<sm::mat44<float>> batch_saved;
+    };
+
+} // namespace
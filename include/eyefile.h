@@ -0,0 +1,245 @@
+/*
+ * Reading and writing compound-ray .eye files.
+ *
+ * The text format has one ommatidium per line: position (x y z), direction (x y z), acceptance
+ * angle (radians) and focal point offset, whitespace separated.
+ *
+ * The binary format (version 1) is laid out so that it can be memory mapped and used in place:
+ *
+ *   bytes  0-7   magic "CREYEBIN"
+ *   bytes  8-11  uint32 version (1)
+ *   bytes 12-15  uint32 byte order mark, 0x01020304 as written by the host
+ *   bytes 16-23  uint64 number of ommatidia, n
+ *   bytes 24-27  uint32 record size in bytes (32)
+ *   bytes 28-31  uint32 reserved (0)
+ *   bytes 32-    n records of 8 floats, as demo::eyefile::ommatidium
+ *
+ * eyefile::eye opens either format, deciding by the magic bytes, not the file suffix.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <span>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace demo::eyefile
+{
+    /*
+     * One ommatidium. The layout (two float triplets then two floats; 32 bytes) is the same as
+     * compound-ray's Ommatidium, which uses CUDA float3s.
+     */
+    struct ommatidium
+    {
+        std::array<float, 3> position = {};
+        std::array<float, 3> direction = {};
+        float acceptance_angle = 0.0f;
+        float focal_offset = 0.0f;
+    };
+    static_assert (sizeof (ommatidium) == 32, "ommatidium must be 8 packed floats");
+
+    // The binary file header
+    struct binary_header
+    {
+        char magic[8] = { 'C', 'R', 'E', 'Y', 'E', 'B', 'I', 'N' };
+        uint32_t version = 1u;
+        uint32_t byte_order = 0x01020304u;
+        uint64_t n = 0u;
+        uint32_t record_size = sizeof (ommatidium);
+        uint32_t reserved = 0u;
+    };
+    static_assert (sizeof (binary_header) == 32, "binary_header must be 32 bytes");
+
+    // Read a whitespace-separated text .eye file
+    inline std::vector<ommatidium> read_text (const std::string& path)
+    {
+        std::ifstream fin (path);
+        if (!fin.is_open()) { throw std::runtime_error ("Could not open eye file '" + path + "'"); }
+        std::vector<ommatidium> omms;
+        std::string line;
+        unsigned int lnum = 0u;
+        while (std::getline (fin, line)) {
+            ++lnum;
+            if (line.find_first_not_of (" \t\r") == std::string::npos) { continue; }
+            std::istringstream ss (line);
+            ommatidium o;
+            ss >> o.position[0] >> o.position[1] >> o.position[2]
+               >> o.direction[0] >> o.direction[1] >> o.direction[2]
+               >> o.acceptance_angle >> o.focal_offset;
+            if (ss.fail()) {
+                throw std::runtime_error ("Malformed line " + std::to_string (lnum) + " in eye file '" + path + "'");
+            }
+            omms.push_back (o);
+        }
+        return omms;
+    }
+
+    // Append o to s as a line of the text format (shortest form that reads back exactly)
+    inline void append_text (std::string& s, const ommatidium& o)
+    {
+        const float v[8] = { o.position[0], o.position[1], o.position[2],
+                             o.direction[0], o.direction[1], o.direction[2], o.acceptance_angle, o.focal_offset };
+        char buf[8 * 16];
+        char* p = buf;
+        for (int k = 0; k < 8; ++k) {
+            p = std::to_chars (p, buf + sizeof (buf) - 1, v[k]).ptr;
+            *p++ = k < 7 ? ' ' : '\n';
+        }
+        s.append (buf, p);
+    }
+
+    // Write a text .eye file (readable by compound-ray's libEyeRenderer3)
+    inline void write_text (const std::string& path, std::span<const ommatidium> omms)
+    {
+        std::ofstream fout (path, std::ios::out | std::ios::trunc);
+        if (!fout.is_open()) { throw std::runtime_error ("Could not open '" + path + "' for writing"); }
+        std::string txt;
+        txt.reserve (1u << 20);
+        for (const auto& o : omms) {
+            append_text (txt, o);
+            if (txt.size() >= (1u << 20) - 128u) {
+                fout.write (txt.data(), static_cast<std::streamsize>(txt.size()));
+                txt.clear();
+            }
+        }
+        fout.write (txt.data(), static_cast<std::streamsize>(txt.size()));
+        if (!fout.good()) { throw std::runtime_error ("Failed writing '" + path + "'"); }
+    }
+
+    // Write a binary .eye file
+    inline void write_binary (const std::string& path, std::span<const ommatidium> omms)
+    {
+        std::ofstream fout (path, std::ios::out | std::ios::trunc | std::ios::binary);
+        if (!fout.is_open()) { throw std::runtime_error ("Could not open '" + path + "' for writing"); }
+        binary_header hdr;
+        hdr.n = omms.size();
+        fout.write (reinterpret_cast<const char*>(&hdr), sizeof (hdr));
+        fout.write (reinterpret_cast<const char*>(omms.data()), static_cast<std::streamsize>(omms.size_bytes()));
+        if (!fout.good()) { throw std::runtime_error ("Failed writing '" + path + "'"); }
+    }
+
+    // True if the file at path starts with the binary magic bytes
+    inline bool is_binary (const std::string& path)
+    {
+        std::ifstream fin (path, std::ios::binary);
+        char magic[8] = {};
+        fin.read (magic, 8);
+        return fin.gcount() == 8 && std::memcmp (magic, binary_header{}.magic, 8) == 0;
+    }
+
+    /*
+     * An eye, opened from either format. A binary file is memory mapped and its ommatidia used
+     * in place; a text file is parsed into memory. Move-only.
+     */
+    struct eye
+    {
+        eye() = default;
+        explicit eye (const std::string& path) { this->open (path); }
+        eye (std::vector<ommatidium>&& omms) : owned (std::move (omms)) { this->view = this->owned; }
+
+        eye (const eye&) = delete;
+        eye& operator= (const eye&) = delete;
+        eye (eye&& other) noexcept { *this = std::move (other); }
+        eye& operator= (eye&& other) noexcept
+        {
+            if (this != &other) {
+                this->unmap();
+                this->owned = std::move (other.owned);
+                this->map_addr = other.map_addr;
+                this->map_len = other.map_len;
+                this->view = other.map_addr != nullptr ? other.view : std::span<const ommatidium>(this->owned);
+                other.map_addr = nullptr;
+                other.map_len = 0u;
+                other.view = {};
+            }
+            return *this;
+        }
+        ~eye() { this->unmap(); }
+
+        void open (const std::string& path)
+        {
+            this->unmap();
+            this->owned.clear();
+            if (is_binary (path)) {
+                this->map (path);
+            } else {
+                this->owned = read_text (path);
+                this->view = this->owned;
+            }
+        }
+
+        std::span<const ommatidium> ommatidia() const { return this->view; }
+        std::size_t size() const { return this->view.size(); }
+        bool empty() const { return this->view.empty(); }
+        const ommatidium& operator[] (std::size_t i) const { return this->view[i]; }
+        bool mapped() const { return this->map_addr != nullptr; }
+
+    private:
+        void map (const std::string& path)
+        {
+            int fd = ::open (path.c_str(), O_RDONLY);
+            if (fd < 0) { throw std::runtime_error ("Could not open eye file '" + path + "'"); }
+            struct stat st;
+            if (::fstat (fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof (binary_header)) {
+                ::close (fd);
+                throw std::runtime_error ("Eye file '" + path + "' is too short");
+            }
+            const std::size_t len = static_cast<std::size_t>(st.st_size);
+            void* addr = ::mmap (nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close (fd);
+            if (addr == MAP_FAILED) { throw std::runtime_error ("Could not mmap eye file '" + path + "'"); }
+            this->map_addr = addr;
+            this->map_len = len;
+
+            binary_header hdr;
+            std::memcpy (&hdr, addr, sizeof (hdr));
+            std::string err;
+            if (hdr.version != 1u) {
+                err = "unsupported version " + std::to_string (hdr.version);
+            } else if (hdr.byte_order != 0x01020304u) {
+                err = "written on a machine of the other byte order";
+            } else if (hdr.record_size != sizeof (ommatidium)) {
+                err = "unexpected record size";
+            } else if (hdr.n > (len - sizeof (binary_header)) / sizeof (ommatidium)) {
+                // (Divide rather than multiply, so that a corrupt n can't wrap past the check)
+                err = "truncated";
+            }
+            if (!err.empty()) {
+                this->unmap();
+                throw std::runtime_error ("Binary eye file '" + path + "': " + err);
+            }
+            // Ommatidia are read straight from the page cache; tell the kernel we want them all
+            ::madvise (addr, len, MADV_WILLNEED);
+            this->view = std::span<const ommatidium> (
+                reinterpret_cast<const ommatidium*>(static_cast<const char*>(addr) + sizeof (binary_header)), hdr.n);
+        }
+
+        void unmap()
+        {
+            if (this->map_addr != nullptr) { ::munmap (this->map_addr, this->map_len); }
+            this->map_addr = nullptr;
+            this->map_len = 0u;
+            this->view = {};
+        }
+
+        std::vector<ommatidium> owned;
+        void* map_addr = nullptr;
+        std::size_t map_len = 0u;
+        std::span<const ommatidium> view;
+    };
+
+} // namespace
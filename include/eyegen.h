@@ -0,0 +1,372 @@
+/*
+ * Compound eye generators. Each generator describes an eye analytically, so that it knows its
+ * number of ommatidia up front and can compute any range of them independently. write() then
+ * streams an eye of any size to a text or binary .eye file (see eyefile.h) a chunk at a time,
+ * generating and formatting each chunk in parallel over a threadpool.
+ *
+ * hex_eye projects a hexagonal lattice onto a sphere, as make_hexy_eye does with an sm::hexgrid.
+ * The lattice keeps the points whose centres lie within a circular boundary, so its edge differs
+ * a little from sm::hexgrid's. An ommatidium's acceptance angle is the angle between it and its
+ * first lattice neighbour, taken in the order E, NE, NW, W, SW, SE.
+ *
+ * geodesic_eye places ommatidia at the vertices of a geodesic sphere: an icosahedron whose faces
+ * are divided into frequency^2 triangles, projected out to the sphere. That gives
+ * 10 x frequency^2 + 2 ommatidia; a frequency of 2^k has the vertex count of k iterations of
+ * sm::geometry::make_icosahedral_geodesic.
+ *
+ * Like the CPU renderer, this is dependency-free, so the generators build without mathplot.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "cpumaths.h"
+#include "eyefile.h"
+#include "threadpool.h"
+
+namespace demo::eyegen
+{
+    using cpu::vec3;
+    using cpu::operator+;
+    using cpu::operator-;
+    using cpu::operator*;
+
+    constexpr float pi = 3.14159265358979f;
+
+    // The ways of placing a plane's points onto a sphere
+    enum class projection
+    {
+        mercator,
+        equirectangular,
+        cassini,
+        splodge
+    };
+
+    inline projection projection_from_string (const std::string& s)
+    {
+        if (s == "mercator") { return projection::mercator; }
+        if (s == "equirectangular") { return projection::equirectangular; }
+        if (s == "cassini") { return projection::cassini; }
+        if (s == "splodge") { return projection::splodge; }
+        throw std::runtime_error ("Unknown projection '" + s + "'");
+    }
+
+    /*
+     * Place the plane's point (x, y) on a sphere of radius r centred on the origin. splodge
+     * 'throws' the plane onto the sphere and then tilts the result by splodge_tilt about y.
+     */
+    inline vec3 project (const projection p, const float x, const float y, const float r,
+                         const cpu::mat4& splodge_tilt)
+    {
+        if (p == projection::splodge) {
+            const float z_sq = r * r - (x * x + y * y);
+            const float z_sph = z_sq >= 0.0f ? -std::sqrt (z_sq) : std::sqrt (-z_sq);
+            return cpu::transform_vector (splodge_tilt, vec3{ z_sph, x, y });
+        }
+        float longitude = 0.0f;
+        float latitude = 0.0f;
+        if (p == projection::equirectangular) {
+            longitude = x / r;
+            latitude = y / r;
+        } else if (p == projection::cassini) {
+            const float d = y / r;
+            longitude = std::atan2 (std::tan (x / r), std::cos (d));
+            latitude = std::asin (std::sin (d) * std::cos (x / r));
+        } else { // inverse Mercator
+            longitude = x / r;
+            latitude = 2.0f * std::atan (std::exp (y / r)) - 0.5f * pi;
+        }
+        const float coslat = std::cos (latitude);
+        return { r * coslat * std::cos (longitude), r * coslat * std::sin (longitude), r * std::sin (latitude) };
+    }
+
+    // The angle between two vectors (atan2 form, accurate for small angles)
+    inline float angle_between (const vec3& a, const vec3& b)
+    {
+        return std::atan2 (cpu::length (cpu::cross (a, b)), cpu::dot (a, b));
+    }
+
+    /*
+     * A hexagonal lattice of the given spacing within a circle of radius boundary, projected
+     * onto a sphere of radius sphere_radius. Call setup() after changing the parameters.
+     */
+    struct hex_eye
+    {
+        float spacing = 1.0f / 15.0f;
+        float boundary = 0.95f;
+        float sphere_radius = 1.0f;
+        projection proj = projection::splodge;
+        // The splodge projection's tilt about the y axis (radians)
+        float splodge_tilt = pi / 6.0f;
+        // If > 0, the focal point offset of every ommatidium (otherwise sphere_radius)
+        float focal_offset = 0.0f;
+
+        // The lattice spacing that gives about n ommatidia within boundary
+        static float spacing_for (const std::size_t n, const float boundary)
+        {
+            const float hex_area = 0.5f * std::sqrt (3.0f);
+            return std::sqrt (pi * boundary * boundary / (hex_area * static_cast<float>(std::max (std::size_t{1}, n))));
+        }
+
+        // Find the lattice rows (and so the number of ommatidia) within the boundary
+        void setup()
+        {
+            if (!(this->spacing > 0.0f) || !(this->boundary > 0.0f)) {
+                throw std::runtime_error ("hex_eye: spacing and boundary must be positive");
+            }
+            this->tilt = cpu::rotation ({ 0.0f, 1.0f, 0.0f }, this->splodge_tilt);
+            this->rows.clear();
+            const int rmax = static_cast<int>(std::floor (this->boundary / (this->row_height())));
+            std::size_t start = 0u;
+            for (int r = -rmax; r <= rmax; ++r) {
+                lattice_row lr;
+                lr.r = r;
+                this->q_range (r, lr.qmin, lr.qmax);
+                // Empty rows are kept, so that row r is rows[r + rmax]
+                lr.start = start;
+                start += static_cast<std::size_t>(std::max (0, lr.qmax - lr.qmin + 1));
+                this->rows.push_back (lr);
+            }
+            this->n = start;
+        }
+
+        std::size_t size() const { return this->n; }
+
+        // Compute ommatidia [b, e) into out[0, e - b)
+        void generate (const std::size_t b, const std::size_t e, eyefile::ommatidium* out) const
+        {
+            if (b >= e) { return; }
+            // The row of ommatidium b (the last of any rows starting there, as earlier ones are
+            // empty), then walk along the rows
+            auto it = std::upper_bound (this->rows.begin(), this->rows.end(), b,
+                                        [](std::size_t i, const lattice_row& lr) { return i < lr.start; }) - 1;
+            int q = it->qmin + static_cast<int>(b - it->start);
+            const float fo = this->focal_offset > 0.0f ? this->focal_offset : this->sphere_radius;
+            for (std::size_t i = b; i < e; ++i) {
+                while (q > it->qmax) {
+                    ++it;
+                    q = it->qmin;
+                }
+                const int r = it->r;
+                const vec3 c = this->point (q, r);
+                // Acceptance angle from the first neighbour that is in the lattice
+                float acceptance_angle = 1.0f;
+                for (const auto& [dq, dr] : neighbour_steps) {
+                    if (this->contains (q + dq, r + dr)) {
+                        acceptance_angle = angle_between (c, this->point (q + dq, r + dr));
+                        break;
+                    }
+                }
+                eyefile::ommatidium& om = out[i - b];
+                om.position = c;
+                om.direction = cpu::normalize (c);
+                om.acceptance_angle = acceptance_angle;
+                om.focal_offset = fo;
+                ++q;
+            }
+        }
+
+    private:
+        struct lattice_row
+        {
+            int r = 0;
+            int qmin = 0;
+            int qmax = -1;
+            std::size_t start = 0u;
+        };
+
+        // Axial steps to the neighbours E, NE, NW, W, SW, SE
+        static constexpr std::array<std::array<int, 2>, 6> neighbour_steps = {{ {1, 0}, {0, 1}, {-1, 1}, {-1, 0}, {0, -1}, {1, -1} }};
+
+        float row_height() const { return 0.5f * std::sqrt (3.0f) * this->spacing; }
+
+        // Lattice point (q, r) is at x = spacing (q + r / 2), y = row_height r
+        void q_range (const int r, int& qmin, int& qmax) const
+        {
+            const float y = this->row_height() * static_cast<float>(r);
+            const float w2 = this->boundary * this->boundary - y * y;
+            if (w2 < 0.0f) {
+                qmin = 0;
+                qmax = -1;
+                return;
+            }
+            const float w = std::sqrt (w2) / this->spacing;
+            qmin = static_cast<int>(std::ceil (-w - 0.5f * static_cast<float>(r)));
+            qmax = static_cast<int>(std::floor (w - 0.5f * static_cast<float>(r)));
+        }
+
+        bool contains (const int q, const int r) const
+        {
+            if (this->rows.empty() || r < this->rows.front().r || r > this->rows.back().r) { return false; }
+            const lattice_row& lr = this->rows[static_cast<std::size_t>(r - this->rows.front().r)];
+            return lr.r == r && q >= lr.qmin && q <= lr.qmax;
+        }
+
+        vec3 point (const int q, const int r) const
+        {
+            const float x = this->spacing * (static_cast<float>(q) + 0.5f * static_cast<float>(r));
+            const float y = this->row_height() * static_cast<float>(r);
+            return project (this->proj, x, y, this->sphere_radius, this->tilt);
+        }
+
+        std::vector<lattice_row> rows;
+        std::size_t n = 0u;
+        cpu::mat4 tilt = cpu::identity();
+    };
+
+    /*
+     * The vertices of a geodesic sphere of the given frequency, as ommatidia on a sphere of the
+     * given radius. They are ordered: the 12 icosahedron corners, then the points along each of
+     * its 30 edges, then the points inside each of its 20 faces.
+     */
+    struct geodesic_eye
+    {
+        unsigned int frequency = 16u;
+        float radius = 0.2f;
+        float acceptance_angle = 0.15f;
+        float focal_offset = 0.1f;
+
+        geodesic_eye()
+        {
+            // The icosahedron's unique edges, in order of their first appearance in faces
+            for (const auto& f : faces) {
+                for (int k = 0; k < 3; ++k) {
+                    const int a = std::min (f[k], f[(k + 1) % 3]);
+                    const int b = std::max (f[k], f[(k + 1) % 3]);
+                    if (std::find (this->edges.begin(), this->edges.end(), std::array<int, 2>{ a, b }) == this->edges.end()) {
+                        this->edges.push_back ({ a, b });
+                    }
+                }
+            }
+        }
+
+        std::size_t size() const
+        {
+            const std::size_t f = std::max (1u, this->frequency);
+            return 10u * f * f + 2u;
+        }
+
+        // Compute ommatidia [b, e) into out[0, e - b)
+        void generate (const std::size_t b, const std::size_t e, eyefile::ommatidium* out) const
+        {
+            const std::size_t f = std::max (1u, this->frequency);
+            const std::size_t per_edge = f - 1u;
+            const std::size_t per_face = per_edge * (f > 1u ? f - 2u : 0u) / 2u;
+            const std::size_t edges_start = 12u;
+            const std::size_t faces_start = edges_start + 30u * per_edge;
+            const float inv_f = 1.0f / static_cast<float>(f);
+
+            for (std::size_t i = b; i < e; ++i) {
+                vec3 d;
+                if (i < edges_start) {
+                    d = corner (static_cast<int>(i));
+                } else if (i < faces_start) {
+                    const std::size_t ei = (i - edges_start) / per_edge;
+                    const float t = static_cast<float>((i - edges_start) % per_edge + 1u) * inv_f;
+                    d = corner (this->edges[ei][0]) * (1.0f - t) + corner (this->edges[ei][1]) * t;
+                } else {
+                    // Face point j lies in row u (1 <= u <= f-2), which holds f-1-u points
+                    const std::size_t fi = (i - faces_start) / per_face;
+                    std::size_t j = (i - faces_start) % per_face;
+                    std::size_t u = 1u;
+                    while (j >= f - 1u - u) { j -= f - 1u - u; ++u; }
+                    const std::size_t v = j + 1u;
+                    const float wb = static_cast<float>(u) * inv_f;
+                    const float wc = static_cast<float>(v) * inv_f;
+                    d = corner (faces[fi][0]) * (1.0f - wb - wc) + corner (faces[fi][1]) * wb + corner (faces[fi][2]) * wc;
+                }
+                d = cpu::normalize (d);
+                eyefile::ommatidium& om = out[i - b];
+                om.position = d * this->radius;
+                om.direction = d;
+                om.acceptance_angle = this->acceptance_angle;
+                om.focal_offset = this->focal_offset;
+            }
+        }
+
+    private:
+        // Corner k of a unit icosahedron
+        static vec3 corner (const int k)
+        {
+            constexpr float phi = 1.61803398874989f;
+            constexpr std::array<std::array<float, 3>, 12> c = {{
+                {-1.0f, phi, 0.0f}, {1.0f, phi, 0.0f}, {-1.0f, -phi, 0.0f}, {1.0f, -phi, 0.0f},
+                {0.0f, -1.0f, phi}, {0.0f, 1.0f, phi}, {0.0f, -1.0f, -phi}, {0.0f, 1.0f, -phi},
+                {phi, 0.0f, -1.0f}, {phi, 0.0f, 1.0f}, {-phi, 0.0f, -1.0f}, {-phi, 0.0f, 1.0f}
+            }};
+            return cpu::normalize (c[static_cast<std::size_t>(k)]);
+        }
+
+        static constexpr std::array<std::array<int, 3>, 20> faces = {{
+            {0, 11, 5}, {0, 5, 1}, {0, 1, 7}, {0, 7, 10}, {0, 10, 11},
+            {1, 5, 9}, {5, 11, 4}, {11, 10, 2}, {10, 7, 6}, {7, 1, 8},
+            {3, 9, 4}, {3, 4, 2}, {3, 2, 6}, {3, 6, 8}, {3, 8, 9},
+            {4, 9, 5}, {2, 4, 11}, {6, 2, 10}, {8, 6, 7}, {9, 8, 1}
+        }};
+
+        std::vector<std::array<int, 2>> edges;
+    };
+
+    enum class format { text, binary };
+
+    /*
+     * Stream the eye that gen describes to out, chunk by chunk. Each chunk is generated (and, for
+     * text, formatted) in parallel over pool, so memory use is bounded by the chunk size however
+     * large the eye. For the binary format, out must have been opened in binary mode.
+     */
+    template <typename G>
+    void write (const G& gen, std::ostream& out, const format fmt, threadpool& pool,
+                const std::size_t chunk = std::size_t{1} << 18)
+    {
+        constexpr std::size_t block = 4096u;
+        const std::size_t n = gen.size();
+        if (fmt == format::binary) {
+            eyefile::binary_header hdr;
+            hdr.n = n;
+            out.write (reinterpret_cast<const char*>(&hdr), sizeof (hdr));
+        }
+        std::vector<eyefile::ommatidium> buf (std::min (n, chunk));
+        std::vector<std::string> text (fmt == format::text ? (buf.size() + block - 1u) / block : 0u);
+        for (std::size_t c0 = 0; c0 < n; c0 += chunk) {
+            const std::size_t cn = std::min (chunk, n - c0);
+            const std::size_t n_blocks = (cn + block - 1u) / block;
+            pool.parallel_for (n_blocks, 1u, [&](std::size_t bb, std::size_t be) {
+                for (std::size_t k = bb; k < be; ++k) {
+                    const std::size_t b = k * block;
+                    const std::size_t e = std::min (cn, b + block);
+                    gen.generate (c0 + b, c0 + e, buf.data() + b);
+                    if (fmt == format::text) {
+                        text[k].clear();
+                        for (std::size_t i = b; i < e; ++i) { eyefile::append_text (text[k], buf[i]); }
+                    }
+                }
+            });
+            if (fmt == format::binary) {
+                out.write (reinterpret_cast<const char*>(buf.data()), static_cast<std::streamsize>(cn * sizeof (eyefile::ommatidium)));
+            } else {
+                for (std::size_t k = 0; k < n_blocks; ++k) { out.write (text[k].data(), static_cast<std::streamsize>(text[k].size())); }
+            }
+        }
+    }
+
+    // Generate the whole eye in memory
+    template <typename G>
+    std::vector<eyefile::ommatidium> generate (const G& gen, threadpool& pool)
+    {
+        std::vector<eyefile::ommatidium> omms (gen.size());
+        pool.parallel_for (omms.size(), 4096u, [&](std::size_t b, std::size_t e) { gen.generate (b, e, omms.data() + b); });
+        return omms;
+    }
+
+} // namespace
@@ -0,0 +1,334 @@
+/*
+ * Ommatidium neighbour graphs for any eye. build() finds each ommatidium's k nearest neighbours
+ * by the angle between their directions (their optical axes), using a uniform grid over the unit
+ * sphere as the spatial index, so it costs O(n k) rather than the O(n^2) of a brute force
+ * search. The graph is held in compressed sparse row (CSR) form: the neighbours of ommatidium i
+ * are indices[offsets[i], offsets[i+1]), nearest first, and angles holds the angle (radians) to
+ * each. With symmetric = true the kNN relation is made mutual, so degrees may exceed k.
+ *
+ * Graphs are stored next to their eye (see graph_path()) in a small binary format:
+ *
+ *   bytes  0-7   magic "CREYENBR"
+ *   bytes  8-11  uint32 version (1)
+ *   bytes 12-15  uint32 byte order mark, 0x01020304 as written by the host
+ *   bytes 16-23  uint64 number of ommatidia, n
+ *   bytes 24-31  uint64 number of edges, m
+ *   bytes 32-35  uint32 k
+ *   bytes 36-39  uint32 flags (bit 0: symmetric)
+ *   bytes 40-    n+1 uint64 offsets, then m uint32 indices, then m float angles
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdexcept>
+
+#include "cpumaths.h"
+#include "eyefile.h"
+#include "threadpool.h"
+
+namespace demo::eyegraph
+{
+    struct graph
+    {
+        uint32_t k = 0u;
+        bool symmetric = false;
+        std::vector<uint64_t> offsets = { 0u };
+        std::vector<uint32_t> indices;
+        std::vector<float> angles;
+
+        std::size_t size() const { return this->offsets.size() - 1u; }
+        std::size_t edges() const { return this->indices.size(); }
+        std::span<const uint32_t> neighbours (const std::size_t i) const
+        {
+            return std::span<const uint32_t>(this->indices).subspan (this->offsets[i], this->offsets[i + 1u] - this->offsets[i]);
+        }
+        std::span<const float> neighbour_angles (const std::size_t i) const
+        {
+            return std::span<const float>(this->angles).subspan (this->offsets[i], this->offsets[i + 1u] - this->offsets[i]);
+        }
+    };
+
+    // The file header
+    struct header
+    {
+        char magic[8] = { 'C', 'R', 'E', 'Y', 'E', 'N', 'B', 'R' };
+        uint32_t version = 1u;
+        uint32_t byte_order = 0x01020304u;
+        uint64_t n = 0u;
+        uint64_t m = 0u;
+        uint32_t k = 0u;
+        uint32_t flags = 0u;
+    };
+    static_assert (sizeof (header) == 40, "eyegraph::header must be 40 bytes");
+
+    // Where the graph of the eye at eye_path is kept
+    inline std::string graph_path (const std::string& eye_path) { return eye_path + ".nbr"; }
+
+    namespace detail
+    {
+        // Directions sorted into the cells of a uniform grid over [-1, 1]^3
+        struct grid
+        {
+            float h = 1.0f;
+            int dim = 1;
+            std::vector<uint64_t> keys;    // sorted cell keys
+            std::vector<uint32_t> points;  // point indices, in the order of keys
+
+            uint64_t key (const int x, const int y, const int z) const
+            {
+                return (static_cast<uint64_t>(x) * static_cast<uint64_t>(this->dim) + static_cast<uint64_t>(y))
+                * static_cast<uint64_t>(this->dim) + static_cast<uint64_t>(z);
+            }
+            int cell (const float c) const { return std::clamp (static_cast<int>((c + 1.0f) / this->h), 0, this->dim - 1); }
+
+            void build (std::span<const cpu::vec3> dirs, const unsigned int k)
+            {
+                // Aim for about k points per occupied cell. Start by assuming that the eye covers
+                // the whole sphere; if it covers less, its cells are fuller, so shrink them.
+                const float n = static_cast<float>(std::max<std::size_t> (dirs.size(), 1u));
+                const float target = static_cast<float>(std::max (1u, k));
+                this->h = std::sqrt (4.0f * 3.14159265f * target / n);
+                for (int attempt = 0; attempt < 3; ++attempt) {
+                    this->h = std::clamp (this->h, 1e-4f, 2.0f);
+                    this->sort_points (dirs);
+                    const std::size_t occupied = static_cast<std::size_t>(
+                        std::unique (this->cells.begin(), this->cells.end()) - this->cells.begin());
+                    const float fill = n / static_cast<float>(std::max<std::size_t> (occupied, 1u));
+                    if (fill < 2.0f * target) { break; }
+                    this->h *= std::sqrt (target / fill);
+                }
+            }
+
+        private:
+            std::vector<uint64_t> cells; // scratch, for counting occupied cells
+
+            void sort_points (std::span<const cpu::vec3> dirs)
+            {
+                this->dim = std::min (static_cast<int>(std::ceil (2.0f / this->h)) + 1, 1 << 20);
+                std::vector<std::pair<uint64_t, uint32_t>> kp (dirs.size());
+                for (std::size_t i = 0; i < dirs.size(); ++i) {
+                    kp[i] = { this->key (this->cell (dirs[i][0]), this->cell (dirs[i][1]), this->cell (dirs[i][2])), static_cast<uint32_t>(i) };
+                }
+                std::sort (kp.begin(), kp.end());
+                this->keys.resize (kp.size());
+                this->points.resize (kp.size());
+                for (std::size_t i = 0; i < kp.size(); ++i) {
+                    this->keys[i] = kp[i].first;
+                    this->points[i] = kp[i].second;
+                }
+                this->cells = this->keys;
+            }
+
+        public:
+
+            // Call fn (j) for each point j in cells (x, y, z0) to (x, y, z1), which are contiguous
+            template <typename F>
+            void visit (const int x, const int y, int z0, int z1, F&& fn) const
+            {
+                if (x < 0 || y < 0 || x >= this->dim || y >= this->dim) { return; }
+                z0 = std::max (z0, 0);
+                z1 = std::min (z1, this->dim - 1);
+                if (z1 < z0) { return; }
+                const uint64_t last = this->key (x, y, z1);
+                auto it = std::lower_bound (this->keys.begin(), this->keys.end(), this->key (x, y, z0));
+                for (; it != this->keys.end() && *it <= last; ++it) {
+                    fn (this->points[static_cast<std::size_t>(it - this->keys.begin())]);
+                }
+            }
+        };
+    } // namespace detail
+
+    /*
+     * Build the k nearest neighbour graph of omms (by the angles between their directions) in
+     * parallel over pool. Throws if an ommatidium's direction is zero.
+     */
+    inline graph build (std::span<const eyefile::ommatidium> omms, const unsigned int k, threadpool& pool,
+                        const bool symmetric = false)
+    {
+        const std::size_t n = omms.size();
+        if (n > std::size_t{0xffffffffu}) { throw std::runtime_error ("eyegraph: too many ommatidia"); }
+        const unsigned int kk = static_cast<unsigned int>(std::min<std::size_t> (k, n > 0u ? n - 1u : 0u));
+        std::vector<cpu::vec3> dirs (n);
+        for (std::size_t i = 0; i < n; ++i) {
+            // A zero (or non-finite) direction would normalise to NaN, which no grid cell holds
+            const float len = cpu::length (omms[i].direction);
+            if (!(len > 0.0f) || !std::isfinite (len)) {
+                throw std::runtime_error ("eyegraph: ommatidium " + std::to_string (i) + " has no direction");
+            }
+            dirs[i] = cpu::normalize (omms[i].direction);
+        }
+        detail::grid g;
+        g.build (dirs, std::max (1u, kk));
+
+        graph gr;
+        gr.k = kk;
+        gr.symmetric = symmetric;
+        gr.offsets.resize (n + 1u);
+        for (std::size_t i = 0; i <= n; ++i) { gr.offsets[i] = i * kk; }
+        gr.indices.resize (n * kk);
+        gr.angles.resize (n * kk);
+
+        // Query in grid order, so that neighbouring queries search neighbouring (cached) cells
+        pool.parallel_for (n, 256u, [&](std::size_t b, std::size_t e) {
+            // (squared chord distance, index), kept as a max-heap of the best kk
+            std::vector<std::pair<float, uint32_t>> best;
+            best.reserve (kk + 1u);
+            for (std::size_t qi = b; qi < e; ++qi) {
+                const std::size_t i = g.points[qi];
+                best.clear();
+                const cpu::vec3& p = dirs[i];
+                const int cx = g.cell (p[0]), cy = g.cell (p[1]), cz = g.cell (p[2]);
+                auto consider = [&](uint32_t j) {
+                    if (j == i) { return; }
+                    const cpu::vec3 d = cpu::operator- (dirs[j], p);
+                    const float d2 = cpu::dot (d, d);
+                    if (best.size() < kk) {
+                        best.emplace_back (d2, j);
+                        std::push_heap (best.begin(), best.end());
+                    } else if (std::make_pair (d2, j) < best.front()) {
+                        std::pop_heap (best.begin(), best.end());
+                        best.back() = { d2, j };
+                        std::push_heap (best.begin(), best.end());
+                    }
+                };
+                // Search shells of cells outwards until the kth nearest is nearer than the shell
+                for (int r = 0; r <= g.dim; ++r) {
+                    for (int x = cx - r; x <= cx + r; ++x) {
+                        for (int y = cy - r; y <= cy + r; ++y) {
+                            if (r == 0 || std::abs (x - cx) == r || std::abs (y - cy) == r) {
+                                g.visit (x, y, cz - r, cz + r, consider);
+                            } else {
+                                // Inside the shell's x-y square, only its two z faces are new
+                                g.visit (x, y, cz - r, cz - r, consider);
+                                g.visit (x, y, cz + r, cz + r, consider);
+                            }
+                        }
+                    }
+                    const float reach = static_cast<float>(r) * g.h;
+                    if (best.size() == kk && (kk == 0u || best.front().first <= reach * reach)) { break; }
+                }
+                std::sort_heap (best.begin(), best.end());
+                for (std::size_t q = 0; q < best.size(); ++q) {
+                    const uint32_t j = best[q].second;
+                    gr.indices[i * kk + q] = j;
+                    gr.angles[i * kk + q] = std::atan2 (cpu::length (cpu::cross (dirs[i], dirs[j])), cpu::dot (dirs[i], dirs[j]));
+                }
+            }
+        });
+
+        if (!symmetric) { return gr; }
+
+        // Make the relation mutual: add j -> i for each i -> j, then drop duplicates
+        std::vector<std::pair<uint32_t, uint32_t>> edges;
+        edges.reserve (2u * gr.indices.size());
+        for (std::size_t i = 0; i < n; ++i) {
+            for (uint32_t j : gr.neighbours (i)) {
+                edges.emplace_back (static_cast<uint32_t>(i), j);
+                edges.emplace_back (j, static_cast<uint32_t>(i));
+            }
+        }
+        std::sort (edges.begin(), edges.end());
+        edges.erase (std::unique (edges.begin(), edges.end()), edges.end());
+        graph sg;
+        sg.k = kk;
+        sg.symmetric = true;
+        sg.offsets.assign (n + 1u, 0u);
+        for (const auto& [i, j] : edges) { ++sg.offsets[i + 1u]; }
+        for (std::size_t i = 0; i < n; ++i) { sg.offsets[i + 1u] += sg.offsets[i]; }
+        sg.indices.resize (edges.size());
+        sg.angles.resize (edges.size());
+        pool.parallel_for (n, 1024u, [&](std::size_t b, std::size_t e) {
+            std::vector<std::pair<float, uint32_t>> row;
+            for (std::size_t i = b; i < e; ++i) {
+                row.clear();
+                for (uint64_t q = sg.offsets[i]; q < sg.offsets[i + 1u]; ++q) {
+                    const uint32_t j = edges[q].second;
+                    row.emplace_back (std::atan2 (cpu::length (cpu::cross (dirs[i], dirs[j])), cpu::dot (dirs[i], dirs[j])), j);
+                }
+                std::sort (row.begin(), row.end());
+                for (std::size_t q = 0; q < row.size(); ++q) {
+                    sg.indices[sg.offsets[i] + q] = row[q].second;
+                    sg.angles[sg.offsets[i] + q] = row[q].first;
+                }
+            }
+        });
+        return sg;
+    }
+
+    inline void write (const std::string& path, const graph& g)
+    {
+        std::ofstream fout (path, std::ios::out | std::ios::trunc | std::ios::binary);
+        if (!fout.is_open()) { throw std::runtime_error ("Could not open '" + path + "' for writing"); }
+        header hdr;
+        hdr.n = g.size();
+        hdr.m = g.edges();
+        hdr.k = g.k;
+        hdr.flags = g.symmetric ? 1u : 0u;
+        fout.write (reinterpret_cast<const char*>(&hdr), sizeof (hdr));
+        fout.write (reinterpret_cast<const char*>(g.offsets.data()), static_cast<std::streamsize>(g.offsets.size() * sizeof (uint64_t)));
+        fout.write (reinterpret_cast<const char*>(g.indices.data()), static_cast<std::streamsize>(g.indices.size() * sizeof (uint32_t)));
+        fout.write (reinterpret_cast<const char*>(g.angles.data()), static_cast<std::streamsize>(g.angles.size() * sizeof (float)));
+        if (!fout.good()) { throw std::runtime_error ("Failed writing '" + path + "'"); }
+    }
+
+    inline graph read (const std::string& path)
+    {
+        std::ifstream fin (path, std::ios::binary);
+        if (!fin.is_open()) { throw std::runtime_error ("Could not open neighbour graph '" + path + "'"); }
+        header hdr;
+        fin.read (reinterpret_cast<char*>(&hdr), sizeof (hdr));
+        if (!fin || std::memcmp (hdr.magic, header{}.magic, 8) != 0) {
+            throw std::runtime_error ("'" + path + "' is not a neighbour graph");
+        }
+        if (hdr.version != 1u || hdr.byte_order != 0x01020304u) {
+            throw std::runtime_error ("Neighbour graph '" + path + "': unsupported version or byte order");
+        }
+        graph g;
+        g.k = hdr.k;
+        g.symmetric = (hdr.flags & 1u) != 0u;
+        g.offsets.resize (hdr.n + 1u);
+        g.indices.resize (hdr.m);
+        g.angles.resize (hdr.m);
+        fin.read (reinterpret_cast<char*>(g.offsets.data()), static_cast<std::streamsize>(g.offsets.size() * sizeof (uint64_t)));
+        fin.read (reinterpret_cast<char*>(g.indices.data()), static_cast<std::streamsize>(g.indices.size() * sizeof (uint32_t)));
+        fin.read (reinterpret_cast<char*>(g.angles.data()), static_cast<std::streamsize>(g.angles.size() * sizeof (float)));
+        if (!fin || g.offsets.back() != hdr.m) { throw std::runtime_error ("Neighbour graph '" + path + "' is truncated"); }
+        return g;
+    }
+
+    /*
+     * The neighbour graph of the eye at eye_path. It is read from graph_path (eye_path) if that
+     * exists, is newer than the eye and has the same n, k and symmetry. Otherwise it is built
+     * (and, if save is true, written there for next time).
+     */
+    inline graph load_or_build (const std::string& eye_path, const unsigned int k, threadpool& pool,
+                                const bool symmetric = false, const bool save = true)
+    {
+        namespace fs = std::filesystem;
+        eyefile::eye e (eye_path);
+        const std::string gpath = graph_path (eye_path);
+        std::error_code ec;
+        if (fs::exists (gpath, ec) && fs::last_write_time (gpath, ec) >= fs::last_write_time (eye_path, ec)) {
+            graph g = read (gpath);
+            const unsigned int kk = static_cast<unsigned int>(std::min<std::size_t> (k, e.size() > 0u ? e.size() - 1u : 0u));
+            if (g.size() == e.size() && g.k == kk && g.symmetric == symmetric) { return g; }
+        }
+        graph g = build (e.ommatidia(), k, pool, symmetric);
+        if (save) { write (gpath, g); }
+        return g;
+    }
+
+} // namespace
@@ -0,0 +1,151 @@
+/*
+ * The compound eyes of one agent. A glTF scene may hold several compound eye cameras (a pair of
+ * eyes and the ocelli, say); an eyerig collects them and moves them as one rigid body. The first
+ * compound camera is the rig's primary camera. It is the one the user (or a trajectory) moves,
+ * and the others keep the poses relative to it that the glTF gave them.
+ *
+ * Each frame, all the eyes are ray cast together by eyebackend::render_eyes(), into one buffer
+ * holding each eye's outputs in turn. Eye k's outputs are [starts[k], starts[k+1]) of that buffer.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <sm/mat44>
+
+#include "eyebackend.h"
+#include "eyefile.h"
+
+namespace demo
+{
+    struct eyerig
+    {
+        // The scene's compound eye cameras. cameras[0] is the primary camera.
+        std::vector<int> cameras;
+        // Each eye's eye file, as the backend reports it (see eyebackend::eye_data_path)
+        std::vector<std::string> eye_paths;
+        // Each eye's pose relative to the primary camera's pose
+        std::vector<sm::mat44<float>> offsets;
+        // Where each eye's outputs begin in a frame; starts.back() is the frame's size
+        std::vector<std::size_t> starts = { 0u };
+
+        // Find the compound eye cameras of backend's scene and make the primary camera current
+        void setup (eyebackend& backend)
+        {
+            this->cameras.clear();
+            this->eye_paths.clear();
+            this->offsets.clear();
+            this->starts.assign (1u, 0u);
+            const int ncam = backend.camera_count();
+            for (int ci = 0; ci < ncam; ++ci) {
+                backend.goto_camera (ci);
+                std::string eye_path = backend.eye_data_path();
+                if (!eye_path.empty()) {
+                    this->cameras.push_back (ci);
+                    this->eye_paths.push_back (eye_path);
+                }
+            }
+            if (this->cameras.empty()) { return; }
+
+            backend.goto_camera (this->cameras[0]);
+            const sm::mat44<float> primary_inv = backend.camera_space().inverse();
+            for (int ci : this->cameras) {
+                this->offsets.push_back (primary_inv * backend.camera_space_of (ci));
+                this->starts.push_back (this->starts.back() + backend.ommatidia_of (ci)->size());
+            }
+        }
+
+        bool empty() const { return this->cameras.empty(); }
+        std::size_t size() const { return this->cameras.size(); }
+        int primary() const { return this->cameras.empty() ? -1 : this->cameras[0]; }
+
+        // The pose of eye k, given the primary camera's pose
+        sm::mat44<float> pose_of (const std::size_t k, const sm::mat44<float>& primary_pose) const
+        {
+            return k == 0u ? primary_pose : primary_pose * this->offsets[k];
+        }
+
+        // Move the other eyes to follow the primary camera
+        void follow (eyebackend& backend) const
+        {
+            if (this->cameras.size() < 2u) { return; }
+            const sm::mat44<float> primary_pose = backend.camera_space();
+            for (std::size_t k = 1; k < this->cameras.size(); ++k) {
+                backend.set_camera_space_of (this->cameras[k], this->pose_of (k, primary_pose));
+            }
+        }
+
+        // Set the samples per ommatidium of every eye. The primary camera stays current.
+        void set_samples (eyebackend& backend, const int samples) const
+        {
+            for (std::size_t k = this->cameras.size(); k-- > 0u;) {
+                backend.goto_camera (this->cameras[k]);
+                const int csamp = backend.samples_per_ommatidium();
+                if (samples != csamp) { backend.change_samples_per_ommatidium_by (samples - csamp); }
+            }
+        }
+
+        // Bring the eyes to the primary camera's pose and ray cast them all into out
+        void render (eyebackend& backend, std::vector<std::array<float, 3>>& out) const
+        {
+            this->follow (backend);
+            backend.render_eyes (this->cameras, out);
+        }
+
+        /*
+         * Ray cast all the eyes at each of a batch of primary camera poses, into out as a
+         * contiguous poses x frame tensor (item b is [b * frame_size(), (b + 1) * frame_size())).
+         * The cameras' poses are left as they were.
+         */
+        void render_batch (eyebackend& backend, std::span<const sm::mat44<float>> primary_poses,
+                           std::vector<std::array<float, 3>>& out) const
+        {
+            std::vector<sm::mat44<float>> poses;
+            poses.reserve (primary_poses.size() * this->cameras.size());
+            for (const sm::mat44<float>& pp : primary_poses) {
+                for (std::size_t k = 0; k < this->cameras.size(); ++k) { poses.push_back (this->pose_of (k, pp)); }
+            }
+            backend.render_batch (this->cameras, poses, out);
+        }
+
+        /*
+         * Each eye's ommatidia, converted from the backend's compound-ray Ommatidium, for std-only
+         * code such as retina::bank. Uses the backend, so call this before a raycast_pipeline
+         * takes it.
+         */
+        std::vector<std::vector<eyefile::ommatidium>> eye_ommatidia (eyebackend& backend) const
+        {
+            std::vector<std::vector<eyefile::ommatidium>> eyes (this->cameras.size());
+            for (std::size_t k = 0; k < this->cameras.size(); ++k) {
+                const std::vector<Ommatidium>* omms = backend.ommatidia_of (this->cameras[k]);
+                eyes[k].resize (omms->size());
+                for (std::size_t i = 0; i < omms->size(); ++i) {
+                    const Ommatidium& o = (*omms)[i];
+                    eyes[k][i].position = { o.relativePosition.x, o.relativePosition.y, o.relativePosition.z };
+                    eyes[k][i].direction = { o.relativeDirection.x, o.relativeDirection.y, o.relativeDirection.z };
+                    eyes[k][i].acceptance_angle = o.acceptanceAngleRadians;
+                    eyes[k][i].focal_offset = o.focalPointOffset;
+                }
+            }
+            return eyes;
+        }
+
+        // The number of outputs in one frame (all the eyes)
+        std::size_t frame_size() const { return this->starts.back(); }
+
+        // Eye k's outputs within a frame
+        template <typename T>
+        std::span<T> eye_data (const std::size_t k, std::span<T> frame) const
+        {
+            return frame.subspan (this->starts[k], this->starts[k + 1u] - this->starts[k]);
+        }
+    };
+
+} // namespace
@@ -0,0 +1,115 @@
+/*
+ * An mplot::compoundray::EyeVisual that uploads only the ommatidium colours that have changed.
+ *
+ * EyeVisual::reinitColours() rebuilds and re-uploads the colours of every ommatidium. With large
+ * eyes that buffer traffic dominates the draw, even though few ommatidia change from frame to
+ * frame while the eye moves slowly (and none while it is still). update_colours() diffs the new
+ * colours against those last uploaded. If none changed, it does nothing. If a few changed, it
+ * writes just those into vertexColors and uploads the changed ranges with glBufferSubData. If
+ * many changed, it does one full reinitColours().
+ *
+ * Partial uploads need each ommatidium to own the same number of consecutive vertices, all of
+ * its colour. That is checked against EyeVisual's own vertexColors after each full upload; if it
+ * doesn't hold, every change is uploaded in full (but unchanged frames are still skipped).
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include <mplot/compoundray/EyeVisual.h>
+
+namespace demo
+{
+    template <int glver = mplot::gl::version_4_1>
+    struct eyevisual : public mplot::compoundray::EyeVisual<glver>
+    {
+        using mplot::compoundray::EyeVisual<glver>::EyeVisual;
+
+        // If more than this fraction of the ommatidia changed, upload them all at once
+        float full_upload_fraction = 0.25f;
+        // Runs of up to this many unchanged ommatidia between changed ones are uploaded too
+        std::size_t merge_gap = 8u;
+
+        /*
+         * Upload the colours in data (the vector that this EyeVisual was given) that changed
+         * since the last upload. Returns the number of ommatidia whose colours were uploaded.
+         */
+        std::size_t update_colours (const std::vector<std::array<float, 3>>& data)
+        {
+            const std::size_t n = data.size();
+            if (n == 0u) { return 0u; }
+            if (this->uploaded.size() != n) { return this->upload_all (data); }
+
+            // Find the ranges [first, second) of changed ommatidia
+            this->dirty.clear();
+            std::size_t n_dirty = 0u;
+            for (std::size_t i = 0; i < n; ++i) {
+                if (data[i] == this->uploaded[i]) { continue; }
+                if (!this->dirty.empty() && i - this->dirty.back().second <= this->merge_gap) {
+                    n_dirty += i + 1u - this->dirty.back().second;
+                    this->dirty.back().second = i + 1u;
+                } else {
+                    this->dirty.emplace_back (i, i + 1u);
+                    ++n_dirty;
+                }
+            }
+            if (n_dirty == 0u) { return 0u; }
+            if (!this->partial_ok || static_cast<float>(n_dirty) > this->full_upload_fraction * static_cast<float>(n)) {
+                return this->upload_all (data);
+            }
+
+            const std::size_t vpo = this->vertexColors.size() / (3u * n);
+            if (this->setContext != nullptr) { this->setContext (this->parentVis); }
+            glBindBuffer (GL_ARRAY_BUFFER, this->vbos[this->colVBO]);
+            for (const auto& [b, e] : this->dirty) {
+                for (std::size_t i = b; i < e; ++i) {
+                    float* c = &this->vertexColors[i * vpo * 3u];
+                    for (std::size_t v = 0; v < vpo; ++v, c += 3) {
+                        c[0] = data[i][0];
+                        c[1] = data[i][1];
+                        c[2] = data[i][2];
+                    }
+                    this->uploaded[i] = data[i];
+                }
+                glBufferSubData (GL_ARRAY_BUFFER,
+                                 static_cast<GLintptr>(b * vpo * 3u * sizeof (float)),
+                                 static_cast<GLsizeiptr>((e - b) * vpo * 3u * sizeof (float)),
+                                 &this->vertexColors[b * vpo * 3u]);
+            }
+            return n_dirty;
+        }
+
+        // Call after reinit() (the eye or the cones changed) so that the next update is in full
+        void forget_colours() { this->uploaded.clear(); }
+
+    private:
+        std::size_t upload_all (const std::vector<std::array<float, 3>>& data)
+        {
+            this->reinitColours();
+            this->uploaded = data;
+            // Can later updates be partial? Only if each ommatidium has vpo vertices of its colour
+            const std::size_t n = data.size();
+            this->partial_ok = n > 0u && this->vertexColors.size() % (3u * n) == 0u && !this->vertexColors.empty();
+            const std::size_t vpo = this->partial_ok ? this->vertexColors.size() / (3u * n) : 0u;
+            for (std::size_t i = 0; i < n && this->partial_ok; ++i) {
+                for (std::size_t v = 0; v < vpo && this->partial_ok; ++v) {
+                    const float* c = &this->vertexColors[(i * vpo + v) * 3u];
+                    this->partial_ok = c[0] == data[i][0] && c[1] == data[i][1] && c[2] == data[i][2];
+                }
+            }
+            return n;
+        }
+
+        // The colours as last uploaded, and this update's changed ranges (reused, so no allocation)
+        std::vector<std::array<float, 3>> uploaded;
+        std::vector<std::pair<std::size_t, std::size_t>> dirty;
+        bool partial_ok = false;
+    };
+
+} // namespace
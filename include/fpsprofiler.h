@@ -7,10 +7,11 @@
  */
 #pragma once
 
+#include <array>
+#include <charconv>
 #include <chrono>
-#include <deque>
 #include <string>
-#include <sstream>
+#include <string_view>
 #include <cmath>
 
 namespace demo::fps
@@ -23,21 +24,26 @@ namespace demo::fps
         sc::time_point t0 = sc::now();
         sc::time_point t1 = sc::now();
 
-        std::deque<double> fps;
+        // The most recent fps values, as a ring over the first fps_mean_over_n_samples_last elements
+        static constexpr unsigned int max_n_samples = 1024;
+        std::array<double, max_n_samples> fps = {};
+        unsigned int fps_count = 0;
+        unsigned int fps_next = 0;
         double fps_mean = 0.0; // a running-mean of fps
         unsigned int fps_mean_over_n_samples_last = 0;
 
         // Current FPS text
         std::string fps_txt;
 
-        // Call at the start of the loop that you're timing
+        // Call at the start of the loop that you're timing. Does not allocate in steady state.
         void at_begin (int csampl)
         {
             sc::duration t_d = this->t1 - this->t0;
             unsigned int fps_mean_over_n_samples = best_n_samples (csampl);
             if (fps_mean_over_n_samples != fps_mean_over_n_samples_last) {
                 // Reset counters
-                this->fps.clear();
+                this->fps_count = 0;
+                this->fps_next = 0;
                 this->fps_mean = 0.0;
                 this->fps_mean_over_n_samples_last = fps_mean_over_n_samples;
             }
@@ -45,16 +51,26 @@ namespace demo::fps
             double fps_now = 0.0;
             double usecs = static_cast<double>(duration_cast<microseconds>(t_d).count());
             if (usecs > 0.0) { fps_now = 1000000.0 / usecs; }
-            this->fps.push_back (fps_now * fps_mean_period);
-            this->fps_mean += this->fps.back();
-            if (this->fps.size() > fps_mean_over_n_samples) {
-                this->fps_mean -= this->fps.front();
-                this->fps.pop_front();
+            // Once the ring is full, fps[fps_next] is the oldest value
+            if (this->fps_count == fps_mean_over_n_samples) {
+                this->fps_mean -= this->fps[this->fps_next];
+            } else {
+                ++this->fps_count;
             }
-            std::stringstream ss;
-            // Stream into ss ready for display
-            ss << csampl << " samples " << static_cast<int>(std::round(this->fps_mean)) << " FPS";
-            this->fps_txt = ss.str();
+            this->fps[this->fps_next] = fps_now * fps_mean_period;
+            this->fps_mean += this->fps[this->fps_next];
+            this->fps_next = (this->fps_next + 1) % fps_mean_over_n_samples;
+
+            // Format into a fixed buffer; assign() then reuses fps_txt's capacity
+            std::array<char, 64> buf;
+            char* p = buf.data();
+            char* e = buf.data() + buf.size();
+            auto append = [&p, e](std::string_view sv) { for (char c : sv) { if (p < e) { *p++ = c; } } };
+            p = std::to_chars (p, e, csampl).ptr;
+            append (" samples ");
+            p = std::to_chars (p, e, static_cast<int>(std::round(this->fps_mean))).ptr;
+            append (" FPS");
+            this->fps_txt.assign (buf.data(), p);
 
             this->t0 = sc::now();
         }
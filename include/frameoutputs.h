@@ -0,0 +1,106 @@
+/*
+ * Where a headless run's frames go. Each step's frame (a camera pose and all the eyes' ommatidium
+ * outputs) is written to any of
+ *
+ *   output_path    a framewriter file (see framewriter.h) or, with an event threshold >= 0, an
+ *                  eventwriter file of the changes (see eventstream.h)
+ *   record_path    an HDF5 recording, written in the background (see recorder.h), of frames or,
+ *                  with an event threshold >= 0, of events
+ *   shm_name       a shared memory frame ring for other processes (see shmring.h)
+ *
+ * each in the outputformat format. The outputs are opened on the first write(), when the frame
+ * size is known. Used by both c_ray_mathplot --headless and the std-only c_ray_cpu.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+
+#include "outputformat.h"
+#include "framewriter.h"
+#include "eventstream.h"
+#include "recorder.h"
+#include "shmring.h"
+
+namespace demo
+{
+    struct frameoutputs
+    {
+        // Empty for no output of that kind
+        std::string output_path = "";
+        std::string record_path = "";
+        std::string shm_name = "";
+        outputformat format = {};
+        // If >= 0, write output_path and record_path as events of changes larger than this
+        float event_threshold = -1.0f;
+        uint32_t keyframe_every = 60u;
+
+        // Write one step's frame to each output. Returns the number of events written (0 without events).
+        std::size_t write (const uint64_t step, const std::array<float, 16>& pose,
+                           std::span<const std::array<float, 3>> data, const int camera = -1)
+        {
+            const std::size_t n_omm = data.size();
+            std::size_t n_events = 0u;
+            if (!this->output_path.empty() && this->event_threshold >= 0.0f) {
+                if (!this->event_writer) {
+                    this->event_writer = std::make_unique<eventwriter> (this->output_path, static_cast<uint32_t>(n_omm),
+                                                                        this->event_threshold, this->keyframe_every,
+                                                                        this->format);
+                }
+                n_events = this->event_writer->write (step, pose, data);
+            } else if (!this->output_path.empty()) {
+                if (!this->writer) {
+                    this->writer = std::make_unique<framewriter> (this->output_path, static_cast<uint32_t>(n_omm),
+                                                                  this->format);
+                }
+                this->writer->write (step, pose, data);
+            }
+            if (!this->record_path.empty()) {
+                if (!this->recorder) {
+                    this->recorder = std::make_unique<h5recorder> (this->record_path, n_omm, 64u, 4u, this->format,
+                                                                   this->event_threshold, this->keyframe_every);
+                    // A batch run records every step, so waits for the writer rather than dropping
+                    this->recorder->wait_when_full = true;
+                }
+                this->recorder->record (step, pose, data);
+            }
+            if (!this->shm_name.empty()) {
+                if (!this->shm_out) {
+                    this->shm_out = std::make_unique<shm::publisher> (this->shm_name, n_omm, 8u, this->format);
+                }
+                this->shm_out->publish (pose, data, camera);
+            }
+            return n_events;
+        }
+
+        // Wait for the recording to reach its file and report on the outputs
+        void finish()
+        {
+            // Both event outputs see every step, so either gives the fraction
+            double fraction = -1.0;
+            if (this->event_writer) { fraction = this->event_writer->encoder.event_fraction(); }
+            if (this->recorder) {
+                if (fraction < 0.0 && this->event_threshold >= 0.0f) { fraction = this->recorder->event_fraction(); }
+                this->recorder.reset();
+                std::cout << "Recorded to " << this->record_path << std::endl;
+            }
+            if (fraction >= 0.0) {
+                std::cout << "Events: " << 100.0 * fraction << "% of ommatidia per step, keyframes included" << std::endl;
+            }
+        }
+
+    private:
+        std::unique_ptr<framewriter> writer;
+        std::unique_ptr<eventwriter> event_writer;
+        std::unique_ptr<h5recorder> recorder;
+        std::unique_ptr<shm::publisher> shm_out;
+    };
+
+} // namespace
@@ -0,0 +1,179 @@
+/*
+ * A pooled ring of ommatidium output frames, for downstream consumers such as brain models.
+ *
+ * The producer (the thread that ray casts) fills a slot obtained from begin_write() and then
+ * calls publish(), which stamps the frame with an id, a timestamp and the camera pose. Consumers,
+ * on any thread, call latest() to get a read-only view of the newest frame. A view reads the
+ * slot in place (no copy) and, while it is held, the producer will not reuse that slot. Each
+ * slot's vector keeps its capacity from frame to frame, so there is no steady-state allocation.
+ *
+ * Views should be short lived. The producer needs one slot to write and the newest frame stays
+ * readable, so with n slots at most n - 2 views may be held at once; begin_write() throws if
+ * every other slot is held.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+#include <stdexcept>
+
+namespace demo
+{
+    template <typename T = std::array<float, 3>>
+    struct framering
+    {
+        using sc = std::chrono::steady_clock;
+
+        // One frame. The producer writes data; publish() fills in the rest
+        struct frame
+        {
+            std::vector<T> data;
+            // The camera localspace (column major) that the frame was ray cast from
+            std::array<float, 16> pose = {};
+            uint64_t id = 0u;
+            sc::time_point timestamp = {};
+            int camera = -1;
+        };
+
+        // A read-only view of one frame. Move-only; release() (or destruction) lets the slot be reused
+        struct view
+        {
+            view() = default;
+            view (const view&) = delete;
+            view& operator= (const view&) = delete;
+            view (view&& other) noexcept { *this = std::move (other); }
+            view& operator= (view&& other) noexcept
+            {
+                if (this != &other) {
+                    this->release();
+                    this->f = other.f;
+                    this->pins = other.pins;
+                    other.f = nullptr;
+                    other.pins = nullptr;
+                }
+                return *this;
+            }
+            ~view() { this->release(); }
+
+            explicit operator bool() const { return this->f != nullptr; }
+            std::span<const T> data() const { return this->f->data; }
+            std::size_t size() const { return this->f->data.size(); }
+            const std::array<float, 16>& pose() const { return this->f->pose; }
+            uint64_t id() const { return this->f->id; }
+            sc::time_point timestamp() const { return this->f->timestamp; }
+            int camera() const { return this->f->camera; }
+
+            void release()
+            {
+                if (this->pins != nullptr) { this->pins->fetch_sub (1, std::memory_order_release); }
+                this->f = nullptr;
+                this->pins = nullptr;
+            }
+
+        private:
+            friend struct framering;
+            view (const frame* _f, std::atomic<int32_t>* _pins) : f (_f), pins (_pins) {}
+            const frame* f = nullptr;
+            std::atomic<int32_t>* pins = nullptr;
+        };
+
+        explicit framering (const std::size_t n_slots = 4u)
+            : slots (n_slots < 3u ? 3u : n_slots), pins (n_slots < 3u ? 3u : n_slots) {}
+
+        framering (const framering&) = delete;
+        framering& operator= (const framering&) = delete;
+
+        // Producer: a free slot to write the next frame's data into
+        frame& begin_write()
+        {
+            const std::size_t n = this->slots.size();
+            const std::size_t nw = this->newest.load (std::memory_order_relaxed);
+            for (std::size_t k = 0; k < n; ++k) {
+                const std::size_t i = (this->next + k) % n;
+                if (i == nw) { continue; }
+                int32_t expected = 0;
+                if (this->pins[i].compare_exchange_strong (expected, writing, std::memory_order_acquire)) {
+                    this->writing_slot = i;
+                    this->next = (i + 1) % n;
+                    return this->slots[i];
+                }
+            }
+            throw std::runtime_error ("framering: every slot is held by a reader");
+        }
+
+        // Producer: stamp the frame from begin_write() and make it the newest. Returns its id.
+        uint64_t publish (const std::array<float, 16>& pose, const int camera = -1)
+        {
+            const std::size_t i = this->writing_slot;
+            frame& f = this->slots[i];
+            f.pose = pose;
+            f.camera = camera;
+            f.id = ++this->last_id;
+            f.timestamp = sc::now();
+            this->pins[i].store (0, std::memory_order_release);
+            this->newest.store (i, std::memory_order_release);
+            this->published.store (f.id, std::memory_order_release);
+            this->published.notify_all();
+            return f.id;
+        }
+
+        // Consumer: a view of the newest frame (empty if nothing has been published yet)
+        view latest()
+        {
+            for (;;) {
+                const std::size_t i = this->newest.load (std::memory_order_acquire);
+                if (i == none) { return view{}; }
+                int32_t p = this->pins[i].load (std::memory_order_relaxed);
+                while (p >= 0) {
+                    if (this->pins[i].compare_exchange_weak (p, p + 1, std::memory_order_acquire,
+                                                             std::memory_order_relaxed)) {
+                        return view (&this->slots[i], &this->pins[i]);
+                    }
+                }
+                // The producer took this slot after we read newest; look again
+            }
+        }
+
+        // The id of the newest frame (0 before the first)
+        uint64_t latest_id() const { return this->published.load (std::memory_order_acquire); }
+
+        // Consumer: block until a frame newer than id is published (or close() is called)
+        uint64_t wait_newer (const uint64_t id) const
+        {
+            this->published.wait (id, std::memory_order_acquire);
+            return this->published.load (std::memory_order_acquire);
+        }
+
+        // Wake any consumers blocked in wait_newer() for good, e.g. at shutdown
+        void close()
+        {
+            this->published.store (closed, std::memory_order_release);
+            this->published.notify_all();
+        }
+
+        static constexpr uint64_t closed = std::numeric_limits<uint64_t>::max();
+
+    private:
+        static constexpr std::size_t none = std::numeric_limits<std::size_t>::max();
+        static constexpr int32_t writing = -1;
+
+        std::vector<frame> slots;
+        // Per slot: the number of views held, or writing while the producer has it
+        std::vector<std::atomic<int32_t>> pins;
+        std::atomic<std::size_t> newest = none;
+        std::atomic<uint64_t> published = 0u;
+        // Owned by the producer
+        std::size_t next = 0u;
+        std::size_t writing_slot = 0u;
+        uint64_t last_id = 0u;
+    };
+
+} // namespace
@@ -0,0 +1,72 @@
+/*
+ * Write ommatidium output frames to a flat binary file, for building datasets in headless runs.
+ *
+ * File layout (little endian):
+ *
+ *   header: char[4] "OMMF", uint32 version (2), uint32 n_ommatidia, uint32 n_channels (3, or 1
+ *           for luminance), uint32 format (outputformat::code(): 0 float32, 1 float16, 2 uint8,
+ *           plus 0x100 for luminance)
+ *   then per step: uint64 step, float[16] camera localspace (column major),
+ *                  n_ommatidia * n_channels ommatidium data elements of the format
+ *
+ * Version 1 files have no format field and are always float32 RGB.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <span>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "outputformat.h"
+
+namespace demo
+{
+    struct framewriter
+    {
+        static constexpr uint32_t version = 2u;
+
+        framewriter (const std::string& path, const uint32_t _n_ommatidia, const outputformat _format = {})
+            : n_ommatidia (_n_ommatidia), format (_format)
+        {
+            if (!this->format.native()) { this->encoded.resize (this->n_ommatidia * this->format.bytes_per_ommatidium()); }
+            // A large stream buffer (set before opening), so that a step costs one write syscall at most
+            this->buf.resize (1u << 22);
+            this->fout.rdbuf()->pubsetbuf (this->buf.data(), static_cast<std::streamsize>(this->buf.size()));
+            this->fout.open (path, std::ios::out | std::ios::trunc | std::ios::binary);
+            if (!this->fout.is_open()) { throw std::runtime_error ("Could not open '" + path + "' for writing"); }
+            const uint32_t hdr[4] = { version, this->n_ommatidia, this->format.channels(), this->format.code() };
+            this->fout.write ("OMMF", 4);
+            this->fout.write (reinterpret_cast<const char*>(hdr), sizeof (hdr));
+        }
+
+        void write (const uint64_t step, const std::array<float, 16>& pose, std::span<const std::array<float, 3>> data)
+        {
+            if (data.size() != this->n_ommatidia) { throw std::runtime_error ("framewriter: wrong number of ommatidia"); }
+            this->fout.write (reinterpret_cast<const char*>(&step), sizeof (step));
+            this->fout.write (reinterpret_cast<const char*>(pose.data()), sizeof (float) * 16u);
+            if (this->format.native()) {
+                this->fout.write (reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size_bytes()));
+            } else {
+                outputcodec::encode (data, this->format, this->encoded.data());
+                this->fout.write (reinterpret_cast<const char*>(this->encoded.data()), static_cast<std::streamsize>(this->encoded.size()));
+            }
+            if (!this->fout.good()) { throw std::runtime_error ("framewriter: write failed"); }
+        }
+
+    private:
+        std::vector<char> buf;
+        std::ofstream fout;
+        uint32_t n_ommatidia = 0u;
+        outputformat format;
+        // One step's ommatidium data in the output format
+        std::vector<uint8_t> encoded;
+    };
+
+} // namespace
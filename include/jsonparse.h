@@ -0,0 +1,259 @@
+/*
+ * A minimal JSON reader, just enough to read glTF files for the CPU renderer without pulling in
+ * the OptiX SDK's tinygltf.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <cstdlib>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <stdexcept>
+
+namespace demo::json
+{
+    enum class type : uint8_t { null, boolean, number, string, array, object };
+
+    struct value
+    {
+        json::type t = json::type::null;
+        bool b = false;
+        double num = 0.0;
+        std::string str;
+        std::vector<value> arr;
+        std::vector<std::pair<std::string, value>> obj;
+
+        bool is_null() const { return this->t == json::type::null; }
+        bool is_number() const { return this->t == json::type::number; }
+        bool is_string() const { return this->t == json::type::string; }
+        bool is_array() const { return this->t == json::type::array; }
+        bool is_object() const { return this->t == json::type::object; }
+
+        // Object member lookup. Returns nullptr if absent (or if this is not an object)
+        const value* find (std::string_view key) const
+        {
+            for (const auto& kv : this->obj) { if (kv.first == key) { return &kv.second; } }
+            return nullptr;
+        }
+        bool contains (std::string_view key) const { return this->find (key) != nullptr; }
+
+        // Object member access that throws if absent
+        const value& operator[] (std::string_view key) const
+        {
+            const value* v = this->find (key);
+            if (v == nullptr) { throw std::runtime_error ("json: missing key '" + std::string(key) + "'"); }
+            return *v;
+        }
+        // Array element access
+        const value& operator[] (std::size_t i) const { return this->arr.at (i); }
+        std::size_t size() const { return this->is_array() ? this->arr.size() : this->obj.size(); }
+
+        // Typed access with defaults, for optional glTF members
+        double number_or (std::string_view key, double dflt) const
+        {
+            const value* v = this->find (key);
+            return (v != nullptr && v->is_number()) ? v->num : dflt;
+        }
+        int int_or (std::string_view key, int dflt) const
+        {
+            return static_cast<int>(this->number_or (key, static_cast<double>(dflt)));
+        }
+        std::string string_or (std::string_view key, const std::string& dflt) const
+        {
+            const value* v = this->find (key);
+            return (v != nullptr && v->is_string()) ? v->str : dflt;
+        }
+    };
+
+    namespace detail
+    {
+        struct parser
+        {
+            std::string_view s;
+            std::size_t p = 0u;
+
+            [[noreturn]] void fail (const char* what) const
+            {
+                throw std::runtime_error ("json: " + std::string(what) + " at offset " + std::to_string (this->p));
+            }
+
+            void skip_ws()
+            {
+                while (this->p < this->s.size()
+                       && (s[p] == ' ' || s[p] == '\t' || s[p] == '\n' || s[p] == '\r')) { ++this->p; }
+            }
+
+            char peek()
+            {
+                this->skip_ws();
+                if (this->p >= this->s.size()) { this->fail ("unexpected end of input"); }
+                return this->s[this->p];
+            }
+
+            void expect (char c)
+            {
+                if (this->peek() != c) { this->fail ("unexpected character"); }
+                ++this->p;
+            }
+
+            void literal (std::string_view lit)
+            {
+                if (this->s.substr (this->p, lit.size()) != lit) { this->fail ("bad literal"); }
+                this->p += lit.size();
+            }
+
+            static void append_utf8 (std::string& out, uint32_t cp)
+            {
+                if (cp < 0x80) {
+                    out += static_cast<char>(cp);
+                } else if (cp < 0x800) {
+                    out += static_cast<char>(0xc0 | (cp >> 6));
+                    out += static_cast<char>(0x80 | (cp & 0x3f));
+                } else if (cp < 0x10000) {
+                    out += static_cast<char>(0xe0 | (cp >> 12));
+                    out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+                    out += static_cast<char>(0x80 | (cp & 0x3f));
+                } else {
+                    out += static_cast<char>(0xf0 | (cp >> 18));
+                    out += static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+                    out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+                    out += static_cast<char>(0x80 | (cp & 0x3f));
+                }
+            }
+
+            uint32_t hex4()
+            {
+                if (this->p + 4 > this->s.size()) { this->fail ("short \\u escape"); }
+                uint32_t cp = 0u;
+                for (int i = 0; i < 4; ++i) {
+                    char c = this->s[this->p++];
+                    cp <<= 4;
+                    if (c >= '0' && c <= '9') { cp |= static_cast<uint32_t>(c - '0'); }
+                    else if (c >= 'a' && c <= 'f') { cp |= static_cast<uint32_t>(c - 'a' + 10); }
+                    else if (c >= 'A' && c <= 'F') { cp |= static_cast<uint32_t>(c - 'A' + 10); }
+                    else { this->fail ("bad \\u escape"); }
+                }
+                return cp;
+            }
+
+            std::string string()
+            {
+                this->expect ('"');
+                std::string out;
+                for (;;) {
+                    if (this->p >= this->s.size()) { this->fail ("unterminated string"); }
+                    char c = this->s[this->p++];
+                    if (c == '"') { break; }
+                    if (c != '\\') { out += c; continue; }
+                    if (this->p >= this->s.size()) { this->fail ("unterminated escape"); }
+                    char e = this->s[this->p++];
+                    switch (e) {
+                    case '"': out += '"'; break;
+                    case '\\': out += '\\'; break;
+                    case '/': out += '/'; break;
+                    case 'b': out += '\b'; break;
+                    case 'f': out += '\f'; break;
+                    case 'n': out += '\n'; break;
+                    case 'r': out += '\r'; break;
+                    case 't': out += '\t'; break;
+                    case 'u':
+                    {
+                        uint32_t cp = this->hex4();
+                        if (cp >= 0xd800 && cp < 0xdc00 && this->s.substr (this->p, 2) == "\\u") {
+                            this->p += 2;
+                            uint32_t lo = this->hex4();
+                            cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+                        }
+                        append_utf8 (out, cp);
+                        break;
+                    }
+                    default: this->fail ("bad escape");
+                    }
+                }
+                return out;
+            }
+
+            double number()
+            {
+                const std::size_t start = this->p;
+                while (this->p < this->s.size()) {
+                    char c = this->s[this->p];
+                    if ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E') {
+                        ++this->p;
+                    } else {
+                        break;
+                    }
+                }
+                std::string tok (this->s.substr (start, this->p - start));
+                char* endp = nullptr;
+                double d = std::strtod (tok.c_str(), &endp);
+                if (tok.empty() || endp != tok.c_str() + tok.size()) { this->fail ("bad number"); }
+                return d;
+            }
+
+            value parse_value (int depth)
+            {
+                if (depth > 256) { this->fail ("nesting too deep"); }
+                value v;
+                char c = this->peek();
+                if (c == '{') {
+                    ++this->p;
+                    v.t = json::type::object;
+                    if (this->peek() == '}') { ++this->p; return v; }
+                    for (;;) {
+                        std::string key = this->string();
+                        this->expect (':');
+                        v.obj.emplace_back (std::move (key), this->parse_value (depth + 1));
+                        char d = this->peek();
+                        ++this->p;
+                        if (d == '}') { break; }
+                        if (d != ',') { this->fail ("expected ',' or '}'"); }
+                    }
+                } else if (c == '[') {
+                    ++this->p;
+                    v.t = json::type::array;
+                    if (this->peek() == ']') { ++this->p; return v; }
+                    for (;;) {
+                        v.arr.push_back (this->parse_value (depth + 1));
+                        char d = this->peek();
+                        ++this->p;
+                        if (d == ']') { break; }
+                        if (d != ',') { this->fail ("expected ',' or ']'"); }
+                    }
+                } else if (c == '"') {
+                    v.t = json::type::string;
+                    v.str = this->string();
+                } else if (c == 't') {
+                    this->literal ("true");
+                    v.t = json::type::boolean;
+                    v.b = true;
+                } else if (c == 'f') {
+                    this->literal ("false");
+                    v.t = json::type::boolean;
+                } else if (c == 'n') {
+                    this->literal ("null");
+                } else {
+                    v.t = json::type::number;
+                    v.num = this->number();
+                }
+                return v;
+            }
+        };
+    } // namespace detail
+
+    // Parse a complete JSON document. Throws std::runtime_error on malformed input.
+    inline value parse (std::string_view text)
+    {
+        detail::parser ps { text };
+        value v = ps.parse_value (0);
+        ps.skip_ws();
+        if (ps.p != text.size()) { ps.fail ("trailing characters"); }
+        return v;
+    }
+
+} // namespace
@@ -0,0 +1,172 @@
+/*
+ * Levels of detail and view culling for the meshes of a demo::cpu::scene, as drawn in the
+ * window (see meshvisual.h).
+ *
+ * make_lods() decimates a mesh by vertex clustering: the mesh's bounding box is divided into
+ * cubic cells, the vertices in each cell are merged into one at their mean, and triangles that
+ * collapse are dropped. It is fast and robust to any input, at the cost of some shape fidelity,
+ * which is hidden by only drawing coarse levels where they are small on screen.
+ *
+ * frustum holds the six planes of a clip transform (projection * view * model), which are
+ * therefore in the model's own frame, so a mesh's local bounding sphere can be tested against
+ * them directly.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "cpumaths.h"
+#include "cpuscene.h"
+
+namespace demo::cpu
+{
+    struct sphere
+    {
+        vec3 centre = { 0.0f, 0.0f, 0.0f };
+        float radius = 0.0f;
+    };
+
+    // A sphere around all of a mesh's vertices (centred on their bounding box)
+    inline sphere bounding_sphere (const mesh& me)
+    {
+        vec3 lo = { 0.0f, 0.0f, 0.0f };
+        vec3 hi = { 0.0f, 0.0f, 0.0f };
+        bool any = false;
+        for (const auto& p : me.primitives) {
+            for (const vec3& v : p.positions) {
+                for (int a = 0; a < 3; ++a) {
+                    lo[a] = any ? std::min (lo[a], v[a]) : v[a];
+                    hi[a] = any ? std::max (hi[a], v[a]) : v[a];
+                }
+                any = true;
+            }
+        }
+        sphere s;
+        s.centre = (lo + hi) * 0.5f;
+        for (const auto& p : me.primitives) {
+            for (const vec3& v : p.positions) { s.radius = std::max (s.radius, length (v - s.centre)); }
+        }
+        return s;
+    }
+
+    inline std::size_t triangle_count (const mesh& me)
+    {
+        std::size_t n = 0u;
+        for (const auto& p : me.primitives) { n += p.indices.size() / 3u; }
+        return n;
+    }
+
+    // Decimate me by merging the vertices within each cubic cell of side cell
+    inline mesh decimate (const mesh& me, const float cell)
+    {
+        mesh out;
+        out.name = me.name;
+        const sphere bs = bounding_sphere (me);
+        const vec3 origin = bs.centre - vec3{ bs.radius, bs.radius, bs.radius };
+        const float inv = 1.0f / cell;
+        for (const auto& p : me.primitives) {
+            primitive q;
+            q.material = p.material;
+            const bool normals = p.normals.size() == p.positions.size();
+            std::unordered_map<uint64_t, uint32_t> cells;
+            std::vector<uint32_t> remap (p.positions.size());
+            std::vector<float> weight;
+            for (std::size_t i = 0; i < p.positions.size(); ++i) {
+                const vec3 r = (p.positions[i] - origin) * inv;
+                const uint64_t key = (static_cast<uint64_t>(std::max (0.0f, r[0])) & 0x1fffffu)
+                                     | ((static_cast<uint64_t>(std::max (0.0f, r[1])) & 0x1fffffu) << 21)
+                                     | ((static_cast<uint64_t>(std::max (0.0f, r[2])) & 0x1fffffu) << 42);
+                auto [it, added] = cells.try_emplace (key, static_cast<uint32_t>(q.positions.size()));
+                if (added) {
+                    q.positions.push_back ({ 0.0f, 0.0f, 0.0f });
+                    if (normals) { q.normals.push_back ({ 0.0f, 0.0f, 0.0f }); }
+                    weight.push_back (0.0f);
+                }
+                const uint32_t j = it->second;
+                remap[i] = j;
+                q.positions[j] = q.positions[j] + p.positions[i];
+                if (normals) { q.normals[j] = q.normals[j] + p.normals[i]; }
+                weight[j] += 1.0f;
+            }
+            for (std::size_t j = 0; j < q.positions.size(); ++j) {
+                q.positions[j] = q.positions[j] * (1.0f / weight[j]);
+                if (normals) { q.normals[j] = normalize (q.normals[j]); }
+            }
+            for (std::size_t t = 0; t + 2 < p.indices.size(); t += 3) {
+                const uint32_t a = remap[p.indices[t]];
+                const uint32_t b = remap[p.indices[t + 1]];
+                const uint32_t c = remap[p.indices[t + 2]];
+                if (a == b || b == c || a == c) { continue; }
+                q.indices.insert (q.indices.end(), { a, b, c });
+            }
+            if (!q.indices.empty()) { out.primitives.push_back (std::move (q)); }
+        }
+        return out;
+    }
+
+    /*
+     * Coarser versions of me, each with cells of cell_fractions[i] times the mesh's diameter. A
+     * level is kept only if it has at most max_ratio of the triangles of the level before it, and
+     * meshes of fewer than min_triangles get none.
+     */
+    inline std::vector<mesh> make_lods (const mesh& me, const std::vector<float>& cell_fractions = { 1.0f / 32.0f, 1.0f / 10.0f },
+                                        const float max_ratio = 0.7f, const std::size_t min_triangles = 256u)
+    {
+        std::vector<mesh> lods;
+        std::size_t prev = triangle_count (me);
+        if (prev < min_triangles) { return lods; }
+        const float diameter = 2.0f * bounding_sphere (me).radius;
+        if (!(diameter > 0.0f)) { return lods; }
+        for (const float f : cell_fractions) {
+            mesh d = decimate (me, f * diameter);
+            const std::size_t nt = triangle_count (d);
+            if (nt == 0u || static_cast<float>(nt) > max_ratio * static_cast<float>(prev)) { continue; }
+            prev = nt;
+            lods.push_back (std::move (d));
+        }
+        return lods;
+    }
+
+    // The view frustum of a clip transform, as six planes (a, b, c, d) with a x + b y + c z + d >= 0 inside
+    struct frustum
+    {
+        std::array<std::array<float, 4>, 6> planes = {};
+
+        explicit frustum (const mat4& clip)
+        {
+            // Rows of the column major clip matrix
+            auto row = [&clip](int r) { return std::array<float, 4>{ clip[r], clip[4 + r], clip[8 + r], clip[12 + r] }; };
+            const std::array<float, 4> r0 = row (0), r1 = row (1), r2 = row (2), r3 = row (3);
+            for (int i = 0; i < 4; ++i) {
+                this->planes[0][i] = r3[i] + r0[i];
+                this->planes[1][i] = r3[i] - r0[i];
+                this->planes[2][i] = r3[i] + r1[i];
+                this->planes[3][i] = r3[i] - r1[i];
+                this->planes[4][i] = r3[i] + r2[i];
+                this->planes[5][i] = r3[i] - r2[i];
+            }
+            for (auto& p : this->planes) {
+                const float l = std::sqrt (p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+                if (l > 0.0f) { for (float& c : p) { c /= l; } }
+            }
+        }
+
+        // Is any of the sphere inside the frustum? (Conservative: some spheres near corners pass.)
+        bool intersects (const sphere& s) const
+        {
+            for (const auto& p : this->planes) {
+                if (p[0] * s.centre[0] + p[1] * s.centre[1] + p[2] * s.centre[2] + p[3] < -s.radius) { return false; }
+            }
+            return true;
+        }
+    };
+
+} // namespace
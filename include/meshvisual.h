@@ -0,0 +1,447 @@
+/*
+ * A mathplot VisualModel that draws one mesh of a demo::cpu::scene. The mesh is built in its
+ * own frame; place it in the world with setViewMatrix (instance transform), or draw it at many
+ * transforms at once with draw_instances(). This is the CPU backend's equivalent of
+ * mplot::compoundray::scene_to_visualmodels.
+ *
+ * Environments repeat the same meshes (trees, shrubs, rocks) many times. scene_to_meshvisuals()
+ * makes one scenemeshvisual per distinct mesh, treating meshes with identical geometry and
+ * colours as one. That holds one copy of the mesh's vertices and one set of vertex buffers per
+ * level of detail, and draws them at each of the mesh's instance transforms. GPU memory and model
+ * setup then grow with the number of distinct meshes, not instances.
+ *
+ * Each frame, a scenemeshvisual skips instances whose bounding spheres are outside the view
+ * frustum, and sorts the others by the level of detail (see meshlod.h) that suits their size on
+ * screen. Each level then draws all of its instances with one glDrawElementsInstanced call, the
+ * instance transforms going to the GPU in a per-instance vertex buffer. mplot::Visual's shader
+ * takes the model matrix as a uniform, so the instances are drawn with instanceshader, which is
+ * the same lighting with the model matrix as a per-instance attribute. The culling and the
+ * instanceshader both take their projection from the window's mplot::Visual, which
+ * scene_to_meshvisuals() gives each model, so nothing is read back from GL.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sm/vec>
+#include <sm/mat44>
+#include <mplot/VisualModel.h>
+#include <mplot/Visual.h>
+
+#include "cpuscene.h"
+#include "cpuinterop.h"
+#include "meshlod.h"
+#include "scenecache.h"
+#include "threadpool.h"
+
+namespace demo
+{
+    /*
+     * The shader program that scenemeshvisual draws instances with: mplot::Visual's lighting (an
+     * ambient light and one diffuse light) with each instance's model matrix read from the four
+     * vertex attributes from instance_loc, a column each, rather than from the m_matrix uniform.
+     * Make one while the window's GL context is current; it is shared by a scene's models.
+     */
+    struct instanceshader
+    {
+        // Locations 0 to 3 are mathplot's positions, normals, colours and texture coordinates
+        static constexpr GLuint instance_loc = 4u;
+
+        instanceshader()
+        {
+            const GLuint vs = compile (GL_VERTEX_SHADER, vertex_source);
+            const GLuint fs = compile (GL_FRAGMENT_SHADER, fragment_source);
+            this->prog = glCreateProgram();
+            glAttachShader (this->prog, vs);
+            glAttachShader (this->prog, fs);
+            glLinkProgram (this->prog);
+            glDeleteShader (vs);
+            glDeleteShader (fs);
+            GLint ok = GL_FALSE;
+            glGetProgramiv (this->prog, GL_LINK_STATUS, &ok);
+            if (ok != GL_TRUE) {
+                const std::string log = info_log (this->prog, false);
+                glDeleteProgram (this->prog);
+                throw std::runtime_error ("instanceshader: link failed: " + log);
+            }
+            this->loc_v = glGetUniformLocation (this->prog, "v_matrix");
+            this->loc_p = glGetUniformLocation (this->prog, "p_matrix");
+            this->loc_light_colour = glGetUniformLocation (this->prog, "light_colour");
+            this->loc_ambient = glGetUniformLocation (this->prog, "ambient_intensity");
+            this->loc_diffuse_position = glGetUniformLocation (this->prog, "diffuse_position");
+            this->loc_diffuse = glGetUniformLocation (this->prog, "diffuse_intensity");
+        }
+        instanceshader (const instanceshader&) = delete;
+        instanceshader& operator= (const instanceshader&) = delete;
+        ~instanceshader() { glDeleteProgram (this->prog); }
+
+        // Use the program, with the window's view (scene) and projection matrices and lights
+        template <int glver>
+        void use (const cpu::mat4& view, const cpu::mat4& proj, const mplot::Visual<glver>& v) const
+        {
+            glUseProgram (this->prog);
+            glUniformMatrix4fv (this->loc_v, 1, GL_FALSE, view.data());
+            glUniformMatrix4fv (this->loc_p, 1, GL_FALSE, proj.data());
+            glUniform3f (this->loc_light_colour, v.light_colour[0], v.light_colour[1], v.light_colour[2]);
+            glUniform1f (this->loc_ambient, v.ambient_intensity);
+            glUniform3f (this->loc_diffuse_position, v.diffuse_position[0], v.diffuse_position[1], v.diffuse_position[2]);
+            glUniform1f (this->loc_diffuse, v.diffuse_intensity);
+        }
+
+    private:
+        static GLuint compile (const GLenum type, const char* source)
+        {
+            const GLuint sh = glCreateShader (type);
+            glShaderSource (sh, 1, &source, nullptr);
+            glCompileShader (sh);
+            GLint ok = GL_FALSE;
+            glGetShaderiv (sh, GL_COMPILE_STATUS, &ok);
+            if (ok != GL_TRUE) {
+                const std::string log = info_log (sh, true);
+                glDeleteShader (sh);
+                throw std::runtime_error ("instanceshader: compile failed: " + log);
+            }
+            return sh;
+        }
+
+        static std::string info_log (const GLuint obj, const bool shader)
+        {
+            GLint len = 0;
+            if (shader) { glGetShaderiv (obj, GL_INFO_LOG_LENGTH, &len); } else { glGetProgramiv (obj, GL_INFO_LOG_LENGTH, &len); }
+            std::string log (static_cast<std::size_t>(std::max (len, 1)), '\0');
+            if (shader) {
+                glGetShaderInfoLog (obj, len, nullptr, log.data());
+            } else {
+                glGetProgramInfoLog (obj, len, nullptr, log.data());
+            }
+            return log;
+        }
+
+        static constexpr const char* vertex_source = R"glsl(#version 330 core
+uniform mat4 v_matrix;
+uniform mat4 p_matrix;
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normalin;
+layout(location = 2) in vec3 color;
+layout(location = 4) in mat4 m_matrix;
+out vec3 fragpos;
+out vec3 normal;
+out vec3 colour;
+void main()
+{
+    vec4 world = m_matrix * vec4(position, 1.0);
+    gl_Position = p_matrix * v_matrix * world;
+    fragpos = world.xyz;
+    normal = mat3(m_matrix) * normalin;
+    colour = color;
+}
+)glsl";
+
+        static constexpr const char* fragment_source = R"glsl(#version 330 core
+uniform vec3 light_colour;
+uniform float ambient_intensity;
+uniform vec3 diffuse_position;
+uniform float diffuse_intensity;
+in vec3 fragpos;
+in vec3 normal;
+in vec3 colour;
+out vec4 finalcolor;
+void main()
+{
+    float diff = max(dot(normalize(normal), normalize(diffuse_position - fragpos)), 0.0);
+    finalcolor = vec4((ambient_intensity + diffuse_intensity * diff) * light_colour * colour, 1.0);
+}
+)glsl";
+
+        GLuint prog = 0u;
+        GLint loc_v = -1;
+        GLint loc_p = -1;
+        GLint loc_light_colour = -1;
+        GLint loc_ambient = -1;
+        GLint loc_diffuse_position = -1;
+        GLint loc_diffuse = -1;
+    };
+
+    template <int glver = mplot::gl::version_4_1>
+    struct meshvisual : public mplot::VisualModel<glver>
+    {
+        meshvisual (const cpu::mesh* _mesh, const std::vector<cpu::material>* _materials)
+            : mplot::VisualModel<glver> (sm::vec<float>{})
+        {
+            this->themesh = _mesh;
+            this->materials = _materials;
+        }
+
+        ~meshvisual()
+        {
+            if (this->instance_vbo != 0u) { glDeleteBuffers (1, &this->instance_vbo); }
+        }
+
+        void initializeVertices()
+        {
+            if (this->themesh == nullptr) { return; }
+            using cpu::operator-;
+            for (const auto& p : this->themesh->primitives) {
+                cpu::vec3 clr = { 0.8f, 0.8f, 0.8f };
+                if (p.material >= 0 && static_cast<std::size_t>(p.material) < this->materials->size()) {
+                    clr = (*this->materials)[p.material].colour;
+                }
+                if (p.normals.size() == p.positions.size()) {
+                    // Shared vertices with the file's normals
+                    const GLuint base = this->idx;
+                    for (std::size_t i = 0; i < p.positions.size(); ++i) {
+                        this->vertex_push (p.positions[i][0], p.positions[i][1], p.positions[i][2], this->vertexPositions);
+                        this->vertex_push (p.normals[i][0], p.normals[i][1], p.normals[i][2], this->vertexNormals);
+                        this->vertex_push (clr[0], clr[1], clr[2], this->vertexColors);
+                    }
+                    for (auto i : p.indices) { this->indices.push_back (base + i); }
+                    this->idx += static_cast<GLuint>(p.positions.size());
+                } else {
+                    // No normals in the file, so make flat-shaded triangles
+                    for (std::size_t i = 0; i + 2 < p.indices.size(); i += 3) {
+                        const cpu::vec3& a = p.positions[p.indices[i]];
+                        const cpu::vec3& b = p.positions[p.indices[i + 1]];
+                        const cpu::vec3& c = p.positions[p.indices[i + 2]];
+                        const cpu::vec3 n = cpu::normalize (cpu::cross (b - a, c - a));
+                        for (const cpu::vec3* v : { &a, &b, &c }) {
+                            this->vertex_push ((*v)[0], (*v)[1], (*v)[2], this->vertexPositions);
+                            this->vertex_push (n[0], n[1], n[2], this->vertexNormals);
+                            this->vertex_push (clr[0], clr[1], clr[2], this->vertexColors);
+                            this->indices.push_back (this->idx++);
+                        }
+                    }
+                }
+            }
+        }
+
+        /*
+         * Draw the mesh once per transform in one instanced draw call, with the program in use
+         * (an instanceshader). The transforms are uploaded to this model's instance buffer, which
+         * is attached to its vertex array as the four columns at instanceshader::instance_loc.
+         */
+        void draw_instances (std::span<const cpu::mat4> ts)
+        {
+            if (ts.empty() || this->indices.empty()) { return; }
+            glBindVertexArray (this->vao);
+            if (this->instance_vbo == 0u) {
+                glGenBuffers (1, &this->instance_vbo);
+                glBindBuffer (GL_ARRAY_BUFFER, this->instance_vbo);
+                for (GLuint c = 0u; c < 4u; ++c) {
+                    const GLuint loc = instanceshader::instance_loc + c;
+                    glEnableVertexAttribArray (loc);
+                    glVertexAttribPointer (loc, 4, GL_FLOAT, GL_FALSE, sizeof (cpu::mat4),
+                                           reinterpret_cast<void*>(c * 4u * sizeof (float)));
+                    glVertexAttribDivisor (loc, 1);
+                }
+            } else {
+                glBindBuffer (GL_ARRAY_BUFFER, this->instance_vbo);
+            }
+            glBufferData (GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(ts.size() * sizeof (cpu::mat4)), ts.data(), GL_STREAM_DRAW);
+            glDrawElementsInstanced (GL_TRIANGLES, static_cast<GLsizei>(this->indices.size()), GL_UNSIGNED_INT, nullptr,
+                                     static_cast<GLsizei>(ts.size()));
+            glBindVertexArray (0);
+        }
+
+        const cpu::mesh* themesh = nullptr;
+        const std::vector<cpu::material>* materials = nullptr;
+
+    private:
+        // Instance transforms for draw_instances (column-major mat4s)
+        GLuint instance_vbo = 0u;
+    };
+
+    // What the scene's models drew in one frame. Reset before each render of the window.
+    struct scene_draw_stats
+    {
+        std::size_t instances = 0u;
+        // Instances drawn (the others were outside the view)
+        std::size_t drawn = 0u;
+        std::size_t triangles = 0u;
+        void reset() { *this = scene_draw_stats{}; }
+    };
+
+    /*
+     * A mesh drawn at each of its instance transforms, at a level of detail chosen per instance,
+     * from one set of vertex buffers per level. The model itself holds no vertices; it draws its
+     * levels, which are meshvisuals that scene_to_meshvisuals() binds to the window.
+     */
+    template <int glver = mplot::gl::version_4_1>
+    struct scenemeshvisual : public mplot::VisualModel<glver>
+    {
+        scenemeshvisual (const cpu::mesh* _mesh, std::vector<cpu::mat4>&& _transforms, std::vector<cpu::mesh>&& _lods)
+            : mplot::VisualModel<glver> (sm::vec<float>{}), transforms (std::move (_transforms)), lods (std::move (_lods))
+        {
+            this->bounds = cpu::bounding_sphere (*_mesh);
+            this->level_meshes.push_back (_mesh);
+            for (const auto& l : this->lods) { this->level_meshes.push_back (&l); }
+            for (const auto* m : this->level_meshes) { this->level_triangles.push_back (cpu::triangle_count (*m)); }
+            for (const auto& t : this->transforms) {
+                const float sx = cpu::length (cpu::column (t, 0));
+                const float sy = cpu::length (cpu::column (t, 1));
+                const float sz = cpu::length (cpu::column (t, 2));
+                this->scales.push_back (std::max (sx, std::max (sy, sz)));
+            }
+            // Rest at the first instance, for anything that asks where this model is
+            if (!this->transforms.empty()) { this->setViewMatrix (to_mat44 (this->transforms[0])); }
+        }
+
+        void initializeVertices() {}
+
+        void render() override
+        {
+            if (this->levels.empty() || this->shader == nullptr || this->vis == nullptr) { return; }
+            if (this->setContext != nullptr) { this->setContext (this->parentVis); }
+            using cpu::operator*;
+            const cpu::mat4 proj = to_mat4 (this->vis->projection);
+            const cpu::mat4 view = to_mat4 (this->scenematrix);
+            const cpu::mat4 clip = proj * view;
+            this->visible.resize (this->levels.size());
+            for (auto& vl : this->visible) { vl.clear(); }
+            for (std::size_t i = 0; i < this->transforms.size(); ++i) {
+                const cpu::mat4& t = this->transforms[i];
+                if (this->stats != nullptr) { ++this->stats->instances; }
+                if (this->cull && !cpu::frustum (clip * t).intersects (this->bounds)) { continue; }
+                // The instance's angular radius decides its level
+                const cpu::vec3 c = cpu::transform_point (view * t, this->bounds.centre);
+                const float size = this->bounds.radius * this->scales[i] / std::max (cpu::length (c), 1e-6f);
+                std::size_t level = 0u;
+                while (level + 1u < this->levels.size() && level < this->lod_sizes.size() && size < this->lod_sizes[level]) { ++level; }
+                this->visible[level].push_back (t);
+                if (this->stats != nullptr) {
+                    ++this->stats->drawn;
+                    this->stats->triangles += this->level_triangles[level];
+                }
+            }
+
+            // One draw call per level, then back to the window's program for the models after this one
+            GLint prev_prog = 0;
+            glGetIntegerv (GL_CURRENT_PROGRAM, &prev_prog);
+            this->shader->use (view, proj, *this->vis);
+            for (std::size_t level = 0; level < this->levels.size(); ++level) {
+                this->levels[level]->draw_instances (this->visible[level]);
+            }
+            glUseProgram (static_cast<GLuint>(prev_prog));
+        }
+
+        // The scene's mesh, then its coarser levels of detail
+        const std::vector<const cpu::mesh*>& meshes() const { return this->level_meshes; }
+
+        // A meshvisual per level of detail, finest first (see scene_to_meshvisuals)
+        std::vector<std::unique_ptr<meshvisual<glver>>> levels;
+        // Below an angular radius (radians) of lod_sizes[i], draw level i + 1 rather than level i
+        std::vector<float> lod_sizes = { 0.011f, 0.0035f };
+        // Skip instances outside the view frustum
+        bool cull = true;
+        scene_draw_stats* stats = nullptr;
+        // The program that draws the levels, and the window whose projection and lights it uses
+        // (see scene_to_meshvisuals)
+        std::shared_ptr<const instanceshader> shader;
+        const mplot::Visual<glver>* vis = nullptr;
+
+    private:
+        std::vector<cpu::mat4> transforms;
+        std::vector<float> scales;
+        std::vector<cpu::mesh> lods;
+        std::vector<const cpu::mesh*> level_meshes;
+        std::vector<std::size_t> level_triangles;
+        cpu::sphere bounds;
+        // This frame's instances in view, by level
+        std::vector<std::vector<cpu::mat4>> visible;
+    };
+
+    /*
+     * For each mesh of sc, the index of the first mesh that is identical to it (the same
+     * primitives, with the same colours), or its own index if there is none.
+     */
+    inline std::vector<uint32_t> identical_meshes (const cpu::scene& sc)
+    {
+        auto colour_of = [&sc](const cpu::primitive& p) {
+            return p.material >= 0 && static_cast<std::size_t>(p.material) < sc.materials.size()
+                   ? sc.materials[p.material].colour : cpu::vec3{ 0.8f, 0.8f, 0.8f };
+        };
+        auto same = [&](const cpu::mesh& a, const cpu::mesh& b) {
+            if (a.primitives.size() != b.primitives.size()) { return false; }
+            for (std::size_t i = 0; i < a.primitives.size(); ++i) {
+                const cpu::primitive& pa = a.primitives[i];
+                const cpu::primitive& pb = b.primitives[i];
+                if (pa.positions != pb.positions || pa.normals != pb.normals || pa.indices != pb.indices
+                    || colour_of (pa) != colour_of (pb)) { return false; }
+            }
+            return true;
+        };
+
+        std::vector<uint32_t> rep (sc.meshes.size());
+        std::unordered_multimap<uint64_t, uint32_t> seen;
+        for (uint32_t m = 0; m < sc.meshes.size(); ++m) {
+            rep[m] = m;
+            uint64_t h = cpu::scenecache::hash_bytes (nullptr, 0u);
+            for (const auto& p : sc.meshes[m].primitives) {
+                h = cpu::scenecache::hash_bytes (p.positions.data(), p.positions.size() * sizeof (cpu::vec3), h);
+                h = cpu::scenecache::hash_bytes (p.normals.data(), p.normals.size() * sizeof (cpu::vec3), h);
+                h = cpu::scenecache::hash_bytes (p.indices.data(), p.indices.size() * sizeof (uint32_t), h);
+                const cpu::vec3 c = colour_of (p);
+                h = cpu::scenecache::hash_bytes (c.data(), sizeof (cpu::vec3), h);
+            }
+            auto [b, e] = seen.equal_range (h);
+            for (auto it = b; it != e; ++it) {
+                if (same (sc.meshes[it->second], sc.meshes[m])) {
+                    rep[m] = it->second;
+                    break;
+                }
+            }
+            if (rep[m] == m) { seen.emplace (h, m); }
+        }
+        return rep;
+    }
+
+    /*
+     * Add sc's mesh instances to v, one scenemeshvisual per distinct mesh (see above). Levels of
+     * detail are made here, in parallel. If stats is given, the models count what they draw in it.
+     * v's GL context must be current (the models share an instanceshader, made here).
+     */
+    template <int glver = mplot::gl::version_4_1>
+    void scene_to_meshvisuals (const cpu::scene& sc, mplot::Visual<glver>* v, scene_draw_stats* stats = nullptr)
+    {
+        const std::vector<uint32_t> rep = identical_meshes (sc);
+        std::vector<std::vector<cpu::mat4>> placed (sc.meshes.size());
+        for (const auto& inst : sc.instances) { placed[rep[inst.mesh]].push_back (inst.transform); }
+
+        std::vector<std::vector<cpu::mesh>> lods (sc.meshes.size());
+        {
+            threadpool pool;
+            cpu::gltf_detail::for_each_index (sc.meshes.size(), &pool, [&](std::size_t m) {
+                if (!placed[m].empty()) { lods[m] = cpu::make_lods (sc.meshes[m]); }
+            });
+        }
+
+        auto shader = std::make_shared<const instanceshader>();
+        for (std::size_t m = 0; m < placed.size(); ++m) {
+            if (placed[m].empty()) { continue; }
+            auto smv = std::make_unique<demo::scenemeshvisual<glver>> (&sc.meshes[m], std::move (placed[m]), std::move (lods[m]));
+            smv->stats = stats;
+            smv->shader = shader;
+            smv->vis = v;
+            for (const cpu::mesh* lm : smv->meshes()) {
+                auto lv = std::make_unique<demo::meshvisual<glver>> (lm, &sc.materials);
+                v->bindmodel (lv);
+                lv->finalize();
+                smv->levels.push_back (std::move (lv));
+            }
+            v->bindmodel (smv);
+            smv->finalize();
+            v->addVisualModel (smv);
+        }
+    }
+
+} // namespace
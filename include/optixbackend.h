@@ -0,0 +1,240 @@
+/*
+ * The OptiX eyebackend. A thin wrapper around compound-ray's libEyeRenderer3, which keeps its
+ * scene in the global 'scene'. libEyeRenderer3 launches only the current camera, so several
+ * compound eyes can't share one launch (that needs a multi-eye launch in compound-ray itself).
+ * render_eyes() and render_batch() instead keep camera switches to a minimum: each eye is visited
+ * once per frame, its pose set, ray cast and read back in the one visit, ending on the camera
+ * that was current.
+ *
+ * The window draws the scene from demo::cpu's copy of the same glTF file, rather than with
+ * mplot::compoundray::scene_to_visualmodels(), so that repeated meshes share their vertex buffers
+ * and are drawn as instances, culled to the view and at distance-based levels of detail (see
+ * meshvisual.h). That copy is loaded through the CPU backend's scene cache (see scenecache.h), so
+ * after the first run it is memory mapped rather than parsed a second time. Scenes that
+ * demo::cpu can't load (.glb files, sparse accessors, non-float positions) or can't draw as they
+ * are (textured materials) are drawn by scene_to_visualmodels() as before.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <algorithm>
+#include <exception>
+#include <iostream>
+
+#include "eyebackend.h"
+#include "cpuscene.h"
+#include "scenecache.h"
+#include "meshvisual.h"
+#include "threadpool.h"
+#include "libEyeRenderer.h"
+#include <mplot/compoundray/interop.h> // mathplot <--> compoundray interoperability
+
+// The compound-ray scene exists at global scope in libEyeRenderer.so. It has to be named 'scene'
+extern MulticamScene* scene;
+
+namespace demo
+{
+    struct optixbackend final : public eyebackend
+    {
+        optixbackend()
+        {
+            // Boilerplate memory alloc for compound-ray
+            multicamAlloc();
+            // Turn off verbose logging
+            setVerbosity (false);
+        }
+        ~optixbackend()
+        {
+            ::stop(); // stop compound-ray from running
+            multicamDealloc(); // De-allocate compound-ray memory
+        }
+
+        void load_scene (const std::string& path, const bool blender_axes) override
+        {
+            loadGlTFscene (path.c_str(), (blender_axes ? mplot::compoundray::blender_transform()
+                                          : sutil::Matrix4x4::identity()));
+            this->scene_path = path;
+            this->blender_axes = blender_axes;
+            ++this->generation;
+        }
+        uint64_t scene_generation() override { return this->generation; }
+
+        // If set, the window's copy of the scene is loaded through a cache in this directory
+        std::string scene_cache_dir = "";
+
+        int camera_count() override { return static_cast<int>(getCameraCount()); }
+        void goto_camera (int ci) override { gotoCamera (ci); }
+        int camera_index() override { return scene->getCameraIndex(); }
+        std::string eye_data_path() override { return std::string (getEyeDataPath()); }
+        bool is_compound_eye_active() override { return isCompoundEyeActive(); }
+
+        int samples_per_ommatidium() override { return getCurrentEyeSamplesPerOmmatidium(); }
+        void change_samples_per_ommatidium_by (int d) override { changeCurrentEyeSamplesPerOmmatidiumBy (d); }
+
+        void translate_cameras_locally (float x, float y, float z) override { translateCamerasLocally (x, y, z); }
+        void rotate_cameras_locally_around (float angle, float x, float y, float z) override
+        {
+            rotateCamerasLocallyAround (angle, x, y, z);
+        }
+        sm::mat44<float> camera_space() override { return mplot::compoundray::getCameraSpace (scene); }
+        void set_camera_space (const sm::mat44<float>& cs) override
+        {
+            setCameraPoseMatrix (mplot::compoundray::mat44_to_Matrix4x4 (cs));
+        }
+
+        void render_frame() override { renderFrame(); }
+        void get_camera_data (std::vector<std::array<float, 3>>& out) override
+        {
+            getCameraData (out);
+            if (this->accumulate) { this->accumulate_frame (out); }
+        }
+        void render_eyes (const std::vector<int>& cameras, std::vector<std::array<float, 3>>& out) override
+        {
+            this->render_items (cameras, {}, out);
+        }
+        void render_batch (const std::vector<int>& cameras, std::span<const sm::mat44<float>> poses,
+                           std::vector<std::array<float, 3>>& out) override
+        {
+            if (cameras.empty() || poses.size() % cameras.size() != 0u) {
+                throw std::runtime_error ("render_batch: need one pose per camera per item");
+            }
+            this->render_items (cameras, poses, out);
+        }
+        // libEyeRenderer3 can't share samples out per ommatidium, so this is a running mean of
+        // whole frames, which converges as long as each launch draws fresh samples
+        void set_accumulation (const bool on) override
+        {
+            this->accumulate = on;
+            this->acc.clear();
+        }
+        std::vector<Ommatidium>* ommatidia() override { return &scene->m_ommVecs[scene->getCameraIndex()]; }
+        std::vector<Ommatidium>* ommatidia_of (const int ci) override { return &scene->m_ommVecs[ci]; }
+
+        void add_scene_to (mplot::Visual<>* v, scene_draw_stats* stats) override
+        {
+            // The models keep pointers into view_scene, which lives as long as this backend
+            try {
+                threadpool pool;
+                cpu::scenecache::loaded l = cpu::scenecache::load (this->scene_path,
+                                                                   this->blender_axes ? cpu::blender_transform() : cpu::identity(),
+                                                                   this->scene_cache_dir, &pool);
+                this->view_scene = std::move (l.sc);
+            } catch (const std::exception& e) {
+                std::cerr << "Drawing the scene with compound-ray's models (" << e.what() << ")" << std::endl;
+                mplot::compoundray::scene_to_visualmodels (scene, v);
+                return;
+            }
+            const bool textured = std::any_of (this->view_scene.materials.begin(), this->view_scene.materials.end(),
+                                               [](const cpu::material& m) { return m.textured; });
+            if (textured) {
+                // demo::cpu doesn't sample textures, so leave a textured scene to compound-ray
+                this->view_scene = cpu::scene{};
+                mplot::compoundray::scene_to_visualmodels (scene, v);
+                return;
+            }
+            demo::scene_to_meshvisuals (this->view_scene, v, stats);
+        }
+
+    private:
+        /*
+         * Ray cast the eyes of cameras into out, one item after another (each laid out as
+         * render_eyes() lays out a frame). With poses, there is an item per poses.size() /
+         * cameras.size(), each camera is moved to its pose for the item as it is visited, and the
+         * cameras end at the poses they started at (with no accumulation). Without, there is one
+         * item at the cameras' own poses. The current camera is visited last in each item, so a
+         * single frame needs no switch back to it.
+         */
+        void render_items (const std::vector<int>& cameras, std::span<const sm::mat44<float>> poses,
+                           std::vector<std::array<float, 3>>& out)
+        {
+            const int cur = this->camera_index();
+            const std::size_t nc = cameras.size();
+            const std::size_t items = poses.empty() ? 1u : poses.size() / nc;
+            this->starts.assign (1u, 0u);
+            this->order.clear();
+            for (std::size_t k = 0; k < nc; ++k) {
+                this->starts.push_back (this->starts.back() + this->ommatidia_of (cameras[k])->size());
+                if (cameras[k] != cur) { this->order.push_back (k); }
+            }
+            for (std::size_t k = 0; k < nc; ++k) { if (cameras[k] == cur) { this->order.push_back (k); } }
+            const std::size_t frame = this->starts.back();
+            out.resize (items * frame);
+            this->saved.resize (nc);
+            for (std::size_t b = 0; b < items; ++b) {
+                for (std::size_t k : this->order) {
+                    if (this->camera_index() != cameras[k]) { gotoCamera (cameras[k]); }
+                    if (!poses.empty()) {
+                        if (b == 0u) { this->saved[k] = this->camera_space(); }
+                        this->set_camera_space (poses[b * nc + k]);
+                        renderFrame();
+                        getCameraData (this->eye_buf);
+                    } else {
+                        renderFrame();
+                        this->get_camera_data (this->eye_buf);
+                    }
+                    if (this->eye_buf.size() != this->starts[k + 1u] - this->starts[k]) {
+                        throw std::runtime_error ("optixbackend: an eye's output doesn't match its ommatidia");
+                    }
+                    std::copy (this->eye_buf.begin(), this->eye_buf.end(), out.begin() + b * frame + this->starts[k]);
+                }
+            }
+            if (!poses.empty()) {
+                for (std::size_t k : this->order) {
+                    if (this->camera_index() != cameras[k]) { gotoCamera (cameras[k]); }
+                    this->set_camera_space (this->saved[k]);
+                }
+            }
+            if (this->camera_index() != cur) { gotoCamera (cur); }
+        }
+
+        void accumulate_frame (std::vector<std::array<float, 3>>& out)
+        {
+            sm::mat44<float> cs = this->camera_space();
+            const int spo = this->samples_per_ommatidium();
+            const std::size_t ci = static_cast<std::size_t>(this->camera_index());
+            if (this->acc.size() <= ci) { this->acc.resize (ci + 1u); }
+            running_mean& a = this->acc[ci];
+            if (a.frames == 0u || cs.mat != a.pose.mat || spo != a.samples || out.size() != a.sum.size()) {
+                a.pose = cs;
+                a.samples = spo;
+                a.frames = 0u;
+                a.sum.assign (out.size(), { 0.0f, 0.0f, 0.0f });
+            }
+            ++a.frames;
+            const float f = 1.0f / static_cast<float>(a.frames);
+            for (std::size_t i = 0; i < out.size(); ++i) {
+                for (int c = 0; c < 3; ++c) {
+                    a.sum[i][c] += out[i][c];
+                    out[i][c] = a.sum[i][c] * f;
+                }
+            }
+        }
+
+        // The running mean of one camera's frames
+        struct running_mean
+        {
+            uint32_t frames = 0u;
+            sm::mat44<float> pose;
+            int samples = 0;
+            std::vector<std::array<float, 3>> sum;
+        };
+
+        uint64_t generation = 0u;
+        bool accumulate = false;
+        // For render_items(): where each eye's outputs begin in an item, the order the eyes are
+        // visited in, their poses before a batch and one eye's outputs
+        std::vector<std::size_t> starts;
+        std::vector<std::size_t> order;
+        std::vector<sm::mat44<float>> saved;
+        std::vector<std::array<float, 3>> eye_buf;
+        // One per camera
+        std::vector<running_mean> acc;
+        // The loaded glTF, and the window's copy of its meshes
+        std::string scene_path = "";
+        bool blender_axes = false;
+        cpu::scene view_scene;
+    };
+
+} // namespace
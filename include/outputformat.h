@@ -0,0 +1,230 @@
+/*
+ * Compact encodings of ommatidium outputs, for the streams that leave the renderer (frame files,
+ * HDF5 recordings and the shared memory ring).
+ *
+ * An ommatidium's output is 3 floats (12 bytes). An outputformat chooses the channels, RGB or
+ * Rec. 709 luminance, and the element type: float32, float16 (IEEE half precision) or uint8
+ * normalised so that 0 is 0.0 and 255 is 1.0 (values outside [0, 1] are clamped). The smallest,
+ * luminance as uint8, is 1 byte per ommatidium.
+ *
+ *   name      bytes per ommatidium
+ *   rgb-f32   12  (the renderer's own format)
+ *   rgb-f16    6
+ *   rgb-u8     3
+ *   lum-f32    4
+ *   lum-f16    2
+ *   lum-u8     1
+ *
+ * encode() and decode() are SIMD loops (the half precision conversions are branch free bit
+ * manipulation, with round to nearest even), so that encoding costs less than the bytes it saves.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <stdexcept>
+
+namespace demo
+{
+    struct outputformat
+    {
+        enum class element : uint32_t { f32 = 0u, f16 = 1u, u8 = 2u };
+
+        element type = element::f32;
+        bool luminance = false;
+
+        uint32_t channels() const { return this->luminance ? 1u : 3u; }
+        std::size_t element_bytes() const { return this->type == element::f32 ? 4u : (this->type == element::f16 ? 2u : 1u); }
+        std::size_t bytes_per_ommatidium() const { return this->channels() * this->element_bytes(); }
+        // Is this the renderer's own format (3 floats), which needs no encoding?
+        bool native() const { return this->type == element::f32 && !this->luminance; }
+
+        // As one uint32 for file and shared memory headers: the element in the low byte, 0x100 for luminance
+        uint32_t code() const { return static_cast<uint32_t>(this->type) | (this->luminance ? 0x100u : 0u); }
+        static outputformat from_code (const uint32_t c)
+        {
+            if ((c & 0xffu) > 2u || (c & ~0x1ffu) != 0u) { throw std::runtime_error ("outputformat: unknown code"); }
+            return outputformat { static_cast<element>(c & 0xffu), (c & 0x100u) != 0u };
+        }
+
+        std::string name() const
+        {
+            const char* t = this->type == element::f32 ? "f32" : (this->type == element::f16 ? "f16" : "u8");
+            return std::string (this->luminance ? "lum-" : "rgb-") + t;
+        }
+
+        // Parse a name from the table above
+        static outputformat parse (const std::string& s)
+        {
+            outputformat f;
+            const std::size_t dash = s.find ('-');
+            const std::string ch = s.substr (0, dash);
+            const std::string ty = dash == std::string::npos ? "" : s.substr (dash + 1);
+            if (ch == "lum") {
+                f.luminance = true;
+            } else if (ch != "rgb") {
+                throw std::runtime_error ("outputformat: unknown format '" + s + "' (use rgb-|lum- then f32|f16|u8)");
+            }
+            if (ty == "f32") {
+                f.type = element::f32;
+            } else if (ty == "f16") {
+                f.type = element::f16;
+            } else if (ty == "u8") {
+                f.type = element::u8;
+            } else {
+                throw std::runtime_error ("outputformat: unknown format '" + s + "' (use rgb-|lum- then f32|f16|u8)");
+            }
+            return f;
+        }
+    };
+
+    namespace outputcodec
+    {
+        // Rec. 709 luminance, as cpu::tracer::luminance
+        inline float luminance (const float r, const float g, const float b) { return 0.2126f * r + 0.7152f * g + 0.0722f * b; }
+
+        // float to IEEE half, rounding to nearest even (NaN stays NaN, overflow goes to infinity)
+        inline uint16_t to_half (const float f)
+        {
+            const uint32_t x = std::bit_cast<uint32_t>(f);
+            const uint32_t sign = (x >> 16) & 0x8000u;
+            const uint32_t a = x & 0x7fffffffu;
+            // Normal halves: rebias the exponent and round the mantissa to 10 bits
+            const uint32_t normal = (a + 0xc8000fffu + ((a >> 13) & 1u)) >> 13;
+            // Subnormal halves (and zero): let float addition do the shift and rounding
+            const float sub_f = std::bit_cast<float>(a) + std::bit_cast<float>(uint32_t{126u} << 23);
+            const uint32_t subnormal = std::bit_cast<uint32_t>(sub_f) - (uint32_t{126u} << 23);
+            // Overflow and infinity, or NaN
+            const uint32_t big = a > 0x7f800000u ? 0x7e00u : 0x7c00u;
+            const uint32_t h = a >= 0x47800000u ? big : (a < 0x38800000u ? subnormal : normal);
+            return static_cast<uint16_t>(h | sign);
+        }
+
+        // IEEE half to float (exact)
+        inline float from_half (const uint16_t hv)
+        {
+            const uint32_t h = hv;
+            const uint32_t e = h & 0x7c00u;
+            const uint32_t m = (h & 0x7fffu) << 13;
+            // Normal: rebias. Inf/NaN: all ones exponent. Subnormal: scale the mantissa as a float.
+            const uint32_t normal = m + (uint32_t{112u} << 23);
+            const uint32_t infnan = m + (uint32_t{224u} << 23);
+            const float sub_f = std::bit_cast<float>(m + (uint32_t{113u} << 23)) - std::bit_cast<float>(uint32_t{113u} << 23);
+            const uint32_t bits = e == 0x7c00u ? infnan : (e == 0u ? std::bit_cast<uint32_t>(sub_f) : normal);
+            return std::bit_cast<float>(bits | ((h & 0x8000u) << 16));
+        }
+
+        inline uint8_t to_u8 (const float f) { return static_cast<uint8_t>(std::clamp (f, 0.0f, 1.0f) * 255.0f + 0.5f); }
+        inline float from_u8 (const uint8_t v) { return static_cast<float>(v) * (1.0f / 255.0f); }
+
+        /*
+         * Encode n = in.size() ommatidium outputs into out, which must have room for
+         * n * fmt.bytes_per_ommatidium() bytes (it need not be aligned).
+         */
+        inline void encode (std::span<const std::array<float, 3>> in, const outputformat& fmt, uint8_t* out)
+        {
+            const std::size_t n = in.size();
+            const float* src = in.data()->data();
+            if (fmt.native()) {
+                std::copy (reinterpret_cast<const uint8_t*>(src), reinterpret_cast<const uint8_t*>(src + 3u * n), out);
+                return;
+            }
+            const std::size_t nv = n * fmt.channels();
+            switch (fmt.type) {
+            case outputformat::element::f32:
+            {
+                // Luminance
+#pragma omp simd
+                for (std::size_t i = 0; i < n; ++i) {
+                    const float l = luminance (src[3 * i], src[3 * i + 1], src[3 * i + 2]);
+                    std::copy_n (reinterpret_cast<const uint8_t*>(&l), 4u, out + 4u * i);
+                }
+                break;
+            }
+            case outputformat::element::f16:
+            {
+                if (fmt.luminance) {
+#pragma omp simd
+                    for (std::size_t i = 0; i < n; ++i) {
+                        const uint16_t h = to_half (luminance (src[3 * i], src[3 * i + 1], src[3 * i + 2]));
+                        out[2 * i] = static_cast<uint8_t>(h);
+                        out[2 * i + 1] = static_cast<uint8_t>(h >> 8);
+                    }
+                } else {
+#pragma omp simd
+                    for (std::size_t i = 0; i < nv; ++i) {
+                        const uint16_t h = to_half (src[i]);
+                        out[2 * i] = static_cast<uint8_t>(h);
+                        out[2 * i + 1] = static_cast<uint8_t>(h >> 8);
+                    }
+                }
+                break;
+            }
+            case outputformat::element::u8:
+            default:
+            {
+                if (fmt.luminance) {
+#pragma omp simd
+                    for (std::size_t i = 0; i < n; ++i) { out[i] = to_u8 (luminance (src[3 * i], src[3 * i + 1], src[3 * i + 2])); }
+                } else {
+#pragma omp simd
+                    for (std::size_t i = 0; i < nv; ++i) { out[i] = to_u8 (src[i]); }
+                }
+                break;
+            }
+            }
+        }
+
+        /*
+         * Decode out.size() ommatidium outputs of format fmt from in back to 3 floats each.
+         * Luminance is given in all three channels.
+         */
+        inline void decode (const uint8_t* in, const outputformat& fmt, std::span<std::array<float, 3>> out)
+        {
+            const std::size_t n = out.size();
+            float* dst = out.data()->data();
+            const std::size_t nv = n * fmt.channels();
+            // Write the channels (nv values), then spread luminance across r, g and b
+            switch (fmt.type) {
+            case outputformat::element::f32:
+            {
+                std::copy (in, in + 4u * nv, reinterpret_cast<uint8_t*>(dst));
+                break;
+            }
+            case outputformat::element::f16:
+            {
+#pragma omp simd
+                for (std::size_t i = 0; i < nv; ++i) {
+                    dst[i] = from_half (static_cast<uint16_t>(in[2 * i] | (in[2 * i + 1] << 8)));
+                }
+                break;
+            }
+            case outputformat::element::u8:
+            default:
+            {
+#pragma omp simd
+                for (std::size_t i = 0; i < nv; ++i) { dst[i] = from_u8 (in[i]); }
+                break;
+            }
+            }
+            if (fmt.luminance) {
+                // Backwards, so that no luminance is overwritten before it is spread
+                for (std::size_t i = n; i-- > 0u;) {
+                    const float l = dst[i];
+                    dst[3 * i] = l;
+                    dst[3 * i + 1] = l;
+                    dst[3 * i + 2] = l;
+                }
+            }
+        }
+    } // namespace outputcodec
+
+} // namespace
@@ -0,0 +1,184 @@
+/*
+ * Pipelined ray casting. A worker thread owns the eyebackend and ray casts frame N+1 while the
+ * GUI thread draws frame N. Camera requests go to the worker, and finished frames come back,
+ * through lock-free triple buffers (demo::triplebuffer), so neither thread takes a lock on the
+ * hot path.
+ *
+ * The worker ray casts all the eyes of an eyerig; the request's pose is the rig's primary camera
+ * pose. While the pipeline runs, only the worker may call the backend. If reuse_frames is true, the
+ * worker skips ray casting while the request and the scene are unchanged (see render_cache) and
+ * sleeps until the next request. If given a retina::bank, the worker filters each frame with it
+ * straight after the ray cast, so that frames arrive post-processed.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <thread>
+#include <stdexcept>
+#include <vector>
+
+#include <sm/mat44>
+
+#include "eyebackend.h"
+#include "eyerig.h"
+#include "retina.h"
+#include "triplebuffer.h"
+#include "rendercache.h"
+#include "cpuinterop.h"
+
+namespace demo
+{
+    // One completed ray casting frame
+    struct eyeframe
+    {
+        // Every eye's outputs, one eye after another (see eyerig::starts)
+        std::vector<std::array<float, 3>> data;
+        // The primary camera's pose
+        sm::mat44<float> pose;
+        int samples = 0;
+        uint64_t id = 0u;
+        // The step of the request that the frame was ray cast for
+        uint64_t step = 0u;
+        // How long the ray cast took, in milliseconds
+        double render_ms = 0.0;
+        // How long the retina's filters took, in milliseconds
+        double retina_ms = 0.0;
+    };
+
+    // What the GUI asks the ray caster to render
+    struct eyerequest
+    {
+        sm::mat44<float> pose;
+        int samples = 1;
+        // The caller's step (e.g. simulation step) number, passed back in the eyeframe
+        uint64_t step = 0u;
+    };
+
+    struct raycast_pipeline
+    {
+        raycast_pipeline (eyebackend& _backend, const eyerig& _rig, const sm::mat44<float>& pose,
+                          const int samples, const bool reuse_frames = true, retina::bank* _retina = nullptr)
+            : backend (_backend), rig (_rig), retina_bank (_retina)
+        {
+            this->cache.enabled = reuse_frames;
+            this->requests.fill (eyerequest{ pose, samples, 0u });
+            this->worker = std::thread ([this]() { this->run(); });
+        }
+
+        raycast_pipeline (const raycast_pipeline&) = delete;
+        raycast_pipeline& operator= (const raycast_pipeline&) = delete;
+
+        ~raycast_pipeline()
+        {
+            this->stopping.store (true);
+            // Wake the worker if it's waiting for the GUI (atomic::wait needs the value to change)
+            this->consumed.store (std::numeric_limits<uint64_t>::max());
+            this->consumed.notify_all();
+            this->n_requests.fetch_add (1u);
+            this->n_requests.notify_all();
+            if (this->worker.joinable()) { this->worker.join(); }
+        }
+
+        // GUI thread: ask for the next frames to be rendered from this pose (for this step)
+        void request (const sm::mat44<float>& pose, const int samples, const uint64_t step = 0u)
+        {
+            eyerequest& r = this->requests.write_slot();
+            r.pose = pose;
+            r.samples = samples;
+            r.step = step;
+            this->requests.publish();
+            this->n_requests.fetch_add (1u, std::memory_order_release);
+            this->n_requests.notify_one();
+        }
+
+        /*
+         * GUI thread: the newest completed frame, or nullptr if there's nothing new since the last
+         * call. The frame remains the GUI thread's until the next call that returns non-null.
+         */
+        eyeframe* latest()
+        {
+            if (this->failed.load (std::memory_order_acquire)) { std::rethrow_exception (this->failure); }
+            if (!this->frames.update()) { return nullptr; }
+            eyeframe* f = &this->frames.read_slot();
+            this->consumed.store (f->id, std::memory_order_release);
+            this->consumed.notify_one();
+            return f;
+        }
+
+    private:
+        void run()
+        {
+            try {
+                eyerequest req = this->requests.read_slot();
+                uint64_t n = 0u;
+                while (!this->stopping.load (std::memory_order_relaxed)) {
+                    const uint64_t seen = this->n_requests.load (std::memory_order_acquire);
+                    if (this->requests.update()) { req = this->requests.read_slot(); }
+                    this->backend.set_camera_space (req.pose);
+                    if (req.samples != this->backend.samples_per_ommatidium()) { this->rig.set_samples (this->backend, req.samples); }
+
+                    render_key key { to_mat4 (req.pose), this->backend.samples_per_ommatidium(),
+                                     this->backend.camera_index(), this->backend.scene_generation() };
+                    if (this->cache.hit (key)) {
+                        // The GUI already has this frame; sleep until it asks for another
+                        this->n_requests.wait (seen, std::memory_order_acquire);
+                        continue;
+                    }
+
+                    if (!this->backend.is_compound_eye_active()) {
+                        // Fail loudly: latest() rethrows this on the GUI thread
+                        throw std::runtime_error ("raycast_pipeline: the backend's camera is not a compound eye");
+                    }
+                    eyeframe& f = this->frames.write_slot();
+                    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+                    this->rig.render (this->backend, f.data);
+                    std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+                    if (this->retina_bank != nullptr) { this->retina_bank->run (f.data); }
+                    std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+                    this->cache.store (key);
+
+                    f.pose = req.pose;
+                    f.step = req.step;
+                    f.samples = this->backend.samples_per_ommatidium();
+                    f.render_ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+                    f.retina_ms = std::chrono::duration<double, std::milli>(t2 - t1).count();
+                    f.id = ++n;
+                    this->frames.publish();
+
+                    // Keep at most one frame ahead of the GUI: start frame n+1 once frame n is taken
+                    uint64_t c = this->consumed.load (std::memory_order_acquire);
+                    while (c < n && !this->stopping.load (std::memory_order_relaxed)) {
+                        this->consumed.wait (c);
+                        c = this->consumed.load (std::memory_order_acquire);
+                    }
+                }
+            } catch (...) {
+                this->failure = std::current_exception();
+                this->failed.store (true, std::memory_order_release);
+            }
+        }
+
+        eyebackend& backend;
+        const eyerig rig;
+        retina::bank* retina_bank; // worker only
+        triplebuffer<eyerequest> requests;
+        triplebuffer<eyeframe> frames;
+        std::atomic<uint64_t> consumed = 0u;
+        // Counts requests, so that the worker can sleep until the next one
+        std::atomic<uint64_t> n_requests = 0u;
+        render_cache cache; // worker only
+        std::atomic<bool> stopping = false;
+        std::exception_ptr failure = nullptr;
+        std::atomic<bool> failed = false;
+        std::thread worker;
+    };
+
+} // namespace
@@ -0,0 +1,387 @@
+/*
+ * Record camera poses and ommatidium frames to HDF5 without holding up the render loop.
+ *
+ * record() copies a frame into a free slot of a fixed ring of preallocated slots and returns; a
+ * background thread takes frames from the ring in order and appends them to chunked, deflate
+ * compressed datasets. If the writer falls behind and the ring is full, record() drops the frame
+ * (it never waits for the disk) and counts it, unless wait_when_full is set. The file holds:
+ *
+ *   /frames      [n, n_ommatidia, channels]  ommatidium outputs (all the eyes of a rig, in turn)
+ *   /poses       float32 [n, 16]             camera localspace, column major
+ *   /steps       uint64  [n]                 the caller's step (or frame) number
+ *   /timestamps  float64 [n]                 seconds since the recorder was created
+ *
+ * /frames is float32 RGB unless another outputformat is chosen, in which case record() encodes
+ * each frame as it copies it (so the queue holds fewer bytes too): float16 is stored as HDF5's
+ * IEEE half type and uint8 as 0-255 for 0.0-1.0. Once closed, the root has the attributes
+ * n_ommatidia, frames_written, frames_dropped and format (the outputformat's name).
+ *
+ * Given an event threshold >= 0, the recorder stores events (see eventstream.h) in place of
+ * /frames: record() encodes each frame it queues against the frames queued before it, and the
+ * file holds
+ *
+ *   /event_counts   uint32 [n]                  events of each frame
+ *   /keyframes      uint8  [n]                  1 if the frame's events are every ommatidium
+ *   /event_indices  uint32 [events]             the ommatidia of each frame's events, in turn
+ *   /event_values   [events, channels]          their values, in the outputformat
+ *
+ * with the attributes event_threshold (float32) and keyframe_interval. Keyframes list their
+ * indices too (0 to n_ommatidia - 1), so frame i's events start at the sum of the counts before
+ * it. Dropped frames are never encoded, so the events of the frames that are written decode
+ * correctly. Only the writer thread calls HDF5 while recording.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdexcept>
+
+#include <hdf5.h>
+
+#include "outputformat.h"
+#include "eventstream.h"
+
+namespace demo
+{
+    struct h5recorder
+    {
+        using sc = std::chrono::steady_clock;
+
+        /*
+         * Create (truncating) the HDF5 file at path for frames of n_ommatidia. queue_frames is the
+         * ring's size: how many frames the writer may fall behind before frames are dropped. With
+         * event_threshold >= 0, record events rather than frames (see above).
+         */
+        h5recorder (const std::string& path, const std::size_t _n_ommatidia, const std::size_t queue_frames = 64u,
+                    const unsigned int deflate_level = 4u, const outputformat _format = {},
+                    const float event_threshold = -1.0f, const uint32_t keyframe_interval = 60u)
+            : n_ommatidia (_n_ommatidia), format (_format), t0 (sc::now())
+        {
+            if (this->n_ommatidia == 0u) { throw std::runtime_error ("h5recorder: no ommatidia"); }
+            if (event_threshold >= 0.0f) {
+                this->encoder = std::make_unique<eventencoder> (this->n_ommatidia, event_threshold, keyframe_interval, this->format);
+            }
+            this->slots.resize (std::max<std::size_t> (queue_frames, 2u));
+            for (auto& s : this->slots) {
+                s.data.resize (this->n_ommatidia * this->format.bytes_per_ommatidium());
+                if (this->encoder) { s.indices.reserve (this->n_ommatidia); }
+            }
+
+            this->file = H5Fcreate (path.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+            if (this->file < 0) { throw std::runtime_error ("h5recorder: could not create '" + path + "'"); }
+
+            // Chunks of about 1 MB: whole frames for small eyes, parts of a frame for large ones
+            const hsize_t nch = this->format.channels();
+            const hsize_t frame_bytes = static_cast<hsize_t>(this->n_ommatidia) * this->format.bytes_per_ommatidium();
+            const hsize_t per_chunk = hsize_t{1} << 20;
+            const hsize_t chunk_frames = std::clamp<hsize_t> (per_chunk / frame_bytes, 1u, 64u);
+            const hsize_t chunk_omm = std::min<hsize_t> (this->n_ommatidia,
+                                                         std::max<hsize_t> (per_chunk / this->format.bytes_per_ommatidium(), 1u));
+            this->frame_type = this->element_type();
+            if (this->encoder) {
+                const hsize_t chunk_events = std::max<hsize_t> (per_chunk / this->format.bytes_per_ommatidium(), 1u);
+                this->event_counts = this->make_dataset ("/event_counts", H5T_NATIVE_UINT32, { 0 }, { 1024 }, deflate_level);
+                this->keyframes = this->make_dataset ("/keyframes", H5T_NATIVE_UINT8, { 0 }, { 1024 }, deflate_level);
+                this->event_indices = this->make_dataset ("/event_indices", H5T_NATIVE_UINT32, { 0 },
+                                                          { std::max<hsize_t> (per_chunk / 4u, 1u) }, deflate_level);
+                this->event_values = this->make_dataset ("/event_values", this->frame_type, { 0, nch },
+                                                         { chunk_events, nch }, deflate_level);
+            } else {
+                this->frames = this->make_dataset ("/frames", this->frame_type, { 0, this->n_ommatidia, nch },
+                                                   { chunk_frames, chunk_omm, nch }, deflate_level);
+            }
+            this->poses = this->make_dataset ("/poses", H5T_NATIVE_FLOAT, { 0, 16 }, { 256, 16 }, deflate_level);
+            this->steps = this->make_dataset ("/steps", H5T_NATIVE_UINT64, { 0 }, { 1024 }, deflate_level);
+            this->timestamps = this->make_dataset ("/timestamps", H5T_NATIVE_DOUBLE, { 0 }, { 1024 }, deflate_level);
+
+            this->writer = std::thread ([this]() { this->run(); });
+        }
+
+        // If true, record() waits for a free slot rather than dropping the frame (for batch runs)
+        bool wait_when_full = false;
+
+        h5recorder (const h5recorder&) = delete;
+        h5recorder& operator= (const h5recorder&) = delete;
+
+        // Write out the frames still queued, then close the file
+        ~h5recorder()
+        {
+            this->stopping.store (true);
+            this->wake.fetch_add (1u);
+            this->wake.notify_one();
+            if (this->writer.joinable()) { this->writer.join(); }
+            this->close_file();
+        }
+
+        /*
+         * Queue a frame for writing. Unless wait_when_full, never blocks: returns false, counting the
+         * frame as dropped, if the writer is too far behind. Call from one thread. Rethrows any error
+         * of the writer.
+         */
+        bool record (const uint64_t step, const std::array<float, 16>& pose, std::span<const std::array<float, 3>> data)
+        {
+            if (this->failed.load (std::memory_order_acquire)) { std::rethrow_exception (this->failure); }
+            if (data.size() != this->n_ommatidia) { throw std::runtime_error ("h5recorder: wrong number of ommatidia"); }
+            const uint64_t head = this->published.load (std::memory_order_relaxed);
+            uint64_t tail = this->consumed.load (std::memory_order_acquire);
+            while (this->wait_when_full && head - tail >= this->slots.size()) {
+                const uint64_t seen = this->freed.load (std::memory_order_acquire);
+                if (this->failed.load (std::memory_order_acquire)) { break; }
+                tail = this->consumed.load (std::memory_order_acquire);
+                if (head - tail < this->slots.size()) { break; }
+                this->freed.wait (seen, std::memory_order_acquire);
+                tail = this->consumed.load (std::memory_order_acquire);
+            }
+            if (this->failed.load (std::memory_order_acquire)) { std::rethrow_exception (this->failure); }
+            if (head - tail >= this->slots.size()) {
+                this->dropped.fetch_add (1u, std::memory_order_relaxed);
+                return false;
+            }
+            slot& s = this->slots[head % this->slots.size()];
+            s.step = step;
+            s.pose = pose;
+            s.seconds = std::chrono::duration<double>(sc::now() - this->t0).count();
+            if (this->encoder) {
+                // Only frames that have a slot are encoded, so the file's events follow on from each other
+                this->encoder->encode (data, this->events);
+                s.keyframe = this->events.keyframe;
+                s.indices.clear();
+                if (this->events.keyframe) {
+                    for (uint32_t i = 0; i < this->n_ommatidia; ++i) { s.indices.push_back (i); }
+                } else {
+                    s.indices.assign (this->events.indices.begin(), this->events.indices.end());
+                }
+                const std::size_t bytes = this->events.size() * this->format.bytes_per_ommatidium();
+                const uint8_t* src = this->format.native() ? reinterpret_cast<const uint8_t*>(this->events.values.data())
+                                                           : this->encoder->encoded().data();
+                std::copy (src, src + bytes, s.data.begin());
+            } else {
+                outputcodec::encode (data, this->format, s.data.data());
+            }
+            this->published.store (head + 1u, std::memory_order_release);
+            this->wake.fetch_add (1u, std::memory_order_release);
+            this->wake.notify_one();
+            return true;
+        }
+
+        // Frames written to the file so far, and frames dropped because the queue was full
+        uint64_t written() const { return this->consumed.load (std::memory_order_acquire); }
+        // With events, the mean fraction of ommatidia per recorded frame that emitted (else 0)
+        double event_fraction() const { return this->encoder ? this->encoder->event_fraction() : 0.0; }
+        uint64_t dropped_frames() const { return this->dropped.load (std::memory_order_relaxed); }
+        // Frames waiting to be written
+        uint64_t queued() const
+        {
+            return this->published.load (std::memory_order_acquire) - this->consumed.load (std::memory_order_acquire);
+        }
+
+    private:
+        struct slot
+        {
+            uint64_t step = 0u;
+            std::array<float, 16> pose = {};
+            double seconds = 0.0;
+            // The frame, encoded in format (with events, the events' values)
+            std::vector<uint8_t> data;
+            // With events, the events' ommatidia
+            bool keyframe = false;
+            std::vector<uint32_t> indices;
+        };
+
+        // The HDF5 type of format's elements (little endian, as outputcodec writes them)
+        hid_t element_type() const
+        {
+            if (this->format.type == outputformat::element::f32) { return H5Tcopy (H5T_IEEE_F32LE); }
+            if (this->format.type == outputformat::element::u8) { return H5Tcopy (H5T_STD_U8LE); }
+            // IEEE half: sign bit 15, exponent bits 10-14 (bias 15), mantissa bits 0-9
+            const hid_t t = H5Tcopy (H5T_IEEE_F32LE);
+            H5Tset_fields (t, 15, 10, 5, 0, 10);
+            H5Tset_precision (t, 16);
+            H5Tset_size (t, 2);
+            H5Tset_ebias (t, 15);
+            return t;
+        }
+
+        hid_t make_dataset (const char* name, const hid_t type, const std::vector<hsize_t>& dims,
+                            const std::vector<hsize_t>& chunk, const unsigned int deflate_level)
+        {
+            std::vector<hsize_t> maxdims = dims;
+            maxdims[0] = H5S_UNLIMITED;
+            const hid_t space = H5Screate_simple (static_cast<int>(dims.size()), dims.data(), maxdims.data());
+            const hid_t dcpl = H5Pcreate (H5P_DATASET_CREATE);
+            H5Pset_chunk (dcpl, static_cast<int>(chunk.size()), chunk.data());
+            if (deflate_level > 0u) {
+                H5Pset_shuffle (dcpl);
+                H5Pset_deflate (dcpl, deflate_level);
+            }
+            // Room in the chunk cache for a whole row of chunks, so each is compressed once, when full
+            const hid_t dapl = H5Pcreate (H5P_DATASET_ACCESS);
+            H5Pset_chunk_cache (dapl, 12421, std::size_t{64} << 20, 1.0);
+            const hid_t ds = H5Dcreate2 (this->file, name, type, space, H5P_DEFAULT, dcpl, dapl);
+            H5Pclose (dapl);
+            H5Pclose (dcpl);
+            H5Sclose (space);
+            if (ds < 0) { throw std::runtime_error (std::string("h5recorder: could not create ") + name); }
+            return ds;
+        }
+
+        // Append rows (of row_dims, without the leading frame dimension) at index n of ds
+        static void append (const hid_t ds, const hid_t type, const hsize_t n, const std::vector<hsize_t>& row_dims,
+                            const void* buf, const hsize_t rows = 1u)
+        {
+            if (rows == 0u) { return; }
+            std::vector<hsize_t> extent (row_dims.size() + 1u);
+            std::vector<hsize_t> start (row_dims.size() + 1u, 0u);
+            std::vector<hsize_t> count (row_dims.size() + 1u);
+            extent[0] = n + rows;
+            start[0] = n;
+            count[0] = rows;
+            for (std::size_t i = 0; i < row_dims.size(); ++i) { extent[i + 1u] = count[i + 1u] = row_dims[i]; }
+            if (H5Dset_extent (ds, extent.data()) < 0) { throw std::runtime_error ("h5recorder: could not extend a dataset"); }
+            const hid_t fspace = H5Dget_space (ds);
+            H5Sselect_hyperslab (fspace, H5S_SELECT_SET, start.data(), nullptr, count.data(), nullptr);
+            const hid_t mspace = H5Screate_simple (static_cast<int>(count.size()), count.data(), nullptr);
+            const herr_t err = H5Dwrite (ds, type, mspace, fspace, H5P_DEFAULT, buf);
+            H5Sclose (mspace);
+            H5Sclose (fspace);
+            if (err < 0) { throw std::runtime_error ("h5recorder: write failed"); }
+        }
+
+        void run()
+        {
+            try {
+                for (;;) {
+                    const uint64_t seen = this->wake.load (std::memory_order_acquire);
+                    const uint64_t head = this->published.load (std::memory_order_acquire);
+                    uint64_t tail = this->consumed.load (std::memory_order_relaxed);
+                    if (tail == head) {
+                        if (this->stopping.load()) { break; }
+                        this->wake.wait (seen, std::memory_order_acquire);
+                        continue;
+                    }
+                    for (; tail < head; ++tail) {
+                        const slot& s = this->slots[tail % this->slots.size()];
+                        if (this->encoder) {
+                            const uint32_t n_events = static_cast<uint32_t>(s.indices.size());
+                            const uint8_t key = s.keyframe ? 1u : 0u;
+                            append (this->event_counts, H5T_NATIVE_UINT32, tail, {}, &n_events);
+                            append (this->keyframes, H5T_NATIVE_UINT8, tail, {}, &key);
+                            append (this->event_indices, H5T_NATIVE_UINT32, this->events_written, {}, s.indices.data(), n_events);
+                            append (this->event_values, this->frame_type, this->events_written, { this->format.channels() },
+                                    s.data.data(), n_events);
+                            this->events_written += n_events;
+                        } else {
+                            append (this->frames, this->frame_type, tail, { this->n_ommatidia, this->format.channels() }, s.data.data());
+                        }
+                        append (this->poses, H5T_NATIVE_FLOAT, tail, { 16 }, s.pose.data());
+                        append (this->steps, H5T_NATIVE_UINT64, tail, {}, &s.step);
+                        append (this->timestamps, H5T_NATIVE_DOUBLE, tail, {}, &s.seconds);
+                        // The slot is free again
+                        this->consumed.store (tail + 1u, std::memory_order_release);
+                        if (this->wait_when_full) {
+                            this->freed.fetch_add (1u, std::memory_order_release);
+                            this->freed.notify_one();
+                        }
+                    }
+                }
+            } catch (...) {
+                this->failure = std::current_exception();
+                this->failed.store (true, std::memory_order_release);
+                // Release a record() that is waiting for a slot
+                this->freed.fetch_add (1u, std::memory_order_release);
+                this->freed.notify_one();
+            }
+        }
+
+        void close_file()
+        {
+            if (this->file < 0) { return; }
+            auto attr = [this](const char* name, const uint64_t v) {
+                const hid_t space = H5Screate (H5S_SCALAR);
+                const hid_t a = H5Acreate2 (this->file, name, H5T_NATIVE_UINT64, space, H5P_DEFAULT, H5P_DEFAULT);
+                if (a >= 0) {
+                    H5Awrite (a, H5T_NATIVE_UINT64, &v);
+                    H5Aclose (a);
+                }
+                H5Sclose (space);
+            };
+            attr ("n_ommatidia", this->n_ommatidia);
+            attr ("frames_written", this->written());
+            attr ("frames_dropped", this->dropped_frames());
+            if (this->encoder) {
+                attr ("keyframe_interval", this->encoder->keyframe_interval);
+                const hid_t space = H5Screate (H5S_SCALAR);
+                const hid_t a = H5Acreate2 (this->file, "event_threshold", H5T_NATIVE_FLOAT, space, H5P_DEFAULT, H5P_DEFAULT);
+                if (a >= 0) {
+                    H5Awrite (a, H5T_NATIVE_FLOAT, &this->encoder->threshold);
+                    H5Aclose (a);
+                }
+                H5Sclose (space);
+            }
+            {
+                const std::string name = this->format.name();
+                const hid_t st = H5Tcopy (H5T_C_S1);
+                H5Tset_size (st, name.size());
+                const hid_t space = H5Screate (H5S_SCALAR);
+                const hid_t a = H5Acreate2 (this->file, "format", st, space, H5P_DEFAULT, H5P_DEFAULT);
+                if (a >= 0) {
+                    H5Awrite (a, st, name.c_str());
+                    H5Aclose (a);
+                }
+                H5Sclose (space);
+                H5Tclose (st);
+            }
+            for (hid_t ds : { this->frames, this->poses, this->steps, this->timestamps,
+                              this->event_counts, this->keyframes, this->event_indices, this->event_values }) {
+                if (ds >= 0) { H5Dclose (ds); }
+            }
+            if (this->frame_type >= 0) { H5Tclose (this->frame_type); }
+            H5Fclose (this->file);
+            this->file = -1;
+        }
+
+        const std::size_t n_ommatidia;
+        const outputformat format;
+        const sc::time_point t0;
+        std::vector<slot> slots;
+        // Frames queued and frames written (free-running; a frame's slot is its count modulo the ring size)
+        std::atomic<uint64_t> published = 0u;
+        std::atomic<uint64_t> consumed = 0u;
+        std::atomic<uint64_t> dropped = 0u;
+        // Bumped to wake the writer, and by the writer to wake a record() waiting for a slot
+        std::atomic<uint64_t> wake = 0u;
+        std::atomic<uint64_t> freed = 0u;
+        std::atomic<bool> stopping = false;
+        std::exception_ptr failure = nullptr;
+        std::atomic<bool> failed = false;
+        // With events: the encoder (used by record()), its last frame, and the events written (by the writer)
+        std::unique_ptr<eventencoder> encoder;
+        eventframe events;
+        hsize_t events_written = 0u;
+
+        hid_t file = -1;
+        hid_t frame_type = -1;
+        hid_t frames = -1;
+        hid_t poses = -1;
+        hid_t steps = -1;
+        hid_t timestamps = -1;
+        hid_t event_counts = -1;
+        hid_t keyframes = -1;
+        hid_t event_indices = -1;
+        hid_t event_values = -1;
+        std::thread writer;
+    };
+
+} // namespace
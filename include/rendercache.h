@@ -0,0 +1,59 @@
+/*
+ * Skip ray casting when nothing that the ray cast depends on has changed. A render_key holds
+ * what a frame depends on (the camera, its pose, its samples per ommatidium and the scene's
+ * generation, which counts scene loads). If the key matches the last frame's, that frame's
+ * output can be reused.
+ *
+ * With more than one sample per ommatidium, each frame draws fresh random samples, so a reused
+ * frame is not bit-identical to a new one. Set enabled = false to always re-render (e.g. to see
+ * or average the sampling noise).
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace demo
+{
+    struct render_key
+    {
+        std::array<float, 16> pose = {};
+        int samples = 0;
+        int camera = -1;
+        uint64_t scene_generation = 0u;
+        bool operator== (const render_key&) const = default;
+    };
+
+    struct render_cache
+    {
+        bool enabled = true;
+
+        // True (and counted as a hit) if key is that of the last frame, which can be reused
+        bool hit (const render_key& key)
+        {
+            if (this->enabled && this->valid && key == this->last) {
+                ++this->hits;
+                return true;
+            }
+            return false;
+        }
+        // Note the key of a frame that has just been rendered
+        void store (const render_key& key)
+        {
+            this->last = key;
+            this->valid = true;
+        }
+        void invalidate() { this->valid = false; }
+
+        // Frames reused so far
+        uint64_t hits = 0u;
+
+    private:
+        render_key last;
+        bool valid = false;
+    };
+
+} // namespace
@@ -0,0 +1,342 @@
+/*
+ * Retina post-processing of ommatidium outputs. A retina applies a chain of filters to each
+ * eye's outputs in the same frame as the ray cast, before they are published to the GUI or a
+ * brain model. The filters are:
+ *
+ *   luminance           RGB to luminance (Rec. 709 weights); later filters work on one channel
+ *   gain:<g>[:<o>]      x * g + o
+ *   rectify             max (x, 0)
+ *   inhibit:<s>         lateral inhibition, x - s * (mean of the neighbours' x)
+ *   smooth:<sigma>      Gaussian smoothing over the neighbours, sigma in radians
+ *
+ * and a chain is written as a comma separated list, such as "luminance,inhibit:0.8,rectify".
+ *
+ * The neighbours of each ommatidium come from its eye's kNN graph (see eyegraph.h), which is
+ * repacked with one column per neighbour slot (padded with zero weights where an ommatidium has
+ * fewer neighbours than the widest). The outputs are copied into structure-of-arrays form, so
+ * each filter is a loop over ommatidia that 'omp simd' turns into SSE/AVX code, with gathers for
+ * the neighbour terms. Both neighbourhood filters are the one weighted sum,
+ * y[i] = c[i] x[i] + sum_j w[j][i] x[nbr[j][i]], with weights precomputed at setup. Ommatidia are
+ * split into chunks over a thread pool.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "eyefile.h"
+#include "eyegraph.h"
+#include "threadpool.h"
+
+namespace demo::retina
+{
+    enum class op { luminance, gain, rectify, inhibit, smooth };
+
+    struct filter
+    {
+        op type = op::gain;
+        // gain: the gain. inhibit: the inhibition strength. smooth: sigma in radians.
+        float a = 1.0f;
+        // gain: the offset
+        float b = 0.0f;
+    };
+
+    // Parse a filter chain such as "luminance,inhibit:0.8,smooth:0.02,gain:2:0.1"
+    inline std::vector<filter> parse (const std::string& spec)
+    {
+        std::vector<filter> chain;
+        std::size_t p = 0u;
+        while (p < spec.size()) {
+            std::size_t q = spec.find (',', p);
+            if (q == std::string::npos) { q = spec.size(); }
+            std::vector<std::string> parts;
+            std::size_t r = p;
+            while (r <= q) {
+                std::size_t s = std::min (spec.find (':', r), q);
+                parts.push_back (spec.substr (r, s - r));
+                r = s + 1u;
+            }
+            p = q + 1u;
+            if (parts[0].empty()) { continue; }
+
+            filter f;
+            std::size_t nargs = 0u;
+            if (parts[0] == "luminance") {
+                f.type = op::luminance;
+            } else if (parts[0] == "gain") {
+                f.type = op::gain;
+                nargs = 2u;
+            } else if (parts[0] == "rectify") {
+                f.type = op::rectify;
+            } else if (parts[0] == "inhibit") {
+                f.type = op::inhibit;
+                nargs = 1u;
+            } else if (parts[0] == "smooth") {
+                f.type = op::smooth;
+                f.a = 0.05f;
+                nargs = 1u;
+            } else {
+                throw std::runtime_error ("retina: unknown filter '" + parts[0] + "'");
+            }
+            if (parts.size() > nargs + 1u) {
+                throw std::runtime_error ("retina: too many parameters for '" + parts[0] + "'");
+            }
+            if (parts.size() > 1u) { f.a = std::stof (parts[1]); }
+            if (parts.size() > 2u) { f.b = std::stof (parts[2]); }
+            if (f.type == op::smooth && !(f.a > 0.0f)) { throw std::runtime_error ("retina: smooth needs sigma > 0"); }
+            chain.push_back (f);
+        }
+        return chain;
+    }
+
+    // Does the chain need a neighbour graph?
+    inline bool needs_graph (const std::vector<filter>& chain)
+    {
+        return std::any_of (chain.begin(), chain.end(), [](const filter& f) {
+            return f.type == op::inhibit || f.type == op::smooth;
+        });
+    }
+
+    // The filter chain for one eye
+    struct processor
+    {
+        // Ommatidia per chunk of work (a multiple of the SIMD width)
+        static constexpr std::size_t grain = 4096u;
+
+        // Set up for an eye of g.size() ommatidia (g may be empty if the chain has no neighbourhood filters)
+        void setup (const eyegraph::graph& g, const std::size_t n_omm, const std::vector<filter>& _chain)
+        {
+            this->chain = _chain;
+            this->n = n_omm;
+            this->width = 0u;
+            if (needs_graph (this->chain)) {
+                if (g.size() != n_omm) { throw std::runtime_error ("retina: the neighbour graph doesn't match the eye"); }
+                for (std::size_t i = 0; i < n_omm; ++i) {
+                    this->width = std::max (this->width, static_cast<std::size_t>(g.offsets[i + 1u] - g.offsets[i]));
+                }
+            }
+            // Neighbour slot j of ommatidium i is nbr[j * n + i]; unused slots point at i itself
+            this->nbr.assign (this->width * n_omm, 0u);
+            for (std::size_t j = 0; j < this->width; ++j) {
+                for (std::size_t i = 0; i < n_omm; ++i) {
+                    const std::size_t deg = g.offsets[i + 1u] - g.offsets[i];
+                    this->nbr[j * n_omm + i] = j < deg ? g.indices[g.offsets[i] + j] : static_cast<uint32_t>(i);
+                }
+            }
+            // The weights of each neighbourhood filter
+            this->centre.assign (this->chain.size(), {});
+            this->weights.assign (this->chain.size(), {});
+            for (std::size_t fi = 0; fi < this->chain.size(); ++fi) {
+                const filter& f = this->chain[fi];
+                if (f.type != op::inhibit && f.type != op::smooth) { continue; }
+                std::vector<float>& c = this->centre[fi];
+                std::vector<float>& w = this->weights[fi];
+                c.assign (n_omm, 1.0f);
+                w.assign (this->width * n_omm, 0.0f);
+                const float inv_2s2 = f.type == op::smooth ? 1.0f / (2.0f * f.a * f.a) : 0.0f;
+                for (std::size_t i = 0; i < n_omm; ++i) {
+                    const std::size_t deg = g.offsets[i + 1u] - g.offsets[i];
+                    if (deg == 0u) { continue; }
+                    if (f.type == op::inhibit) {
+                        for (std::size_t j = 0; j < deg; ++j) { w[j * n_omm + i] = -f.a / static_cast<float>(deg); }
+                    } else {
+                        // Normalised Gaussian weights; the ommatidium itself is at angle 0
+                        float sum = 1.0f;
+                        for (std::size_t j = 0; j < deg; ++j) {
+                            const float ang = g.angles[g.offsets[i] + j];
+                            w[j * n_omm + i] = std::exp (-ang * ang * inv_2s2);
+                            sum += w[j * n_omm + i];
+                        }
+                        c[i] = 1.0f / sum;
+                        for (std::size_t j = 0; j < deg; ++j) { w[j * n_omm + i] *= c[i]; }
+                    }
+                }
+            }
+            for (int ch = 0; ch < 3; ++ch) {
+                this->x[ch].assign (n_omm, 0.0f);
+                this->y[ch].assign (n_omm, 0.0f);
+            }
+        }
+
+        bool empty() const { return this->chain.empty(); }
+
+        // Filter one eye's outputs in place
+        void run (std::span<std::array<float, 3>> data, threadpool& pool)
+        {
+            if (this->chain.empty() || data.empty()) { return; }
+            if (data.size() != this->n) { throw std::runtime_error ("retina: the eye's outputs don't match its ommatidia"); }
+            const std::size_t nn = this->n;
+
+            // To structure-of-arrays
+            pool.parallel_for (nn, grain, [&](std::size_t b, std::size_t e) {
+                float* r = this->x[0].data();
+                float* gr = this->x[1].data();
+                float* bl = this->x[2].data();
+                const std::array<float, 3>* d = data.data();
+                for (std::size_t i = b; i < e; ++i) {
+                    r[i] = d[i][0];
+                    gr[i] = d[i][1];
+                    bl[i] = d[i][2];
+                }
+            });
+            this->channels = 3;
+
+            for (std::size_t fi = 0; fi < this->chain.size(); ++fi) {
+                const filter& f = this->chain[fi];
+                switch (f.type) {
+                case op::luminance:
+                {
+                    if (this->channels == 1) { break; }
+                    pool.parallel_for (nn, grain, [&](std::size_t b, std::size_t e) {
+                        float* r = this->x[0].data();
+                        const float* gr = this->x[1].data();
+                        const float* bl = this->x[2].data();
+#pragma omp simd
+                        for (std::size_t i = b; i < e; ++i) { r[i] = 0.2126f * r[i] + 0.7152f * gr[i] + 0.0722f * bl[i]; }
+                    });
+                    this->channels = 1;
+                    break;
+                }
+                case op::gain:
+                {
+                    pool.parallel_for (nn, grain, [&](std::size_t b, std::size_t e) {
+                        for (int ch = 0; ch < this->channels; ++ch) {
+                            float* v = this->x[ch].data();
+                            const float g = f.a;
+                            const float o = f.b;
+#pragma omp simd
+                            for (std::size_t i = b; i < e; ++i) { v[i] = v[i] * g + o; }
+                        }
+                    });
+                    break;
+                }
+                case op::rectify:
+                {
+                    pool.parallel_for (nn, grain, [&](std::size_t b, std::size_t e) {
+                        for (int ch = 0; ch < this->channels; ++ch) {
+                            float* v = this->x[ch].data();
+#pragma omp simd
+                            for (std::size_t i = b; i < e; ++i) { v[i] = std::max (v[i], 0.0f); }
+                        }
+                    });
+                    break;
+                }
+                case op::inhibit:
+                case op::smooth:
+                {
+                    const float* c = this->centre[fi].data();
+                    const float* w = this->weights[fi].data();
+                    pool.parallel_for (nn, grain, [&](std::size_t b, std::size_t e) {
+                        for (int ch = 0; ch < this->channels; ++ch) {
+                            const float* src = this->x[ch].data();
+                            float* dst = this->y[ch].data();
+#pragma omp simd
+                            for (std::size_t i = b; i < e; ++i) { dst[i] = c[i] * src[i]; }
+                            for (std::size_t j = 0; j < this->width; ++j) {
+                                const uint32_t* nj = this->nbr.data() + j * nn;
+                                const float* wj = w + j * nn;
+#pragma omp simd
+                                for (std::size_t i = b; i < e; ++i) { dst[i] += wj[i] * src[nj[i]]; }
+                            }
+                        }
+                    });
+                    for (int ch = 0; ch < this->channels; ++ch) { this->x[ch].swap (this->y[ch]); }
+                    break;
+                }
+                }
+            }
+
+            // Back to RGB triples (grey if the chain took the luminance)
+            pool.parallel_for (nn, grain, [&](std::size_t b, std::size_t e) {
+                const float* r = this->x[0].data();
+                const float* gr = this->x[this->channels == 1 ? 0 : 1].data();
+                const float* bl = this->x[this->channels == 1 ? 0 : 2].data();
+                std::array<float, 3>* d = data.data();
+                for (std::size_t i = b; i < e; ++i) { d[i] = { r[i], gr[i], bl[i] }; }
+            });
+        }
+
+    private:
+        std::vector<filter> chain;
+        std::size_t n = 0u;
+        // The largest number of neighbours of any ommatidium
+        std::size_t width = 0u;
+        std::vector<uint32_t> nbr;
+        // Per filter (empty for pointwise filters): centre weights c[i], neighbour weights w[j * n + i]
+        std::vector<std::vector<float>> centre;
+        std::vector<std::vector<float>> weights;
+        // The working channels and the neighbourhood filters' output
+        std::array<std::vector<float>, 3> x;
+        std::array<std::vector<float>, 3> y;
+        int channels = 3;
+    };
+
+    // A retina for each eye of a rig, and the threads that run them
+    struct bank
+    {
+        explicit bank (unsigned int n_threads = 0u) : pool (n_threads) {}
+
+        /*
+         * Set up the chain for each eye, given its ommatidia in omms. The eyes' outputs lie one
+         * after another in a frame, as eyerig lays them out (see eyerig::eye_ommatidia). If the
+         * chain needs each eye's neighbour graph (of k nearest neighbours, made symmetric), it is
+         * read from beside the eye's file in eye_paths, where eye_neighbours -s -k <k> stores it
+         * (see eyegraph::load_or_build), or else built here from the eye's ommatidia.
+         */
+        void setup (const std::vector<std::vector<eyefile::ommatidium>>& omms, const std::vector<std::string>& eye_paths,
+                    const std::vector<filter>& chain, const unsigned int k = 6u)
+        {
+            this->eyes.assign (omms.size(), processor{});
+            this->starts.assign (1u, 0u);
+            const bool graph = needs_graph (chain);
+            for (std::size_t e = 0; e < omms.size(); ++e) {
+                eyegraph::graph g;
+                const std::string path = e < eye_paths.size() ? eye_paths[e] : std::string{};
+                std::error_code ec;
+                if (graph && !path.empty() && std::filesystem::exists (path, ec)) {
+                    try {
+                        g = eyegraph::load_or_build (path, k, this->pool, true, false);
+                    } catch (const std::exception&) {
+                        // An unreadable eye or graph file; build from the ommatidia below
+                        g = eyegraph::graph{};
+                    }
+                }
+                if (graph && g.size() != omms[e].size()) {
+                    // No eye file to hand, or it doesn't match the eye that is ray cast: build from its ommatidia
+                    g = eyegraph::build (omms[e], k, this->pool, true);
+                }
+                this->eyes[e].setup (g, omms[e].size(), chain);
+                this->starts.push_back (this->starts.back() + omms[e].size());
+            }
+        }
+
+        bool empty() const { return this->eyes.empty() || this->eyes[0].empty(); }
+
+        // Filter a frame of the eyes' outputs in place
+        void run (std::span<std::array<float, 3>> frame)
+        {
+            if (this->empty() || frame.empty()) { return; }
+            if (frame.size() != this->starts.back()) { throw std::runtime_error ("retina: the frame doesn't match the eyes"); }
+            for (std::size_t e = 0; e < this->eyes.size(); ++e) {
+                this->eyes[e].run (frame.subspan (this->starts[e], this->starts[e + 1u] - this->starts[e]), this->pool);
+            }
+        }
+
+    private:
+        // Where each eye's outputs begin in a frame; starts.back() is the frame's size
+        std::vector<std::size_t> starts = { 0u };
+        std::vector<processor> eyes;
+        threadpool pool;
+    };
+
+} // namespace
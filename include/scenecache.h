@@ -0,0 +1,411 @@
+/*
+ * A cache of loaded CPU scenes. Parsing a large glTF (JSON, base64 buffers, index conversion)
+ * and building its BVH can take much longer than the rest of startup, so scenecache::load()
+ * writes the processed scene (flattened meshes, instance transforms, materials, cameras) and its
+ * BVH to a binary file, and later runs memory map that file instead.
+ *
+ * A cache file is keyed by the glTF file's contents and full path and by the world transform it
+ * was loaded with (so -b, the Blender axes, gets its own entry). The external buffers that the
+ * glTF reads are recorded with their hashes and checked on every load. Anything that doesn't
+ * match is a miss: the glTF is loaded (in parallel, on the given pool) and the cache rewritten.
+ *
+ *   bytes  0-7   magic "CRSCENE1"
+ *   bytes  8-11  uint32 version (2)
+ *   bytes 12-15  uint32 byte order mark, 0x01020304 as written by the host
+ *   bytes 16-23  uint64 key
+ *   bytes 24-31  uint64 payload size in bytes
+ *   bytes 32-    payload: dependencies, materials, meshes, instances, cameras, background shader,
+ *                up vector, then the BVH's nodes, triangles and triangle materials. Arrays are a
+ *                uint64 count then their elements; strings a uint64 length then their bytes.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cpumaths.h"
+#include "cpuscene.h"
+#include "cpubvh.h"
+#include "threadpool.h"
+
+namespace demo::cpu::scenecache
+{
+    static constexpr uint32_t version = 2u;
+
+    struct header
+    {
+        char magic[8] = { 'C', 'R', 'S', 'C', 'E', 'N', 'E', '1' };
+        uint32_t version = scenecache::version;
+        uint32_t byte_order = 0x01020304u;
+        uint64_t key = 0u;
+        uint64_t payload = 0u;
+    };
+    static_assert (sizeof (header) == 32, "scenecache::header should be 32 bytes");
+
+    // FNV-1a, a 64 bit word at a time
+    inline uint64_t hash_bytes (const void* data, const std::size_t n, uint64_t h = 14695981039346656037ull)
+    {
+        constexpr uint64_t prime = 1099511628211ull;
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        std::size_t i = 0u;
+        for (; i + 8u <= n; i += 8u) {
+            uint64_t w;
+            std::memcpy (&w, p + i, 8u);
+            h = (h ^ w) * prime;
+        }
+        for (; i < n; ++i) { h = (h ^ p[i]) * prime; }
+        return h;
+    }
+
+    inline uint64_t hash_file (const std::string& path)
+    {
+        std::ifstream f (path, std::ios::binary);
+        if (!f.is_open()) { throw std::runtime_error ("Could not open '" + path + "'"); }
+        std::vector<char> buf (std::size_t{1} << 20);
+        uint64_t h = hash_bytes (nullptr, 0u);
+        while (f) {
+            f.read (buf.data(), static_cast<std::streamsize>(buf.size()));
+            h = hash_bytes (buf.data(), static_cast<std::size_t>(f.gcount()), h);
+        }
+        return h;
+    }
+
+    // The cache entry's key: the glTF's contents and absolute path, the transform and the version
+    inline uint64_t make_key (const std::string& gltf_path, const mat4& world_transform)
+    {
+        const std::string abs = std::filesystem::absolute (gltf_path).lexically_normal().string();
+        uint64_t h = hash_file (gltf_path);
+        h = hash_bytes (abs.data(), abs.size(), h);
+        h = hash_bytes (world_transform.data(), sizeof (mat4), h);
+        return hash_bytes (&version, sizeof (version), h);
+    }
+
+    // $XDG_CACHE_HOME/c_ray_mathplot, or ~/.cache/c_ray_mathplot, or one in the temp directory
+    inline std::string default_dir()
+    {
+        namespace fs = std::filesystem;
+        if (const char* x = std::getenv ("XDG_CACHE_HOME"); x != nullptr && *x != '\0') {
+            return (fs::path(x) / "c_ray_mathplot").string();
+        }
+        if (const char* home = std::getenv ("HOME"); home != nullptr && *home != '\0') {
+            return (fs::path(home) / ".cache" / "c_ray_mathplot").string();
+        }
+        return (fs::temp_directory_path() / "c_ray_mathplot").string();
+    }
+
+    // Where the cache entry for key lives, e.g. <dir>/natural_env-0123456789abcdef.crscene
+    inline std::string cache_path (const std::string& dir, const std::string& gltf_path, const uint64_t key)
+    {
+        char hex[17];
+        static constexpr char digits[] = "0123456789abcdef";
+        for (int i = 0; i < 16; ++i) { hex[i] = digits[(key >> (60 - 4 * i)) & 0xfu]; }
+        hex[16] = '\0';
+        const std::string stem = std::filesystem::path(gltf_path).stem().string();
+        return (std::filesystem::path(dir) / (stem + "-" + hex + ".crscene")).string();
+    }
+
+    namespace detail
+    {
+        struct writer
+        {
+            std::ofstream& out;
+            uint64_t bytes = 0u;
+
+            void raw (const void* p, const std::size_t n)
+            {
+                this->out.write (static_cast<const char*>(p), static_cast<std::streamsize>(n));
+                this->bytes += n;
+            }
+            template <typename T>
+            void put (const T& v)
+            {
+                static_assert (std::is_trivially_copyable_v<T>);
+                this->raw (&v, sizeof (T));
+            }
+            void str (const std::string& s)
+            {
+                this->put (static_cast<uint64_t>(s.size()));
+                this->raw (s.data(), s.size());
+            }
+            template <typename T>
+            void vec (const std::vector<T>& v)
+            {
+                static_assert (std::is_trivially_copyable_v<T>);
+                this->put (static_cast<uint64_t>(v.size()));
+                this->raw (v.data(), v.size() * sizeof (T));
+            }
+        };
+
+        // Reads a memory mapped payload, throwing if it would read past the end
+        struct reader
+        {
+            const char* p = nullptr;
+            const char* end = nullptr;
+
+            void raw (void* dst, const std::size_t n)
+            {
+                if (n > static_cast<std::size_t>(this->end - this->p)) { throw std::runtime_error ("truncated"); }
+                if (n > 0u) { std::memcpy (dst, this->p, n); }
+                this->p += n;
+            }
+            template <typename T>
+            T get()
+            {
+                T v;
+                this->raw (&v, sizeof (T));
+                return v;
+            }
+            std::size_t count (const std::size_t elsize)
+            {
+                const uint64_t n = this->get<uint64_t>();
+                if (n > static_cast<uint64_t>(this->end - this->p) / std::max<std::size_t> (elsize, 1u)) {
+                    throw std::runtime_error ("truncated");
+                }
+                return static_cast<std::size_t>(n);
+            }
+            std::string str()
+            {
+                std::string s (this->count (1u), '\0');
+                this->raw (s.data(), s.size());
+                return s;
+            }
+            template <typename T>
+            void vec (std::vector<T>& v)
+            {
+                v.resize (this->count (sizeof (T)));
+                this->raw (v.data(), v.size() * sizeof (T));
+            }
+        };
+
+        // A read-only memory map of a whole file
+        struct mapping
+        {
+            explicit mapping (const std::string& path)
+            {
+                int fd = ::open (path.c_str(), O_RDONLY);
+                if (fd < 0) { return; }
+                struct stat st;
+                if (::fstat (fd, &st) == 0 && st.st_size > 0) {
+                    this->len = static_cast<std::size_t>(st.st_size);
+                    void* a = ::mmap (nullptr, this->len, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (a != MAP_FAILED) {
+                        this->addr = a;
+                        ::madvise (a, this->len, MADV_SEQUENTIAL);
+                    }
+                }
+                ::close (fd);
+            }
+            mapping (const mapping&) = delete;
+            mapping& operator= (const mapping&) = delete;
+            ~mapping() { if (this->addr != nullptr) { ::munmap (this->addr, this->len); } }
+
+            const char* data() const { return static_cast<const char*>(this->addr); }
+
+            void* addr = nullptr;
+            std::size_t len = 0u;
+        };
+    } // namespace detail
+
+    /*
+     * Write the scene and its BVH to path. The file is written alongside and renamed into place,
+     * so a reader never sees half a cache file.
+     */
+    inline void write (const std::string& path, const uint64_t key, const scene& sc, const bvh& accel)
+    {
+        namespace fs = std::filesystem;
+        const std::string tmp = path + ".tmp" + std::to_string (::getpid());
+        {
+            std::ofstream fout (tmp, std::ios::out | std::ios::trunc | std::ios::binary);
+            if (!fout.is_open()) { throw std::runtime_error ("Could not open '" + tmp + "' for writing"); }
+            header hdr;
+            hdr.key = key;
+            fout.write (reinterpret_cast<const char*>(&hdr), sizeof (hdr));
+
+            detail::writer w { fout };
+            w.put (static_cast<uint64_t>(sc.dependencies.size()));
+            for (const auto& d : sc.dependencies) {
+                w.str (fs::absolute (d).lexically_normal().string());
+                w.put (hash_file (d));
+            }
+            w.put (static_cast<uint64_t>(sc.materials.size()));
+            for (const auto& m : sc.materials) {
+                w.str (m.name);
+                w.put (m.colour);
+                w.put (static_cast<uint8_t>(m.textured));
+            }
+            w.put (static_cast<uint64_t>(sc.meshes.size()));
+            for (const auto& me : sc.meshes) {
+                w.str (me.name);
+                w.put (static_cast<uint64_t>(me.primitives.size()));
+                for (const auto& pr : me.primitives) {
+                    w.vec (pr.positions);
+                    w.vec (pr.normals);
+                    w.vec (pr.indices);
+                    w.put (static_cast<int32_t>(pr.material));
+                }
+            }
+            w.put (static_cast<uint64_t>(sc.instances.size()));
+            for (const auto& inst : sc.instances) {
+                w.str (inst.name);
+                w.put (inst.mesh);
+                w.put (inst.transform);
+            }
+            w.put (static_cast<uint64_t>(sc.cameras.size()));
+            for (const auto& c : sc.cameras) {
+                w.str (c.name);
+                w.put (c.pose);
+                // Eye paths may be relative to the working directory, so store them absolute
+                std::error_code ec;
+                w.str (!c.eye_path.empty() && fs::exists (c.eye_path, ec) ? fs::absolute (c.eye_path).string() : c.eye_path);
+                w.str (c.projection);
+            }
+            w.str (sc.background_shader);
+            w.put (sc.up);
+            w.vec (accel.nodes);
+            w.vec (accel.triangles);
+            w.vec (accel.materials);
+
+            hdr.payload = w.bytes;
+            fout.seekp (0);
+            fout.write (reinterpret_cast<const char*>(&hdr), sizeof (hdr));
+            fout.close();
+            if (!fout) {
+                fs::remove (tmp);
+                throw std::runtime_error ("Failed writing '" + tmp + "'");
+            }
+        }
+        fs::rename (tmp, path);
+    }
+
+    /*
+     * Read the cache file at path into sc and accel. Returns false (leaving them unchanged) if
+     * there is no such file, or it is for another key, or it is damaged, or any of the glTF's
+     * buffers has changed since it was written.
+     */
+    inline bool read (const std::string& path, const uint64_t key, scene& sc, bvh& accel)
+    {
+        detail::mapping mp (path);
+        if (mp.data() == nullptr || mp.len < sizeof (header)) { return false; }
+        header hdr;
+        std::memcpy (&hdr, mp.data(), sizeof (hdr));
+        const header expected;
+        if (std::memcmp (hdr.magic, expected.magic, sizeof (hdr.magic)) != 0 || hdr.version != version
+            || hdr.byte_order != expected.byte_order || hdr.key != key || hdr.payload != mp.len - sizeof (header)) {
+            return false;
+        }
+
+        scene s;
+        bvh b;
+        try {
+            detail::reader r { mp.data() + sizeof (header), mp.data() + mp.len };
+            s.dependencies.resize (r.count (16u));
+            for (auto& d : s.dependencies) {
+                d = r.str();
+                const uint64_t h = r.get<uint64_t>();
+                std::error_code ec;
+                if (!std::filesystem::exists (d, ec) || hash_file (d) != h) { return false; }
+            }
+            s.materials.resize (r.count (16u));
+            for (auto& m : s.materials) {
+                m.name = r.str();
+                m.colour = r.get<vec3>();
+                m.textured = r.get<uint8_t>() != 0u;
+            }
+            s.meshes.resize (r.count (16u));
+            for (auto& me : s.meshes) {
+                me.name = r.str();
+                me.primitives.resize (r.count (28u));
+                for (auto& pr : me.primitives) {
+                    r.vec (pr.positions);
+                    r.vec (pr.normals);
+                    r.vec (pr.indices);
+                    pr.material = r.get<int32_t>();
+                }
+            }
+            s.instances.resize (r.count (16u));
+            for (auto& inst : s.instances) {
+                inst.name = r.str();
+                inst.mesh = r.get<uint32_t>();
+                inst.transform = r.get<mat4>();
+                if (inst.mesh >= s.meshes.size()) { return false; }
+            }
+            s.cameras.resize (r.count (16u));
+            for (auto& c : s.cameras) {
+                c.name = r.str();
+                c.pose = r.get<mat4>();
+                c.eye_path = r.str();
+                c.projection = r.str();
+            }
+            s.background_shader = r.str();
+            s.up = r.get<vec3>();
+            r.vec (b.nodes);
+            r.vec (b.triangles);
+            r.vec (b.materials);
+            if (r.p != r.end || b.materials.size() != b.triangles.size()) { return false; }
+        } catch (const std::runtime_error&) {
+            return false;
+        }
+        sc = std::move (s);
+        accel = std::move (b);
+        return true;
+    }
+
+    struct loaded
+    {
+        scene sc;
+        bvh accel;
+        // True if the scene came from the cache; false if the glTF was parsed
+        bool from_cache = false;
+    };
+
+    /*
+     * Load the glTF at gltf_path through the cache in dir (no cache if dir is empty). On a miss
+     * the glTF is parsed, in parallel on pool if given, its BVH built and the cache entry written.
+     * Failing to write the cache (a read-only directory, say) is not an error.
+     */
+    inline loaded load (const std::string& gltf_path, const mat4& world_transform, const std::string& dir,
+                        threadpool* pool = nullptr)
+    {
+        loaded l;
+        uint64_t key = 0u;
+        std::string cpath;
+        if (!dir.empty()) {
+            key = make_key (gltf_path, world_transform);
+            cpath = cache_path (dir, gltf_path, key);
+            if (read (cpath, key, l.sc, l.accel)) {
+                l.sc.path = gltf_path;
+                l.from_cache = true;
+                return l;
+            }
+        }
+        l.sc = load_gltf (gltf_path, world_transform, pool);
+        l.accel.build (l.sc);
+        if (!dir.empty()) {
+            try {
+                std::filesystem::create_directories (dir);
+                write (cpath, key, l.sc, l.accel);
+            } catch (const std::exception&) {
+                // Carry on without the cache
+            }
+        }
+        return l;
+    }
+
+} // namespace
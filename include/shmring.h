@@ -0,0 +1,362 @@
+/*
+ * A POSIX shared memory ring of ommatidium frames, to pass each frame to brain models running in
+ * other processes without serialising it.
+ *
+ * shm::publisher (in the renderer) creates the shared memory object and writes each frame, with
+ * its camera pose and a timestamp, into the next slot of a ring. shm::reader (in any number of
+ * other processes) maps the object read-only and reads frames in place: no copies and no system
+ * calls per frame. The publisher never waits for readers. Each slot is guarded by a sequence
+ * number (a seqlock), so a reader that was too slow, and whose frame was overwritten while it
+ * read it, can tell: it checks frame::valid() after reading and then drops or retries the frame.
+ * With n slots, a frame stays intact until n - 1 newer frames have been published.
+ *
+ * The layout (all little or all big endian, as the host; see the byte order mark):
+ *
+ *   bytes  0-7    magic "CRSHMRNG"
+ *   bytes  8-11   uint32 version (2)
+ *   bytes 12-15   uint32 byte order mark, 0x01020304 as written by the host
+ *   bytes 16-23   uint64 ommatidia per frame, n
+ *   bytes 24-27   uint32 slots
+ *   bytes 28-31   uint32 data format, outputformat::code() (0 for float32 RGB)
+ *   bytes 32-39   uint64 bytes per slot
+ *   bytes 64-71   atomic uint64 id of the newest complete frame (0 before the first)
+ *   bytes 72-75   atomic uint32 closed (1 once the publisher has gone)
+ *   bytes 128-    the slots, each:
+ *     bytes  0-7    atomic uint64 sequence: 2 id - 1 while frame id is written, 2 id when done
+ *     bytes  8-15   int64 timestamp, steady clock (CLOCK_MONOTONIC) nanoseconds
+ *     bytes 16-19   int32 camera
+ *     bytes 32-95   float[16] camera localspace, column major
+ *     bytes 96-     n ommatidium outputs in the data format (float[n][3] for float32 RGB)
+ *
+ * The publisher may encode frames more compactly (see outputformat.h). frame::data() reads float32
+ * RGB frames in place; for other formats, read frame::bytes() or decode the frame into floats.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <span>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "outputformat.h"
+
+namespace demo::shm
+{
+    static_assert (std::atomic<uint64_t>::is_always_lock_free, "shm: needs lock-free 64 bit atomics");
+
+    constexpr std::array<char, 8> magic = { 'C', 'R', 'S', 'H', 'M', 'R', 'N', 'G' };
+    constexpr uint32_t version = 2u;
+    constexpr uint32_t bom = 0x01020304u;
+    constexpr std::size_t header_bytes = 128u;
+    constexpr std::size_t slot_header_bytes = 96u;
+
+    namespace detail
+    {
+        struct header
+        {
+            std::array<char, 8> magic;
+            uint32_t version;
+            uint32_t bom;
+            uint64_t n_ommatidia;
+            uint32_t n_slots;
+            uint32_t format;
+            uint64_t slot_bytes;
+            uint8_t pad[24];
+            std::atomic<uint64_t> head;
+            std::atomic<uint32_t> closed;
+        };
+        static_assert (offsetof (header, head) == 64u && sizeof (header) <= header_bytes);
+
+        struct slot
+        {
+            std::atomic<uint64_t> seq;
+            int64_t timestamp_ns;
+            int32_t camera;
+            uint8_t pad[12];
+            float pose[16];
+            // The ommatidium outputs follow
+        };
+        static_assert (offsetof (slot, pose) == 32u && sizeof (slot) == slot_header_bytes);
+
+        // Shared memory object names start with a single '/'
+        inline std::string object_name (const std::string& name) { return name.starts_with ("/") ? name : "/" + name; }
+
+        inline int64_t now_ns()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+    } // namespace detail
+
+    // Writes frames into a new shared memory ring. One producer thread.
+    struct publisher
+    {
+        publisher (const std::string& name, const std::size_t _n_ommatidia, const uint32_t n_slots = 8u,
+                   const outputformat _format = {})
+            : shm_name (detail::object_name (name)), n_ommatidia (_n_ommatidia), format (_format)
+        {
+            if (this->n_ommatidia == 0u || n_slots < 2u) { throw std::runtime_error ("shm::publisher: bad frame size or slots"); }
+            // Round slots up to whole cache lines so that they don't share them
+            this->slot_bytes = (slot_header_bytes + this->n_ommatidia * this->format.bytes_per_ommatidium() + 63u) & ~std::size_t{63};
+            this->len = header_bytes + n_slots * this->slot_bytes;
+
+            // Replace any ring left behind by a publisher that did not exit cleanly
+            ::shm_unlink (this->shm_name.c_str());
+            int fd = ::shm_open (this->shm_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+            if (fd < 0) { throw std::runtime_error ("shm::publisher: could not create '" + this->shm_name + "'"); }
+            if (::ftruncate (fd, static_cast<off_t>(this->len)) != 0) {
+                ::close (fd);
+                ::shm_unlink (this->shm_name.c_str());
+                throw std::runtime_error ("shm::publisher: could not size '" + this->shm_name + "'");
+            }
+            void* a = ::mmap (nullptr, this->len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close (fd);
+            if (a == MAP_FAILED) {
+                ::shm_unlink (this->shm_name.c_str());
+                throw std::runtime_error ("shm::publisher: could not map '" + this->shm_name + "'");
+            }
+            this->base = static_cast<uint8_t*>(a);
+
+            // The new object is zero filled; construct the atomics and then the header's fields
+            detail::header* h = this->hdr();
+            new (&h->head) std::atomic<uint64_t> (0u);
+            new (&h->closed) std::atomic<uint32_t> (0u);
+            for (uint32_t i = 0; i < n_slots; ++i) { new (&this->slot_at (i)->seq) std::atomic<uint64_t> (0u); }
+            h->n_ommatidia = this->n_ommatidia;
+            h->n_slots = n_slots;
+            h->slot_bytes = this->slot_bytes;
+            h->format = this->format.code();
+            h->version = version;
+            h->bom = bom;
+            // The magic goes last, so a reader that sees it sees a complete header
+            std::atomic_thread_fence (std::memory_order_release);
+            std::memcpy (h->magic.data(), magic.data(), magic.size());
+        }
+
+        publisher (const publisher&) = delete;
+        publisher& operator= (const publisher&) = delete;
+
+        // Mark the ring closed (readers holding it see closed()) and remove its name
+        ~publisher()
+        {
+            this->hdr()->closed.store (1u, std::memory_order_release);
+            ::munmap (this->base, this->len);
+            ::shm_unlink (this->shm_name.c_str());
+        }
+
+        // Write (encode) a frame into the next slot and make it the newest. Returns its id (from 1).
+        uint64_t publish (const std::array<float, 16>& pose, std::span<const std::array<float, 3>> data, const int camera = -1)
+        {
+            if (data.size() != this->n_ommatidia) { throw std::runtime_error ("shm::publisher: wrong number of ommatidia"); }
+            const uint64_t id = ++this->last_id;
+            detail::slot* s = this->slot_at (id % this->hdr()->n_slots);
+            s->seq.store (2u * id - 1u, std::memory_order_relaxed);
+            std::atomic_thread_fence (std::memory_order_release);
+            s->timestamp_ns = detail::now_ns();
+            s->camera = camera;
+            std::memcpy (s->pose, pose.data(), sizeof (s->pose));
+            outputcodec::encode (data, this->format, reinterpret_cast<uint8_t*>(s) + slot_header_bytes);
+            s->seq.store (2u * id, std::memory_order_release);
+            this->hdr()->head.store (id, std::memory_order_release);
+            return id;
+        }
+
+        const std::string& name() const { return this->shm_name; }
+
+    private:
+        detail::header* hdr() { return reinterpret_cast<detail::header*>(this->base); }
+        detail::slot* slot_at (const std::size_t i) { return reinterpret_cast<detail::slot*>(this->base + header_bytes + i * this->slot_bytes); }
+
+        std::string shm_name;
+        std::size_t n_ommatidia = 0u;
+        outputformat format;
+        std::size_t slot_bytes = 0u;
+        std::size_t len = 0u;
+        uint8_t* base = nullptr;
+        uint64_t last_id = 0u;
+    };
+
+    /*
+     * A frame read in place from the ring. Read what you need, then check valid(): if it is
+     * false, the publisher overwrote the frame while you read it and what you read is garbage.
+     */
+    struct frame
+    {
+        explicit operator bool() const { return this->s != nullptr; }
+        uint64_t id() const { return this->frame_id; }
+        const outputformat& format() const { return this->fmt; }
+        // The ommatidium outputs, in place. Only for float32 RGB rings; see bytes() and decode().
+        std::span<const std::array<float, 3>> data() const
+        {
+            if (!this->fmt.native()) { throw std::runtime_error ("shm::frame: the ring is " + this->fmt.name() + ", not float32 RGB"); }
+            return { reinterpret_cast<const std::array<float, 3>*>(this->bytes().data()), this->n };
+        }
+        // The encoded ommatidium outputs, in place
+        std::span<const uint8_t> bytes() const
+        {
+            return { reinterpret_cast<const uint8_t*>(this->s) + slot_header_bytes, this->n * this->fmt.bytes_per_ommatidium() };
+        }
+        // Decode the ommatidium outputs to float32 RGB into out (resized to the frame's ommatidia)
+        void decode (std::vector<std::array<float, 3>>& out) const
+        {
+            out.resize (this->n);
+            outputcodec::decode (this->bytes().data(), this->fmt, out);
+        }
+        std::span<const float, 16> pose() const { return std::span<const float, 16>(this->s->pose, 16u); }
+        int camera() const { return this->s->camera; }
+        // Steady clock time of publication. Processes on one host share this clock.
+        std::chrono::steady_clock::time_point timestamp() const
+        {
+            return std::chrono::steady_clock::time_point (std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                              std::chrono::nanoseconds (this->s->timestamp_ns)));
+        }
+        // Is the frame still intact (has it not been overwritten since it was taken)?
+        bool valid() const
+        {
+            if (this->s == nullptr) { return false; }
+            std::atomic_thread_fence (std::memory_order_acquire);
+            return this->s->seq.load (std::memory_order_relaxed) == 2u * this->frame_id;
+        }
+
+    private:
+        friend struct reader;
+        const detail::slot* s = nullptr;
+        uint64_t frame_id = 0u;
+        std::size_t n = 0u;
+        outputformat fmt;
+    };
+
+    // Reads frames from a publisher's ring, in another process (or the same one)
+    struct reader
+    {
+        // Map the ring called name. Throws if there is none (yet).
+        explicit reader (const std::string& name)
+        {
+            const std::string shm_name = detail::object_name (name);
+            int fd = ::shm_open (shm_name.c_str(), O_RDONLY, 0);
+            if (fd < 0) { throw std::runtime_error ("shm::reader: no ring called '" + shm_name + "'"); }
+            struct stat st;
+            if (::fstat (fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < header_bytes) {
+                ::close (fd);
+                throw std::runtime_error ("shm::reader: '" + shm_name + "' is not ready");
+            }
+            this->len = static_cast<std::size_t>(st.st_size);
+            void* a = ::mmap (nullptr, this->len, PROT_READ, MAP_SHARED, fd, 0);
+            ::close (fd);
+            if (a == MAP_FAILED) { throw std::runtime_error ("shm::reader: could not map '" + shm_name + "'"); }
+            this->base = static_cast<const uint8_t*>(a);
+            std::atomic_thread_fence (std::memory_order_acquire);
+            const detail::header* h = this->hdr();
+            bool ok = h->magic == magic && h->version == version && h->bom == bom
+                      && header_bytes + static_cast<std::size_t>(h->n_slots) * h->slot_bytes <= this->len;
+            if (ok) {
+                try {
+                    this->fmt = outputformat::from_code (h->format);
+                } catch (const std::exception&) {
+                    ok = false;
+                }
+                ok = ok && h->slot_bytes >= slot_header_bytes + h->n_ommatidia * this->fmt.bytes_per_ommatidium();
+            }
+            if (!ok) {
+                ::munmap (const_cast<uint8_t*>(this->base), this->len);
+                throw std::runtime_error ("shm::reader: '" + shm_name + "' is not a frame ring (or is not ready)");
+            }
+        }
+
+        reader (const reader&) = delete;
+        reader& operator= (const reader&) = delete;
+        ~reader() { ::munmap (const_cast<uint8_t*>(this->base), this->len); }
+
+        std::size_t n_ommatidia() const { return this->hdr()->n_ommatidia; }
+        std::size_t n_slots() const { return this->hdr()->n_slots; }
+        // The format of the ring's frames
+        const outputformat& format() const { return this->fmt; }
+        // The id of the newest frame (0 if none yet)
+        uint64_t newest() const { return this->hdr()->head.load (std::memory_order_acquire); }
+        // Has the publisher gone? (A new publisher makes a new ring; open it with a new reader.)
+        bool closed() const { return this->hdr()->closed.load (std::memory_order_acquire) != 0u; }
+
+        // The newest frame (empty if there is none yet)
+        frame latest() const
+        {
+            for (;;) {
+                const uint64_t id = this->newest();
+                if (id == 0u) { return frame{}; }
+                frame f = this->take (id);
+                if (f) { return f; }
+                // Lapped while looking; the head has moved on, so look again
+            }
+        }
+
+        /*
+         * The oldest frame after last_id that is still in the ring, to read every frame in turn.
+         * Empty if there is no newer frame. skipped is set to the frames missed since last_id.
+         */
+        frame next (const uint64_t last_id, uint64_t& skipped) const
+        {
+            skipped = 0u;
+            for (;;) {
+                const uint64_t head = this->newest();
+                if (head <= last_id) { return frame{}; }
+                // The slot after the head may be being written, so n - 1 frames are readable
+                const uint64_t oldest = head >= this->n_slots() ? head - this->n_slots() + 2u : 1u;
+                const uint64_t id = std::max (last_id + 1u, oldest);
+                skipped = id - last_id - 1u;
+                frame f = this->take (id);
+                if (f) { return f; }
+            }
+        }
+
+        /*
+         * Copy the newest frame into data (and its pose into pose), decoded to float32 RGB, retrying
+         * if it is overwritten while being copied. Returns its id, or 0 if there is none yet.
+         */
+        uint64_t copy_latest (std::vector<std::array<float, 3>>& data, std::array<float, 16>& pose) const
+        {
+            for (;;) {
+                frame f = this->latest();
+                if (!f) { return 0u; }
+                f.decode (data);
+                std::copy (f.pose().begin(), f.pose().end(), pose.begin());
+                if (f.valid()) { return f.id(); }
+            }
+        }
+
+    private:
+        const detail::header* hdr() const { return reinterpret_cast<const detail::header*>(this->base); }
+
+        // Frame id, if its slot holds it complete
+        frame take (const uint64_t id) const
+        {
+            const detail::slot* s = reinterpret_cast<const detail::slot*>(
+                this->base + header_bytes + (id % this->n_slots()) * this->hdr()->slot_bytes);
+            frame f;
+            if (s->seq.load (std::memory_order_acquire) != 2u * id) { return f; }
+            f.s = s;
+            f.frame_id = id;
+            f.n = this->n_ommatidia();
+            f.fmt = this->fmt;
+            return f;
+        }
+
+        const uint8_t* base = nullptr;
+        std::size_t len = 0u;
+        outputformat fmt;
+    };
+
+} // namespace
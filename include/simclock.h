@@ -0,0 +1,104 @@
+/*
+ * A fixed timestep simulation clock, to decouple simulated time from the display's frame rate.
+ *
+ * The simulation advances in steps of step_s simulated seconds. Each time round the main loop,
+ * due() says how many steps to take to keep simulated time at speed times wall clock time; when
+ * the display is slow this is several steps per loop (up to max_steps), and simulated speed no
+ * longer depends on the frame rate. With speed <= 0 the simulation runs as fast as it can, one
+ * step per loop, and display_due() throttles drawing the window to display_hz. While paused no
+ * steps are due, except one for each single-step request.
+ *
+ * If the steps cannot keep up (the ray casting is too slow for real time) the caller drops the
+ * backlog with fall_behind(), and the simulation then runs slower than requested rather than
+ * taking ever longer to catch up.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+namespace demo
+{
+    struct simclock
+    {
+        using sc = std::chrono::steady_clock;
+
+        // Simulated seconds per step
+        double step_s = 1.0 / 60.0;
+        // Simulated seconds per wall clock second; <= 0 to run as fast as possible
+        double speed = 1.0;
+        // Most steps in one loop
+        unsigned int max_steps = 8u;
+        // How often to draw the window, in Hz; 0 to draw every loop
+        double display_hz = 0.0;
+        // Wall clock seconds of steps per loop, after which the rest are given up (see fall_behind)
+        double budget_s = 1.0 / 30.0;
+
+        // Steps taken so far, and the simulated time
+        uint64_t steps = 0u;
+        double time() const { return static_cast<double>(this->steps) * this->step_s; }
+
+        bool unlimited() const { return !(this->speed > 0.0); }
+
+        // How many steps to take now (call once per loop). single_step is a request to take one
+        // step while paused.
+        unsigned int due (const bool paused, const bool single_step) { return this->due (paused, single_step, sc::now()); }
+
+        // due(), with the wall clock at now
+        unsigned int due (const bool paused, const bool single_step, const sc::time_point now)
+        {
+            const double wall_s = std::chrono::duration<double>(now - this->t_last).count();
+            this->t_last = now;
+            if (paused) {
+                this->backlog_s = 0.0;
+                return single_step ? 1u : 0u;
+            }
+            if (this->unlimited()) { return 1u; }
+            this->backlog_s += wall_s * this->speed;
+            const double n = std::floor (this->backlog_s / this->step_s);
+            if (n > static_cast<double>(this->max_steps)) {
+                this->backlog_s = 0.0;
+                return this->max_steps;
+            }
+            this->backlog_s -= n * this->step_s;
+            return static_cast<unsigned int>(n);
+        }
+
+        // Count a step taken
+        void stepped() { ++this->steps; }
+
+        // Give up on the steps still owed (simulated time then lags the requested speed)
+        void fall_behind() { this->backlog_s = 0.0; }
+
+        // Wall clock seconds until the next step is due (for an event wait timeout)
+        double until_due_s() const
+        {
+            if (this->unlimited()) { return 0.0; }
+            return std::max (0.0, (this->step_s - this->backlog_s) / this->speed);
+        }
+
+        // Is it time to draw the window? If so, the draw is counted as done.
+        bool display_due() { return this->display_due (sc::now()); }
+
+        // display_due(), with the wall clock at now
+        bool display_due (const sc::time_point now)
+        {
+            if (!(this->display_hz > 0.0)) { return true; }
+            if (std::chrono::duration<double>(now - this->t_display).count() < 1.0 / this->display_hz) { return false; }
+            this->t_display = now;
+            return true;
+        }
+
+    private:
+        sc::time_point t_last = sc::now();
+        sc::time_point t_display = {};
+        // Simulated seconds owed
+        double backlog_s = 0.0;
+    };
+
+} // namespace
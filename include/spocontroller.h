@@ -0,0 +1,74 @@
+/*
+ * An adaptive samples-per-ommatidium controller. It chooses the samples per ommatidium to hold
+ * the ray cast time of each frame near a target, for closed-loop experiments that need a fixed
+ * frame rate.
+ *
+ * Ray cast time is close to proportional to the samples per ommatidium. The controller smooths
+ * the measured time and leaves the samples alone while the smoothed time is within the band
+ * [low_fraction, high_fraction] x target. Outside the band it estimates the cost of one sample
+ * and jumps to the samples that would put the time in the middle of the band. The width of the
+ * band is the hysteresis; after each change the controller waits settle_frames before judging
+ * again, so one slow frame does not set it off.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+namespace demo
+{
+    struct spo_controller
+    {
+        // The ray cast time to aim for, in milliseconds
+        double target_ms = 16.0;
+        // The band of smoothed times, as fractions of target_ms, within which nothing changes
+        double low_fraction = 0.7;
+        double high_fraction = 1.0;
+        // Weight of the newest measurement in the smoothed time
+        double smoothing = 0.25;
+        // Frames to measure after a change before another change
+        unsigned int settle_frames = 4u;
+        // Largest factor by which one change may raise or lower the samples
+        int max_step = 4;
+        int min_samples = 1;
+        int max_samples = 32000;
+
+        /*
+         * Give the last frame's ray cast time (ms) and the samples per ommatidium it was cast
+         * with. Returns the samples per ommatidium for the next frame.
+         */
+        int update (const double raycast_ms, const int samples)
+        {
+            if (samples != this->samples_last) {
+                // A new setting (ours or the user's); start measuring afresh
+                this->samples_last = samples;
+                this->n_measured = 0u;
+            }
+            this->smoothed = this->n_measured == 0u ? raycast_ms : this->smoothed + this->smoothing * (raycast_ms - this->smoothed);
+            ++this->n_measured;
+            if (this->n_measured < this->settle_frames || samples < 1) { return samples; }
+
+            const double lo = this->low_fraction * this->target_ms;
+            const double hi = this->high_fraction * this->target_ms;
+            if (this->smoothed >= lo && this->smoothed <= hi) { return samples; }
+
+            const double ms_per_sample = this->smoothed / static_cast<double>(samples);
+            if (ms_per_sample <= 0.0) { return samples; }
+            int wanted = static_cast<int>(std::floor (0.5 * (lo + hi) / ms_per_sample));
+            wanted = std::clamp (wanted, std::max (1, samples / this->max_step), samples * this->max_step);
+            return std::clamp (wanted, this->min_samples, this->max_samples);
+        }
+
+        // The smoothed ray cast time (ms)
+        double smoothed_ms() const { return this->smoothed; }
+
+    private:
+        int samples_last = 0;
+        unsigned int n_measured = 0u;
+        double smoothed = 0.0;
+    };
+
+} // namespace
@@ -0,0 +1,245 @@
+/*
+ * A per-stage frame profiler. Extends demo::fps::profiler with named stages, timed by scoped
+ * timers, whose recent durations are kept in fixed-size rings for percentiles (p50/p95/p99). The
+ * most recent stage timings can be written out as Chrome trace-event JSON, which
+ * chrome://tracing or https://ui.perfetto.dev will display. Named counters record values that
+ * change over time (such as the samples per ommatidium) alongside the timings.
+ *
+ * All storage is allocated when the profiler is constructed and when stages are added, so timing
+ * a stage does not allocate. Like the fps profiler, use it from one thread.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "fpsprofiler.h"
+
+namespace demo::fps
+{
+    // Summary of a stage's recent durations, in microseconds
+    struct stage_stats
+    {
+        double mean = 0.0;
+        double p50 = 0.0;
+        double p95 = 0.0;
+        double p99 = 0.0;
+        std::size_t n = 0u;
+    };
+
+    struct stage_profiler : public profiler
+    {
+        static constexpr std::size_t max_stages = 16;
+        static constexpr std::size_t max_counters = 12;
+        // How many recent durations each stage keeps for its percentiles
+        static constexpr std::size_t history = 1024;
+        // How many recent timings are kept for the trace (older ones are overwritten)
+        static constexpr std::size_t trace_capacity = 1u << 16;
+
+        stage_profiler() : t_origin (sc::now())
+        {
+            this->stages.reserve (max_stages);
+            this->counters.reserve (max_counters);
+            this->trace.resize (trace_capacity);
+            this->fps_txt.reserve (64);
+        }
+
+        // Add a named stage (do this at setup). Returns the id to pass to time() or record().
+        int add_stage (const std::string& name)
+        {
+            if (this->stages.size() == max_stages) { throw std::runtime_error ("stage_profiler: too many stages"); }
+            this->stages.emplace_back();
+            this->stages.back().name = name;
+            return static_cast<int>(this->stages.size() - 1);
+        }
+
+        // Add a named counter (do this at setup). Returns the id to pass to count().
+        int add_counter (const std::string& name)
+        {
+            if (this->counters.size() == max_counters) { throw std::runtime_error ("stage_profiler: too many counters"); }
+            this->counters.emplace_back();
+            this->counters.back().name = name;
+            return static_cast<int>(this->counters.size() - 1);
+        }
+
+        // Record the counter's current value
+        void count (const int counter, const double value)
+        {
+            counter_state& c = this->counters[counter];
+            c.min = c.n == 0u ? value : std::min (c.min, value);
+            c.max = c.n == 0u ? value : std::max (c.max, value);
+            c.last = value;
+            ++c.n;
+            trace_event& e = this->next_event();
+            e.counter = true;
+            e.stage = counter;
+            e.t_start = sc::now();
+            e.value = value;
+        }
+
+        // Times the stage from construction to destruction
+        struct scoped
+        {
+            scoped (stage_profiler& _prof, const int _stage) : prof (_prof), stage (_stage), t_start (sc::now()) {}
+            scoped (const scoped&) = delete;
+            scoped& operator= (const scoped&) = delete;
+            ~scoped() { this->prof.record (this->stage, this->t_start, sc::now()); }
+            stage_profiler& prof;
+            const int stage;
+            const sc::time_point t_start;
+        };
+
+        // Use as: { auto t = prof.time (stage_id); do_stage(); }
+        scoped time (const int stage) { return scoped (*this, stage); }
+
+        // Record one timing of stage
+        void record (const int stage, const sc::time_point t_start, const sc::time_point t_end)
+        {
+            const float us = duration<float, std::micro>(t_end - t_start).count();
+            stage_ring& r = this->stages[stage];
+            r.durations[r.next] = us;
+            r.next = (r.next + 1) % history;
+            r.count = std::min (r.count + 1, history);
+            r.last = us;
+
+            trace_event& e = this->next_event();
+            e.counter = false;
+            e.stage = stage;
+            e.t_start = t_start;
+            e.value = us;
+        }
+
+        // The stage's most recent duration, in microseconds
+        double last (const int stage) const { return this->stages[stage].last; }
+
+        std::size_t stage_count() const { return this->stages.size(); }
+        const std::string& stage_name (const int stage) const { return this->stages[stage].name; }
+
+        // Mean and percentiles of the stage's most recent durations (does not allocate)
+        stage_stats stats (const int stage) const
+        {
+            const stage_ring& r = this->stages[stage];
+            stage_stats st;
+            st.n = r.count;
+            if (r.count == 0u) { return st; }
+            std::copy_n (r.durations.begin(), r.count, this->scratch.begin());
+            auto first = this->scratch.begin();
+            auto last = first + r.count;
+            double sum = 0.0;
+            for (auto it = first; it != last; ++it) { sum += *it; }
+            st.mean = sum / static_cast<double>(r.count);
+            auto pct = [first, last, n = r.count](double q) {
+                auto nth = first + std::min (static_cast<std::size_t>(q * static_cast<double>(n)), n - 1u);
+                std::nth_element (first, nth, last);
+                return static_cast<double>(*nth);
+            };
+            st.p50 = pct (0.50);
+            st.p95 = pct (0.95);
+            st.p99 = pct (0.99);
+            return st;
+        }
+
+        // A table of each stage's stats, for printing at exit
+        std::string summary() const
+        {
+            std::stringstream ss;
+            ss << std::fixed << std::setprecision (1);
+            ss << std::left << std::setw (24) << "stage (microseconds)" << std::right
+               << std::setw (10) << "mean" << std::setw (10) << "p50"
+               << std::setw (10) << "p95" << std::setw (10) << "p99" << std::endl;
+            for (std::size_t i = 0; i < this->stages.size(); ++i) {
+                stage_stats st = this->stats (static_cast<int>(i));
+                ss << std::left << std::setw (24) << this->stages[i].name << std::right
+                   << std::setw (10) << st.mean << std::setw (10) << st.p50
+                   << std::setw (10) << st.p95 << std::setw (10) << st.p99 << std::endl;
+            }
+            for (const counter_state& c : this->counters) {
+                ss << std::left << std::setw (24) << c.name << std::right
+                   << "      last " << c.last << " (min " << c.min << ", max " << c.max << ")" << std::endl;
+            }
+            return ss.str();
+        }
+
+        // Write the kept timings as Chrome trace-event JSON ("X" complete events, "C" counters)
+        void write_chrome_trace (const std::string& path) const
+        {
+            std::ofstream fout (path, std::ios::out | std::ios::trunc);
+            if (!fout.is_open()) { throw std::runtime_error ("Could not open '" + path + "' for writing"); }
+            fout << std::fixed << std::setprecision (3);
+            fout << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+            // Oldest first
+            const std::size_t start = (this->trace_next + trace_capacity - this->trace_count) % trace_capacity;
+            for (std::size_t k = 0; k < this->trace_count; ++k) {
+                const trace_event& e = this->trace[(start + k) % trace_capacity];
+                const double ts = duration<double, std::micro>(e.t_start - this->t_origin).count();
+                fout << (k == 0 ? "\n" : ",\n");
+                if (e.counter) {
+                    const std::string& name = this->counters[e.stage].name;
+                    fout << "{\"name\":\"" << name << "\",\"ph\":\"C\",\"pid\":1,\"tid\":1,"
+                         << "\"ts\":" << ts << ",\"args\":{\"" << name << "\":" << e.value << "}}";
+                } else {
+                    fout << "{\"name\":\"" << this->stages[e.stage].name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+                         << "\"ts\":" << ts << ",\"dur\":" << e.value << "}";
+                }
+            }
+            fout << "\n]}\n";
+            if (!fout.good()) { throw std::runtime_error ("Failed writing '" + path + "'"); }
+        }
+
+    private:
+        struct stage_ring
+        {
+            std::string name;
+            std::array<float, history> durations = {};
+            std::size_t next = 0u;
+            std::size_t count = 0u;
+            double last = 0.0;
+        };
+
+        struct counter_state
+        {
+            std::string name;
+            double last = 0.0;
+            double min = 0.0;
+            double max = 0.0;
+            std::size_t n = 0u;
+        };
+
+        // A stage timing (value is its duration in microseconds) or a counter value
+        struct trace_event
+        {
+            bool counter = false;
+            int stage = 0;
+            sc::time_point t_start = {};
+            double value = 0.0;
+        };
+
+        trace_event& next_event()
+        {
+            trace_event& e = this->trace[this->trace_next];
+            this->trace_next = (this->trace_next + 1) % trace_capacity;
+            this->trace_count = std::min (this->trace_count + 1, trace_capacity);
+            return e;
+        }
+
+        sc::time_point t_origin;
+        std::vector<stage_ring> stages;
+        std::vector<counter_state> counters;
+        std::vector<trace_event> trace;
+        std::size_t trace_next = 0u;
+        std::size_t trace_count = 0u;
+        // Working space for the percentiles
+        mutable std::array<float, history> scratch = {};
+    };
+
+} // namespace
@@ -0,0 +1,144 @@
+/*
+ * A small fixed-size pool of worker threads with a blocking parallel_for. Used by the CPU
+ * compound eye renderer to spread ommatidia across all cores.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace demo
+{
+    struct threadpool
+    {
+        // Create a pool. n_threads == 0 means 'one per hardware thread'
+        explicit threadpool (unsigned int n_threads = 0u)
+        {
+            if (n_threads == 0u) { n_threads = std::max (1u, std::thread::hardware_concurrency()); }
+            // The calling thread also works in parallel_for, so start one fewer workers
+            for (unsigned int i = 1u; i < n_threads; ++i) {
+                this->workers.emplace_back ([this]() { this->worker_loop(); });
+            }
+        }
+
+        threadpool (const threadpool&) = delete;
+        threadpool& operator= (const threadpool&) = delete;
+
+        ~threadpool()
+        {
+            {
+                std::lock_guard<std::mutex> lk (this->m);
+                this->finishing = true;
+            }
+            this->cv_work.notify_all();
+            for (auto& w : this->workers) { w.join(); }
+        }
+
+        // The number of threads that work on a parallel_for, including the caller
+        unsigned int size() const { return static_cast<unsigned int>(this->workers.size()) + 1u; }
+
+        /*
+         * Call fn (begin, end) over [0, n) in chunks of up to grain elements. Chunks are handed
+         * out dynamically, so uneven work (e.g. ommatidia looking at sky vs. dense foliage)
+         * balances itself. Blocks until every chunk is done. Not re-entrant. If fn throws (on
+         * any thread), the chunks not yet started are skipped and, once every thread has
+         * stopped, the first exception is rethrown here.
+         */
+        void parallel_for (std::size_t n, std::size_t grain,
+                           const std::function<void(std::size_t, std::size_t)>& fn)
+        {
+            if (n == 0u) { return; }
+            grain = std::max (grain, std::size_t{1});
+            if (this->workers.empty() || n <= grain) { fn (0u, n); return; }
+
+            {
+                std::lock_guard<std::mutex> lk (this->m);
+                this->job = &fn;
+                this->job_n = n;
+                this->job_grain = grain;
+                this->next.store (0u);
+                this->busy = static_cast<unsigned int>(this->workers.size());
+                ++this->generation;
+            }
+            this->cv_work.notify_all();
+
+            this->run_chunks (fn, n, grain);
+
+            std::exception_ptr err = nullptr;
+            {
+                std::unique_lock<std::mutex> lk (this->m);
+                this->cv_done.wait (lk, [this]() { return this->busy == 0u; });
+                this->job = nullptr;
+                std::swap (err, this->error);
+            }
+            if (err) { std::rethrow_exception (err); }
+        }
+
+    private:
+
+        void run_chunks (const std::function<void(std::size_t, std::size_t)>& fn,
+                         const std::size_t n, const std::size_t grain)
+        {
+            try {
+                for (;;) {
+                    std::size_t b = this->next.fetch_add (grain);
+                    if (b >= n) { break; }
+                    fn (b, std::min (n, b + grain));
+                }
+            } catch (...) {
+                // Keep the first exception for parallel_for to rethrow, and hand out no more chunks
+                std::lock_guard<std::mutex> lk (this->m);
+                if (!this->error) { this->error = std::current_exception(); }
+                this->next.store (n);
+            }
+        }
+
+        void worker_loop()
+        {
+            unsigned long long seen = 0u;
+            for (;;) {
+                const std::function<void(std::size_t, std::size_t)>* fn = nullptr;
+                std::size_t n = 0u;
+                std::size_t grain = 1u;
+                {
+                    std::unique_lock<std::mutex> lk (this->m);
+                    this->cv_work.wait (lk, [this, seen]() { return this->finishing || this->generation != seen; });
+                    if (this->finishing) { return; }
+                    seen = this->generation;
+                    fn = this->job;
+                    n = this->job_n;
+                    grain = this->job_grain;
+                }
+                this->run_chunks (*fn, n, grain);
+                {
+                    std::lock_guard<std::mutex> lk (this->m);
+                    if (--this->busy == 0u) { this->cv_done.notify_one(); }
+                }
+            }
+        }
+
+        std::vector<std::thread> workers;
+        std::mutex m;
+        std::condition_variable cv_work;
+        std::condition_variable cv_done;
+        const std::function<void(std::size_t, std::size_t)>* job = nullptr;
+        std::size_t job_n = 0u;
+        std::size_t job_grain = 1u;
+        std::atomic<std::size_t> next = 0u;
+        unsigned int busy = 0u;
+        std::exception_ptr error = nullptr;
+        unsigned long long generation = 0u;
+        bool finishing = false;
+    };
+
+} // namespace
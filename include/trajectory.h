@@ -0,0 +1,67 @@
+/*
+ * Camera pose trajectories for headless batch runs.
+ *
+ * A trajectory file has one camera pose per line. Blank lines and lines starting with '#' are
+ * ignored. A pose is either
+ *
+ *   16 numbers: the camera localspace matrix, column major (as mplot::compoundray::getCameraSpace)
+ *    7 numbers: position x y z, then orientation quaternion x y z w (glTF order)
+ *
+ * Values may be separated by spaces, tabs or commas.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "cpumaths.h"
+
+namespace demo
+{
+    inline std::vector<cpu::mat4> read_trajectory (const std::string& path)
+    {
+        std::ifstream fin (path);
+        if (!fin.is_open()) { throw std::runtime_error ("Could not open trajectory file '" + path + "'"); }
+        std::vector<cpu::mat4> poses;
+        std::string line;
+        unsigned int lnum = 0u;
+        while (std::getline (fin, line)) {
+            ++lnum;
+            auto first = line.find_first_not_of (" \t\r");
+            if (first == std::string::npos || line[first] == '#') { continue; }
+            std::replace (line.begin(), line.end(), ',', ' ');
+            std::istringstream ss (line);
+            std::vector<float> v;
+            float f = 0.0f;
+            while (ss >> f) { v.push_back (f); }
+            if (!ss.eof()) {
+                throw std::runtime_error ("Line " + std::to_string (lnum) + " of " + path + " has a value that isn't a number");
+            }
+            if (v.size() == 16u) {
+                cpu::mat4 m;
+                std::copy (v.begin(), v.end(), m.begin());
+                poses.push_back (m);
+            } else if (v.size() == 7u) {
+                std::array<float, 4> q = { v[3], v[4], v[5], v[6] };
+                float ql = std::sqrt (q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+                if (ql <= 0.0f) { throw std::runtime_error ("Zero quaternion on line " + std::to_string (lnum) + " of " + path); }
+                for (auto& qi : q) { qi /= ql; }
+                poses.push_back (cpu::from_trs ({ v[0], v[1], v[2] }, q, { 1.0f, 1.0f, 1.0f }));
+            } else {
+                throw std::runtime_error ("Line " + std::to_string (lnum) + " of " + path
+                                          + " has " + std::to_string (v.size()) + " values (expected 7 or 16)");
+            }
+        }
+        return poses;
+    }
+
+} // namespace
@@ -0,0 +1,56 @@
+/*
+ * A lock-free triple buffer for handing the latest value from one producer thread to one
+ * consumer thread. The producer fills write_slot() and calls publish(); the consumer calls
+ * update() and, if it returns true, reads the newest value from read_slot(). Neither side ever
+ * waits for the other. Values that are overwritten before the consumer looks are skipped, which
+ * is what we want for camera poses and eye frames.
+ *
+ * Slots are swapped, not copied, so a consumer may also swap the contents of read_slot() (e.g.
+ * a std::vector) with its own object, and the buffer that it hands back will be reused.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace demo
+{
+    template <typename T>
+    struct triplebuffer
+    {
+        // Producer side
+        T& write_slot() { return this->slots[this->back]; }
+        void publish()
+        {
+            this->back = this->middle.exchange (this->back | fresh, std::memory_order_acq_rel) & index_mask;
+        }
+
+        // Consumer side. Returns true if a newer value is now in read_slot()
+        bool update()
+        {
+            if ((this->middle.load (std::memory_order_acquire) & fresh) == 0u) { return false; }
+            this->front = this->middle.exchange (this->front, std::memory_order_acq_rel) & index_mask;
+            return true;
+        }
+        T& read_slot() { return this->slots[this->front]; }
+        const T& read_slot() const { return this->slots[this->front]; }
+
+        // Set all three slots (only before the threads start)
+        void fill (const T& v) { for (auto& s : this->slots) { s = v; } }
+
+    private:
+        static constexpr uint8_t index_mask = 0x3u;
+        static constexpr uint8_t fresh = 0x4u;
+        std::array<T, 3> slots;
+        // Which slot is in the middle, and whether it holds a value the consumer hasn't seen
+        std::atomic<uint8_t> middle = 1u;
+        // Owned by the producer and consumer respectively
+        uint8_t back = 0u;
+        uint8_t front = 2u;
+    };
+
+} // namespace
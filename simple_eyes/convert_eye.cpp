@@ -0,0 +1,54 @@
+/*
+ * Convert compound eye files between the text .eye format and the memory-mappable binary format
+ * described in include/eyefile.h.
+ *
+ * By default a text input is written as binary and a binary input is written as text (which
+ * compound-ray's libEyeRenderer3 can read). Use -b or -t to force the output format.
+ */
+
+#include <iostream>
+#include <string>
+#include <stdexcept>
+
+#include "eyefile.h"
+
+int main (int argc, char** argv)
+{
+    std::string inpath = "";
+    std::string outpath = "";
+    int force = 0; // 1: binary, 2: text
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = std::string(argv[i]);
+        if (arg == "-b") {
+            force = 1;
+        } else if (arg == "-t") {
+            force = 2;
+        } else if (inpath.empty()) {
+            inpath = arg;
+        } else {
+            outpath = arg;
+        }
+    }
+    if (inpath.empty() || outpath.empty()) {
+        std::cout << "USAGE:\nconvert_eye [-b|-t] <input eye file> <output eye file>\n\n"
+                  << "\t-b\tWrite binary (the default for text input)\n"
+                  << "\t-t\tWrite text (the default for binary input)\n";
+        return 1;
+    }
+
+    try {
+        demo::eyefile::eye e (inpath);
+        bool to_binary = force == 0 ? !e.mapped() : force == 1;
+        if (to_binary) {
+            demo::eyefile::write_binary (outpath, e.ommatidia());
+        } else {
+            demo::eyefile::write_text (outpath, e.ommatidia());
+        }
+        std::cout << "Wrote " << e.size() << " ommatidia to " << outpath
+                  << (to_binary ? " (binary)" : " (text)") << std::endl;
+    } catch (const std::exception& ex) {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
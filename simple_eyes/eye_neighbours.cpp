@@ -0,0 +1,61 @@
+/*
+ * Build the k nearest neighbour graph of an eye's ommatidia (see include/eyegraph.h) and store it
+ * next to the eye, as <eye file>.nbr, so that models of lateral interactions can load it at
+ * startup rather than searching for neighbours.
+ */
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <stdexcept>
+
+#include "eyegraph.h"
+
+int main (int argc, char** argv)
+{
+    using sc = std::chrono::steady_clock;
+
+    std::string inpath = "";
+    std::string outpath = "";
+    unsigned int k = 6u;
+    bool symmetric = false;
+    unsigned int threads = 0u;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = std::string(argv[i]);
+        if (arg == "-k" && i + 1 < argc) {
+            k = static_cast<unsigned int>(std::stoul (argv[++i]));
+        } else if (arg == "-s") {
+            symmetric = true;
+        } else if (arg == "-j" && i + 1 < argc) {
+            threads = static_cast<unsigned int>(std::stoul (argv[++i]));
+        } else if (inpath.empty()) {
+            inpath = arg;
+        } else {
+            outpath = arg;
+        }
+    }
+    if (inpath.empty()) {
+        std::cout << "USAGE:\neye_neighbours [-k <k>] [-s] [-j <threads>] <eye file> [<output graph file>]\n\n"
+                  << "\t-k\tNeighbours per ommatidium (default 6)\n"
+                  << "\t-s\tMake the graph symmetric (if i is a neighbour of j, j is one of i)\n"
+                  << "\t-j\tThreads (default all cores)\n"
+                  << "The graph is written to <eye file>.nbr unless an output path is given.\n";
+        return 1;
+    }
+    if (outpath.empty()) { outpath = demo::eyegraph::graph_path (inpath); }
+
+    try {
+        demo::eyefile::eye e (inpath);
+        demo::threadpool pool (threads);
+        sc::time_point t0 = sc::now();
+        demo::eyegraph::graph g = demo::eyegraph::build (e.ommatidia(), k, pool, symmetric);
+        const double secs = std::chrono::duration<double>(sc::now() - t0).count();
+        demo::eyegraph::write (outpath, g);
+        std::cout << g.size() << " ommatidia, " << g.edges() << " edges in " << secs << " s; wrote "
+                  << outpath << std::endl;
+    } catch (const std::exception& ex) {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * Generate compound eyes from the command line with the generators of include/eyegen.h. The eye
+ * is generated and written in parallel chunks, so eyes of millions of ommatidia take seconds.
+ *
+ *   make_eye hex -n 1000000 -p mercator -b -o big_hexy.eyeb
+ *   make_eye geodesic -i 8 -r 0.2 -a 0.01 -o fine_poly.eye
+ */
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <stdexcept>
+
+#include "eyegen.h"
+
+namespace
+{
+    void print_help()
+    {
+        std::cout << "USAGE:\nmake_eye hex|geodesic [options] -o <path>\n\n"
+                  << "\t-o\tOutput eye file ('-' for text on stdout)\n"
+                  << "\t-b\tWrite the binary eye format (see include/eyefile.h) rather than text\n"
+                  << "\t-j\tThreads (default all cores)\n"
+                  << "hex (a projected hexagonal lattice, as make_hexy_eye):\n"
+                  << "\t-p\tProjection: splodge (default), mercator, equirectangular or cassini\n"
+                  << "\t-n\tAbout this many ommatidia (sets the lattice spacing)\n"
+                  << "\t-d\tLattice spacing (default 1/15)\n"
+                  << "\t-R\tRadius of the lattice's circular boundary (default 0.95 r for splodge, else pi r / 2)\n"
+                  << "\t-r\tSphere radius (default 1)\n"
+                  << "\t-t\tSplodge tilt about y, in degrees (default 30)\n"
+                  << "\t-f\tFocal point offset (default the sphere radius)\n"
+                  << "geodesic (the vertices of a geodesic sphere, as make_poly_eye):\n"
+                  << "\t-i\tIterations; the frequency is 2^i (default 4)\n"
+                  << "\t-F\tFrequency (10 F^2 + 2 ommatidia), instead of -i\n"
+                  << "\t-r\tRadius (default 0.2)\n"
+                  << "\t-a\tAcceptance angle in radians (default 0.15)\n"
+                  << "\t-f\tFocal point offset (default 0.1)\n";
+    }
+}
+
+int main (int argc, char** argv)
+{
+    using sc = std::chrono::steady_clock;
+
+    if (argc < 2) {
+        print_help();
+        return 1;
+    }
+    const std::string kind = argv[1];
+    if (kind != "hex" && kind != "geodesic") {
+        print_help();
+        return 1;
+    }
+
+    std::string outpath = "";
+    bool binary = false;
+    unsigned int threads = 0u;
+    demo::eyegen::hex_eye hex;
+    demo::eyegen::geodesic_eye geo;
+    std::size_t target_n = 0u;
+    bool boundary_set = false;
+
+    try {
+        for (int i = 2; i < argc; ++i) {
+            const std::string arg = argv[i];
+            const bool has_value = i + 1 < argc;
+            if (arg == "-b") {
+                binary = true;
+            } else if (arg == "-o" && has_value) {
+                outpath = argv[++i];
+            } else if (arg == "-j" && has_value) {
+                threads = static_cast<unsigned int>(std::stoul (argv[++i]));
+            } else if (arg == "-p" && has_value) {
+                hex.proj = demo::eyegen::projection_from_string (argv[++i]);
+            } else if (arg == "-n" && has_value) {
+                target_n = static_cast<std::size_t>(std::stod (argv[++i]));
+            } else if (arg == "-d" && has_value) {
+                hex.spacing = std::stof (argv[++i]);
+            } else if (arg == "-R" && has_value) {
+                hex.boundary = std::stof (argv[++i]);
+                boundary_set = true;
+            } else if (arg == "-r" && has_value) {
+                hex.sphere_radius = geo.radius = std::stof (argv[++i]);
+            } else if (arg == "-t" && has_value) {
+                hex.splodge_tilt = std::stof (argv[++i]) * demo::eyegen::pi / 180.0f;
+            } else if (arg == "-f" && has_value) {
+                hex.focal_offset = geo.focal_offset = std::stof (argv[++i]);
+            } else if (arg == "-i" && has_value) {
+                geo.frequency = 1u << std::stoul (argv[++i]);
+            } else if (arg == "-F" && has_value) {
+                geo.frequency = static_cast<unsigned int>(std::stoul (argv[++i]));
+            } else if (arg == "-a" && has_value) {
+                geo.acceptance_angle = std::stof (argv[++i]);
+            } else {
+                std::cerr << "Unknown or incomplete option '" << arg << "'\n";
+                print_help();
+                return 1;
+            }
+        }
+        if (outpath.empty()) {
+            print_help();
+            return 1;
+        }
+        if (outpath == "-" && binary) { throw std::runtime_error ("Binary eyes can't be written to stdout"); }
+
+        if (kind == "hex") {
+            if (!boundary_set) {
+                hex.boundary = hex.proj == demo::eyegen::projection::splodge ? 0.95f * hex.sphere_radius
+                                                                             : 0.5f * demo::eyegen::pi * hex.sphere_radius;
+            }
+            if (target_n > 0u) { hex.spacing = demo::eyegen::hex_eye::spacing_for (target_n, hex.boundary); }
+            hex.setup();
+        }
+
+        sc::time_point t0 = sc::now();
+        demo::threadpool pool (threads);
+        const demo::eyegen::format fmt = binary ? demo::eyegen::format::binary : demo::eyegen::format::text;
+        std::unique_ptr<std::ofstream> fout;
+        std::ostream* out = &std::cout;
+        if (outpath != "-") {
+            fout = std::make_unique<std::ofstream> (outpath, std::ios::out | std::ios::trunc | std::ios::binary);
+            if (!fout->is_open()) { throw std::runtime_error ("Could not open '" + outpath + "' for writing"); }
+            out = fout.get();
+        }
+        std::size_t n = 0u;
+        if (kind == "hex") {
+            n = hex.size();
+            demo::eyegen::write (hex, *out, fmt, pool);
+        } else {
+            n = geo.size();
+            demo::eyegen::write (geo, *out, fmt, pool);
+        }
+        out->flush();
+        if (!out->good()) { throw std::runtime_error ("Failed writing '" + outpath + "'"); }
+        const double secs = std::chrono::duration<double>(sc::now() - t0).count();
+        std::cerr << "Wrote " << n << " ommatidia in " << secs << " s" << std::endl;
+
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
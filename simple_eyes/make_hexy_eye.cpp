@@ -4,14 +4,14 @@
 
 #include <iostream>
 #include <fstream>
+#include <string>
+#include <vector>
 #include <cmath>
 
 #include <sm/mathconst>
-#include <sm/mat44>
 #include <sm/scale>
 #include <sm/vec>
 #include <sm/vvec>
-#include <sm/quaternion>
 #define HEXGRID_COMPILE_LOAD_AND_SAVE 1 // DO need to save out the HexGrid
 #include <sm/hexgrid>
 #include <sm/hdfdata>
@@ -21,6 +21,9 @@
 #include <mplot/QuiverVisual.h>
 #include <mplot/HexGridVisual.h>
 
+#include "eyefile.h"
+#include "eyegen.h"
+
 enum class spherical_projection
 {
     mercator,
@@ -29,10 +32,14 @@ enum class spherical_projection
     splodge
 };
 
-int main()
+int main (int argc, char** argv)
 {
     constexpr spherical_projection proj =  spherical_projection::splodge;
 
+    // With -b, write the binary eye format (hexy.eyeb; see include/eyefile.h) instead of hexy.eye
+    bool write_binary = false;
+    for (int i = 1; i < argc; ++i) { if (std::string(argv[i]) == "-b") { write_binary = true; } }
+
     // You can hide the RGB arrows
     constexpr bool show_rgb = true;
 
@@ -68,62 +75,24 @@ int main()
         hg.setCircularBoundary (0.5f * mc::pi * r_sph);
     }
 
-    // hg has d_x and d_y. Can make up a new container of 3D locations for each hex.
+    // Project each hex of hg onto the sphere (in parallel; see include/eyegen.h for the maths)
+    demo::threadpool pool;
+    demo::eyegen::projection eproj = demo::eyegen::projection::mercator;
+    if constexpr (proj == spherical_projection::equirectangular) {
+        eproj = demo::eyegen::projection::equirectangular;
+    } else if constexpr (proj == spherical_projection::cassini) {
+        eproj = demo::eyegen::projection::cassini;
+    } else if constexpr (proj == spherical_projection::splodge) {
+        eproj = demo::eyegen::projection::splodge;
+    }
+    const demo::cpu::mat4 splodge_tilt = demo::cpu::rotation ({ 0.0f, 1.0f, 0.0f }, mc::pi_over_6);
     sm::vvec<sm::vec<float, 3>> sphere_coords(hg.num());
-    for (unsigned int i = 0u; i < hg.num(); ++i) {
-        // This is the inverse Mercator projection.
-        // See https://stackoverflow.com/questions/12732590/how-map-2d-grid-points-x-y-onto-sphere-as-3d-points-x-y-z
-        sm::vec<float, 2> xy = { hg.d_x[i], hg.d_y[i] };
-
-        float longitude = 0.0f; // or lambda
-        float latitude = 0.0f;  // or phi
-        if constexpr (proj == spherical_projection::equirectangular) {
-            float phi0 = 0.0f;
-            float phi1 = 0.0f;
-            float lambda0 = 0.0f;
-            longitude = xy[0] / (r_sph * std::cos(phi1)) + lambda0;
-            latitude = xy[1] / r_sph + phi0;
-        } else if constexpr (proj == spherical_projection::cassini) {
-            // Spherical Cassini
-            float phi0 = 0.0f;
-            float lambda0 = 0.0f;
-            float D = xy[1] / r_sph + phi0;
-            longitude = lambda0 + std::atan2 (std::tan(xy[0]/r_sph), std::cos(D));
-            latitude = std::asin (std::sin(D) * std::cos(xy[0]/r_sph));
-
-        } else if constexpr (proj == spherical_projection::splodge) {
-            // It's all below
-        } else { // Default Mercator projection
-            longitude = xy[0] / r_sph;
-            latitude = 2.0f * std::atan (std::exp(xy[1]/r_sph)) - mc::pi_over_2;
-        }
-
-        if constexpr (proj == spherical_projection::splodge) {
-            // In the splodge projection we just 'throw' the 2D plane onto a sphere
-            sphere_coords[i][1] = xy[0];
-            sphere_coords[i][2] = xy[1];
-            float z_sq = r_sph * r_sph - xy.sq().sum();
-            float z_sph = 0.0f;
-            if (z_sq >= 0.0f)  {
-                z_sph = -std::sqrt (z_sq);
-            } else {
-                z_sph = +std::sqrt (-z_sq); // Anything beyond the edge of r_sph
-            }
-            sm::vec<float> prerotate = { eye_x_loc + z_sph, xy[0], xy[1] };
-            sm::quaternion<float> q1;
-            q1.rotate (sm::vec<float>{0, 1, 0}, mc::pi_over_6);
-            sm::mat44<float> m1;
-            m1.rotate (q1);
-            sphere_coords[i] = (m1 * prerotate).less_one_dim();
-            //sphere_coords[i][0] =  eye_x_loc + z_sph;
-        } else { // it's a serious projection
-            float coslat = std::cos (latitude);
-            float sinlat = std::sin (latitude);
-            float coslong = std::cos (longitude);
-            float sinlong = std::sin (longitude);
-            sphere_coords[i] =  { eye_x_loc + r_sph * coslat * coslong, r_sph * coslat * sinlong , r_sph * sinlat };
+    pool.parallel_for (hg.num(), 4096u, [&](std::size_t b, std::size_t e) {
+        for (std::size_t i = b; i < e; ++i) {
+            demo::cpu::vec3 c = demo::eyegen::project (eproj, hg.d_x[i], hg.d_y[i], r_sph, splodge_tilt);
+            sphere_coords[i] = { eye_x_loc + c[0], c[1], c[2] };
         }
-    }
+    });
 
     // 'R' neighbours (neighbour east) on the sphere
     sm::vvec<sm::vec<float, 3>> neighb_r(hg.num(), sm::vec<float, 3>{0,0,0});
@@ -152,43 +121,41 @@ int main()
         d.add_contained_vals ("/sphere_coords", sphere_coords);
     }
 
-    // Will call this fn once for the eye
-    auto output_coords = [r_sph, hg](const sm::vvec<sm::vec<float, 3>>& coords, sm::vec<float, 3> eyeoffset, std::ofstream& fout) {
+    // The ommatidia. An ommatidium's acceptance angle is the angle to its first neighbour.
+    auto make_ommatidia = [r_sph, &hg, &pool](const sm::vvec<sm::vec<float, 3>>& coords, sm::vec<float, 3> eyeoffset) {
         constexpr float focal_offset = r_sph;
         constexpr float radius = r_sph;
-        for (unsigned int i = 0; i < coords.size(); ++i) {
-            auto norm = coords[i];
-            norm.renormalize();
-            float acceptance_angle = 1.0f;
-            auto c1 = radius * (coords[i] - eyeoffset);
-            if (hg.d_ne[i] != -1) {
-                auto c2 = radius * (coords[hg.d_ne[i]] - eyeoffset);
-                acceptance_angle *= c1.angle(c2);
-            } else if (hg.d_nne[i] != -1) {
-                auto c2 = radius * (coords[hg.d_nne[i]] - eyeoffset);
-                acceptance_angle *= c1.angle(c2);
-            } else if (hg.d_nnw[i] != -1) {
-                auto c2 = radius * (coords[hg.d_nnw[i]] - eyeoffset);
-                acceptance_angle *= c1.angle(c2);
-            } else if (hg.d_nw[i] != -1) {
-                auto c2 = radius * (coords[hg.d_nw[i]] - eyeoffset);
-                acceptance_angle *= c1.angle(c2);
-            } else if (hg.d_nsw[i] != -1) {
-                auto c2 = radius * (coords[hg.d_nsw[i]] - eyeoffset);
-                acceptance_angle *= c1.angle(c2);
-            } else if (hg.d_nse[i] != -1) {
-                auto c2 = radius * (coords[hg.d_nse[i]] - eyeoffset);
-                acceptance_angle *= c1.angle(c2);
-            } // else acceptange angle will be unchanged at 1.0f
-
-            std::string ntxt = norm.str_comma_separated(' '); // normals (vertices were already normalized)
-            std::string vtxt = (coords[i] * radius).str_comma_separated(' ');
-            fout << vtxt << " " << ntxt << " " << acceptance_angle << " " << focal_offset << std::endl;
-        }
+        std::vector<demo::eyefile::ommatidium> omms (coords.size());
+        pool.parallel_for (coords.size(), 4096u, [&](std::size_t b, std::size_t e) {
+            for (std::size_t i = b; i < e; ++i) {
+                auto norm = coords[i];
+                norm.renormalize();
+                float acceptance_angle = 1.0f;
+                auto c1 = radius * (coords[i] - eyeoffset);
+                for (int nb : { hg.d_ne[i], hg.d_nne[i], hg.d_nnw[i], hg.d_nw[i], hg.d_nsw[i], hg.d_nse[i] }) {
+                    if (nb != -1) {
+                        auto c2 = radius * (coords[nb] - eyeoffset);
+                        acceptance_angle = demo::eyegen::angle_between ({ c1[0], c1[1], c1[2] }, { c2[0], c2[1], c2[2] });
+                        break;
+                    }
+                } // else acceptance angle will be unchanged at 1.0f
+
+                demo::eyefile::ommatidium& om = omms[i];
+                for (unsigned int j = 0; j < 3; ++j) {
+                    om.position[j] = coords[i][j] * radius;
+                    om.direction[j] = norm[j];
+                }
+                om.acceptance_angle = acceptance_angle;
+                om.focal_offset = focal_offset;
+            }
+        });
+        return omms;
     };
-    std::ofstream fout ("hexy.eye", std::ios::out | std::ios::trunc);
-    if (fout.is_open()) {
-        output_coords (sphere_coords, sm::vec<float, 3>{eye_x_loc, 0, 0}, fout);
+    std::vector<demo::eyefile::ommatidium> omms = make_ommatidia (sphere_coords, sm::vec<float, 3>{eye_x_loc, 0, 0});
+    if (write_binary) {
+        demo::eyefile::write_binary ("hexy.eyeb", omms);
+    } else {
+        demo::eyefile::write_text ("hexy.eye", omms);
     }
     sm::vvec<float> data;
     data.linspace (0, 1, hg.num());
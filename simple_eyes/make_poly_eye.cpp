@@ -1,22 +1,39 @@
 #include <string>
+#include <fstream>
 #include <iostream>
-#include <sm/geometry>
+
+#include "eyegen.h"
 
 int main (int argc, char **argv)
 {
-    int iterations = 4; // Increase for finer subdivision
+    // The geodesic's frequency is 2^iterations. Increase for finer subdivision (-i)
+    unsigned int iterations = 4;
 
-    sm::geometry::icosahedral_geodesic<double> geo = sm::geometry::make_icosahedral_geodesic<double> (iterations);
+    // With -b <path>, write a binary eye file (see include/eyefile.h) instead of text on stdout
+    std::string binpath = "";
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "-b" && i + 1 < argc) { binpath = std::string(argv[++i]); }
+        else if (std::string(argv[i]) == "-i" && i + 1 < argc) { iterations = std::stoul (std::string(argv[++i])); }
+    }
 
-    constexpr float acceptance_angle = 0.15f;
-    constexpr float focal_offset = 0.1f;
-    constexpr float radius = 0.2f;
+    demo::eyegen::geodesic_eye geo;
+    geo.frequency = 1u << iterations;
+    geo.acceptance_angle = 0.15f;
+    geo.focal_offset = 0.1f;
+    geo.radius = 0.2f;
 
-    for (unsigned int i = 0; i < geo.poly.vertices.size(); ++i) {
-        std::string ntxt = geo.poly.vertices[i].str_comma_separated(' '); // normals (vertices were already normalized)
-        std::string vtxt = (geo.poly.vertices[i] * radius).str_comma_separated(' ');
-        std::cout << vtxt << " " << ntxt << " " << acceptance_angle << " " << focal_offset << std::endl;
+    demo::threadpool pool;
+    if (!binpath.empty()) {
+        std::ofstream fout (binpath, std::ios::out | std::ios::trunc | std::ios::binary);
+        if (!fout.is_open()) {
+            std::cerr << "Could not open '" << binpath << "' for writing" << std::endl;
+            return 1;
+        }
+        demo::eyegen::write (geo, fout, demo::eyegen::format::binary, pool);
+        return fout.good() ? 0 : 1;
     }
 
+    demo::eyegen::write (geo, std::cout, demo::eyegen::format::text, pool);
+
     return 0;
 }
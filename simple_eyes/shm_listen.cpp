@@ -0,0 +1,82 @@
+/*
+ * An example reader of the shared memory frame ring (see include/shmring.h) that c_ray_mathplot
+ * publishes with --shm. Once a second it prints the frames received and skipped, their mean
+ * luminance and the latency from publication to reading. Brain models can start from this.
+ */
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdexcept>
+
+#include "shmring.h"
+
+int main (int argc, char** argv)
+{
+    using sc = std::chrono::steady_clock;
+
+    if (argc < 2) {
+        std::cout << "USAGE:\nshm_listen <ring name, as given to c_ray_mathplot --shm>\n";
+        return 1;
+    }
+    const std::string name = argv[1];
+
+    // Wait for the publisher, which makes the ring with its first frame
+    std::unique_ptr<demo::shm::reader> r;
+    while (!r) {
+        try {
+            r = std::make_unique<demo::shm::reader> (name);
+        } catch (const std::exception&) {
+            std::this_thread::sleep_for (std::chrono::milliseconds (100));
+        }
+    }
+    std::cout << "Reading " << r->n_ommatidia() << " ommatidia per frame (" << r->format().name() << ") from "
+              << r->n_slots() << " slots\n";
+    // Frames in a compact format are decoded into here; float32 RGB frames are read in place
+    std::vector<std::array<float, 3>> decoded;
+
+    uint64_t last = 0u;
+    uint64_t got = 0u;
+    uint64_t skipped = 0u;
+    double lum = 0.0;
+    double latency_ms = 0.0;
+    sc::time_point t_report = sc::now();
+    while (!r->closed() || r->newest() > last) {
+        uint64_t missed = 0u;
+        demo::shm::frame f = r->next (last, missed);
+        if (!f) {
+            // Nothing new; a real model would do its own work here
+            std::this_thread::sleep_for (std::chrono::microseconds (200));
+            continue;
+        }
+        // Read the frame in place, then check that it was not overwritten meanwhile
+        double l = 0.0;
+        if (!f.format().native()) { f.decode (decoded); }
+        std::span<const std::array<float, 3>> data = f.format().native() ? f.data() : std::span<const std::array<float, 3>>(decoded);
+        for (const auto& c : data) { l += 0.2126 * c[0] + 0.7152 * c[1] + 0.0722 * c[2]; }
+        const double ms = std::chrono::duration<double, std::milli>(sc::now() - f.timestamp()).count();
+        skipped += missed;
+        last = f.id();
+        if (!f.valid()) {
+            ++skipped;
+            continue;
+        }
+        ++got;
+        lum += l / static_cast<double>(data.size());
+        latency_ms += ms;
+
+        if (sc::now() - t_report >= std::chrono::seconds (1)) {
+            std::cout << got << " frames (" << skipped << " skipped), mean luminance " << lum / got
+                      << ", latency " << latency_ms / got << " ms" << std::endl;
+            got = skipped = 0u;
+            lum = latency_ms = 0.0;
+            t_report = sc::now();
+        }
+    }
+    std::cout << "The publisher has gone" << std::endl;
+    return 0;
+}
@@ -0,0 +1,265 @@
+/*
+ * c_ray_mathplot's headless batch mode on the CPU ray caster alone. It uses only the std-only
+ * headers (demo::cpu::eyerenderer, the retina and the frame outputs; no OptiX, CUDA, compound-ray
+ * or mathplot), so it builds and runs on GPU-less machines (cmake -DCPU_ONLY=ON). Each pose of a
+ * trajectory file is ray cast with the scene's compound eye cameras moving as one rig, as
+ * c_ray_mathplot -c --headless does, and the frames go to the same outputs.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "cpumaths.h"
+#include "cpueyerenderer.h"
+#include "scenecache.h"
+#include "trajectory.h"
+#include "retina.h"
+#include "frameoutputs.h"
+#include "outputformat.h"
+#include "stageprofiler.h"
+
+namespace demo
+{
+    void printHelp()
+    {
+        std::cout << "USAGE:\nc_ray_cpu -f <path to gltf scene> -t <trajectory file> [options]" << std::endl << std::endl;
+        std::cout << "\t-h\tDisplay this help information." << std::endl;
+        std::cout << "\t-f\tPath to a gltf scene file." << std::endl;
+        std::cout << "\t-b\tTransform the glTF into Blender's z-up axes." << std::endl;
+        std::cout << "\t-t\tPath to a camera pose trajectory file (see include/trajectory.h)." << std::endl;
+        std::cout << "\t-o\tPath for output frames (see include/framewriter.h)." << std::endl;
+        std::cout << "\t-s\tSamples per ommatidium (default: as the scene gives)." << std::endl;
+        std::cout << "\t-j\tThreads (default: all cores)." << std::endl;
+        std::cout << "\t--batch\tRay cast this many trajectory poses at once (default 16)." << std::endl;
+        std::cout << "\t--trace\tPrint per-stage timings and write them to this path as Chrome trace JSON." << std::endl;
+        std::cout << "\t--retina\tFilter the ommatidium outputs with this chain (see include/retina.h)." << std::endl;
+        std::cout << "\t--retina-k\tNeighbours per ommatidium for the retina's filters (default 6)." << std::endl;
+        std::cout << "\t--record\tAlso record the frames (or, with --events, their events) to this HDF5 file "
+                  << "(see include/recorder.h)." << std::endl;
+        std::cout << "\t--shm\tAlso publish the frames to a shared memory ring of this name "
+                  << "(see include/shmring.h)." << std::endl;
+        std::cout << "\t--output-format\trgb-f32 (default), rgb-f16, rgb-u8, lum-f32, lum-f16 or lum-u8 "
+                  << "(see include/outputformat.h)." << std::endl;
+        std::cout << "\t--events\tWrite -o and --record as events of changes larger than this "
+                  << "(see include/eventstream.h)." << std::endl;
+        std::cout << "\t--keyframe-every\tWith --events, write every ommatidium each this many steps "
+                  << "(default 60)." << std::endl;
+        std::cout << "\t--scene-cache\tCache processed scenes in this directory (default "
+                  << demo::cpu::scenecache::default_dir() << ")." << std::endl;
+        std::cout << "\t--no-scene-cache\tAlways parse the glTF file." << std::endl;
+    }
+
+    struct settings
+    {
+        std::string scene_path = "";
+        bool blender_axes = false;
+        std::string trajectory_path = "";
+        std::string trace_path = "";
+        // 0 to keep the scene's samples per ommatidium
+        int samples_per_omm = 0;
+        unsigned int threads = 0u;
+        unsigned int batch = 16u;
+        std::string retina_spec = "";
+        unsigned int retina_k = 6u;
+        std::string scene_cache_dir = demo::cpu::scenecache::default_dir();
+        // Where the frames go (see include/frameoutputs.h)
+        std::string output_path = "";
+        std::string record_path = "";
+        std::string shm_name = "";
+        demo::outputformat output_format = {};
+        float event_threshold = -1.0f;
+        uint32_t keyframe_every = 60u;
+    };
+
+    // Parse the command line into sets. Returns false (having said why) if the program should exit.
+    bool parse_inputs (int argc, char* argv[], settings& sets)
+    {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = std::string(argv[i]);
+            if (arg == "-h") {
+                printHelp();
+                return false;
+            } else if (arg == "-b") {
+                sets.blender_axes = true;
+                continue;
+            } else if (arg == "--no-scene-cache") {
+                sets.scene_cache_dir = "";
+                continue;
+            } else if (i + 1 >= argc) {
+                std::cerr << "Option " << arg << " needs a value" << std::endl;
+                return false;
+            }
+            std::string val = std::string(argv[++i]);
+            try {
+                if (arg == "-f") {
+                    sets.scene_path = val;
+                } else if (arg == "-t") {
+                    sets.trajectory_path = val;
+                } else if (arg == "-o") {
+                    sets.output_path = val;
+                } else if (arg == "-s") {
+                    sets.samples_per_omm = std::stoi (val);
+                } else if (arg == "-j") {
+                    sets.threads = static_cast<unsigned int>(std::stoul (val));
+                } else if (arg == "--batch") {
+                    sets.batch = static_cast<unsigned int>(std::stoul (val));
+                } else if (arg == "--trace") {
+                    sets.trace_path = val;
+                } else if (arg == "--retina") {
+                    sets.retina_spec = val;
+                } else if (arg == "--retina-k") {
+                    sets.retina_k = static_cast<unsigned int>(std::stoul (val));
+                } else if (arg == "--record") {
+                    sets.record_path = val;
+                } else if (arg == "--shm") {
+                    sets.shm_name = val;
+                } else if (arg == "--output-format") {
+                    sets.output_format = demo::outputformat::parse (val);
+                } else if (arg == "--events") {
+                    sets.event_threshold = std::stof (val);
+                } else if (arg == "--keyframe-every") {
+                    sets.keyframe_every = static_cast<uint32_t>(std::stoul (val));
+                } else if (arg == "--scene-cache") {
+                    sets.scene_cache_dir = val;
+                } else {
+                    std::cerr << "Unknown option " << arg << std::endl;
+                    return false;
+                }
+            } catch (const std::exception& e) {
+                std::cerr << "Bad value '" << val << "' for " << arg << " (" << e.what() << ")" << std::endl;
+                return false;
+            }
+        }
+        if (sets.scene_path.empty() || sets.trajectory_path.empty()) {
+            printHelp();
+            return false;
+        }
+        if (sets.event_threshold >= 0.0f
+            && sets.event_threshold < demo::eventencoder::min_threshold (sets.output_format)) {
+            std::cerr << "--events " << sets.event_threshold << " is below half of " << sets.output_format.name()
+                      << "'s step; using " << demo::eventencoder::min_threshold (sets.output_format) << std::endl;
+        }
+        return true;
+    }
+
+    int run (const settings& sets)
+    {
+        using sc = std::chrono::steady_clock;
+        using demo::cpu::operator*;
+
+        demo::cpu::eyerenderer r (sets.threads);
+        r.scene_cache_dir = sets.scene_cache_dir;
+        std::cout << "Loading glTF file \"" << sets.scene_path << "\"..." << std::endl;
+        r.load_gltf_scene (sets.scene_path, sets.blender_axes ? demo::cpu::blender_transform() : demo::cpu::identity());
+
+        // The compound eye cameras move as one rig with the first of them (as demo::eyerig)
+        std::vector<std::size_t> cameras;
+        std::vector<std::string> eye_paths;
+        for (std::size_t ci = 0; ci < r.camera_count(); ++ci) {
+            r.goto_camera (ci);
+            if (!r.is_compound_eye_active()) { continue; }
+            if (sets.samples_per_omm > 0) {
+                r.change_samples_per_ommatidium_by (sets.samples_per_omm - r.samples_per_ommatidium());
+            }
+            cameras.push_back (ci);
+            eye_paths.push_back (r.eye_data_path());
+        }
+        if (cameras.empty()) {
+            std::cerr << "There is no compound eye camera in the scene" << std::endl;
+            return 1;
+        }
+        r.goto_camera (cameras[0]);
+        const demo::cpu::mat4 primary_inv = demo::cpu::inverse (r.camera_pose (cameras[0]));
+        std::vector<demo::cpu::mat4> offsets;
+        std::vector<std::vector<demo::eyefile::ommatidium>> eyes;
+        std::size_t frame_size = 0u;
+        for (std::size_t ci : cameras) {
+            offsets.push_back (primary_inv * r.camera_pose (ci));
+            eyes.emplace_back (r.ommatidia (ci).begin(), r.ommatidia (ci).end());
+            frame_size += eyes.back().size();
+        }
+        std::cout << cameras.size() << " compound eye(s) of " << frame_size << " ommatidia, "
+                  << r.samples_per_ommatidium() << " samples per ommatidium, " << r.pool.size() << " threads" << std::endl;
+
+        demo::retina::bank retina (sets.threads);
+        if (!sets.retina_spec.empty()) {
+            retina.setup (eyes, eye_paths, demo::retina::parse (sets.retina_spec), sets.retina_k);
+        }
+
+        std::vector<demo::cpu::mat4> trajectory = demo::read_trajectory (sets.trajectory_path);
+        std::cout << "Running " << trajectory.size() << " trajectory steps headless..." << std::endl;
+
+        demo::frameoutputs outputs;
+        outputs.output_path = sets.output_path;
+        outputs.record_path = sets.record_path;
+        outputs.shm_name = sets.shm_name;
+        outputs.format = sets.output_format;
+        outputs.event_threshold = sets.event_threshold;
+        outputs.keyframe_every = sets.keyframe_every;
+        demo::fps::stage_profiler prof;
+        const int st_raycast = prof.add_stage ("ray cast");
+        const int st_retina = prof.add_stage ("retina");
+        const int st_write = prof.add_stage ("write");
+        const int ct_events = prof.add_counter ("events per step");
+        const std::size_t batch = std::max (1u, sets.batch);
+        std::vector<demo::cpu::mat4> eye_poses;
+        std::vector<std::array<float, 3>> batch_frames;
+        sc::time_point t0 = sc::now();
+        for (std::size_t step = 0; step < trajectory.size(); ++step) {
+            const std::size_t b = step % batch;
+            if (b == 0u) {
+                auto t = prof.time (st_raycast);
+                eye_poses.clear();
+                for (std::size_t s = step; s < std::min (step + batch, trajectory.size()); ++s) {
+                    for (std::size_t k = 0; k < cameras.size(); ++k) {
+                        eye_poses.push_back (k == 0u ? trajectory[s] : trajectory[s] * offsets[k]);
+                    }
+                }
+                r.render_batch (cameras, eye_poses, batch_frames);
+            }
+            std::span<std::array<float, 3>> f (batch_frames.data() + b * frame_size, frame_size);
+            {
+                auto t = prof.time (st_retina);
+                retina.run (f);
+            }
+            {
+                auto t = prof.time (st_write);
+                const std::size_t n_events = outputs.write (step, trajectory[step], f, static_cast<int>(cameras[0]));
+                if (outputs.event_threshold >= 0.0f && !outputs.output_path.empty()) {
+                    prof.count (ct_events, static_cast<double>(n_events));
+                }
+            }
+        }
+        outputs.finish();
+        double secs = std::chrono::duration<double>(sc::now() - t0).count();
+        double steps_per_sec = secs > 0.0 ? static_cast<double>(trajectory.size()) / secs : 0.0;
+        std::cout << trajectory.size() << " steps in " << secs << " s (" << steps_per_sec << " steps/s, "
+                  << steps_per_sec * static_cast<double>(frame_size) * r.samples_per_ommatidium()
+                  << " rays/s)" << std::endl;
+        if (!sets.trace_path.empty()) {
+            std::cout << prof.summary();
+            prof.write_chrome_trace (sets.trace_path);
+        }
+        return 0;
+    }
+} // namespace demo
+
+int main (int argc, char* argv[])
+{
+    demo::settings sets;
+    if (!demo::parse_inputs (argc, argv, sets)) { return 1; }
+    try {
+        return demo::run (sets);
+    } catch (const std::exception& e) {
+        std::cerr << "c_ray_cpu: " << e.what() << std::endl;
+        return 1;
+    }
+}
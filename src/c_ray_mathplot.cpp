@@ -3,23 +3,34 @@
 #include <array>
 #include <deque>
 #include <chrono>
+#include <memory>
 #include <sm/flags>
 
 #include <sampleConfig.h>
 
-#include "MulticamScene.h"
-#include "libEyeRenderer.h"
+#include "eyebackend.h"
+#include "optixbackend.h"
+#include "cpubackend.h"
+#include "eyerig.h"
 
 #include "eye3dvisual.h"
-#include "fpsprofiler.h"
-#include <mplot/compoundray/interop.h> // mathplot <--> compoundray interoperability
+#include "eyevisual.h"
+#include "stageprofiler.h"
+#include "trajectory.h"
+#include "cpuinterop.h"
+#include "pipeline.h"
+#include "framering.h"
+#include "spocontroller.h"
+#include "rendercache.h"
+#include "retina.h"
+#include "recorder.h"
+#include "frameoutputs.h"
+#include "simclock.h"
+#include "shmring.h"
+#include "outputformat.h"
 
-#include <mplot/compoundray/EyeVisual.h>
 #include <mplot/CoordArrows.h>
 
-// The compound-ray scene exists at global scope in libEyeRenderer.so. It has to be named 'scene'
-extern MulticamScene* scene;
-
 // When the program starts, how many samples per ommatidium/element do you want?
 constexpr int samples_per_omm_default = 64;
 
@@ -32,6 +43,47 @@ namespace demo
         std::cout << "\t-h\tDisplay this help information." << std::endl;
         std::cout << "\t-f\tPath to a gltf scene file (absolute or relative to current "
                   << "working directory, e.g. './data/axis_coloured_blocks.gltf')." << std::endl;
+        std::cout << "\t-b\tTransform the glTF into Blender's z-up axes." << std::endl;
+        std::cout << "\t-x\tPoll for events rather than waiting (maximum FPS)." << std::endl;
+        std::cout << "\t-c\tRay cast on the CPU (all cores) instead of with OptiX on the GPU." << std::endl;
+        std::cout << "\t-s\tSamples per ommatidium (default " << samples_per_omm_default << ")." << std::endl;
+        std::cout << "\t-p\tPipelined: ray cast on a worker thread while the window draws the last frame." << std::endl;
+        std::cout << "\t-a\tAccumulate samples over frames while the eye is still (progressive refinement). "
+                  << "With -c, each frame's rays go to the least converged ommatidia; with OptiX (whose "
+                  << "launches sample every ommatidium alike) this is a running mean of whole frames." << std::endl;
+        std::cout << "\t--always-render\tRay cast every frame, even when the eye, its pose and the scene "
+                  << "are unchanged (to see fresh sampling noise)." << std::endl;
+        std::cout << "\t--headless\tNo window. Ray cast each pose in the trajectory file (-t) as fast as "
+                  << "possible, writing ommatidium outputs to the file given with -o." << std::endl;
+        std::cout << "\t-t\tPath to a camera pose trajectory file (see include/trajectory.h)." << std::endl;
+        std::cout << "\t-o\tPath for headless output frames (see include/framewriter.h)." << std::endl;
+        std::cout << "\t--batch\tWith --headless, ray cast this many trajectory poses at once (default 16)." << std::endl;
+        std::cout << "\t--target-ms\tAdapt the samples per ommatidium to keep each ray cast near this "
+                  << "many milliseconds (Page Up/Page Down turn this off)." << std::endl;
+        std::cout << "\t--trace\tOn exit, print per-stage frame timings and write them to this path "
+                  << "as Chrome trace JSON." << std::endl;
+        std::cout << "\t--retina\tFilter the ommatidium outputs each frame with this chain, e.g. "
+                  << "'luminance,inhibit:0.8,rectify' (see include/retina.h)." << std::endl;
+        std::cout << "\t--retina-k\tNeighbours per ommatidium for the retina's filters (default 6)." << std::endl;
+        std::cout << "\t--record\tRecord each new frame's camera pose and ommatidium outputs to this HDF5 "
+                  << "file, in the background (see include/recorder.h)." << std::endl;
+        std::cout << "\t--shm\tPublish each new frame to other processes through a shared memory ring "
+                  << "of this name (see include/shmring.h)." << std::endl;
+        std::cout << "\t--output-format\tElement format for -o, --record and --shm: rgb-f32 (default), "
+                  << "rgb-f16, rgb-u8, lum-f32, lum-f16 or lum-u8 (see include/outputformat.h)." << std::endl;
+        std::cout << "\t--events\tWrite --record (and, with --headless, -o) as events: only the ommatidia that "
+                  << "changed by more than this since they last did (see include/eventstream.h)." << std::endl;
+        std::cout << "\t--keyframe-every\tWith --events, write every ommatidium each this many steps "
+                  << "(default 60; 0 for the first step only)." << std::endl;
+        std::cout << "\t--sim-hz\tSimulation steps (camera moves and ray casts) per simulated second "
+                  << "(default 60)." << std::endl;
+        std::cout << "\t--sim-speed\tSimulated seconds per real second (default 1); 0 runs the simulation "
+                  << "as fast as possible." << std::endl;
+        std::cout << "\t--display-hz\tDraw the window at most this often (default: every loop, or 30 Hz "
+                  << "with --sim-speed 0)." << std::endl;
+        std::cout << "\t--scene-cache\tCache processed scenes (with OptiX, the window's copy) in this directory "
+                  << "(default " << demo::cpu::scenecache::default_dir() << ")." << std::endl;
+        std::cout << "\t--no-scene-cache\tAlways parse the glTF file." << std::endl;
     }
     // Helper to plot coords
     mplot::CoordArrows<>* plot_axes (mplot::Visual<>* thevisual)
@@ -48,32 +100,229 @@ namespace demo
         blender_axes,     // Set true to transform glTF into Blender's z-up axes
         keep_moving,      // If true, movements keep moving
         max_fps,          // If true, poll, instead of wait to increase fps
+        cpu_backend,      // If true, ray cast with demo::cpubackend rather than OptiX
+        headless,         // If true, run a trajectory with no window
+        pipelined,        // If true, ray cast on a demo::raycast_pipeline worker thread
+        accumulate,       // If true, accumulate samples over frames while the eye is still
+        always_render,    // If true, ray cast every frame even if nothing has changed
         can_exit          // Can exit the program
     };
+    // Non-boolean settings from the cmd line
+    struct settings
+    {
+        int samples_per_omm = samples_per_omm_default;
+        std::string trajectory_path = "";
+        std::string output_path = "";
+        std::string trace_path = "";
+        // If > 0, adapt the samples per ommatidium to hold the ray cast time near this (ms)
+        double target_ms = 0.0;
+        // The retina's filter chain (see include/retina.h); empty for none
+        std::string retina_spec = "";
+        unsigned int retina_k = 6u;
+        // If set, record poses and ommatidium outputs to this HDF5 file (see include/recorder.h)
+        std::string record_path = "";
+        // If set, publish frames to a shared memory ring of this name (see include/shmring.h)
+        std::string shm_name = "";
+        // The encoding of ommatidium outputs in -o, --record and --shm (see include/outputformat.h)
+        demo::outputformat output_format = {};
+        // If >= 0, write -o (headless) and --record as events of changes larger than this (see include/eventstream.h)
+        float event_threshold = -1.0f;
+        uint32_t keyframe_every = 60u;
+        // The simulation clock (see include/simclock.h)
+        double sim_hz = 60.0;
+        double sim_speed = 1.0;
+        double display_hz = 0.0;
+        // Trajectory poses per ray cast in headless mode (see eyebackend::render_batch)
+        unsigned int batch = 16u;
+        // Where the CPU backend caches processed scenes; empty for no cache
+        std::string scene_cache_dir = demo::cpu::scenecache::default_dir();
+    };
     // Parse cmd line to find the path and set options
-    std::string parse_inputs (int argc, char* argv[], sm::flags<demo::options>& opts)
+    std::string parse_inputs (int argc, char* argv[], sm::flags<demo::options>& opts, demo::settings& sets)
     {
         std::string path = "";
         for (int i=0; i<argc; i++) {
             std::string arg = std::string(argv[i]);
-            if (arg == "-h") {
-                demo::printHelp();
+            try {
+                if (arg == "-h") {
+                    demo::printHelp();
+                    opts |= demo::options::can_exit;
+                } else if (arg == "-f" && i + 1 < argc) {
+                    i++;
+                    path = std::string(argv[i]);
+                } else if (arg == "-b") {
+                    opts |= demo::options::blender_axes;
+                } else if (arg == "-x") {
+                    opts |= demo::options::max_fps;
+                } else if (arg == "-c") {
+                    opts |= demo::options::cpu_backend;
+                } else if (arg == "-p") {
+                    opts |= demo::options::pipelined;
+                } else if (arg == "-a") {
+                    opts |= demo::options::accumulate;
+                } else if (arg == "--always-render") {
+                    opts |= demo::options::always_render;
+                } else if (arg == "--headless") {
+                    opts |= demo::options::headless;
+                } else if (arg == "-s" && i + 1 < argc) {
+                    i++;
+                    sets.samples_per_omm = std::stoi (std::string(argv[i]));
+                } else if (arg == "-t" && i + 1 < argc) {
+                    i++;
+                    sets.trajectory_path = std::string(argv[i]);
+                } else if (arg == "-o" && i + 1 < argc) {
+                    i++;
+                    sets.output_path = std::string(argv[i]);
+                } else if (arg == "--target-ms" && i + 1 < argc) {
+                    i++;
+                    sets.target_ms = std::stod (std::string(argv[i]));
+                } else if (arg == "--trace" && i + 1 < argc) {
+                    i++;
+                    sets.trace_path = std::string(argv[i]);
+                } else if (arg == "--retina" && i + 1 < argc) {
+                    i++;
+                    sets.retina_spec = std::string(argv[i]);
+                } else if (arg == "--retina-k" && i + 1 < argc) {
+                    i++;
+                    sets.retina_k = static_cast<unsigned int>(std::stoul (std::string(argv[i])));
+                } else if (arg == "--record" && i + 1 < argc) {
+                    i++;
+                    sets.record_path = std::string(argv[i]);
+                } else if (arg == "--shm" && i + 1 < argc) {
+                    i++;
+                    sets.shm_name = std::string(argv[i]);
+                } else if (arg == "--output-format" && i + 1 < argc) {
+                    i++;
+                    sets.output_format = demo::outputformat::parse (std::string(argv[i]));
+                } else if (arg == "--events" && i + 1 < argc) {
+                    i++;
+                    sets.event_threshold = std::stof (std::string(argv[i]));
+                } else if (arg == "--keyframe-every" && i + 1 < argc) {
+                    i++;
+                    sets.keyframe_every = static_cast<uint32_t>(std::stoul (std::string(argv[i])));
+                } else if (arg == "--batch" && i + 1 < argc) {
+                    i++;
+                    sets.batch = static_cast<unsigned int>(std::stoul (std::string(argv[i])));
+                } else if (arg == "--sim-hz" && i + 1 < argc) {
+                    i++;
+                    sets.sim_hz = std::stod (std::string(argv[i]));
+                } else if (arg == "--sim-speed" && i + 1 < argc) {
+                    i++;
+                    sets.sim_speed = std::stod (std::string(argv[i]));
+                } else if (arg == "--display-hz" && i + 1 < argc) {
+                    i++;
+                    sets.display_hz = std::stod (std::string(argv[i]));
+                } else if (arg == "--scene-cache" && i + 1 < argc) {
+                    i++;
+                    sets.scene_cache_dir = std::string(argv[i]);
+                } else if (arg == "--no-scene-cache") {
+                    sets.scene_cache_dir = "";
+                }
+            } catch (const std::exception& e) {
+                // A bad number (std::stoi and friends) or output format
+                std::cerr << "Bad value '" << argv[i] << "' for " << arg << " (" << e.what() << ")" << std::endl;
                 opts |= demo::options::can_exit;
-            } else if (arg == "-f") {
-                i++;
-                path = std::string(argv[i]);
-            } else if (arg == "-b") {
-                opts |= demo::options::blender_axes;
-            } else if (arg == "-x") {
-                opts |= demo::options::max_fps;
             }
         }
         if (path.empty()) {
             demo::printHelp();
             opts |= demo::options::can_exit;
         }
+        if (!(sets.sim_hz > 0.0)) {
+            std::cerr << "--sim-hz must be positive" << std::endl;
+            opts |= demo::options::can_exit;
+        }
+        if (sets.event_threshold >= 0.0f
+            && sets.event_threshold < demo::eventencoder::min_threshold (sets.output_format)) {
+            std::cerr << "--events " << sets.event_threshold << " is below half of " << sets.output_format.name()
+                      << "'s step; using " << demo::eventencoder::min_threshold (sets.output_format) << std::endl;
+        }
+        if (opts.test (demo::options::headless) && sets.trajectory_path.empty()) {
+            std::cerr << "--headless needs a trajectory file (-t)" << std::endl;
+            opts |= demo::options::can_exit;
+        }
         return path;
     }
+
+    /*
+     * Headless batch mode. Ray cast the compound eyes with the rig's primary camera at each pose
+     * of the trajectory (sets.batch poses per call to the backend) as fast as the backend
+     * allows, and write each step's ommatidium outputs (all the eyes, one after another) to
+     * sets.output_path (if set), after the retina's filters.
+     * With sets.record_path, the steps are also recorded to HDF5 by a background writer. With
+     * sets.event_threshold >= 0, sets.output_path holds events rather than whole frames.
+     */
+    int run_headless (demo::eyebackend& backend, const demo::eyerig& rig, demo::retina::bank& retina,
+                      const demo::settings& sets)
+    {
+        using sc = std::chrono::steady_clock;
+
+        if (rig.empty()) {
+            std::cerr << "There is no compound eye camera in the scene" << std::endl;
+            return 1;
+        }
+        std::vector<demo::cpu::mat4> trajectory = demo::read_trajectory (sets.trajectory_path);
+        std::cout << "Running " << trajectory.size() << " trajectory steps headless..." << std::endl;
+
+        demo::framering<> frames;
+        std::size_t n_omm = 0u;
+        demo::frameoutputs outputs;
+        outputs.output_path = sets.output_path;
+        outputs.record_path = sets.record_path;
+        outputs.shm_name = sets.shm_name;
+        outputs.format = sets.output_format;
+        outputs.event_threshold = sets.event_threshold;
+        outputs.keyframe_every = sets.keyframe_every;
+        demo::fps::stage_profiler prof;
+        const int st_raycast = prof.add_stage ("ray cast");
+        const int st_retina = prof.add_stage ("retina");
+        const int st_write = prof.add_stage ("write");
+        const int ct_events = prof.add_counter ("events per step");
+        // The poses are ray cast sets.batch at a time, into one contiguous buffer of frames
+        const std::size_t batch = std::max (1u, sets.batch);
+        std::vector<sm::mat44<float>> batch_poses;
+        std::vector<std::array<float, 3>> batch_frames;
+        const std::size_t frame_size = rig.frame_size();
+        sc::time_point t0 = sc::now();
+        for (std::size_t step = 0; step < trajectory.size(); ++step) {
+            const std::size_t b = step % batch;
+            if (b == 0u) {
+                auto t = prof.time (st_raycast);
+                batch_poses.clear();
+                for (std::size_t s = step; s < std::min (step + batch, trajectory.size()); ++s) {
+                    batch_poses.push_back (demo::to_mat44 (trajectory[s]));
+                }
+                rig.render_batch (backend, batch_poses, batch_frames);
+            }
+            demo::framering<>::frame& fw = frames.begin_write();
+            fw.data.assign (batch_frames.begin() + b * frame_size, batch_frames.begin() + (b + 1u) * frame_size);
+            {
+                auto t = prof.time (st_retina);
+                retina.run (fw.data);
+            }
+            frames.publish (trajectory[step], backend.camera_index());
+            demo::framering<>::view f = frames.latest();
+            n_omm = f.size();
+            {
+                auto t = prof.time (st_write);
+                const std::size_t n_events = outputs.write (step, f.pose(), f.data(), f.camera());
+                if (outputs.event_threshold >= 0.0f && !outputs.output_path.empty()) {
+                    prof.count (ct_events, static_cast<double>(n_events));
+                }
+            }
+        }
+        outputs.finish();
+        double secs = std::chrono::duration<double>(sc::now() - t0).count();
+        double steps_per_sec = secs > 0.0 ? static_cast<double>(trajectory.size()) / secs : 0.0;
+        std::cout << trajectory.size() << " steps in " << secs << " s (" << steps_per_sec << " steps/s, "
+                  << steps_per_sec * static_cast<double>(n_omm) * backend.samples_per_ommatidium()
+                  << " rays/s)" << std::endl;
+        if (!sets.trace_path.empty()) {
+            std::cout << prof.summary();
+            prof.write_chrome_trace (sets.trace_path);
+        }
+        return 0;
+    }
 } // namespace demo
 
 int main (int argc, char* argv[])
@@ -82,22 +331,64 @@ int main (int argc, char* argv[])
 
     // Program options and boolean state
     sm::flags<demo::options> opts;
-    std::string path = demo::parse_inputs (argc, argv, opts);
+    demo::settings sets;
+    std::string path = demo::parse_inputs (argc, argv, opts, sets);
     if (opts.test (demo::options::can_exit)) { return 1; }
 
-    // Boilerplate memory alloc for compound-ray
-    multicamAlloc();
-
-    std::vector<sm::vec<float, 3>> ommatidiaPositions;
-    std::vector<std::array<float, 3>> ommatidiaData;
-    std::vector<Ommatidium>* ommatidia = nullptr;
+    // Choose the ray caster. OptiX needs a GPU; the CPU backend runs anywhere.
+    std::unique_ptr<demo::eyebackend> backend;
+    demo::cpubackend* cpu = nullptr;
+    if (opts.test (demo::options::cpu_backend)) {
+        auto cb = std::make_unique<demo::cpubackend>();
+        cb->r.scene_cache_dir = sets.scene_cache_dir;
+        cpu = cb.get();
+        backend = std::move (cb);
+    } else {
+        auto ob = std::make_unique<demo::optixbackend>();
+        ob->scene_cache_dir = sets.scene_cache_dir;
+        backend = std::move (ob);
+    }
 
-    // Turn off verbose logging
-    setVerbosity (false);
     // Load the file
     std::cout << "Loading glTF file \"" << path << "\"..." << std::endl;
-    loadGlTFscene (path.c_str(), (opts.test(demo::options::blender_axes)
-                                  ? mplot::compoundray::blender_transform() : sutil::Matrix4x4::identity()));
+    std::chrono::steady_clock::time_point t_load = std::chrono::steady_clock::now();
+    backend->load_scene (path, opts.test(demo::options::blender_axes));
+    std::cout << "Loaded in " << std::chrono::duration<double>(std::chrono::steady_clock::now() - t_load).count() << " s"
+              << (cpu != nullptr && cpu->r.scene_from_cache ? " (from the scene cache)" : "") << std::endl;
+
+    // Collect the compound eye cameras (from their eye data paths in the glTF file) into a rig
+    // that moves with the first of them, and set their samples per ommatidium/element
+    demo::eyerig rig;
+    rig.setup (*backend);
+    if (!rig.empty()) {
+        int csamp = backend->samples_per_ommatidium();
+        std::cout << rig.size() << " compound eye(s); current eye samples per ommatidium is " << csamp << std::endl;
+        if (csamp < 32000) { rig.set_samples (*backend, sets.samples_per_omm); }
+    }
+
+    backend->set_accumulation (opts.test (demo::options::accumulate));
+
+    // The retina filters the eyes' outputs each frame, straight after the ray cast
+    demo::retina::bank retina;
+    if (!sets.retina_spec.empty() && !rig.empty()) {
+        try {
+            retina.setup (rig.eye_ommatidia (*backend), rig.eye_paths, demo::retina::parse (sets.retina_spec),
+                          sets.retina_k);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    // In headless mode there is no window; just run through the trajectory
+    if (opts.test (demo::options::headless)) {
+        try {
+            return demo::run_headless (*backend, rig, retina, sets);
+        } catch (const std::exception& e) {
+            std::cerr << "Headless run failed: " << e.what() << std::endl;
+            return 1;
+        }
+    }
 
     // Create a mathplot window (eye3dvisual derives from mplot::Visual) to render the eye/sensor
     demo::eye3dvisual v (2000, 1200, "Eye 3D (mathplot graphics)", opts.test(demo::options::blender_axes));
@@ -123,156 +414,369 @@ int main (int argc, char* argv[])
     v.speed = 0.05f;
     v.angularSpeed = 2.0f * mc::two_pi / 360.0f;
 
-    // Use a FPS profiler with a text object on screen
-    demo::fps::profiler fps_profiler;
+    // Use a FPS profiler with a text object on screen. It also times each stage of the main loop.
+    demo::fps::stage_profiler fps_profiler;
+    const int st_detect = fps_profiler.add_stage ("detect camera changes");
+    const int st_render = fps_profiler.add_stage ("mathplot render");
+    const int st_events = fps_profiler.add_stage ("event wait");
+    const int st_move = fps_profiler.add_stage ("camera move");
+    const int st_raycast = fps_profiler.add_stage ("ray cast");
+    const int st_retina = fps_profiler.add_stage ("retina");
+    const int st_data = fps_profiler.add_stage ("camera data");
+    const int ct_samples = fps_profiler.add_counter ("samples per ommatidium");
+    const int ct_uploaded = fps_profiler.add_counter ("ommatidium colours uploaded");
+    // In pipelined mode the retina runs on the worker, so its time is counted rather than timed
+    const int ct_retina_ms = fps_profiler.add_counter ("retina ms (worker)");
+    const int ct_drawn = fps_profiler.add_counter ("scene instances drawn");
+    const int ct_triangles = fps_profiler.add_counter ("scene triangles drawn");
+    const int ct_dropped = fps_profiler.add_counter ("frames dropped by the recorder");
+    const int ct_steps = fps_profiler.add_counter ("simulation steps per loop");
+
+    // Optionally, adapt the samples per ommatidium to a ray cast time budget
+    bool adapt_samples = sets.target_ms > 0.0;
+    if (adapt_samples && opts.test (demo::options::accumulate)) {
+        // Accumulated frames get cheaper as they converge, which would fool the controller
+        std::cout << "--target-ms is ignored with -a" << std::endl;
+        adapt_samples = false;
+    }
+    demo::spo_controller spo_control;
+    spo_control.target_ms = sets.target_ms;
     mplot::VisualTextModel<>* fps_label;
     v.addLabel ("0 FPS", {0.63f, -0.43f, 0.0f}, fps_label);
 
-    // We get the eye data path from the glTF file
-    std::string efpath("");
-    int ncam = static_cast<int>(getCameraCount());
-    int num_compound_cameras = 0;
-    int my_compound_camera = -1;
-    for (int ci = 0; ci < ncam; ++ci) {
-        gotoCamera (ci);
-        efpath = getEyeDataPath();
-        if (!efpath.empty()) {
-            ++num_compound_cameras;
-            my_compound_camera = ci;
-        }
-    }
-    if (num_compound_cameras > 1) {
-        throw std::runtime_error ("This program works for only one compound eye camera in your gltf.");
-    }
-    // Now switch to our compound ray camera and set the samples per ommatidium/element
-    if (my_compound_camera != -1) {
-        gotoCamera (my_compound_camera);
-        int csamp = getCurrentEyeSamplesPerOmmatidium();
-        std::cout << "Current eye samples per ommatidium is " << csamp << std::endl;
-        if (csamp < 32000) { changeCurrentEyeSamplesPerOmmatidiumBy (samples_per_omm_default - csamp); }
-    }
-
     // We get the initial camera localspace. This also serves to reset the camera pose. This is set in the GLTF file.
-    sm::mat44<float> initial_camera_space = mplot::compoundray::getCameraSpace (scene);
+    sm::mat44<float> initial_camera_space = backend->camera_space();
 
-    // Plot the visual models
-    mplot::compoundray::scene_to_visualmodels (scene, &v);
+    // Plot the visual models. Those of the scene are culled to the view and drawn at a level of
+    // detail that suits their distance; draw_stats counts what they drew each frame.
+    demo::scene_draw_stats draw_stats;
+    backend->add_scene_to (&v, &draw_stats);
 
-    // Create an EyeVisual 'eye' in our mathplot scene, v.
+    // Each eye of the rig gets an EyeVisual in our mathplot scene, v, with its own copy of the
+    // eye's outputs. The ommatidia are fetched now, before any pipeline worker takes the backend.
+    struct eye_model
+    {
+        std::vector<std::array<float, 3>> data;
+        std::vector<Ommatidium>* ommatidia = nullptr;
+        demo::eyevisual<>* vm = nullptr;
+        std::size_t last_size = 0u;
+    };
+    std::vector<eye_model> eyes (rig.size());
+    std::vector<std::vector<Ommatidium>*> rig_ommatidia;
     sm::vec<float, 3> offset = {};
-    auto eyevm = std::make_unique<mplot::compoundray::EyeVisual<>> (offset, &ommatidiaData, ommatidia);
-    v.bindmodel (eyevm);
-    eyevm->setViewMatrix (initial_camera_space);
-    eyevm->finalize();
-    mplot::compoundray::EyeVisual<>* eyevm_ptr = v.addVisualModel (eyevm);
+    for (std::size_t k = 0; k < rig.size(); ++k) {
+        rig_ommatidia.push_back (backend->ommatidia_of (rig.cameras[k]));
+        auto eyevm = std::make_unique<demo::eyevisual<>> (offset, &eyes[k].data, eyes[k].ommatidia);
+        v.bindmodel (eyevm);
+        eyevm->setViewMatrix (rig.pose_of (k, initial_camera_space));
+        eyevm->finalize();
+        eyes[k].vm = v.addVisualModel (eyevm);
+    }
 
     // Make CoordArrows axes to show our camera's localspace
     mplot::CoordArrows<>* cam_cs_ptr = demo::plot_axes (&v);
     cam_cs_ptr->setViewMatrix (initial_camera_space);
 
-    // We keep a track of the eye size. Used in subr_detect_camera_changes
-    size_t last_eye_size = 0u;
+    // Completed frames, in either mode (with -p, as the worker delivers them). A brain model can
+    // take a zero-copy view of the newest with frames.latest()
+    demo::framering<> frames;
+    // Skip ray casting while nothing has changed (unless refining with -a, or asked not to)
+    demo::render_cache frame_cache;
+    frame_cache.enabled = !opts.test (demo::options::always_render) && !opts.test (demo::options::accumulate);
+
+    // With --record, each step's frame is queued for the HDF5 recorder (made with the first frame,
+    // when its size is known) and written in the background; frames are dropped if the disk can't
+    // keep up. A step whose ray cast was skipped (nothing changed) records the last frame again. With
+    // -p, the worker may skip steps, so each frame it delivers is recorded under the step it was
+    // asked for. With --events, the recording holds events rather than frames. With --shm, each new
+    // frame is also published to other processes through a shared memory ring.
+    std::unique_ptr<demo::h5recorder> recorder;
+    std::unique_ptr<demo::shm::publisher> shm_out;
+    uint64_t frames_made = 0u;
+    auto record_frame = [&recorder, &shm_out, &sets, &frames_made, &fps_profiler, ct_dropped]
+                        (const uint64_t step, const std::array<float, 16>& pose, std::span<const std::array<float, 3>> data,
+                         const bool is_new = true)
+    {
+        if (is_new && !sets.shm_name.empty()) {
+            if (!shm_out) { shm_out = std::make_unique<demo::shm::publisher> (sets.shm_name, data.size(), 8u, sets.output_format); }
+            shm_out->publish (pose, data);
+        }
+        if (sets.record_path.empty()) { return; }
+        if (!recorder) {
+            recorder = std::make_unique<demo::h5recorder> (sets.record_path, data.size(), 64u, 4u, sets.output_format,
+                                                           sets.event_threshold, sets.keyframe_every);
+        }
+        recorder->record (step, pose, data);
+        ++frames_made;
+        fps_profiler.count (ct_dropped, static_cast<double>(recorder->dropped_frames()));
+    };
+
+    // The simulation's fixed timestep clock
+    demo::simclock sim;
+    sim.step_s = 1.0 / sets.sim_hz;
+    sim.speed = sets.sim_speed;
+    sim.display_hz = sets.display_hz;
+    // When running as fast as possible, don't draw the window every step
+    if (sim.unlimited() && !(sim.display_hz > 0.0)) { sim.display_hz = 30.0; }
+
+    // The samples per ommatidium that the GUI wants (changed with Page Up/Page Down)
+    int samples = backend->samples_per_ommatidium();
+
+    // In pipelined mode, the camera pose is kept here and handed to the ray casting worker
+    demo::cpu::mat4 gui_pose = demo::to_mat4 (initial_camera_space);
+    std::unique_ptr<demo::raycast_pipeline> pipeline;
+    if (opts.test (demo::options::pipelined)) {
+        pipeline = std::make_unique<demo::raycast_pipeline> (*backend, rig, initial_camera_space, samples, frame_cache.enabled,
+                                                             retina.empty() ? nullptr : &retina);
+    }
 
     /**
      * Subroutine lambda: Detect changes in the camera (in compound-ray there can be multiple
      * cameras, some compound, some non-compound).
      */
-    auto subr_detect_camera_changes = [&v, &ommatidia, &ommatidiaData, &ommatidiaPositions,
-                                       &last_eye_size, &eyevm_ptr, opts] ()
+    auto subr_detect_camera_changes = [&v, &eyes, &fps_profiler, ct_uploaded] ()
     {
-        size_t curr_eye_size = last_eye_size;
-        // Detect changes in the camera and update eye model as necessary
-        if (ommatidiaData.size() == 0) {
-            if (isCompoundEyeActive()) { getCameraData (ommatidiaData); }
-        } // else no need to re-get data
-
-        // Change the eye visual model to show the 'cones' of the compound eye visual model?
-        if (eyevm_ptr->show_cones != v.vstate.test(demo::eye3dvisual::state::show_cones)) {
-            eyevm_ptr->show_cones = v.vstate.test(demo::eye3dvisual::state::show_cones);
-            eyevm_ptr->reinit();
-        }
-        // Change the length of the cones?
-        if (eyevm_ptr->get_cone_length() != v.manual_cone_length) {
-            eyevm_ptr->set_cone_length (v.manual_cone_length);
-        }
-        // Update eyevm model (or just update colours)
-        eyevm_ptr->ommatidia = ommatidia;
-
-        if (ommatidia != nullptr) {
-            curr_eye_size = ommatidia->size();
-            if (curr_eye_size != last_eye_size) {
-                eyevm_ptr->reinit();
-                last_eye_size = curr_eye_size;
-            } else {
-                eyevm_ptr->reinitColours(); // 4x faster to just reinitColours
+        // Each eye's data and ommatidia arrive with the first frame
+        std::size_t uploaded = 0u;
+        for (eye_model& eye : eyes) {
+            // Change the eye visual model to show the 'cones' of the compound eye visual model?
+            if (eye.vm->show_cones != v.vstate.test(demo::eye3dvisual::state::show_cones)) {
+                eye.vm->show_cones = v.vstate.test(demo::eye3dvisual::state::show_cones);
+                eye.vm->reinit();
+                eye.vm->forget_colours();
+            }
+            // Change the length of the cones?
+            if (eye.vm->get_cone_length() != v.manual_cone_length) {
+                eye.vm->set_cone_length (v.manual_cone_length);
+            }
+            // Update eye model (or just update colours)
+            eye.vm->ommatidia = eye.ommatidia;
+
+            if (eye.ommatidia != nullptr) {
+                if (eye.ommatidia->size() != eye.last_size) {
+                    eye.vm->reinit();
+                    eye.vm->forget_colours();
+                    eye.last_size = eye.ommatidia->size();
+                } else {
+                    // Upload only the colours that changed (if any)
+                    uploaded += eye.vm->update_colours (eye.data);
+                }
             }
         }
+        fps_profiler.count (ct_uploaded, static_cast<double>(uploaded));
     };
 
     /**
      * Subroutine: Move the camera according to key events in the mathplot window
      */
-    auto subr_key_move_camera = [&v, &eyevm_ptr, &cam_cs_ptr, &initial_camera_space, opts]()
+    auto subr_key_move_camera = [&v, &backend, &pipeline, &gui_pose, &samples, &rig, &eyes, &cam_cs_ptr,
+                                 &initial_camera_space, &sim, opts]()
     {
-        cam_cs_ptr->setHide (!v.vstate.test(demo::eye3dvisual::state::show_camframe));
+        if (pipeline) {
+            // The worker owns the backend, so move our own copy of the pose and hand it over
+            if (v.isActivelyMoving()) {
+                sm::vec<float, 3> t = v.getMovementVector (opts.test(demo::options::keep_moving));
+                demo::cpu::translate_locally (gui_pose, { t.x(), t.y(), t.z() });
+                demo::cpu::rotate_locally (gui_pose, v.getVerticalRotationAngle (opts.test(demo::options::keep_moving)), { 1.0f, 0.0f, 0.0f });
+                demo::cpu::rotate_locally (gui_pose, v.getHorizontalRotationAngle (opts.test(demo::options::keep_moving)), { 0.0f, 1.0f, 0.0f });
+                demo::cpu::rotate_locally (gui_pose, v.getRollRotationAngle (opts.test(demo::options::keep_moving)), { 0.0f, 0.0f, 1.0f });
+            }
+            if (v.vstate.test (demo::eye3dvisual::state::campose_reset_request) == true) {
+                gui_pose = demo::to_mat4 (initial_camera_space);
+                v.stop(); // cancel any active movements
+                v.vstate.reset (demo::eye3dvisual::state::campose_reset_request);
+            }
+            sm::mat44<float> camera_space = demo::to_mat44 (gui_pose);
+            pipeline->request (camera_space, samples, sim.steps);
+            // The eye model follows the pose of each frame as it arrives; the axes follow the request
+            cam_cs_ptr->setViewMatrix (camera_space);
+            return;
+        }
 
         if (v.isActivelyMoving()) {
             sm::vec<float, 3> t = v.getMovementVector (opts.test(demo::options::keep_moving));
-            translateCamerasLocally (t.x(), t.y(), t.z());
+            backend->translate_cameras_locally (t.x(), t.y(), t.z());
             // Up-down (pitch) is rotation about local camera frame axis x
-            rotateCamerasLocallyAround (v.getVerticalRotationAngle (opts.test(demo::options::keep_moving)), 1.0f, 0.0f, 0.0f);
+            backend->rotate_cameras_locally_around (v.getVerticalRotationAngle (opts.test(demo::options::keep_moving)), 1.0f, 0.0f, 0.0f);
             // Left-and-right (yaw) is rotation about local camera frame axis y
-            rotateCamerasLocallyAround (v.getHorizontalRotationAngle (opts.test(demo::options::keep_moving)), 0.0f, 1.0f, 0.0f);
+            backend->rotate_cameras_locally_around (v.getHorizontalRotationAngle (opts.test(demo::options::keep_moving)), 0.0f, 1.0f, 0.0f);
             // Roll
-            rotateCamerasLocallyAround (v.getRollRotationAngle (opts.test(demo::options::keep_moving)), 0.0f, 0.0f, 1.0f);
+            backend->rotate_cameras_locally_around (v.getRollRotationAngle (opts.test(demo::options::keep_moving)), 0.0f, 0.0f, 1.0f);
         }
 
         // Get the camera space and update our eye and camera-frame models
-        sm::mat44<float> camera_space = mplot::compoundray::getCameraSpace (scene);
+        sm::mat44<float> camera_space = backend->camera_space();
 
         // reset to initial camera space if requested
         if (v.vstate.test (demo::eye3dvisual::state::campose_reset_request) == true) {
-            setCameraPoseMatrix (mplot::compoundray::mat44_to_Matrix4x4 (initial_camera_space));
+            backend->set_camera_space (initial_camera_space);
             v.stop(); // cancel any active movements
             camera_space = initial_camera_space;
             v.vstate.reset (demo::eye3dvisual::state::campose_reset_request);
         }
 
-        // Update the view matrix of eye and eye localspace axes
-        eyevm_ptr->setViewMatrix (camera_space);
+        // Update the view matrices of the eyes and the primary eye's localspace axes
+        for (std::size_t k = 0; k < eyes.size(); ++k) { eyes[k].vm->setViewMatrix (rig.pose_of (k, camera_space)); }
         cam_cs_ptr->setViewMatrix (camera_space);
     };
 
     /**
-     * The main program loop
+     * The main program loop. The simulation (camera movement and ray casting) advances in the
+     * fixed steps of the sim clock, as many in each loop as are due, so its speed does not depend
+     * on how fast the window draws. Space pauses it and f takes single steps while paused.
      */
 
     while (!v.readyToFinish()) {
 
         // Tell the fps_profiler that we're at the start of a loop
-        fps_profiler.at_begin (getCurrentEyeSamplesPerOmmatidium());
+        fps_profiler.at_begin (samples);
         fps_label->setupText (fps_profiler.fps_txt);
-        // The current camera may have changed, this subroutine deals with any changes
-        subr_detect_camera_changes();
-        // Now render the mathplot window
-        v.render();
-        // Save some electricity while developing - limit to 60 FPS. For max speed use v.poll() (-x)
-        if (opts.test (demo::options::max_fps)) { v.poll(); } else { v.waitevents (0.018); }
-        // Deal with any movements commanded by key press events (including reset)
-        subr_key_move_camera();
-        // Do the compound-ray ray casting to recompute the scene
-        renderFrame();
-        // Access data so that a brain model could be fed
-        if (isCompoundEyeActive()) {
-            getCameraData (ommatidiaData);
-            ommatidia = &scene->m_ommVecs[scene->getCameraIndex()];
+        // Draw the window (no more than sim.display_hz times a second)
+        if (sim.display_due()) {
+            // The current camera may have changed, this subroutine deals with any changes
+            {
+                auto t = fps_profiler.time (st_detect);
+                subr_detect_camera_changes();
+            }
+            // Now render the mathplot window
+            cam_cs_ptr->setHide (!v.vstate.test(demo::eye3dvisual::state::show_camframe));
+            {
+                auto t = fps_profiler.time (st_render);
+                draw_stats.reset();
+                v.render();
+            }
+            fps_profiler.count (ct_drawn, static_cast<double>(draw_stats.drawn));
+            fps_profiler.count (ct_triangles, static_cast<double>(draw_stats.triangles));
+        }
+        // Save some electricity while developing - wait for events until the next step is due
+        // (at most 18 ms). For max speed use v.poll() (-x)
+        const bool paused = v.vstate.test (demo::eye3dvisual::state::paused);
+        {
+            auto t = fps_profiler.time (st_events);
+            if (opts.test (demo::options::max_fps) || (sim.unlimited() && !paused)) {
+                v.poll();
+            } else {
+                v.waitevents (paused ? 0.018 : std::min (0.018, sim.until_due_s()));
+            }
+        }
+        // Page Up/Page Down change the samples per ommatidium (and take over from the controller)
+        int requested = v.requestedSamples (samples);
+        if (requested != samples && adapt_samples) {
+            std::cout << "Manual samples per ommatidium; adaptive control is off" << std::endl;
+            adapt_samples = false;
+        }
+        samples = requested;
+
+        // Take the simulation steps that are due
+        const bool single_step = v.vstate.test (demo::eye3dvisual::state::stepfwd);
+        v.vstate.reset (demo::eye3dvisual::state::stepfwd);
+        const unsigned int n_steps = sim.due (v.vstate.test (demo::eye3dvisual::state::paused), single_step);
+        const std::chrono::steady_clock::time_point t_steps = std::chrono::steady_clock::now();
+        for (unsigned int step = 0; step < n_steps; ++step) {
+            // Deal with any movements commanded by key press events (including reset)
+            {
+                auto t = fps_profiler.time (st_move);
+                subr_key_move_camera();
+            }
+            if (!pipeline) {
+                if (samples != backend->samples_per_ommatidium()) {
+                    rig.set_samples (*backend, samples);
+                    samples = backend->samples_per_ommatidium();
+                }
+                demo::render_key key { demo::to_mat4 (backend->camera_space()), samples,
+                                       backend->camera_index(), backend->scene_generation() };
+                if (backend->is_compound_eye_active() && frame_cache.hit (key)) {
+                    // Nothing the ray cast depends on has changed, so the last frame stands (and is
+                    // this step's frame)
+                    if (demo::framering<>::view f = frames.latest()) { record_frame (sim.steps, f.pose(), f.data(), false); }
+                } else if (backend->is_compound_eye_active()) {
+                    // Ray cast all the eyes straight into a free slot in the frame ring, filter it
+                    // with the retina, then publish it so that a brain model could be fed (consumers
+                    // read it in place)
+                    demo::framering<>::frame& fw = frames.begin_write();
+                    {
+                        auto t = fps_profiler.time (st_raycast);
+                        rig.render (*backend, fw.data);
+                    }
+                    if (!retina.empty()) {
+                        auto t = fps_profiler.time (st_retina);
+                        retina.run (fw.data);
+                    }
+                    frame_cache.store (key);
+                    if (adapt_samples) { samples = spo_control.update (fps_profiler.last (st_raycast) / 1000.0, samples); }
+                    auto t = fps_profiler.time (st_data);
+                    frames.publish (key.pose, key.camera);
+                    // Each EyeVisual draws from its eye's data, so the GUI keeps its own copies
+                    demo::framering<>::view f = frames.latest();
+                    record_frame (sim.steps, f.pose(), f.data());
+                    for (std::size_t k = 0; k < eyes.size(); ++k) {
+                        auto d = rig.eye_data (k, f.data());
+                        eyes[k].data.assign (d.begin(), d.end());
+                        eyes[k].ommatidia = rig_ommatidia[k];
+                    }
+                } else {
+                    // Do the compound-ray ray casting to recompute the scene
+                    auto t = fps_profiler.time (st_raycast);
+                    backend->render_frame();
+                }
+            }
+            sim.stepped();
+            // If the steps take too long, the simulation runs slower than asked rather than
+            // holding up the window
+            if (std::chrono::duration<double>(std::chrono::steady_clock::now() - t_steps).count() > sim.budget_s) {
+                sim.fall_behind();
+                break;
+            }
+        }
+        fps_profiler.count (ct_steps, static_cast<double>(n_steps));
+
+        if (pipeline) {
+            // Ray casting runs on the pipeline's worker (which was handed each step's pose); take
+            // its newest frame, if there is one, and publish it to the frame ring. Swapping (not
+            // copying) it into a ring slot hands that slot's old buffer back to the worker.
+            auto t = fps_profiler.time (st_data);
+            demo::eyeframe* f = nullptr;
+            try {
+                f = pipeline->latest();
+            } catch (const std::exception& e) {
+                // The worker has stopped, so no more frames would come
+                std::cerr << "Ray casting failed: " << e.what() << std::endl;
+                return 1;
+            }
+            if (f != nullptr) {
+                demo::framering<>::frame& fw = frames.begin_write();
+                fw.data.swap (f->data);
+                frames.publish (demo::to_mat4 (f->pose), rig.cameras[0]);
+                demo::framering<>::view fv = frames.latest();
+                record_frame (f->step, fv.pose(), fv.data());
+                for (std::size_t k = 0; k < eyes.size(); ++k) {
+                    auto d = rig.eye_data (k, fv.data());
+                    eyes[k].data.assign (d.begin(), d.end());
+                    eyes[k].ommatidia = rig_ommatidia[k];
+                    eyes[k].vm->setViewMatrix (rig.pose_of (k, f->pose));
+                }
+                if (adapt_samples) { samples = spo_control.update (f->render_ms, f->samples); }
+                if (!retina.empty()) { fps_profiler.count (ct_retina_ms, f->retina_ms); }
+            }
         }
+        fps_profiler.count (ct_samples, samples);
         // Mark that we got to the end of the loop
         fps_profiler.at_end();
     }
 
-    stop(); // stop compound-ray from running
-    multicamDealloc(); // De-allocate compound-ray memory
+    if (!sets.trace_path.empty()) {
+        std::cout << fps_profiler.summary();
+        fps_profiler.write_chrome_trace (sets.trace_path);
+        std::cout << "Wrote stage timings to " << sets.trace_path << std::endl;
+    }
+
+    if (recorder) {
+        const uint64_t dropped = recorder->dropped_frames();
+        // Wait for the queued frames to reach the file
+        recorder.reset();
+        std::cout << "Recorded " << frames_made - dropped << " frames to " << sets.record_path
+                  << " (" << dropped << " dropped)" << std::endl;
+    }
 
     return 0;
 }
@@ -0,0 +1,233 @@
+/*
+ * Tests of the CPU ray caster against brute force: the BVH's packet traversal finds the same
+ * nearest hits as intersecting every triangle, and the tracer gives an eye's ommatidia the colours
+ * of the triangles (or the sky) that their axes hit. Exits non-zero if any check fails.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "cpumaths.h"
+#include "cpuscene.h"
+#include "cpubvh.h"
+#include "cpueyerenderer.h"
+#include "eyefile.h"
+#include "threadpool.h"
+#include "testutil.h"
+
+namespace
+{
+    using testutil::check;
+    using namespace demo::cpu;
+
+    // The nearest hit of one ray on every triangle, in double precision. Returns -1 for a miss.
+    int32_t brute_force (const std::vector<bvh_triangle>& tris, const vec3& o, const vec3& d, float& t_hit)
+    {
+        int32_t best = -1;
+        double best_t = std::numeric_limits<double>::max();
+        for (std::size_t i = 0; i < tris.size(); ++i) {
+            const bvh_triangle& tr = tris[i];
+            const double px = double(d[1]) * tr.e2[2] - double(d[2]) * tr.e2[1];
+            const double py = double(d[2]) * tr.e2[0] - double(d[0]) * tr.e2[2];
+            const double pz = double(d[0]) * tr.e2[1] - double(d[1]) * tr.e2[0];
+            const double det = tr.e1[0] * px + tr.e1[1] * py + tr.e1[2] * pz;
+            if (std::fabs (det) <= 1e-12) { continue; }
+            const double sx = double(o[0]) - tr.v0[0];
+            const double sy = double(o[1]) - tr.v0[1];
+            const double sz = double(o[2]) - tr.v0[2];
+            const double u = (sx * px + sy * py + sz * pz) / det;
+            const double qx = sy * tr.e1[2] - sz * tr.e1[1];
+            const double qy = sz * tr.e1[0] - sx * tr.e1[2];
+            const double qz = sx * tr.e1[1] - sy * tr.e1[0];
+            const double v = (d[0] * qx + d[1] * qy + d[2] * qz) / det;
+            const double t = (tr.e2[0] * qx + tr.e2[1] * qy + tr.e2[2] * qz) / det;
+            if (u >= 0.0 && v >= 0.0 && u + v <= 1.0 && t > bvh::t_min && t < best_t) {
+                best_t = t;
+                best = static_cast<int32_t>(i);
+            }
+        }
+        t_hit = static_cast<float>(best_t);
+        return best;
+    }
+
+    std::vector<bvh_triangle> random_triangles (std::mt19937& rng, const std::size_t n)
+    {
+        std::uniform_real_distribution<float> centre (-10.0f, 10.0f);
+        std::uniform_real_distribution<float> edge (-1.0f, 1.0f);
+        std::vector<bvh_triangle> tris (n);
+        for (auto& tr : tris) {
+            tr.v0 = { centre (rng), centre (rng), centre (rng) };
+            tr.e1 = { edge (rng), edge (rng), edge (rng) };
+            tr.e2 = { edge (rng), edge (rng), edge (rng) };
+        }
+        return tris;
+    }
+
+    void test_bvh()
+    {
+        std::mt19937 rng (1u);
+        const std::vector<bvh_triangle> tris = random_triangles (rng, 3000u);
+        bvh accel;
+        accel.build (tris, std::vector<int32_t> (tris.size(), 0));
+        check (accel.triangles.size() == tris.size(), "the BVH holds every triangle");
+        check (accel.nodes.size() < 2u * tris.size(), "the BVH has fewer than 2n nodes");
+
+        std::uniform_real_distribution<float> u (-1.0f, 1.0f);
+        std::uniform_real_distribution<float> pos (-12.0f, 12.0f);
+        std::size_t rays = 0u;
+        std::size_t hits = 0u;
+        std::size_t disagree = 0u;
+        for (int p = 0; p < 500; ++p) {
+            // A packet of rays from one point that fan out, as an ommatidium's samples do
+            ray_packet<8> rp;
+            const vec3 o = { pos (rng), pos (rng), pos (rng) };
+            const vec3 axis = normalize (vec3{ u (rng), u (rng), u (rng) });
+            for (int k = 0; k < 8; ++k) {
+                const vec3 d = normalize (axis + vec3{ u (rng), u (rng), u (rng) } * 0.2f);
+                rp.ox[k] = o[0];
+                rp.oy[k] = o[1];
+                rp.oz[k] = o[2];
+                rp.dx[k] = d[0];
+                rp.dy[k] = d[1];
+                rp.dz[k] = d[2];
+                rp.t[k] = std::numeric_limits<float>::max();
+            }
+            accel.intersect (rp);
+            for (int k = 0; k < 8; ++k) {
+                float t = 0.0f;
+                const int32_t want = brute_force (tris, o, { rp.dx[k], rp.dy[k], rp.dz[k] }, t);
+                ++rays;
+                if (want >= 0) { ++hits; }
+                // The BVH reorders its triangles, so compare the hits by distance
+                const bool same = (want < 0) == (rp.tri[k] < 0) && (want < 0 || std::fabs (rp.t[k] - t) <= 1e-3f * std::max (1.0f, t));
+                if (!same) { ++disagree; }
+            }
+        }
+        check (hits > rays / 10u && hits < rays, "the rays both hit and miss");
+        // Rays that graze a triangle's edge may go either way in float precision
+        check (disagree <= rays / 1000u, "BVH nearest hits agree with brute force (" + std::to_string (disagree) + " differ)");
+
+        // Lanes with a zero maximum distance hit nothing
+        ray_packet<8> rp;
+        for (int k = 0; k < 8; ++k) {
+            rp.ox[k] = rp.oy[k] = rp.oz[k] = 0.0f;
+            rp.dx[k] = 1.0f;
+            rp.dy[k] = rp.dz[k] = 0.0f;
+            rp.t[k] = 0.0f;
+        }
+        accel.intersect (rp);
+        bool none = true;
+        for (int k = 0; k < 8; ++k) { none = none && rp.tri[k] == -1; }
+        check (none, "zero-length rays hit nothing");
+
+        bvh empty;
+        empty.build (std::vector<bvh_triangle>{}, std::vector<int32_t>{});
+        rp.t[0] = std::numeric_limits<float>::max();
+        empty.intersect (rp);
+        check (rp.tri[0] == -1, "an empty BVH is all misses");
+    }
+
+    void test_tracer()
+    {
+        std::mt19937 rng (2u);
+        std::uniform_real_distribution<float> u (-1.0f, 1.0f);
+        std::uniform_real_distribution<float> c01 (0.0f, 1.0f);
+
+        // A mesh of two primitives, placed twice, in a scene of four materials
+        scene sc;
+        for (int m = 0; m < 4; ++m) { sc.materials.push_back ({ "", { c01 (rng), c01 (rng), c01 (rng) } }); }
+        mesh me;
+        for (int p = 0; p < 2; ++p) {
+            primitive pr;
+            pr.material = p == 0 ? 1 : 3;
+            const std::vector<bvh_triangle> tris = random_triangles (rng, 400u);
+            for (const auto& tr : tris) {
+                pr.indices.push_back (static_cast<uint32_t>(pr.positions.size()));
+                pr.positions.push_back (tr.v0);
+                pr.indices.push_back (static_cast<uint32_t>(pr.positions.size()));
+                pr.positions.push_back (tr.v0 + tr.e1);
+                pr.indices.push_back (static_cast<uint32_t>(pr.positions.size()));
+                pr.positions.push_back (tr.v0 + tr.e2);
+            }
+            me.primitives.push_back (pr);
+        }
+        sc.meshes.push_back (me);
+        sc.instances.push_back ({ "a", 0u, identity() });
+        mat4 moved = identity();
+        moved[12] = 5.0f;
+        moved[14] = -3.0f;
+        sc.instances.push_back ({ "b", 0u, moved });
+
+        bvh accel;
+        accel.build (sc);
+        // The same world triangles, with their materials, for brute force
+        std::vector<bvh_triangle> world;
+        std::vector<int32_t> mats;
+        for (const auto& inst : sc.instances) {
+            for (const auto& p : sc.meshes[inst.mesh].primitives) {
+                for (std::size_t i = 0; i + 2 < p.indices.size(); i += 3) {
+                    const vec3 a = transform_point (inst.transform, p.positions[p.indices[i]]);
+                    const vec3 b = transform_point (inst.transform, p.positions[p.indices[i + 1]]);
+                    const vec3 c = transform_point (inst.transform, p.positions[p.indices[i + 2]]);
+                    world.push_back ({ a, b - a, c - a });
+                    mats.push_back (p.material);
+                }
+            }
+        }
+
+        // An eye of single-sample ommatidia, posed away from the origin
+        std::vector<demo::eyefile::ommatidium> omms (2000);
+        for (auto& o : omms) {
+            o.position = { 0.1f * u (rng), 0.1f * u (rng), 0.1f * u (rng) };
+            o.direction = { u (rng), u (rng), u (rng) };
+            o.acceptance_angle = 0.0f;
+        }
+        mat4 pose = identity();
+        pose[12] = 1.0f;
+        pose[13] = 2.0f;
+        pose[14] = 0.5f;
+        std::vector<std::array<float, 3>> out (omms.size());
+        eye_view ev;
+        ev.ommatidia = omms.data();
+        ev.n = omms.size();
+        ev.pose = pose;
+        ev.samples = 1;
+        ev.out = out.data();
+        tracer tr;
+        tr.sc = &sc;
+        tr.accel = &accel;
+        demo::threadpool pool (4u);
+        tr.trace (pool, &ev, 1u);
+
+        std::size_t hits = 0u;
+        std::size_t disagree = 0u;
+        for (std::size_t i = 0; i < omms.size(); ++i) {
+            const vec3 o = transform_point (pose, omms[i].position);
+            const vec3 d = normalize (transform_vector (pose, omms[i].direction));
+            float t = 0.0f;
+            const int32_t hit = brute_force (world, o, d, t);
+            const vec3 want = hit >= 0 ? sc.materials[static_cast<std::size_t>(mats[static_cast<std::size_t>(hit)])].colour : tr.sky (d);
+            if (hit >= 0) { ++hits; }
+            if (out[i] != want) { ++disagree; }
+        }
+        check (hits > omms.size() / 10u && hits < omms.size(), "the ommatidia see both the meshes and the sky");
+        check (disagree <= omms.size() / 500u, "tracer colours agree with brute force (" + std::to_string (disagree) + " differ)");
+    }
+} // namespace
+
+int main()
+{
+    return testutil::run ("BVH and tracer", [] {
+        test_bvh();
+        test_tracer();
+    });
+}
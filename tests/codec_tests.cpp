@@ -0,0 +1,113 @@
+/*
+ * Tests of the output formats (outputformat.h): every float16 round trips, with round to nearest
+ * even and the special values; uint8 clamps and round trips; and each format's codec and name.
+ * Exits non-zero if any check fails.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "outputformat.h"
+#include "testutil.h"
+
+namespace
+{
+    using testutil::check;
+    using testutil::throws;
+
+    void test_half()
+    {
+        using namespace demo::outputcodec;
+        // Every half converts to a float and back to itself (NaNs stay NaN)
+        for (uint32_t h = 0; h < 0x10000u; ++h) {
+            const float f = from_half (static_cast<uint16_t>(h));
+            const bool nan = (h & 0x7c00u) == 0x7c00u && (h & 0x3ffu) != 0u;
+            if (nan) {
+                check (std::isnan (f) && std::isnan (from_half (to_half (f))), "half NaN " + std::to_string (h));
+            } else {
+                check (to_half (f) == h, "half round trip " + std::to_string (h));
+            }
+        }
+        // Known values
+        check (from_half (0x0001u) == std::ldexp (1.0f, -24), "smallest subnormal half");
+        check (from_half (0x03ffu) == std::ldexp (1023.0f, -24), "largest subnormal half");
+        check (from_half (0x0400u) == std::ldexp (1.0f, -14), "smallest normal half");
+        check (from_half (0x7bffu) == 65504.0f && to_half (65504.0f) == 0x7bffu, "largest half, 65504");
+        check (to_half (65520.0f) == 0x7c00u, "65520 rounds up to infinity");
+        check (to_half (std::numeric_limits<float>::infinity()) == 0x7c00u, "infinity");
+        check (to_half (-std::numeric_limits<float>::infinity()) == 0xfc00u, "minus infinity");
+        check (std::isinf (from_half (0x7c00u)) && from_half (0xfc00u) < 0.0f, "infinities from half");
+        check ((to_half (std::numeric_limits<float>::quiet_NaN()) & 0x7fffu) > 0x7c00u, "NaN to half");
+        check (to_half (-0.0f) == 0x8000u && std::signbit (from_half (0x8000u)), "minus zero");
+        check (to_half (std::ldexp (1.0f, -25)) == 0x0000u, "half of the smallest subnormal rounds to even (zero)");
+        check (to_half (std::ldexp (3.0f, -25)) == 0x0002u, "1.5 smallest subnormals round to even (2)");
+        check (to_half (1.0f + std::ldexp (1.0f, -11)) == 0x3c00u, "1 + half an ulp rounds to even (1)");
+        check (to_half (1.0f + std::ldexp (3.0f, -11)) == 0x3c02u, "1 + 1.5 ulp rounds to even");
+        // Floats to half and back are within half an ulp
+        std::mt19937 rng (1u);
+        std::uniform_real_distribution<float> u (-70000.0f, 70000.0f);
+        for (int i = 0; i < 100000; ++i) {
+            const float f = u (rng);
+            const float g = from_half (to_half (f));
+            if (std::fabs (f) >= 65520.0f) {
+                check (std::isinf (g), "overflow to infinity");
+            } else {
+                const float ulp = std::ldexp (1.0f, std::max (std::ilogb (f), -14) - 10);
+                check (std::fabs (g - f) <= 0.5f * ulp, "half rounding error of " + std::to_string (f));
+            }
+        }
+    }
+
+    void test_u8_and_codecs()
+    {
+        using namespace demo;
+        check (outputcodec::to_u8 (-0.5f) == 0u && outputcodec::to_u8 (0.0f) == 0u, "u8 clamps below 0");
+        check (outputcodec::to_u8 (1.0f) == 255u && outputcodec::to_u8 (7.0f) == 255u, "u8 clamps above 1");
+        check (outputcodec::to_u8 (0.5f) == 128u, "u8 rounds 0.5 to 128");
+        for (uint32_t v = 0; v < 256u; ++v) {
+            check (outputcodec::to_u8 (outputcodec::from_u8 (static_cast<uint8_t>(v))) == v, "u8 round trip " + std::to_string (v));
+        }
+
+        const std::vector<std::array<float, 3>> in = { { 0.0f, 0.0f, 0.0f }, { 1.0f, 0.5f, 0.25f },
+                                                       { 0.2f, 0.9f, 0.4f }, { 2.0f, -1.0f, 0.5f }, { 0.3f, 0.3f, 0.3f } };
+        for (const char* name : { "rgb-f32", "rgb-f16", "rgb-u8", "lum-f32", "lum-f16", "lum-u8" }) {
+            const outputformat fmt = outputformat::parse (name);
+            check (outputformat::parse (fmt.name()).code() == fmt.code(), std::string("format name ") + name);
+            check (outputformat::from_code (fmt.code()).name() == fmt.name(), std::string("format code ") + name);
+            std::vector<uint8_t> bytes (in.size() * fmt.bytes_per_ommatidium());
+            outputcodec::encode (in, fmt, bytes.data());
+            std::vector<std::array<float, 3>> out (in.size());
+            outputcodec::decode (bytes.data(), fmt, out);
+            const float tol = fmt.type == outputformat::element::u8 ? 0.5f / 255.0f + 1e-6f
+                              : (fmt.type == outputformat::element::f16 ? 1e-3f : 1e-6f);
+            for (std::size_t i = 0; i < in.size(); ++i) {
+                for (int c = 0; c < 3; ++c) {
+                    float want = fmt.luminance ? outputcodec::luminance (in[i][0], in[i][1], in[i][2]) : in[i][c];
+                    if (fmt.type == outputformat::element::u8) { want = std::clamp (want, 0.0f, 1.0f); }
+                    check (std::fabs (out[i][c] - want) <= tol, std::string("codec ") + name + " value " + std::to_string (i));
+                }
+                // Luminance is spread across all three channels
+                if (fmt.luminance) { check (out[i][0] == out[i][1] && out[i][1] == out[i][2], std::string("spread ") + name); }
+            }
+        }
+        check (throws ([] { outputformat::parse ("rgb-f64"); }), "unknown format name");
+        check (throws ([] { outputformat::from_code (3u); }), "unknown format code");
+    }
+} // namespace
+
+int main()
+{
+    return testutil::run ("output format", [] {
+        test_half();
+        test_u8_and_codecs();
+    });
+}
@@ -0,0 +1,165 @@
+/*
+ * Tests of the event output (eventstream.h): replaying the events stays within the threshold in
+ * every format with keyframes at the interval, the threshold's floor at half a compact format's
+ * step, and h5recorder's events mode. Exits non-zero if any check fails.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include <hdf5.h>
+
+#include "outputformat.h"
+#include "eventstream.h"
+#include "recorder.h"
+#include "testutil.h"
+
+namespace
+{
+    using testutil::check;
+    using testutil::throws;
+    using testutil::temp_path;
+
+    void test_events()
+    {
+        using namespace demo;
+        const std::size_t n = 5000;
+        const float threshold = 0.02f;
+        for (const char* name : { "rgb-f32", "rgb-f16", "rgb-u8", "lum-f16", "lum-u8" }) {
+            const outputformat fmt = outputformat::parse (name);
+            std::mt19937 rng (3u);
+            std::normal_distribution<float> step (0.0f, 0.01f);
+            std::vector<std::array<float, 3>> frame (n, { 0.5f, 0.5f, 0.5f });
+            std::vector<std::array<float, 3>> replay (n);
+            eventencoder enc (n, threshold, 16u, fmt);
+            eventframe ev;
+            float worst = 0.0f;
+            std::size_t keyframes = 0u;
+            for (int k = 0; k < 64; ++k) {
+                for (std::size_t i = 0; i < n; i += 3) {
+                    for (float& c : frame[i]) { c = std::clamp (c + step (rng), 0.0f, 1.0f); }
+                }
+                enc.encode (frame, ev);
+                keyframes += ev.keyframe ? 1u : 0u;
+                // Replay from the encoded bytes, as a reader of the event file would
+                if (!fmt.native()) { outputcodec::decode (enc.encoded().data(), fmt, ev.values); }
+                apply_events (ev, replay);
+                for (std::size_t i = 0; i < n; ++i) {
+                    for (int c = 0; c < 3; ++c) {
+                        const float truth = fmt.luminance ? outputcodec::luminance (frame[i][0], frame[i][1], frame[i][2]) : frame[i][c];
+                        worst = std::max (worst, std::fabs (replay[i][c] - truth));
+                    }
+                }
+            }
+            check (worst <= threshold * 1.0001f, std::string("event replay within the threshold for ") + name);
+            check (keyframes == 4u, std::string("a keyframe every 16 frames for ") + name);
+            check (enc.event_fraction() < 0.5, std::string("events are sparse for ") + name);
+        }
+        check (throws ([] { eventencoder e (10u, -1.0f); }), "negative event threshold");
+    }
+    void test_event_threshold_floor()
+    {
+        using namespace demo;
+        check (eventencoder::min_threshold (outputformat::parse ("rgb-u8")) == 0.5f / 255.0f
+               && eventencoder::min_threshold (outputformat::parse ("lum-f32")) == 0.0f, "event threshold floors");
+        // Values between the format's steps, unchanged from frame to frame, emit nothing after the keyframe
+        const std::size_t n = 1000;
+        std::mt19937 rng (4u);
+        std::uniform_real_distribution<float> u (0.0f, 1.0f);
+        std::vector<std::array<float, 3>> frame (n);
+        for (auto& c : frame) { c = { u (rng), u (rng), u (rng) }; }
+        for (const char* name : { "rgb-f16", "rgb-u8", "lum-u8" }) {
+            const outputformat fmt = outputformat::parse (name);
+            eventencoder enc (n, 0.0f, 0u, fmt);
+            check (enc.threshold == eventencoder::min_threshold (fmt), std::string("threshold raised to the floor for ") + name);
+            eventframe ev;
+            enc.encode (frame, ev);
+            enc.encode (frame, ev);
+            check (!ev.keyframe && ev.size() == 0u, std::string("an unchanging frame emits nothing in ") + name);
+        }
+    }
+
+    template <typename T>
+    std::vector<T> read_dataset (const hid_t file, const char* name, const hid_t type)
+    {
+        const hid_t ds = H5Dopen2 (file, name, H5P_DEFAULT);
+        if (ds < 0) { throw std::runtime_error (std::string("no dataset ") + name); }
+        const hid_t space = H5Dget_space (ds);
+        std::vector<T> v (static_cast<std::size_t>(H5Sget_simple_extent_npoints (space)));
+        const herr_t err = v.empty() ? 0 : H5Dread (ds, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, v.data());
+        H5Sclose (space);
+        H5Dclose (ds);
+        if (err < 0) { throw std::runtime_error (std::string("could not read ") + name); }
+        return v;
+    }
+
+    void test_recorded_events()
+    {
+        using namespace demo;
+        const std::size_t n = 300;
+        const float threshold = 0.02f;
+        const std::string path = temp_path ("event_tests.h5");
+        std::mt19937 rng (5u);
+        std::normal_distribution<float> step (0.0f, 0.01f);
+        std::vector<std::vector<std::array<float, 3>>> frames (10u, std::vector<std::array<float, 3>> (n, { 0.5f, 0.5f, 0.5f }));
+        {
+            h5recorder rec (path, n, 4u, 4u, outputformat::parse ("rgb-u8"), threshold, 4u);
+            rec.wait_when_full = true;
+            std::array<float, 16> pose = {};
+            for (std::size_t k = 0; k < frames.size(); ++k) {
+                if (k > 0u) { frames[k] = frames[k - 1u]; }
+                for (std::size_t i = 0; i < n; i += 2) {
+                    for (float& c : frames[k][i]) { c = std::clamp (c + step (rng), 0.0f, 1.0f); }
+                }
+                rec.record (k, pose, frames[k]);
+            }
+        }
+
+        // Replay the file's events, as a reader of the recording would
+        const hid_t file = H5Fopen (path.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+        check (file >= 0, "open the event recording");
+        if (file < 0) { return; }
+        check (H5Lexists (file, "/frames", H5P_DEFAULT) == 0, "an event recording has no /frames");
+        const auto counts = read_dataset<uint32_t> (file, "/event_counts", H5T_NATIVE_UINT32);
+        const auto keys = read_dataset<uint8_t> (file, "/keyframes", H5T_NATIVE_UINT8);
+        const auto indices = read_dataset<uint32_t> (file, "/event_indices", H5T_NATIVE_UINT32);
+        const auto values = read_dataset<uint8_t> (file, "/event_values", H5T_NATIVE_UINT8);
+        H5Fclose (file);
+        check (counts.size() == frames.size() && keys.size() == frames.size(), "a count and keyframe flag per frame");
+        check (values.size() == 3u * indices.size(), "a value per event index");
+        std::vector<std::array<float, 3>> replay (n);
+        std::size_t e = 0u;
+        float worst = 0.0f;
+        for (std::size_t k = 0; k < counts.size() && k < frames.size(); ++k) {
+            check ((keys[k] != 0u) == (k % 4u == 0u), "recorded keyframes every 4 frames");
+            for (uint32_t j = 0; j < counts[k] && e < indices.size(); ++j, ++e) {
+                for (int c = 0; c < 3; ++c) { replay[indices[e]][c] = outputcodec::from_u8 (values[3u * e + c]); }
+            }
+            for (std::size_t i = 0; i < n; ++i) {
+                for (int c = 0; c < 3; ++c) { worst = std::max (worst, std::fabs (replay[i][c] - frames[k][i][c])); }
+            }
+        }
+        check (e == indices.size(), "the counts cover every recorded event");
+        check (worst <= threshold * 1.0001f, "recorded events replay within the threshold");
+        std::filesystem::remove (path);
+    }
+} // namespace
+
+int main()
+{
+    return testutil::run ("event", [] {
+        test_events();
+        test_event_threshold_floor();
+        test_recorded_events();
+    });
+}
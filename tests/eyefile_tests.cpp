@@ -0,0 +1,102 @@
+/*
+ * Tests of demo::eyefile: text to binary eye file round trips, and the rejection of truncated
+ * and corrupt binary files. Exits non-zero if any check fails.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "eyefile.h"
+#include "testutil.h"
+
+namespace
+{
+    using testutil::check;
+    using testutil::throws;
+    using testutil::temp_path;
+
+    void test_eyefile()
+    {
+        using namespace demo::eyefile;
+        std::vector<ommatidium> omms (1000);
+        std::mt19937 rng (2u);
+        std::uniform_real_distribution<float> u (-1.0f, 1.0f);
+        for (auto& o : omms) {
+            o.position = { u (rng), u (rng), u (rng) };
+            o.direction = { u (rng), u (rng), u (rng) };
+            o.acceptance_angle = std::fabs (u (rng));
+            o.focal_offset = u (rng);
+        }
+        const std::string text = temp_path ("eyefile_tests.eye");
+        const std::string bin = temp_path ("eyefile_tests.eyeb");
+        const std::string bin2 = temp_path ("eyefile_tests2.eyeb");
+        const std::string bad = temp_path ("eyefile_tests_bad.eyeb");
+
+        // text -> binary -> text gives back the same ommatidia
+        write_text (text, omms);
+        {
+            eye e (text);
+            check (!is_binary (text) && e.size() == omms.size(), "text eye size");
+            write_binary (bin, e.ommatidia());
+        }
+        {
+            eye e (bin);
+            check (is_binary (bin) && e.size() == omms.size(), "binary eye size");
+            bool same = true;
+            for (std::size_t i = 0; i < omms.size(); ++i) {
+                const ommatidium& a = omms[i];
+                const ommatidium& b = e.ommatidia()[i];
+                same = same && a.position == b.position && a.direction == b.direction
+                       && a.acceptance_angle == b.acceptance_angle && a.focal_offset == b.focal_offset;
+            }
+            check (same, "text to binary round trip is exact");
+            write_text (text, e.ommatidia());
+        }
+        {
+            eye e (text);
+            write_binary (bin2, e.ommatidia());
+        }
+        {
+            std::ifstream a (bin, std::ios::binary);
+            std::ifstream b (bin2, std::ios::binary);
+            const std::string sa ((std::istreambuf_iterator<char>(a)), std::istreambuf_iterator<char>());
+            const std::string sb ((std::istreambuf_iterator<char>(b)), std::istreambuf_iterator<char>());
+            check (!sa.empty() && sa == sb, "binary to text to binary is byte identical");
+        }
+
+        // A truncated binary file is rejected
+        std::filesystem::copy_file (bin, bad, std::filesystem::copy_options::overwrite_existing);
+        std::filesystem::resize_file (bad, std::filesystem::file_size (bad) - 1u);
+        check (throws ([&] { eye e (bad); }), "truncated binary eye");
+        // So is one whose count would wrap the size check
+        {
+            std::fstream f (bad, std::ios::in | std::ios::out | std::ios::binary);
+            const uint64_t huge = std::numeric_limits<uint64_t>::max() / sizeof (ommatidium) + 2u;
+            f.seekp (16);
+            f.write (reinterpret_cast<const char*>(&huge), sizeof (huge));
+        }
+        check (throws ([&] { eye e (bad); }), "binary eye with a corrupt count");
+        // And a file shorter than the header
+        std::filesystem::resize_file (bad, 10u);
+        check (throws ([&] { eye e (bad); }), "binary eye shorter than its header");
+
+        for (const auto& p : { text, bin, bin2, bad }) { std::filesystem::remove (p); }
+    }
+} // namespace
+
+int main()
+{
+    return testutil::run ("eye file", [] {
+        test_eyefile();
+    });
+}
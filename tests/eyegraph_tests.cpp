@@ -0,0 +1,161 @@
+/*
+ * Tests of the ommatidium neighbour graphs (eyegraph.h): build()'s grid search finds the same k
+ * nearest neighbours as a brute force search, for random eyes and a real one; the symmetric graph
+ * is mutual; and graphs survive a round trip through their file. Exits non-zero if any check
+ * fails.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "cpumaths.h"
+#include "eyefile.h"
+#include "eyegraph.h"
+#include "threadpool.h"
+#include "testutil.h"
+
+namespace
+{
+    using testutil::check;
+    using testutil::throws;
+    using testutil::temp_path;
+    using demo::eyefile::ommatidium;
+    using demo::cpu::operator-;
+    using demo::cpu::operator*;
+
+    /*
+     * Check g against a brute force kNN search of omms: each ommatidium's neighbours must be
+     * nearest first and as near as the brute force k nearest (ties may pick either).
+     */
+    void check_knn (const std::vector<ommatidium>& omms, const demo::eyegraph::graph& g, const unsigned int k,
+                    const std::string& what)
+    {
+        const std::size_t n = omms.size();
+        std::vector<demo::cpu::vec3> dirs (n);
+        for (std::size_t i = 0; i < n; ++i) { dirs[i] = demo::cpu::normalize (omms[i].direction); }
+        auto chord2 = [&](std::size_t i, std::size_t j) {
+            const demo::cpu::vec3 d = dirs[j] - dirs[i];
+            return demo::cpu::dot (d, d);
+        };
+        std::size_t wrong = 0u;
+        std::vector<float> all;
+        for (std::size_t i = 0; i < n; ++i) {
+            all.clear();
+            for (std::size_t j = 0; j < n; ++j) { if (j != i) { all.push_back (chord2 (i, j)); } }
+            std::sort (all.begin(), all.end());
+            const auto nb = g.neighbours (i);
+            bool ok = nb.size() == k;
+            for (std::size_t q = 0; ok && q < nb.size(); ++q) {
+                ok = nb[q] != i && std::fabs (chord2 (i, nb[q]) - all[q]) <= 1e-6f;
+                // The angles match the neighbours and go nearest first
+                const float ang = std::acos (std::clamp (demo::cpu::dot (dirs[i], dirs[nb[q]]), -1.0f, 1.0f));
+                ok = ok && std::fabs (g.neighbour_angles (i)[q] - ang) <= 1e-3f;
+                ok = ok && (q == 0u || g.neighbour_angles (i)[q - 1u] <= g.neighbour_angles (i)[q] + 1e-6f);
+            }
+            if (!ok) { ++wrong; }
+        }
+        check (wrong == 0u, what + ": kNN agrees with brute force (" + std::to_string (wrong) + " ommatidia differ)");
+    }
+
+    std::vector<ommatidium> random_eye (std::mt19937& rng, const std::size_t n)
+    {
+        std::normal_distribution<float> gauss (0.0f, 1.0f);
+        std::uniform_real_distribution<float> scale (0.1f, 10.0f);
+        std::vector<ommatidium> omms (n);
+        for (std::size_t i = 0; i < n; ++i) {
+            // Uniform over the sphere, except for a dense cluster, at assorted lengths
+            demo::cpu::vec3 d = { gauss (rng), gauss (rng), gauss (rng) };
+            if (i % 4u == 0u) { d = { 0.05f * gauss (rng), 0.05f * gauss (rng), 1.0f }; }
+            omms[i].direction = demo::cpu::normalize (d) * scale (rng);
+        }
+        return omms;
+    }
+
+    void test_knn()
+    {
+        demo::threadpool pool (4u);
+        std::mt19937 rng (1u);
+        const std::vector<ommatidium> omms = random_eye (rng, 3000u);
+        for (unsigned int k : { 1u, 6u, 12u }) {
+            check_knn (omms, demo::eyegraph::build (omms, k, pool), k, "random eye, k " + std::to_string (k));
+        }
+        // A real eye, whose directions lie on a regular lattice
+        demo::eyefile::eye poly (std::string(TEST_DATA_DIR) + "/eyes/poly.eye");
+        const std::vector<ommatidium> real (poly.ommatidia().begin(), poly.ommatidia().end());
+        check_knn (real, demo::eyegraph::build (real, 6u, pool), 6u, "poly.eye");
+
+        // k is limited to the other ommatidia
+        const std::vector<ommatidium> three (omms.begin(), omms.begin() + 3);
+        const demo::eyegraph::graph small = demo::eyegraph::build (three, 6u, pool);
+        check (small.k == 2u && small.edges() == 6u, "k is at most n - 1");
+        check (demo::eyegraph::build (std::vector<ommatidium>{}, 6u, pool).size() == 0u, "an empty eye");
+
+        std::vector<ommatidium> zero = three;
+        zero[1].direction = { 0.0f, 0.0f, 0.0f };
+        check (throws ([&] { demo::eyegraph::build (zero, 2u, pool); }), "a zero direction");
+    }
+
+    void test_symmetric()
+    {
+        demo::threadpool pool (4u);
+        std::mt19937 rng (2u);
+        const std::vector<ommatidium> omms = random_eye (rng, 2000u);
+        const demo::eyegraph::graph g = demo::eyegraph::build (omms, 6u, pool);
+        const demo::eyegraph::graph s = demo::eyegraph::build (omms, 6u, pool, true);
+        auto has = [](const demo::eyegraph::graph& gr, std::size_t i, uint32_t j) {
+            const auto nb = gr.neighbours (i);
+            return std::find (nb.begin(), nb.end(), j) != nb.end();
+        };
+        bool mutual = true;
+        bool covers = true;
+        for (std::size_t i = 0; i < omms.size(); ++i) {
+            for (uint32_t j : s.neighbours (i)) { mutual = mutual && has (s, j, static_cast<uint32_t>(i)); }
+            for (uint32_t j : g.neighbours (i)) { covers = covers && has (s, i, j); }
+        }
+        check (s.symmetric && mutual, "the symmetric graph is mutual");
+        check (covers && s.edges() >= g.edges(), "the symmetric graph holds the kNN graph");
+    }
+
+    void test_files()
+    {
+        demo::threadpool pool (2u);
+        std::mt19937 rng (3u);
+        const std::vector<ommatidium> omms = random_eye (rng, 500u);
+        const std::string eye_path = temp_path ("eyegraph_tests.eye");
+        demo::eyefile::write_binary (eye_path, omms);
+        const std::string gpath = demo::eyegraph::graph_path (eye_path);
+        std::filesystem::remove (gpath);
+
+        const demo::eyegraph::graph built = demo::eyegraph::load_or_build (eye_path, 6u, pool);
+        check (std::filesystem::exists (gpath), "load_or_build saves the graph next to the eye");
+        const demo::eyegraph::graph read = demo::eyegraph::read (gpath);
+        check (read.k == built.k && read.offsets == built.offsets && read.indices == built.indices
+               && read.angles == built.angles, "a graph's file round trip is exact");
+        const demo::eyegraph::graph again = demo::eyegraph::load_or_build (eye_path, 6u, pool);
+        check (again.indices == built.indices, "load_or_build reads the saved graph");
+        // A saved graph for another k is rebuilt, not used
+        check (demo::eyegraph::load_or_build (eye_path, 4u, pool, false, false).k == 4u, "a graph of the wrong k is rebuilt");
+
+        std::filesystem::resize_file (gpath, std::filesystem::file_size (gpath) - 4u);
+        check (throws ([&] { demo::eyegraph::read (gpath); }), "a truncated graph file");
+        for (const auto& p : { eye_path, gpath }) { std::filesystem::remove (p); }
+    }
+} // namespace
+
+int main()
+{
+    return testutil::run ("neighbour graph", [] {
+        test_knn();
+        test_symmetric();
+        test_files();
+    });
+}
@@ -0,0 +1,65 @@
+/*
+ * Tests of the frame passing structures: framering's pooled slots and the zero-copy views that
+ * hold them, and the triplebuffer between the ray casting thread and the window. Exits non-zero
+ * if any check fails.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+
+#include <cstdint>
+#include <vector>
+
+#include "framering.h"
+#include "triplebuffer.h"
+#include "testutil.h"
+
+namespace
+{
+    using testutil::check;
+    using testutil::throws;
+
+    void test_framering()
+    {
+        demo::framering<> ring (4u);
+        check (!ring.latest(), "framering starts empty");
+        for (uint64_t i = 1; i <= 3u; ++i) {
+            auto& f = ring.begin_write();
+            f.data.assign (8u, { static_cast<float>(i), 0.0f, 0.0f });
+            check (ring.publish ({}, 2) == i, "framering ids count from 1");
+        }
+        {
+            auto v = ring.latest();
+            check (v && v.id() == 3u && v.size() == 8u && v.data()[0][0] == 3.0f && v.camera() == 2, "framering latest");
+            // Hold a view of each new frame until every slot is held
+            std::vector<demo::framering<>::view> held;
+            for (int i = 4; i <= 6; ++i) {
+                auto& f = ring.begin_write();
+                f.data.assign (8u, { static_cast<float>(i), 0.0f, 0.0f });
+                ring.publish ({});
+                held.push_back (ring.latest());
+            }
+            check (v.data()[0][0] == 3.0f && held[0].data()[0][0] == 4.0f, "held views are not overwritten");
+            check (throws ([&] { ring.begin_write(); }), "framering throws when every slot is held");
+        }
+        check (ring.latest().id() == 6u, "framering newest after release");
+        check (ring.begin_write().data.capacity() >= 8u, "framering slots keep their capacity");
+
+        demo::triplebuffer<int> tb;
+        tb.fill (0);
+        check (!tb.update(), "triplebuffer has nothing new at first");
+        tb.write_slot() = 1;
+        tb.publish();
+        tb.write_slot() = 2;
+        tb.publish();
+        check (tb.update() && tb.read_slot() == 2, "triplebuffer reads the newest");
+        check (!tb.update() && tb.read_slot() == 2, "triplebuffer keeps the slot until something new");
+    }
+} // namespace
+
+int main()
+{
+    return testutil::run ("frame ring", [] {
+        test_framering();
+    });
+}
@@ -0,0 +1,238 @@
+/*
+ * Tests of the mesh levels of detail and view culling (meshlod.h): bounding spheres hold their
+ * meshes; decimation merges vertices without leaving degenerate or out of range triangles, and
+ * coarser cells leave fewer triangles; make_lods keeps only levels that are coarse enough; and a
+ * frustum agrees with clip space about which points are in view and never culls a sphere that is
+ * partly in view. Exits non-zero if any check fails.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "cpumaths.h"
+#include "cpuscene.h"
+#include "meshlod.h"
+#include "testutil.h"
+
+namespace
+{
+    using testutil::check;
+    using namespace demo::cpu;
+
+    // A sphere of radius r at centre, as rings of segs vertices between two poles, in one primitive
+    mesh uv_sphere (const int rings, const int segs, const float r = 1.0f, const vec3& centre = { 0.0f, 0.0f, 0.0f })
+    {
+        const float pi = 3.14159265f;
+        primitive p;
+        p.material = 2;
+        auto add = [&](const vec3& n) {
+            p.positions.push_back (centre + n * r);
+            p.normals.push_back (n);
+        };
+        add ({ 0.0f, 1.0f, 0.0f });
+        for (int i = 1; i < rings; ++i) {
+            const float th = pi * static_cast<float>(i) / static_cast<float>(rings);
+            for (int j = 0; j < segs; ++j) {
+                const float ph = 2.0f * pi * static_cast<float>(j) / static_cast<float>(segs);
+                add ({ std::sin (th) * std::cos (ph), std::cos (th), std::sin (th) * std::sin (ph) });
+            }
+        }
+        add ({ 0.0f, -1.0f, 0.0f });
+        const uint32_t south = static_cast<uint32_t>(p.positions.size() - 1u);
+        auto at = [&](int i, int j) { return static_cast<uint32_t>(1 + (i - 1) * segs + (j % segs)); };
+        for (int j = 0; j < segs; ++j) {
+            p.indices.insert (p.indices.end(), { 0u, at (1, j + 1), at (1, j) });
+            p.indices.insert (p.indices.end(), { south, at (rings - 1, j), at (rings - 1, j + 1) });
+            for (int i = 1; i + 1 < rings; ++i) {
+                p.indices.insert (p.indices.end(), { at (i, j), at (i, j + 1), at (i + 1, j) });
+                p.indices.insert (p.indices.end(), { at (i, j + 1), at (i + 1, j + 1), at (i + 1, j) });
+            }
+        }
+        mesh me;
+        me.name = "sphere";
+        me.primitives.push_back (p);
+        return me;
+    }
+
+    // Every triangle of me has three distinct, in range vertices
+    bool well_formed (const mesh& me)
+    {
+        for (const auto& p : me.primitives) {
+            if (p.indices.size() % 3u != 0u || p.normals.size() != p.positions.size()) { return false; }
+            for (std::size_t t = 0; t < p.indices.size(); t += 3) {
+                const uint32_t a = p.indices[t], b = p.indices[t + 1], c = p.indices[t + 2];
+                if (a >= p.positions.size() || b >= p.positions.size() || c >= p.positions.size()) { return false; }
+                if (a == b || b == c || a == c) { return false; }
+            }
+        }
+        return true;
+    }
+
+    // An OpenGL perspective projection, column major
+    mat4 perspective (const float fovy, const float aspect, const float near, const float far)
+    {
+        const float f = 1.0f / std::tan (fovy / 2.0f);
+        mat4 m = {};
+        m[0] = f / aspect;
+        m[5] = f;
+        m[10] = (far + near) / (near - far);
+        m[11] = -1.0f;
+        m[14] = 2.0f * far * near / (near - far);
+        return m;
+    }
+
+    mat4 translation (const vec3& t)
+    {
+        mat4 m = identity();
+        m[12] = t[0];
+        m[13] = t[1];
+        m[14] = t[2];
+        return m;
+    }
+
+    // Is p inside the clip volume of clip (-w <= x, y, z <= w)? margin > 0 asks for well inside
+    // or well outside, returning 0 (out), 1 (in) or -1 (near a face, so undecided).
+    int in_clip (const mat4& clip, const vec3& p, const float margin)
+    {
+        std::array<float, 4> c = {};
+        for (int r = 0; r < 4; ++r) { c[r] = clip[r] * p[0] + clip[4 + r] * p[1] + clip[8 + r] * p[2] + clip[12 + r]; }
+        const float w = c[3];
+        bool in = w > 0.0f;
+        bool near = false;
+        for (int a = 0; a < 3; ++a) {
+            in = in && std::fabs (c[a]) <= w;
+            near = near || std::fabs (std::fabs (c[a]) - std::fabs (w)) <= margin * std::fabs (w);
+        }
+        return near ? -1 : (in ? 1 : 0);
+    }
+
+    void test_bounding_sphere()
+    {
+        const mesh me = uv_sphere (16, 24, 2.0f, { 1.0f, -3.0f, 5.0f });
+        const sphere s = bounding_sphere (me);
+        check (length (s.centre - vec3{ 1.0f, -3.0f, 5.0f }) <= 1e-4f, "the bounding sphere's centre");
+        check (std::fabs (s.radius - 2.0f) <= 1e-4f, "the bounding sphere's radius");
+        bool holds = true;
+        for (const vec3& v : me.primitives[0].positions) { holds = holds && length (v - s.centre) <= s.radius; }
+        check (holds, "the bounding sphere holds every vertex");
+        check (bounding_sphere (mesh{}).radius == 0.0f, "an empty mesh has a point sphere");
+    }
+
+    void test_decimate()
+    {
+        const mesh me = uv_sphere (48, 96);
+        const std::size_t n = triangle_count (me);
+        check (n == 2u * 96u * 47u, "the sphere's triangles");
+
+        // Cells smaller than the vertex spacing change nothing
+        const mesh fine = decimate (me, 1e-4f);
+        check (triangle_count (fine) == n && fine.primitives[0].positions.size() == me.primitives[0].positions.size(),
+               "tiny cells keep every triangle");
+
+        std::size_t prev = n;
+        bool fewer = true;
+        bool formed = true;
+        bool inside = true;
+        bool unit = true;
+        for (const float cell : { 0.02f, 0.05f, 0.1f, 0.2f, 0.5f }) {
+            const mesh d = decimate (me, cell);
+            const std::size_t nt = triangle_count (d);
+            fewer = fewer && nt < prev && nt > 0u;
+            prev = nt;
+            formed = formed && well_formed (d) && d.primitives.size() == 1u && d.primitives[0].material == 2;
+            // The mean of vertices on the sphere within one cell is within the cell's diagonal of it
+            for (const vec3& v : d.primitives[0].positions) {
+                inside = inside && length (v) <= 1.0f + 1e-5f && length (v) >= 1.0f - 1.8f * cell;
+            }
+            for (const vec3& nv : d.primitives[0].normals) { unit = unit && std::fabs (length (nv) - 1.0f) <= 1e-4f; }
+        }
+        check (fewer, "coarser cells leave fewer triangles");
+        check (formed, "decimated meshes are well formed and keep their material");
+        check (inside, "merged vertices lie on the mesh, within a cell");
+        check (unit, "merged normals are unit length");
+        check (triangle_count (decimate (me, 10.0f)) == 0u, "one cell collapses every triangle");
+    }
+
+    void test_make_lods()
+    {
+        const mesh me = uv_sphere (48, 96);
+        const std::vector<mesh> lods = make_lods (me);
+        check (lods.size() == 2u, "two levels for a fine sphere");
+        std::size_t prev = triangle_count (me);
+        bool ratio = true;
+        for (const mesh& l : lods) {
+            ratio = ratio && static_cast<float>(triangle_count (l)) <= 0.7f * static_cast<float>(prev) && well_formed (l);
+            prev = triangle_count (l);
+        }
+        check (ratio, "each level has at most 0.7 of the triangles of the one before");
+        check (make_lods (uv_sphere (6, 8)).empty(), "a small mesh gets no levels");
+        // A level that barely decimates is dropped
+        check (make_lods (me, { 1e-6f }).empty(), "a level that removes too little is dropped");
+    }
+
+    void test_frustum()
+    {
+        const mat4 proj = perspective (1.2f, 1.5f, 0.1f, 100.0f);
+        const frustum fr (proj);
+        check (fr.intersects ({ { 0.0f, 0.0f, -10.0f }, 1.0f }), "a sphere ahead is in view");
+        check (!fr.intersects ({ { 0.0f, 0.0f, 10.0f }, 1.0f }), "a sphere behind is culled");
+        check (!fr.intersects ({ { 0.0f, 0.0f, -200.0f }, 1.0f }), "a sphere beyond the far plane is culled");
+        check (!fr.intersects ({ { 50.0f, 0.0f, -10.0f }, 1.0f }), "a sphere off to the side is culled");
+        check (fr.intersects ({ { 50.0f, 0.0f, -10.0f }, 40.0f }), "a large sphere reaching into view is kept");
+
+        // The planes are in the model's frame: a model moved out of view is culled
+        const frustum moved (proj * translation ({ 0.0f, 0.0f, 20.0f }));
+        check (!moved.intersects ({ { 0.0f, 0.0f, -10.0f }, 1.0f }), "the planes follow the model transform");
+
+        std::mt19937 rng (1u);
+        std::uniform_real_distribution<float> u (-60.0f, 60.0f);
+        // In front of the near plane to beyond the far one
+        std::uniform_real_distribution<float> uz (-150.0f, 30.0f);
+        std::uniform_real_distribution<float> r01 (0.0f, 1.0f);
+        const mat4 clip = proj * translation ({ 3.0f, -2.0f, -20.0f });
+        const frustum f (clip);
+        std::size_t points = 0u;
+        std::size_t in_view = 0u;
+        std::size_t wrong = 0u;
+        std::size_t culled_in_view = 0u;
+        for (int i = 0; i < 20000; ++i) {
+            const vec3 c = { u (rng), u (rng), uz (rng) };
+            // A point agrees with clip space, away from the faces
+            const int want = in_clip (clip, c, 1e-3f);
+            if (want >= 0) {
+                ++points;
+                if (want == 1) { ++in_view; }
+                if (f.intersects ({ c, 0.0f }) != (want == 1)) { ++wrong; }
+            }
+            // A sphere with any point in view is never culled
+            const float rad = 10.0f * r01 (rng);
+            const sphere s = { c, rad };
+            if (!f.intersects (s)) {
+                for (int k = 0; k < 64; ++k) {
+                    const vec3 d = normalize (vec3{ u (rng), u (rng), u (rng) }) * (rad * r01 (rng));
+                    if (in_clip (clip, c + d, 0.0f) == 1) { ++culled_in_view; break; }
+                }
+            }
+        }
+        check (in_view > points / 50u && in_view < points, "the points are both in and out of view");
+        check (wrong == 0u, "points agree with clip space (" + std::to_string (wrong) + " differ)");
+        check (culled_in_view == 0u, "no sphere partly in view is culled (" + std::to_string (culled_in_view) + ")");
+    }
+} // namespace
+
+int main()
+{
+    return testutil::run ("mesh LOD", [] {
+        test_bounding_sphere();
+        test_decimate();
+        test_make_lods();
+        test_frustum();
+    });
+}
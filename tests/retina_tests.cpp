@@ -0,0 +1,225 @@
+/*
+ * Tests of the retina filters (retina.h): each filter's outputs match a direct computation, for
+ * the pointwise filters and for inhibit and smooth over a known neighbour graph; the outputs don't
+ * depend on the number of threads; a bank filters each eye of a frame with its own graph; and bad
+ * chains and mismatched frames are refused. Exits non-zero if any check fails.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "eyefile.h"
+#include "eyegraph.h"
+#include "retina.h"
+#include "threadpool.h"
+#include "testutil.h"
+
+namespace
+{
+    using testutil::check;
+    using testutil::throws;
+    using demo::retina::op;
+    using frame_t = std::vector<std::array<float, 3>>;
+
+    frame_t random_frame (std::mt19937& rng, const std::size_t n)
+    {
+        std::uniform_real_distribution<float> u (-1.0f, 2.0f);
+        frame_t f (n);
+        for (auto& v : f) { v = { u (rng), u (rng), u (rng) }; }
+        return f;
+    }
+
+    // A graph of n nodes in which node i has i % 4 neighbours (so some have none), at assorted angles
+    demo::eyegraph::graph ragged_graph (std::mt19937& rng, const std::size_t n)
+    {
+        std::uniform_int_distribution<uint32_t> node (0u, static_cast<uint32_t>(n - 1u));
+        std::uniform_real_distribution<float> angle (0.01f, 0.1f);
+        demo::eyegraph::graph g;
+        g.k = 3u;
+        for (std::size_t i = 0; i < n; ++i) {
+            for (std::size_t j = 0; j < i % 4u; ++j) {
+                g.indices.push_back (node (rng));
+                g.angles.push_back (angle (rng));
+            }
+            g.offsets.push_back (g.indices.size());
+        }
+        return g;
+    }
+
+    float max_diff (const frame_t& a, const frame_t& b)
+    {
+        float d = 0.0f;
+        for (std::size_t i = 0; i < a.size(); ++i) {
+            for (int c = 0; c < 3; ++c) { d = std::max (d, std::fabs (a[i][c] - b[i][c])); }
+        }
+        return d;
+    }
+
+    frame_t run_chain (const demo::eyegraph::graph& g, const std::size_t n, const std::string& spec,
+                       const frame_t& in, const unsigned int threads = 2u)
+    {
+        demo::threadpool pool (threads);
+        demo::retina::processor p;
+        p.setup (g, n, demo::retina::parse (spec));
+        frame_t out = in;
+        p.run (out, pool);
+        return out;
+    }
+
+    void test_parse()
+    {
+        const auto chain = demo::retina::parse ("luminance,gain:2:0.1,,rectify,inhibit:0.8,smooth:0.02");
+        check (chain.size() == 5u, "a chain of five filters (empty entries skipped)");
+        check (chain[0].type == op::luminance && chain[2].type == op::rectify, "the pointwise filters");
+        check (chain[1].type == op::gain && chain[1].a == 2.0f && chain[1].b == 0.1f, "gain's gain and offset");
+        check (chain[3].type == op::inhibit && chain[3].a == 0.8f, "inhibit's strength");
+        check (chain[4].type == op::smooth && chain[4].a == 0.02f, "smooth's sigma");
+        check (demo::retina::parse ("gain:3")[0].b == 0.0f, "gain's offset defaults to 0");
+        check (demo::retina::parse ("").empty(), "an empty chain");
+        check (demo::retina::needs_graph (chain) && !demo::retina::needs_graph (demo::retina::parse ("gain:2,rectify")),
+               "only the neighbourhood filters need a graph");
+
+        check (throws ([] { demo::retina::parse ("blur:2"); }), "an unknown filter");
+        check (throws ([] { demo::retina::parse ("rectify:1"); }), "too many parameters");
+        check (throws ([] { demo::retina::parse ("smooth:0"); }), "smooth with sigma 0");
+        check (throws ([] { demo::retina::parse ("gain:x"); }), "a parameter that isn't a number");
+    }
+
+    void test_pointwise()
+    {
+        std::mt19937 rng (1u);
+        const std::size_t n = 1000u;
+        const frame_t in = random_frame (rng, n);
+        const demo::eyegraph::graph none;
+
+        frame_t want = in;
+        for (auto& v : want) { for (float& x : v) { x = x * 2.5f + -0.25f; } }
+        check (max_diff (run_chain (none, n, "gain:2.5:-0.25", in), want) <= 1e-6f, "gain");
+
+        want = in;
+        for (auto& v : want) { for (float& x : v) { x = std::max (x, 0.0f); } }
+        check (run_chain (none, n, "rectify", in) == want, "rectify");
+
+        want = in;
+        for (auto& v : want) {
+            const float l = std::max (0.2126f * v[0] + 0.7152f * v[1] + 0.0722f * v[2], 0.0f);
+            v = { l, l, l };
+        }
+        check (max_diff (run_chain (none, n, "luminance,rectify,luminance", in), want) <= 1e-6f,
+               "luminance gives grey, once");
+
+        check (run_chain (none, n, "", in) == in, "an empty chain leaves the outputs alone");
+    }
+
+    void test_neighbourhood()
+    {
+        std::mt19937 rng (2u);
+        const std::size_t n = 500u;
+        const frame_t in = random_frame (rng, n);
+        const demo::eyegraph::graph g = ragged_graph (rng, n);
+
+        // inhibit: x - s * mean of the neighbours, and x alone with no neighbours
+        const float s = 0.8f;
+        frame_t want (n);
+        for (std::size_t i = 0; i < n; ++i) {
+            const auto nb = g.neighbours (i);
+            for (int c = 0; c < 3; ++c) {
+                double mean = 0.0;
+                for (uint32_t j : nb) { mean += in[j][c]; }
+                if (!nb.empty()) { mean /= static_cast<double>(nb.size()); }
+                want[i][c] = static_cast<float>(in[i][c] - s * mean);
+            }
+        }
+        check (max_diff (run_chain (g, n, "inhibit:0.8", in), want) <= 1e-5f, "inhibit");
+
+        // smooth: the Gaussian weighted mean of x and its neighbours, by their angles
+        const double sigma = 0.05;
+        for (std::size_t i = 0; i < n; ++i) {
+            const auto nb = g.neighbours (i);
+            const auto ang = g.neighbour_angles (i);
+            for (int c = 0; c < 3; ++c) {
+                double sum = in[i][c];
+                double wsum = 1.0;
+                for (std::size_t j = 0; j < nb.size(); ++j) {
+                    const double w = std::exp (-ang[j] * ang[j] / (2.0 * sigma * sigma));
+                    sum += w * in[nb[j]][c];
+                    wsum += w;
+                }
+                want[i][c] = static_cast<float>(sum / wsum);
+            }
+        }
+        check (max_diff (run_chain (g, n, "smooth:0.05", in), want) <= 1e-5f, "smooth");
+
+        // After the luminance, the neighbourhood filters work on the one channel
+        frame_t lum = in;
+        for (auto& v : lum) { v[0] = v[1] = v[2] = 0.2126f * v[0] + 0.7152f * v[1] + 0.0722f * v[2]; }
+        check (max_diff (run_chain (g, n, "luminance,inhibit:0.8", in), run_chain (g, n, "inhibit:0.8", lum)) <= 1e-5f,
+               "inhibit of the luminance");
+
+        check (throws ([&] { run_chain (g, n - 1u, "inhibit:0.8", in); }), "a graph of the wrong size");
+        check (throws ([&] { run_chain (g, n, "smooth:0.05", frame_t (n + 1u)); }), "outputs of the wrong size");
+    }
+
+    void test_threads()
+    {
+        // Several chunks of work, so that the threads share them out
+        std::mt19937 rng (3u);
+        const std::size_t n = 3u * demo::retina::processor::grain + 17u;
+        const frame_t in = random_frame (rng, n);
+        const demo::eyegraph::graph g = ragged_graph (rng, n);
+        const std::string spec = "gain:2:0.1,inhibit:0.5,smooth:0.03,rectify";
+        check (run_chain (g, n, spec, in, 1u) == run_chain (g, n, spec, in, 4u), "the same outputs on 1 and 4 threads");
+    }
+
+    void test_bank()
+    {
+        std::mt19937 rng (4u);
+        std::normal_distribution<float> gauss (0.0f, 1.0f);
+        std::vector<std::vector<demo::eyefile::ommatidium>> omms (2);
+        for (std::size_t e = 0; e < omms.size(); ++e) {
+            omms[e].resize (e == 0 ? 300u : 200u);
+            for (auto& o : omms[e]) { o.direction = { gauss (rng), gauss (rng), gauss (rng) }; }
+        }
+        const frame_t in = random_frame (rng, 500u);
+        const std::string spec = "luminance,inhibit:0.7";
+
+        // With no eye files, each eye's graph is built from its ommatidia
+        demo::retina::bank b (2u);
+        check (b.empty(), "a bank is empty before setup");
+        b.setup (omms, {}, demo::retina::parse (spec), 4u);
+        frame_t got = in;
+        b.run (got);
+
+        demo::threadpool pool (2u);
+        frame_t want;
+        for (std::size_t e = 0, start = 0; e < omms.size(); start += omms[e].size(), ++e) {
+            const frame_t eye (in.begin() + start, in.begin() + start + omms[e].size());
+            const demo::eyegraph::graph g = demo::eyegraph::build (omms[e], 4u, pool, true);
+            const frame_t out = run_chain (g, omms[e].size(), spec, eye);
+            want.insert (want.end(), out.begin(), out.end());
+        }
+        check (got == want, "a bank filters each eye with its own graph");
+
+        frame_t short_frame (499u);
+        check (throws ([&] { b.run (short_frame); }), "a frame of the wrong size");
+    }
+} // namespace
+
+int main()
+{
+    return testutil::run ("retina", [] {
+        test_parse();
+        test_pointwise();
+        test_neighbourhood();
+        test_threads();
+        test_bank();
+    });
+}
@@ -0,0 +1,173 @@
+/*
+ * Tests of the scene cache (scenecache.h): a scene loaded from the cache is the same as the one
+ * parsed from its glTF, BVH and all; and an entry goes stale (the glTF is parsed again) when the
+ * glTF, one of its external buffers or the world transform changes, or the entry is damaged.
+ * Exits non-zero if any check fails.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "cpumaths.h"
+#include "cpuscene.h"
+#include "cpubvh.h"
+#include "scenecache.h"
+#include "threadpool.h"
+#include "testutil.h"
+
+namespace
+{
+    using testutil::check;
+    using testutil::temp_path;
+    using namespace demo::cpu;
+    namespace fs = std::filesystem;
+
+    // Byte-wise equality of two vectors of trivially copyable elements
+    template <typename T>
+    bool same_bytes (const std::vector<T>& a, const std::vector<T>& b)
+    {
+        return a.size() == b.size() && (a.empty() || std::memcmp (a.data(), b.data(), a.size() * sizeof (T)) == 0);
+    }
+
+    bool same_scene (const scenecache::loaded& a, const scenecache::loaded& b)
+    {
+        const scene& x = a.sc;
+        const scene& y = b.sc;
+        bool ok = x.materials.size() == y.materials.size() && x.meshes.size() == y.meshes.size()
+                  && x.instances.size() == y.instances.size() && x.cameras.size() == y.cameras.size()
+                  && x.background_shader == y.background_shader && x.up == y.up && x.dependencies == y.dependencies;
+        for (std::size_t i = 0; ok && i < x.materials.size(); ++i) {
+            ok = x.materials[i].name == y.materials[i].name && x.materials[i].colour == y.materials[i].colour
+                 && x.materials[i].textured == y.materials[i].textured;
+        }
+        for (std::size_t i = 0; ok && i < x.meshes.size(); ++i) {
+            ok = x.meshes[i].name == y.meshes[i].name && x.meshes[i].primitives.size() == y.meshes[i].primitives.size();
+            for (std::size_t p = 0; ok && p < x.meshes[i].primitives.size(); ++p) {
+                const primitive& px = x.meshes[i].primitives[p];
+                const primitive& py = y.meshes[i].primitives[p];
+                ok = px.positions == py.positions && px.normals == py.normals && px.indices == py.indices
+                     && px.material == py.material;
+            }
+        }
+        for (std::size_t i = 0; ok && i < x.instances.size(); ++i) {
+            ok = x.instances[i].name == y.instances[i].name && x.instances[i].mesh == y.instances[i].mesh
+                 && x.instances[i].transform == y.instances[i].transform;
+        }
+        for (std::size_t i = 0; ok && i < x.cameras.size(); ++i) {
+            ok = x.cameras[i].name == y.cameras[i].name && x.cameras[i].pose == y.cameras[i].pose
+                 && x.cameras[i].eye_path == y.cameras[i].eye_path && x.cameras[i].projection == y.cameras[i].projection;
+        }
+        return ok && same_bytes (a.accel.nodes, b.accel.nodes) && same_bytes (a.accel.triangles, b.accel.triangles)
+               && a.accel.materials == b.accel.materials;
+    }
+
+    void write_text (const std::string& path, const std::string& text)
+    {
+        std::ofstream f (path, std::ios::trunc);
+        f << text;
+    }
+
+    // A glTF of one triangle whose positions are in the external buffer tri.bin
+    void write_triangle (const std::string& dir, const float scale)
+    {
+        const std::array<float, 9> pos = { 0.0f, 0.0f, 0.0f, scale, 0.0f, 0.0f, 0.0f, scale, 0.0f };
+        std::ofstream bin (dir + "/tri.bin", std::ios::binary | std::ios::trunc);
+        bin.write (reinterpret_cast<const char*>(pos.data()), sizeof (pos));
+        bin.close();
+        write_text (dir + "/tri.gltf",
+                    "{ \"asset\": { \"version\": \"2.0\" }, \"scene\": 0, \"scenes\": [ { \"nodes\": [ 0 ] } ],\n"
+                    "  \"nodes\": [ { \"name\": \"tri\", \"mesh\": 0 } ],\n"
+                    "  \"meshes\": [ { \"name\": \"tri\", \"primitives\": [ { \"attributes\": { \"POSITION\": 0 } } ] } ],\n"
+                    "  \"accessors\": [ { \"bufferView\": 0, \"componentType\": 5126, \"count\": 3, \"type\": \"VEC3\" } ],\n"
+                    "  \"bufferViews\": [ { \"buffer\": 0, \"byteOffset\": 0, \"byteLength\": 36 } ],\n"
+                    "  \"buffers\": [ { \"uri\": \"tri.bin\", \"byteLength\": 36 } ] }\n");
+    }
+
+    void test_round_trip()
+    {
+        const std::string dir = temp_path ("scenecache_tests");
+        const std::string cache = dir + "/cache";
+        fs::remove_all (dir);
+        fs::create_directories (dir);
+        const std::string gltf = dir + "/blocks.gltf";
+        fs::copy_file (std::string(TEST_DATA_DIR) + "/axis_coloured_blocks.gltf", gltf);
+        demo::threadpool pool (2u);
+
+        const scenecache::loaded parsed = scenecache::load (gltf, identity(), "", &pool);
+        check (!parsed.from_cache && !fs::exists (cache), "no cache directory, no cache");
+        check (parsed.sc.triangle_count() > 0u && !parsed.sc.cameras.empty(), "the scene has meshes and cameras");
+
+        const scenecache::loaded first = scenecache::load (gltf, identity(), cache, &pool);
+        check (!first.from_cache, "the first load misses");
+        const std::string entry = scenecache::cache_path (cache, gltf, scenecache::make_key (gltf, identity()));
+        check (fs::exists (entry), "the first load writes the entry");
+        const scenecache::loaded second = scenecache::load (gltf, identity(), cache, &pool);
+        check (second.from_cache, "the second load hits");
+        check (same_scene (second, first) && same_scene (second, parsed), "the cached scene and BVH are the parsed ones");
+        check (second.sc.path == gltf, "the cached scene has the glTF's path");
+
+        // Another transform is another entry, and both then hit
+        const scenecache::loaded blender = scenecache::load (gltf, blender_transform(), cache, &pool);
+        check (!blender.from_cache, "a new transform misses");
+        check (!same_scene (blender, first), "a new transform gives a new scene");
+        check (scenecache::load (gltf, blender_transform(), cache, &pool).from_cache
+               && scenecache::load (gltf, identity(), cache, &pool).from_cache, "each transform has its entry");
+
+        // A changed glTF is a new key
+        std::ofstream (gltf, std::ios::app) << "\n";
+        check (!scenecache::load (gltf, identity(), cache, &pool).from_cache, "a changed glTF misses");
+
+        // A damaged entry, or one read with the wrong key, is a miss
+        const uint64_t key = scenecache::make_key (gltf, identity());
+        const std::string path = scenecache::cache_path (cache, gltf, key);
+        scene sc;
+        bvh accel;
+        check (scenecache::read (path, key, sc, accel), "the rewritten entry reads");
+        check (!scenecache::read (path, key + 1u, sc, accel), "an entry for another key is refused");
+        fs::resize_file (path, fs::file_size (path) - 8u);
+        check (!scenecache::read (path, key, sc, accel), "a truncated entry is refused");
+        const scenecache::loaded repaired = scenecache::load (gltf, identity(), cache, &pool);
+        check (!repaired.from_cache && same_scene (repaired, first), "a truncated entry is rewritten");
+        check (scenecache::load (gltf, identity(), cache, &pool).from_cache, "and then hits");
+        fs::remove_all (dir);
+    }
+
+    void test_dependencies()
+    {
+        const std::string dir = temp_path ("scenecache_deps");
+        const std::string cache = dir + "/cache";
+        fs::remove_all (dir);
+        fs::create_directories (dir);
+        write_triangle (dir, 1.0f);
+        const std::string gltf = dir + "/tri.gltf";
+
+        const scenecache::loaded first = scenecache::load (gltf, identity(), cache);
+        check (first.sc.dependencies.size() == 1u && first.sc.triangle_count() == 1u, "the triangle reads its buffer");
+        check (scenecache::load (gltf, identity(), cache).from_cache, "an unchanged buffer hits");
+
+        // The glTF is the same but its buffer isn't, so the entry is stale
+        write_triangle (dir, 2.0f);
+        const scenecache::loaded changed = scenecache::load (gltf, identity(), cache);
+        check (!changed.from_cache, "a changed buffer misses");
+        check (!changed.sc.meshes.empty() && changed.sc.meshes[0].primitives[0].positions[1] == vec3{ 2.0f, 0.0f, 0.0f },
+               "the new buffer's positions are loaded");
+        const scenecache::loaded again = scenecache::load (gltf, identity(), cache);
+        check (again.from_cache && same_scene (again, changed), "the rewritten entry hits with the new buffer");
+        fs::remove_all (dir);
+    }
+} // namespace
+
+int main()
+{
+    return testutil::run ("scene cache", [] {
+        test_round_trip();
+        test_dependencies();
+    });
+}
@@ -0,0 +1,87 @@
+/*
+ * Tests of the shared memory frame ring (shmring.h): a reader thread, racing the publisher,
+ * never accepts a frame that was overwritten while it was read, in float32 and compact formats.
+ * Exits non-zero if any check fails.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "outputformat.h"
+#include "shmring.h"
+#include "testutil.h"
+
+namespace
+{
+    using testutil::check;
+    using testutil::throws;
+
+    void test_shm()
+    {
+        using namespace demo;
+        const std::string name = "shm_tests_" + std::to_string (::getpid());
+        const std::size_t n = 4096;
+        for (const char* fname : { "rgb-f32", "lum-u8" }) {
+            const outputformat fmt = outputformat::parse (fname);
+            shm::publisher pub (name, n, 4u, fmt);
+            shm::reader r (name);
+            check (r.n_ommatidia() == n && r.format().code() == fmt.code(), "shm header");
+            check (!r.latest(), "shm ring starts empty");
+
+            // Every value of frame id is id / 65536, exact in all the formats tested
+            std::atomic<bool> done = false;
+            std::atomic<uint64_t> torn = 0u;
+            std::atomic<uint64_t> read = 0u;
+            std::thread reader_thread ([&] {
+                std::vector<std::array<float, 3>> data;
+                uint64_t last = 0u;
+                while (!done.load() || r.newest() > last) {
+                    uint64_t skipped = 0u;
+                    shm::frame f = r.next (last, skipped);
+                    if (!f) { continue; }
+                    f.decode (data);
+                    const float want = fmt.type == outputformat::element::u8 ? outputcodec::from_u8 (static_cast<uint8_t>(f.id() & 0xffu))
+                                                                               : static_cast<float>(f.id()) / 65536.0f;
+                    bool same = f.pose()[0] == static_cast<float>(f.id());
+                    for (const auto& c : data) { same = same && c[0] == want && c[2] == want; }
+                    last = f.id();
+                    // A frame that was overwritten while read must say so
+                    if (f.valid()) {
+                        if (!same) { torn.fetch_add (1u); }
+                        read.fetch_add (1u);
+                    }
+                }
+            });
+            std::vector<std::array<float, 3>> frame (n);
+            std::array<float, 16> pose = {};
+            for (uint64_t id = 1; id <= 3000u; ++id) {
+                const float v = fmt.type == outputformat::element::u8 ? outputcodec::from_u8 (static_cast<uint8_t>(id & 0xffu))
+                                                                      : static_cast<float>(id) / 65536.0f;
+                frame.assign (n, { v, v, v });
+                pose[0] = static_cast<float>(id);
+                check (pub.publish (pose, frame) == id, "shm frame ids count from 1");
+            }
+            done.store (true);
+            reader_thread.join();
+            check (torn.load() == 0u, std::string("no torn shm frame passes valid() for ") + fname);
+            check (read.load() > 0u, std::string("shm frames were read for ") + fname);
+            check (fmt.native() || throws ([&] { (void)r.latest().data(); }), "shm data() needs float32 RGB");
+        }
+    }
+} // namespace
+
+int main()
+{
+    return testutil::run ("shared memory ring", [] {
+        test_shm();
+    });
+}
@@ -0,0 +1,125 @@
+/*
+ * Tests of the simulation clock (simclock.h), on a wall clock that the tests move: steps come at
+ * speed times wall clock time whatever the loop's rate, a stall gives at most max_steps and is
+ * then dropped, no steps are due while paused except single steps, an unlimited clock steps once
+ * per loop, and the window is drawn at display_hz. Exits non-zero if any check fails.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "simclock.h"
+#include "testutil.h"
+
+namespace
+{
+    using testutil::check;
+    using sc = demo::simclock::sc;
+
+    // Wall clock intervals that are exact in both nanoseconds and doubles
+    constexpr sc::duration tick = std::chrono::nanoseconds (15625000); // 1/64 s
+
+    // A clock of 1/8 s steps, in step with the wall clock at t0
+    demo::simclock make_clock (const sc::time_point t0, const double speed = 1.0)
+    {
+        demo::simclock c;
+        c.step_s = 0.125;
+        c.speed = speed;
+        c.due (true, false, t0);
+        return c;
+    }
+
+    void test_stepping()
+    {
+        sc::time_point t = sc::time_point{} + std::chrono::seconds (100);
+        demo::simclock c = make_clock (t);
+        check (c.due (false, false, t + 3 * tick) == 0u, "no step before step_s of wall clock time");
+        check (c.until_due_s() == 5.0 / 64.0, "the time until the next step");
+        check (c.due (false, false, t + 8 * tick) == 1u, "a step at step_s");
+        check (c.due (false, false, t + 25 * tick) == 2u, "two steps after 2 step_s more");
+        check (c.until_due_s() == 7.0 / 64.0, "the backlog carries over");
+
+        // Over many loops of assorted lengths, simulated time is speed times wall clock time
+        for (const double speed : { 1.0, 2.0, 0.5 }) {
+            t = sc::time_point{} + std::chrono::seconds (100);
+            c = make_clock (t, speed);
+            uint64_t steps = 0u;
+            bool within = true;
+            int ticks = 0;
+            for (int loop = 0; loop < 1000; ++loop) {
+                const int dt = 1 + loop % 5;
+                ticks += dt;
+                t += dt * tick;
+                const unsigned int n = c.due (false, false, t);
+                within = within && n <= c.max_steps;
+                for (unsigned int s = 0; s < n; ++s) { c.stepped(); }
+                steps += n;
+            }
+            const double sim_s = speed * ticks / 64.0;
+            check (within && c.steps == steps && steps == static_cast<uint64_t>(sim_s / c.step_s),
+                   "simulated time keeps to speed " + std::to_string (speed));
+            check (c.time() == static_cast<double>(steps) * c.step_s, "time() is steps of step_s");
+        }
+    }
+
+    void test_stall()
+    {
+        sc::time_point t = sc::time_point{} + std::chrono::seconds (100);
+        demo::simclock c = make_clock (t);
+        t += std::chrono::seconds (10);
+        check (c.due (false, false, t) == c.max_steps, "a stall gives at most max_steps");
+        check (c.due (false, false, t + tick) == 0u, "and the rest of the stall is dropped");
+
+        c = make_clock (t);
+        check (c.due (false, false, t + 20 * tick) == 2u, "two steps due, with 4/64 s over");
+        c.fall_behind();
+        check (c.until_due_s() == c.step_s, "fall_behind drops the backlog");
+        check (c.due (false, false, t + 24 * tick) == 0u, "so the part step is not made up");
+    }
+
+    void test_pause()
+    {
+        sc::time_point t = sc::time_point{} + std::chrono::seconds (100);
+        demo::simclock c = make_clock (t);
+        check (c.due (false, false, t + 12 * tick) == 1u, "a step, with 4/64 s over, before pausing");
+        check (c.due (true, false, t + 64 * tick) == 0u, "no steps while paused");
+        check (c.due (true, true, t + 65 * tick) == 1u, "one step for a single step request");
+        check (c.due (true, false, t + 66 * tick) == 0u, "and then none");
+        // Neither the time spent paused nor the part step before it is owed when running again
+        check (c.until_due_s() == c.step_s, "no backlog while paused");
+        check (c.due (false, false, t + 70 * tick) == 0u, "no backlog from the pause");
+        check (c.due (false, false, t + 74 * tick) == 1u, "stepping resumes at speed");
+    }
+
+    void test_unlimited()
+    {
+        sc::time_point t = sc::time_point{} + std::chrono::seconds (100);
+        demo::simclock c = make_clock (t, 0.0);
+        check (c.unlimited() && c.until_due_s() == 0.0, "speed 0 is unlimited");
+        check (c.due (false, false, t) == 1u && c.due (false, false, t + std::chrono::seconds (5)) == 1u,
+               "an unlimited clock steps once per loop");
+        check (c.due (true, false, t) == 0u, "an unlimited clock pauses");
+
+        // The window is drawn every loop, or at display_hz
+        check (c.display_due (t) && c.display_due (t), "no display_hz draws every loop");
+        c.display_hz = 8.0;
+        check (c.display_due (t), "the first draw is due");
+        check (!c.display_due (t + 7 * tick), "no draw before 1/display_hz");
+        check (c.display_due (t + 8 * tick), "a draw at 1/display_hz");
+        check (!c.display_due (t + 9 * tick), "counted from the last draw");
+    }
+} // namespace
+
+int main()
+{
+    return testutil::run ("simulation clock", [] {
+        test_stepping();
+        test_stall();
+        test_pause();
+        test_unlimited();
+    });
+}
@@ -0,0 +1,64 @@
+/*
+ * The checks shared by the test programs. Each program calls check() for each thing it tests
+ * and returns testutil::run() from main, which is non-zero if any check failed or a test threw.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+#pragma once
+
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
+namespace testutil
+{
+    inline int failures = 0;
+
+    inline void check (const bool ok, const std::string& what)
+    {
+        if (!ok) {
+            std::cerr << "FAIL: " << what << std::endl;
+            ++failures;
+        }
+    }
+
+    template <typename F>
+    bool throws (F&& f)
+    {
+        try {
+            f();
+        } catch (const std::exception&) {
+            return true;
+        }
+        return false;
+    }
+
+    // A path in the temporary directory, unique to this process
+    inline std::string temp_path (const std::string& name)
+    {
+        return (std::filesystem::temp_directory_path() / (name + "_" + std::to_string (::getpid()))).string();
+    }
+
+    // Call tests, then report. Returns main's exit code.
+    template <typename F>
+    int run (const std::string& what, F&& tests)
+    {
+        try {
+            tests();
+        } catch (const std::exception& e) {
+            std::cerr << "FAIL: " << e.what() << std::endl;
+            return 1;
+        }
+        if (failures > 0) {
+            std::cerr << failures << " checks failed" << std::endl;
+            return 1;
+        }
+        std::cout << "All " << what << " tests passed" << std::endl;
+        return 0;
+    }
+
+} // namespace
@@ -0,0 +1,89 @@
+/*
+ * Tests of read_trajectory (trajectory.h): matrix and position plus quaternion poses, the
+ * separators, comments and blank lines it allows, and the lines it rejects. Exits non-zero if any
+ * check fails.
+ *
+ * Author: Seb James
+ * Date: 2025
+ */
+
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "cpumaths.h"
+#include "trajectory.h"
+#include "testutil.h"
+
+namespace
+{
+    using testutil::check;
+    using testutil::throws;
+    using testutil::temp_path;
+
+    void write_file (const std::string& path, const std::string& text)
+    {
+        std::ofstream fout (path, std::ios::trunc);
+        fout << text;
+    }
+
+    bool near (const demo::cpu::mat4& a, const demo::cpu::mat4& b)
+    {
+        for (std::size_t i = 0; i < 16u; ++i) { if (std::fabs (a[i] - b[i]) > 1e-6f) { return false; } }
+        return true;
+    }
+
+    void test_trajectory()
+    {
+        const std::string path = temp_path ("trajectory_tests.txt");
+        write_file (path,
+                    "# A comment, then a blank line\n"
+                    "\n"
+                    "   \t\n"
+                    "1 0 0 0  0 1 0 0  0 0 1 0  4 5 6 1\n"
+                    "1,2,3,\t0,0,0,1\n"
+                    "  # An indented comment\n"
+                    "0 0 0 0 0 1.4142135 1.4142135\n");
+        const std::vector<demo::cpu::mat4> poses = demo::read_trajectory (path);
+        check (poses.size() == 3u, "three poses, skipping comments and blank lines");
+        if (poses.size() == 3u) {
+            demo::cpu::mat4 m = demo::cpu::identity();
+            m[12] = 4.0f;
+            m[13] = 5.0f;
+            m[14] = 6.0f;
+            check (near (poses[0], m), "16 values are a column major matrix");
+            m = demo::cpu::identity();
+            m[12] = 1.0f;
+            m[13] = 2.0f;
+            m[14] = 3.0f;
+            check (near (poses[1], m), "7 values with commas and tabs are a position and quaternion");
+            // A quarter turn about z (from an unnormalised quaternion) takes x to y and y to -x
+            m = demo::cpu::identity();
+            m[0] = 0.0f;
+            m[1] = 1.0f;
+            m[4] = -1.0f;
+            m[5] = 0.0f;
+            check (near (poses[2], m), "quaternions are normalised");
+        }
+
+        write_file (path, "1 2 3 4 5\n");
+        check (throws ([&] { demo::read_trajectory (path); }), "a line of 5 values");
+        write_file (path, "1 2 3 0 0 0 0\n");
+        check (throws ([&] { demo::read_trajectory (path); }), "a zero quaternion");
+        write_file (path, "1 2 3 0 0 0 1 x\n");
+        check (throws ([&] { demo::read_trajectory (path); }), "a value that isn't a number after a whole pose");
+        write_file (path, "1 2 three 0 0 0 1\n");
+        check (throws ([&] { demo::read_trajectory (path); }), "a value that isn't a number");
+        write_file (path, "# Only a comment\n");
+        check (demo::read_trajectory (path).empty(), "a file of comments has no poses");
+        std::filesystem::remove (path);
+        check (throws ([&] { demo::read_trajectory (path); }), "a missing file");
+    }
+} // namespace
+
+int main()
+{
+    return testutil::run ("trajectory", [] { test_trajectory(); });
+}